@@ -13,11 +13,15 @@ extern ssize_t opt_muzzy_decay_ms;
 extern percpu_arena_mode_t opt_percpu_arena;
 extern const char *percpu_arena_mode_names[];
 
+extern decay_curve_t opt_decay_curve;
+extern const char *decay_curve_names[];
+
 extern const uint64_t h_steps[SMOOTHSTEP_NSTEPS];
 extern malloc_mutex_t arenas_lock;
 
 extern size_t opt_oversize_threshold;
 extern size_t oversize_threshold;
+extern size_t opt_dirty_max;
 
 void arena_basic_stats_merge(tsdn_t *tsdn, arena_t *arena,
     unsigned *nthreads, const char **dss, ssize_t *dirty_decay_ms,
@@ -44,12 +48,17 @@ ssize_t arena_dirty_decay_ms_get(arena_t *arena);
 bool arena_dirty_decay_ms_set(tsdn_t *tsdn, arena_t *arena, ssize_t decay_ms);
 ssize_t arena_muzzy_decay_ms_get(arena_t *arena);
 bool arena_muzzy_decay_ms_set(tsdn_t *tsdn, arena_t *arena, ssize_t decay_ms);
+const uint64_t *arena_decay_h_steps(arena_decay_t *decay);
+decay_curve_t arena_decay_curve_get(arena_t *arena);
+bool arena_decay_curve_set(tsdn_t *tsdn, arena_t *arena, decay_curve_t curve);
 void arena_decay(tsdn_t *tsdn, arena_t *arena, bool is_background_thread,
     bool all);
 void arena_reset(tsd_t *tsd, arena_t *arena);
 void arena_destroy(tsd_t *tsd, arena_t *arena);
 void arena_tcache_fill_small(tsdn_t *tsdn, arena_t *arena, tcache_t *tcache,
     cache_bin_t *tbin, szind_t binind);
+size_t arena_fill_small_batch(tsdn_t *tsdn, arena_t *arena, szind_t binind,
+    void **ptrs, size_t nfill, bool zero);
 void arena_alloc_junk_small(void *ptr, const bin_info_t *bin_info,
     bool zero);
 
@@ -65,7 +74,12 @@ void arena_dalloc_promoted(tsdn_t *tsdn, void *ptr, tcache_t *tcache,
     bool slow_path);
 void arena_dalloc_bin_junked_locked(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
     szind_t binind, extent_t *extent, void *ptr);
+unsigned arena_bin_remote_dalloc_locked(tsdn_t *tsdn, arena_t *arena,
+    bin_t *bin, szind_t binind, void *list, bool is_background_thread);
+void arena_bin_remote_drain(tsdn_t *tsdn, arena_t *arena, szind_t binind);
 void arena_dalloc_small(tsdn_t *tsdn, void *ptr);
+void arena_dalloc_small_batch(tsdn_t *tsdn, void **ptrs, extent_t **extents,
+    size_t n);
 bool arena_ralloc_no_move(tsdn_t *tsdn, void *ptr, size_t oldsize, size_t size,
     size_t extra, bool zero, size_t *newsize);
 void *arena_ralloc(tsdn_t *tsdn, arena_t *arena, void *ptr, size_t oldsize,
@@ -77,6 +91,8 @@ ssize_t arena_dirty_decay_ms_default_get(void);
 bool arena_dirty_decay_ms_default_set(ssize_t decay_ms);
 ssize_t arena_muzzy_decay_ms_default_get(void);
 bool arena_muzzy_decay_ms_default_set(ssize_t decay_ms);
+decay_curve_t arena_decay_curve_default_get(void);
+bool arena_decay_curve_default_set(decay_curve_t curve);
 bool arena_retain_grow_limit_get_set(tsd_t *tsd, arena_t *arena,
     size_t *old_limit, size_t *new_limit);
 unsigned arena_nthreads_get(arena_t *arena, bool internal);
@@ -87,6 +103,8 @@ arena_t *arena_new(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks);
 bool arena_init_huge(void);
 bool arena_is_huge(unsigned arena_ind);
 arena_t *arena_choose_huge(tsd_t *tsd);
+bin_t *arena_bin_choose(tsdn_t *tsdn, arena_t *arena, szind_t binind,
+    unsigned *binshard);
 bin_t *arena_bin_choose_lock(tsdn_t *tsdn, arena_t *arena, szind_t binind,
     unsigned *binshard);
 void arena_boot(sc_data_t *sc_data);
@@ -98,6 +116,7 @@ void arena_prefork4(tsdn_t *tsdn, arena_t *arena);
 void arena_prefork5(tsdn_t *tsdn, arena_t *arena);
 void arena_prefork6(tsdn_t *tsdn, arena_t *arena);
 void arena_prefork7(tsdn_t *tsdn, arena_t *arena);
+void arena_prefork8(tsdn_t *tsdn, arena_t *arena);
 void arena_postfork_parent(tsdn_t *tsdn, arena_t *arena);
 void arena_postfork_child(tsdn_t *tsdn, arena_t *arena);
 
@@ -2,6 +2,7 @@
 #define JEMALLOC_INTERNAL_ARENA_STATS_H
 
 #include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/bit_util.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/mutex_prof.h"
 #include "jemalloc/internal/sc.h"
@@ -47,6 +48,24 @@ struct arena_stats_large_s {
 	size_t		curlextents; /* Derived. */
 };
 
+/*
+ * Decay histograms have power-of-two buckets: bucket 0 counts the samples of
+ * value 0, bucket j > 0 those in [2^(j-1), 2^j), and the last bucket also
+ * counts all larger samples.
+ */
+#define ARENA_DECAY_NHIST	24
+
+static inline unsigned
+arena_decay_hist_ind(uint64_t value) {
+	if (value == 0) {
+		return 0;
+	}
+	if (value >= ((uint64_t)1 << (ARENA_DECAY_NHIST - 2))) {
+		return ARENA_DECAY_NHIST - 1;
+	}
+	return (unsigned)lg_floor((size_t)value) + 1;
+}
+
 typedef struct arena_stats_decay_s arena_stats_decay_t;
 struct arena_stats_decay_s {
 	/* Total number of purge sweeps. */
@@ -55,6 +74,18 @@ struct arena_stats_decay_s {
 	arena_stats_u64_t	nmadvise;
 	/* Total number of pages purged. */
 	arena_stats_u64_t	purged;
+
+	/* Histogram of the duration of purge sweeps, in microseconds. */
+	arena_stats_u64_t	npurge_hist[ARENA_DECAY_NHIST];
+	/* Same, for the sweeps made by application threads only. */
+	arena_stats_u64_t	npurge_app_hist[ARENA_DECAY_NHIST];
+	/*
+	 * Histogram of the time the decay mutex is held for at once while
+	 * decaying, in microseconds.
+	 */
+	arena_stats_u64_t	nlocked_hist[ARENA_DECAY_NHIST];
+	/* Histogram of the number of pages purged per madvise call. */
+	arena_stats_u64_t	nmadvise_hist[ARENA_DECAY_NHIST];
 };
 
 typedef struct arena_stats_extents_s arena_stats_extents_t;
@@ -7,6 +7,7 @@
 #include "jemalloc/internal/bitmap.h"
 #include "jemalloc/internal/eset.h"
 #include "jemalloc/internal/extent_dss.h"
+#include "jemalloc/internal/hpa.h"
 #include "jemalloc/internal/jemalloc_internal_types.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/nstime.h"
@@ -63,6 +64,17 @@ struct arena_decay_s {
 	 * relative to epoch.
 	 */
 	size_t			backlog[SMOOTHSTEP_NSTEPS];
+	/*
+	 * Trailing log of the peak number of active pages in the arena during
+	 * each of the past SMOOTHSTEP_NSTEPS decay epochs, for
+	 * decay_curve_peak.
+	 */
+	size_t			nactive_backlog[SMOOTHSTEP_NSTEPS];
+	/*
+	 * The decay_curve_t in effect.  Only written with mtx held, but read
+	 * racily by background threads.
+	 */
+	atomic_u_t		curve;
 
 	/*
 	 * Pointer to associated stats.  These stats are embedded directly in
@@ -71,6 +83,8 @@ struct arena_decay_s {
 	 *
 	 * Synchronization: Same as associated arena's stats field. */
 	arena_stats_decay_t	*stats;
+	/* Time at which mtx was last acquired.  Used for stats only. */
+	nstime_t		locked_time;
 	/* Peak number of pages in associated extents.  Used for debug only. */
 	uint64_t		ceil_npages;
 };
@@ -107,7 +121,8 @@ struct arena_s {
 	/*
 	 * Lists of tcaches and cache_bin_array_descriptors for extant threads
 	 * associated with this arena.  Stats from these are merged
-	 * incrementally, and at exit if opt_stats_print is enabled.
+	 * incrementally, and at exit if opt_stats_print is enabled.  The
+	 * tcaches are also walked by tcache_reclaim().
 	 *
 	 * Synchronization: tcache_ql_mtx.
 	 */
@@ -184,6 +199,13 @@ struct arena_s {
 	pszind_t		retain_grow_limit;
 	malloc_mutex_t		extent_grow_mtx;
 
+	/*
+	 * Hugepage regions that slabs are carved from if opt_hpa.
+	 *
+	 * Synchronization: internal.
+	 */
+	hpa_t			hpa;
+
 	/*
 	 * Available extent structures that were allocated via
 	 * base_alloc_extent().
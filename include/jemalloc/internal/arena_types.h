@@ -9,6 +9,25 @@
 /* Number of event ticks between time checks. */
 #define DECAY_NTICKS_PER_UPDATE	1000
 
+/*
+ * Curves that the number of unused dirty pages allowed to remain follows, as
+ * those pages age over the decay time.
+ */
+typedef enum {
+	/* Smoothstep from all of the pages down to none of them. */
+	decay_curve_smoothstep = 0,
+	/* Exponential decay, with a half-life of an eighth of the decay time. */
+	decay_curve_exponential = 1,
+	/*
+	 * Smoothstep, but keeping enough pages to get back to the peak number
+	 * of active pages over the decay time.
+	 */
+	decay_curve_peak = 2,
+
+	decay_curve_names_limit = 3 /* Used for options processing. */
+} decay_curve_t;
+#define DECAY_CURVE_DEFAULT	decay_curve_smoothstep
+
 typedef struct arena_decay_s arena_decay_t;
 typedef struct arena_s arena_t;
 typedef struct arena_tdata_s arena_tdata_t;
@@ -30,6 +30,20 @@ struct background_thread_info_s {
 	atomic_b_t		indefinite_sleep;
 	/* Next scheduled wakeup time (absolute time in ns). */
 	nstime_t		next_wakeup;
+	/* True while the thread waits on cond. */
+	atomic_b_t		idle;
+	/*
+	 * True while the thread has been running for long enough that other
+	 * threads help it decay its arenas.
+	 */
+	atomic_b_t		busy;
+	/*
+	 * The arenas left in the current run, counted in arenas of this thread:
+	 * the owner's progress cursor in the low half and the end of the run in
+	 * the high half.  The owner claims arenas from the cursor on, helpers
+	 * from the end down, until both meet.
+	 */
+	atomic_zu_t		work_range;
 	/*
 	 *  Since the last background thread run, newly added number of pages
 	 *  that need to be purged by the next wakeup.  This is adjusted on
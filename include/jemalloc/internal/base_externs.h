@@ -12,6 +12,9 @@ extent_hooks_t *base_extent_hooks_set(base_t *base,
     extent_hooks_t *extent_hooks);
 void *base_alloc(tsdn_t *tsdn, base_t *base, size_t size, size_t alignment);
 extent_t *base_alloc_extent(tsdn_t *tsdn, base_t *base);
+void base_dalloc(tsdn_t *tsdn, base_t *base, void *ptr, size_t size,
+    size_t alignment);
+void base_dalloc_extent(tsdn_t *tsdn, base_t *base, extent_t *extent);
 void base_stats_get(tsdn_t *tsdn, base_t *base, size_t *allocated,
     size_t *resident, size_t *mapped, size_t *n_thp);
 void base_prefork(tsdn_t *tsdn, base_t *base);
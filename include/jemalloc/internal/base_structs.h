@@ -6,6 +6,12 @@
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/sc.h"
 
+/* Embedded at the beginning of every region freed via base_dalloc(). */
+struct base_free_s {
+	base_free_t	*next;
+	size_t		size;
+};
+
 /* Embedded at the beginning of every block of base-managed virtual memory. */
 struct base_block_s {
 	/* Total size of block's virtual memory mapping. */
@@ -14,6 +20,12 @@ struct base_block_s {
 	/* Next block in list of base's blocks. */
 	base_block_t	*next;
 
+	/*
+	 * Bytes within the block that are currently allocated, not counting
+	 * the header.  The block is unmapped once this drops to zero.
+	 */
+	size_t		allocated;
+
 	/* Tracks unused trailing space. */
 	extent_t	extent;
 };
@@ -28,7 +40,9 @@ struct base_s {
 	 */
 	atomic_p_t	extent_hooks;
 
-	/* Protects base_alloc() and base_stats_get() operations. */
+	/*
+	 * Protects base_alloc(), base_dalloc() and base_stats_get() operations.
+	 */
 	malloc_mutex_t	mtx;
 
 	/* Using THP when true (metadata_thp auto mode). */
@@ -49,6 +63,13 @@ struct base_s {
 	/* Heap of extents that track unused trailing space within blocks. */
 	extent_heap_t	avail[SC_NSIZES];
 
+	/*
+	 * Regions returned via base_dalloc(), segregated by the largest size
+	 * class that does not exceed their size.
+	 */
+	base_free_t	*free[SC_NSIZES];
+	size_t		nfree;
+
 	/* Stats, only maintained if config_stats. */
 	size_t		allocated;
 	size_t		resident;
@@ -2,6 +2,7 @@
 #define JEMALLOC_INTERNAL_BASE_TYPES_H
 
 typedef struct base_block_s base_block_t;
+typedef struct base_free_s base_free_t;
 typedef struct base_s base_t;
 
 #define METADATA_THP_DEFAULT metadata_thp_disabled
@@ -9,15 +9,98 @@
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/sc.h"
 
+/*
+ * State for choosing the size of a bin's new slabs with opt_slab_autotune.  See
+ * arena_bin_slab_info_choose().
+ */
+#define BIN_SLAB_TUNE_NSLABS		8
+#define BIN_SLAB_TUNE_UTIL_ONE		1024U
+#define BIN_SLAB_TUNE_UTIL_LOW		(BIN_SLAB_TUNE_UTIL_ONE / 2)
+#define BIN_SLAB_TUNE_UTIL_HIGH		(BIN_SLAB_TUNE_UTIL_ONE * 3 / 4)
+typedef struct bin_slab_tune_s bin_slab_tune_t;
+struct bin_slab_tune_s {
+	/* Index into bin_slab_infos[binind] of the size of new slabs. */
+	unsigned		size;
+	/* New slabs since size was last reconsidered. */
+	unsigned		nslabs;
+	/*
+	 * Lowest utilization (curregs over nregs, in BIN_SLAB_TUNE_UTIL_ONE
+	 * units) seen since size was last reconsidered.
+	 */
+	unsigned		util_min;
+	/*
+	 * Total number of regions in the bin's slabs, which, unlike
+	 * nregs * curslabs, holds for slabs of differing sizes.
+	 */
+	size_t			nregs;
+};
+
+/*
+ * With opt_bin_shards_max, a bin's lock is checked for contention every
+ * BIN_CONTENTION_NLOCK_OPS acquisitions; a size class gets one more shard once
+ * one of its bins saw at least 1 in BIN_CONTENTION_RATIO_INV acquisitions
+ * contended for BIN_CONTENTION_NSTRIKES checks in a row.
+ */
+#define BIN_CONTENTION_NLOCK_OPS	4096
+#define BIN_CONTENTION_RATIO_INV	8
+#define BIN_CONTENTION_NSTRIKES		2
+typedef struct bin_contention_s bin_contention_t;
+struct bin_contention_s {
+	/* Lock counters (from lock.prof_data) as of the last check. */
+	uint64_t		nlock_ops;
+	uint64_t		ncontended;
+	/* Number of checks in a row that found the lock contended. */
+	unsigned		nstrikes;
+};
+
+/*
+ * Maximum number of regions a bin stashes for allocation without its lock (see
+ * opt_bin_stash).  bin_t.stash_state packs the number of regions in stash[]
+ * into its low BIN_STASH_LG_GEN_SHIFT bits, under a generation count.
+ */
+#define BIN_STASH_MAX			16
+#define BIN_STASH_LG_GEN_SHIFT		8
+#define BIN_STASH_COUNT_MASK		((ZU(1) << BIN_STASH_LG_GEN_SHIFT) - 1)
+
 /*
  * A bin contains a set of extents that are currently being used for slab
  * allocations.
  */
 typedef struct bin_s bin_t;
 struct bin_s {
-	/* All operations on bin_t fields require lock ownership. */
+	/*
+	 * All operations on bin_t fields require lock ownership, except for
+	 * pushes onto remote_free and pops from stash.
+	 */
 	malloc_mutex_t		lock;
 
+	/*
+	 * Regions freed by threads that found lock contended and did not want
+	 * to wait for it, linked through their first word.  Pushed onto
+	 * without the lock; taken (as a whole) with it, by whoever next fills
+	 * from or flushes to this bin.
+	 */
+	atomic_p_t		remote_free;
+
+	/*
+	 * Regions claimed from slabcur in advance, and accounted for as
+	 * allocated, for arena_malloc_small() to pop without the lock.  Only
+	 * refilled (when empty) and emptied with the lock held, both of which
+	 * bump the generation in stash_state; a pop CASes stash_state, so one
+	 * that raced with either fails instead of handing out a stale region.
+	 *
+	 * stash has room for opt_bin_stash regions, and is NULL without
+	 * opt_bin_stash.  arena_new() sets it for every shard, including those
+	 * added later on.
+	 */
+	atomic_zu_t		stash_state;
+	atomic_p_t		*stash;
+	/*
+	 * stash_state as of the last arena_bins_stash_drain() pass, to tell
+	 * whether the stash went unused since.
+	 */
+	size_t			stash_state_seen;
+
 	/*
 	 * Current slab being used to service allocations of this bin's size
 	 * class.  slabcur is independent of slabs_{nonfull,full}; whenever
@@ -36,6 +119,12 @@ struct bin_s {
 	/* List used to track full slabs. */
 	extent_list_t		slabs_full;
 
+	/* Slab size autotuning. */
+	bin_slab_tune_t		slab_tune;
+
+	/* Lock contention tracking, for adding shards. */
+	bin_contention_t	contention;
+
 	/* Bin statistics. */
 	bin_stats_t	stats;
 };
@@ -43,22 +132,129 @@ struct bin_s {
 /* A set of sharded bins of the same size class. */
 typedef struct bins_s bins_t;
 struct bins_s {
-	/* Sharded bins.  Dynamically sized. */
+	/*
+	 * Sharded bins.  Dynamically sized, with room for bin_shards_cap()
+	 * shards, of which the first nshards are initialized and in use.
+	 */
 	bin_t *bin_shards;
+	/* Only grows, and only with opt_bin_shards_max. */
+	atomic_u_t nshards;
+	/*
+	 * Shards initialized or being initialized; the one adding shard
+	 * nshards claims it by bumping this first.
+	 */
+	atomic_u_t nshards_claimed;
 };
 
 void bin_shard_sizes_boot(unsigned bin_shards[SC_NBINS]);
 bool bin_update_shard_size(unsigned bin_shards[SC_NBINS], size_t start_size,
     size_t end_size, size_t nshards);
 
+extern unsigned opt_bin_stash;
+
+static inline unsigned
+bins_nshards_get(bins_t *bins) {
+	return atomic_load_u(&bins->nshards, ATOMIC_ACQUIRE);
+}
+
 /* Initializes a bin to empty.  Returns true on error. */
 bool bin_init(bin_t *bin);
+void bin_slab_tune_init(bin_slab_tune_t *slab_tune);
 
 /* Forking. */
 void bin_prefork(tsdn_t *tsdn, bin_t *bin);
 void bin_postfork_parent(tsdn_t *tsdn, bin_t *bin);
 void bin_postfork_child(tsdn_t *tsdn, bin_t *bin);
 
+/*
+ * Pushes the chain of regions first..last, already linked through their first
+ * words, onto the remote free list.  Does not require the lock.
+ */
+static inline void
+bin_remote_free_push(bin_t *bin, void *first, void *last) {
+	void *head = atomic_load_p(&bin->remote_free, ATOMIC_RELAXED);
+	do {
+		*(void **)last = head;
+	} while (!atomic_compare_exchange_weak_p(&bin->remote_free, &head,
+	    first, ATOMIC_RELEASE, ATOMIC_RELAXED));
+}
+
+/* Detaches and returns the whole remote free list (or NULL if empty). */
+static inline void *
+bin_remote_free_take(tsdn_t *tsdn, bin_t *bin) {
+	malloc_mutex_assert_owner(tsdn, &bin->lock);
+	if (atomic_load_p(&bin->remote_free, ATOMIC_RELAXED) == NULL) {
+		return NULL;
+	}
+	return atomic_exchange_p(&bin->remote_free, NULL, ATOMIC_ACQUIRE);
+}
+
+/*
+ * Pops a region off the stash without the lock, or returns NULL if the stash is
+ * empty.
+ */
+static inline void *
+bin_stash_pop(bin_t *bin) {
+	size_t state = atomic_load_zu(&bin->stash_state, ATOMIC_ACQUIRE);
+	while (true) {
+		size_t n = state & BIN_STASH_COUNT_MASK;
+		if (n == 0) {
+			return NULL;
+		}
+		void *ret = atomic_load_p(&bin->stash[n - 1], ATOMIC_RELAXED);
+		if (atomic_compare_exchange_weak_zu(&bin->stash_state, &state,
+		    state - 1, ATOMIC_ACQUIRE, ATOMIC_ACQUIRE)) {
+			return ret;
+		}
+	}
+}
+
+/* Returns whether the stash is empty, and may be refilled. */
+static inline bool
+bin_stash_empty(tsdn_t *tsdn, bin_t *bin) {
+	malloc_mutex_assert_owner(tsdn, &bin->lock);
+	return (atomic_load_zu(&bin->stash_state, ATOMIC_RELAXED) &
+	    BIN_STASH_COUNT_MASK) == 0;
+}
+
+/* Refills the (empty) stash with the n regions in ptrs. */
+static inline void
+bin_stash_fill(tsdn_t *tsdn, bin_t *bin, void **ptrs, unsigned n) {
+	assert(bin_stash_empty(tsdn, bin));
+	assert(n <= BIN_STASH_MAX);
+	for (unsigned i = 0; i < n; i++) {
+		atomic_store_p(&bin->stash[i], ptrs[i], ATOMIC_RELAXED);
+	}
+	size_t state = atomic_load_zu(&bin->stash_state, ATOMIC_RELAXED);
+	state = ((state >> BIN_STASH_LG_GEN_SHIFT) + 1) <<
+	    BIN_STASH_LG_GEN_SHIFT;
+	atomic_store_zu(&bin->stash_state, state | n, ATOMIC_RELEASE);
+}
+
+/*
+ * Empties the stash into ptrs (which must have room for BIN_STASH_MAX regions),
+ * and returns the number of regions taken.
+ */
+static inline unsigned
+bin_stash_take(tsdn_t *tsdn, bin_t *bin, void **ptrs) {
+	malloc_mutex_assert_owner(tsdn, &bin->lock);
+	size_t state = atomic_load_zu(&bin->stash_state, ATOMIC_RELAXED);
+	size_t empty;
+	do {
+		if ((state & BIN_STASH_COUNT_MASK) == 0) {
+			return 0;
+		}
+		empty = ((state >> BIN_STASH_LG_GEN_SHIFT) + 1) <<
+		    BIN_STASH_LG_GEN_SHIFT;
+	} while (!atomic_compare_exchange_weak_zu(&bin->stash_state, &state,
+	    empty, ATOMIC_ACQUIRE, ATOMIC_RELAXED));
+	unsigned n = (unsigned)(state & BIN_STASH_COUNT_MASK);
+	for (unsigned i = 0; i < n; i++) {
+		ptrs[i] = atomic_load_p(&bin->stash[i], ATOMIC_RELAXED);
+	}
+	return n;
+}
+
 /* Stats. */
 static inline void
 bin_stats_merge(tsdn_t *tsdn, bin_stats_t *dst_bin_stats, bin_t *bin) {
@@ -33,7 +33,10 @@ struct bin_info_s {
 	/* Total number of regions in a slab for this bin's size class. */
 	uint32_t		nregs;
 
-	/* Number of sharded bins in each arena for this size class. */
+	/*
+	 * Number of sharded bins in each arena for this size class, to begin
+	 * with.
+	 */
 	uint32_t		n_shards;
 
 	/*
@@ -43,7 +46,49 @@ struct bin_info_s {
 	bitmap_info_t		bitmap_info;
 };
 
+/*
+ * With opt_slab_autotune, each bin chooses among BIN_SLAB_NSIZES slab sizes for
+ * its new slabs: halving, keeping, doubling or quadrupling the configured one
+ * (as clamped to what a slab's bitmap allows).  bin_slab_infos[i][j] describes
+ * the geometry of slabs of the jth size; the default entry matches
+ * bin_infos[i] except in n_shards, which is not meaningful there.
+ */
+#define BIN_SLAB_NSIZES		4
+#define BIN_SLAB_SIZE_DEFAULT	1
+
+extern bool opt_slab_autotune;
+extern unsigned opt_bin_shards_max;
 extern bin_info_t bin_infos[SC_NBINS];
+extern bin_info_t bin_slab_infos[SC_NBINS][BIN_SLAB_NSIZES];
+
+/*
+ * Number of shards there is room for in each arena for size class binind: more
+ * than the n_shards to begin with if opt_bin_shards_max allows adding some.
+ */
+static inline unsigned
+bin_shards_cap(szind_t binind) {
+	return (opt_bin_shards_max > bin_infos[binind].n_shards) ?
+	    opt_bin_shards_max : bin_infos[binind].n_shards;
+}
+
+/*
+ * Returns the geometry of a slab of the given size class and size, which only
+ * differs from bin_infos[binind] with opt_slab_autotune.
+ */
+static inline const bin_info_t *
+bin_slab_info_get(szind_t binind, size_t slab_size) {
+	if (likely(!opt_slab_autotune) ||
+	    slab_size == bin_infos[binind].slab_size) {
+		return &bin_infos[binind];
+	}
+	for (unsigned i = 0; i < BIN_SLAB_NSIZES; i++) {
+		if (bin_slab_infos[binind][i].slab_size == slab_size) {
+			return &bin_slab_infos[binind][i];
+		}
+	}
+	not_reached();
+	return &bin_infos[binind];
+}
 
 void bin_info_boot(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS]);
 
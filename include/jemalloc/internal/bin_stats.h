@@ -48,6 +48,12 @@ struct bin_stats_s {
 	/* Current size of nonfull slabs heap in this bin. */
 	size_t		nonfull_slabs;
 
+	/*
+	 * Current number of shards of this size class, which may grow past
+	 * bin_infos[].n_shards with opt_bin_shards_max.
+	 */
+	uint32_t	nshards;
+
 	mutex_prof_data_t mutex_data;
 };
 
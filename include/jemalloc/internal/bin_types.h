@@ -7,11 +7,16 @@
 #define N_BIN_SHARDS_DEFAULT 1
 
 /* Used in TSD static initializer only. Real init in arena_bind(). */
-#define TSD_BINSHARDS_ZERO_INITIALIZER {{UINT8_MAX}}
+#define TSD_BINSHARDS_ZERO_INITIALIZER {{UINT8_MAX}, 0}
 
 typedef struct tsd_binshards_s tsd_binshards_t;
 struct tsd_binshards_s {
 	uint8_t binshard[SC_NBINS];
+	/*
+	 * The thread's rank among those bound to its arena, from which the
+	 * shards are derived; kept to rebind the thread as shards get added.
+	 */
+	unsigned ticket;
 };
 
 #endif /* JEMALLOC_INTERNAL_BIN_TYPES_H */
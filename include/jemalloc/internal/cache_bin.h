@@ -33,32 +33,38 @@ typedef struct cache_bin_info_s cache_bin_info_t;
 struct cache_bin_info_s {
 	/* The size of the bin stack, i.e. ncached_max * sizeof(ptr). */
 	cache_bin_sz_t stack_size;
+	/* Initial value of ncached_cap; equals ncached_max unless adaptive. */
+	cache_bin_sz_t ncached_cap_init;
 };
 extern cache_bin_info_t	*tcache_bin_info;
 
 typedef struct cache_bin_s cache_bin_t;
 struct cache_bin_s {
 	/*
-	 * The cache bin stack is represented using 3 pointers: cur_ptr,
-	 * low_water and full, optimized for the fast path efficiency.
+	 * The cache bin stack is represented using 4 pointers: cur_ptr,
+	 * low_water, full and empty, optimized for the fast path efficiency.
 	 *
 	 * low addr ==> high addr
-	 * |----|----|----|item1|item2|.....................|itemN|
-	 *  full            cur                                    empty
-	 * (ncached == N; full + ncached_max == empty)
+	 * |----|----|----|----|item1|item2|................|itemN|
+	 *  (unused)  full       cur                               empty
+	 * (ncached == N; full + ncached_cap == empty; ncached_cap <= ncached_max)
 	 *
 	 * Data directly stored:
 	 * 1) cur_ptr points to the current item to be allocated, i.e. *cur_ptr.
-	 * 2) full points to the top of the stack (i.e. ncached == ncached_max),
+	 * 2) full points to the top of the stack (i.e. ncached == ncached_cap),
 	 * which is compared against on free_fastpath to check "is_full".
 	 * 3) low_water indicates a low water mark of ncached.
 	 * Range of low_water is [cur, empty], i.e. values of [ncached, 0].
+	 * 4) empty is the position when ncached == 0.  It is fixed for the
+	 * lifetime of the bin, and not accessed in the common case (guarded
+	 * behind low_water).
 	 *
-	 * The empty position (ncached == 0) is derived via full + ncached_max
-	 * and not accessed in the common case (guarded behind low_water).
+	 * The stack space reserved for each bin holds ncached_max items.  The
+	 * capacity in effect (ncached_cap) can be lowered by moving full toward
+	 * empty, so the tcache may resize a bin without touching the fast path.
 	 *
-	 * On 64-bit, 2 of the 3 pointers (full and low water) are compressed by
-	 * omitting the high 32 bits.  Overflow of the half pointers is avoided
+	 * On 64-bit, 3 of the 4 pointers (full, low water and empty) are
+	 * compressed by omitting the high 32 bits.  Overflow of the half pointers is avoided
 	 * when allocating / initializing the stack space.  As a result,
 	 * cur_ptr.lowbits can be safely used for pointer comparisons.
 	 */
@@ -93,6 +99,8 @@ struct cache_bin_s {
 	 * stack goes to higher address for newer allocations (i.e. cur_ptr++).
 	 */
 	uint32_t full_position;
+	/* Points to the position when the cache is empty. */
+	uint32_t empty_position;
 };
 
 typedef struct cache_bin_array_descriptor_s cache_bin_array_descriptor_t;
@@ -112,17 +120,25 @@ struct cache_bin_array_descriptor_s {
  * relies on pointer comparisons to determine if the cache is full / empty.
  */
 
-/* Returns ncached_max: Upper limit on ncached. */
+/* Returns ncached_max: Upper limit on ncached_cap. */
 static inline cache_bin_sz_t
 cache_bin_ncached_max_get(szind_t ind) {
 	return tcache_bin_info[ind].stack_size / sizeof(void *);
 }
 
+/* Returns ncached_cap: Current upper limit on ncached. */
+static inline cache_bin_sz_t
+cache_bin_ncached_cap_get(cache_bin_t *bin) {
+	return (cache_bin_sz_t)((bin->empty_position - bin->full_position) /
+	    sizeof(void *));
+}
+
 static inline cache_bin_sz_t
 cache_bin_ncached_get(cache_bin_t *bin, szind_t ind) {
-	cache_bin_sz_t n = (cache_bin_sz_t)((tcache_bin_info[ind].stack_size +
-	    bin->full_position - bin->cur_ptr.lowbits) / sizeof(void *));
-	assert(n <= cache_bin_ncached_max_get(ind));
+	cache_bin_sz_t n = (cache_bin_sz_t)((bin->empty_position -
+	    bin->cur_ptr.lowbits) / sizeof(void *));
+	assert(n <= cache_bin_ncached_cap_get(bin));
+	assert(cache_bin_ncached_cap_get(bin) <= cache_bin_ncached_max_get(ind));
 	assert(n == 0 || *(bin->cur_ptr.ptr) != NULL);
 
 	return n;
@@ -134,9 +150,8 @@ cache_bin_empty_position_get(cache_bin_t *bin, szind_t ind) {
 	/* Low bits overflow disallowed when allocating the space. */
 	assert((uint32_t)(uintptr_t)ret >= bin->cur_ptr.lowbits);
 
-	/* Can also be computed via (full_position + ncached_max) | highbits. */
-	uintptr_t lowbits = bin->full_position +
-	    tcache_bin_info[ind].stack_size;
+	/* Can also be computed via empty_position | highbits. */
+	uintptr_t lowbits = bin->empty_position;
 	uintptr_t highbits = (uintptr_t)bin->cur_ptr.ptr &
 	    ~(((uint64_t)1 << 32) - 1);
 	assert(ret == (void **)(lowbits | highbits));
@@ -156,25 +171,52 @@ cache_bin_bottom_item_get(cache_bin_t *bin, szind_t ind) {
 /* Returns the numeric value of low water in [0, ncached]. */
 static inline cache_bin_sz_t
 cache_bin_low_water_get(cache_bin_t *bin, szind_t ind) {
-	cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(ind);
-	cache_bin_sz_t low_water = ncached_max -
-	    (cache_bin_sz_t)((bin->low_water_position - bin->full_position) /
-	    sizeof(void *));
-	assert(low_water <= ncached_max);
+	cache_bin_sz_t low_water = (cache_bin_sz_t)((bin->empty_position -
+	    bin->low_water_position) / sizeof(void *));
+	assert(low_water <= cache_bin_ncached_cap_get(bin));
 	assert(low_water <= cache_bin_ncached_get(bin, ind));
 	assert(bin->low_water_position >= bin->cur_ptr.lowbits);
 
 	return low_water;
 }
 
+/*
+ * Racy version of cache_bin_ncached_get(), for reading the bins of other
+ * threads while they may be in use.  The result may be stale, but is always
+ * within [0, ncached_max].
+ */
+static inline cache_bin_sz_t
+cache_bin_ncached_get_racy(cache_bin_t *bin, szind_t ind) {
+	uint32_t empty_position = bin->empty_position;
+	uint32_t cur = bin->cur_ptr.lowbits;
+	if (cur >= empty_position) {
+		return 0;
+	}
+	size_t n = (empty_position - cur) / sizeof(void *);
+	cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(ind);
+
+	return n < ncached_max ? (cache_bin_sz_t)n : ncached_max;
+}
+
 static inline void
 cache_bin_ncached_set(cache_bin_t *bin, szind_t ind, cache_bin_sz_t n) {
-	bin->cur_ptr.lowbits = bin->full_position +
-	    tcache_bin_info[ind].stack_size - n * sizeof(void *);
-	assert(n <= cache_bin_ncached_max_get(ind));
+	bin->cur_ptr.lowbits = bin->empty_position - n * sizeof(void *);
+	assert(n <= cache_bin_ncached_cap_get(bin));
 	assert(n == 0 || *bin->cur_ptr.ptr != NULL);
 }
 
+/*
+ * Sets ncached_cap, by moving the full position.  The caller is responsible
+ * for flushing the bin down to at most cap items first.
+ */
+static inline void
+cache_bin_ncached_cap_set(cache_bin_t *bin, szind_t ind, cache_bin_sz_t cap) {
+	assert(cap <= cache_bin_ncached_max_get(ind));
+	assert(cache_bin_ncached_get(bin, ind) <= cap);
+	bin->full_position = bin->empty_position - cap * sizeof(void *);
+	assert(bin->cur_ptr.lowbits >= bin->full_position);
+}
+
 static inline void
 cache_bin_array_descriptor_init(cache_bin_array_descriptor_t *descriptor,
     cache_bin_t *bins_small, cache_bin_t *bins_large) {
@@ -196,14 +238,12 @@ cache_bin_alloc_easy_impl(cache_bin_t *bin, bool *success, szind_t ind,
 	/*
 	 * Check for both bin->ncached == 0 and ncached < low_water in a single
 	 * branch.  When adjust_low_water is true, this also avoids accessing
-	 * tcache_bin_info (which is on a separate cacheline / page) in the
-	 * common case.
+	 * the empty position in the common case.
 	 */
 	if (unlikely(bin->cur_ptr.lowbits > bin->low_water_position)) {
 		if (adjust_low_water) {
 			assert(ind != INVALID_SZIND);
-			uint32_t empty_position = bin->full_position +
-			    tcache_bin_info[ind].stack_size;
+			uint32_t empty_position = bin->empty_position;
 			if (unlikely(bin->cur_ptr.lowbits > empty_position)) {
 				/* Over-allocated; revert. */
 				bin->cur_ptr.ptr--;
@@ -246,6 +286,25 @@ cache_bin_alloc_easy(cache_bin_t *bin, bool *success, szind_t ind) {
 
 #undef INVALID_SZIND
 
+/*
+ * Pop up to n items off the stack into ptrs, in the same order as successive
+ * cache_bin_alloc_easy() calls would return them.  Returns the number of items
+ * popped, which is less than n iff the bin ran empty.
+ */
+JEMALLOC_ALWAYS_INLINE cache_bin_sz_t
+cache_bin_alloc_batch(cache_bin_t *bin, szind_t ind, size_t n, void **ptrs) {
+	cache_bin_sz_t ncached = cache_bin_ncached_get(bin, ind);
+	cache_bin_sz_t npop = (n < ncached) ? (cache_bin_sz_t)n : ncached;
+
+	memcpy(ptrs, bin->cur_ptr.ptr, npop * sizeof(void *));
+	bin->cur_ptr.ptr += npop;
+	if (bin->cur_ptr.lowbits > bin->low_water_position) {
+		bin->low_water_position = bin->cur_ptr.lowbits;
+	}
+
+	return npop;
+}
+
 JEMALLOC_ALWAYS_INLINE bool
 cache_bin_dalloc_easy(cache_bin_t *bin, void *ptr) {
 	if (unlikely(bin->cur_ptr.lowbits == bin->full_position)) {
@@ -58,6 +58,9 @@ typedef struct ctl_stats_s {
 
 	background_thread_stats_t background_thread;
 	mutex_prof_data_t mutex_prof_data[mutex_prof_num_global_mutexes];
+	/* rtree_ctx cache statistics, summed over all threads. */
+	uint64_t rtree_ctx_nhits_l2;
+	uint64_t rtree_ctx_nmisses;
 } ctl_stats_t;
 
 typedef struct ctl_arena_s ctl_arena_t;
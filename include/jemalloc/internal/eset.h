@@ -2,48 +2,86 @@
 #define JEMALLOC_INTERNAL_ESET_H
 
 #include "jemalloc/internal/atomic.h"
-#include "jemalloc/internal/bitmap.h"
 #include "jemalloc/internal/extent.h"
 #include "jemalloc/internal/mutex.h"
 
 /*
  * An eset ("extent set") is a quantized collection of extents, with built-in
  * LRU queue.
+ *
+ * The quantized heaps are grouped into ranges, one per doubling of size, each
+ * with its own lock.  Allocation only locks the ranges it looks into, guided
+ * by a summary bitmap of non-empty heaps that is read without any lock.
  */
+#define ESET_NHEAPS		(SC_NPSIZES + 1)
+#define ESET_LG_RANGE_NHEAPS	SC_LG_NGROUP
+#define ESET_RANGE_NHEAPS	(1U << ESET_LG_RANGE_NHEAPS)
+#define ESET_NRANGES							\
+    ((ESET_NHEAPS + ESET_RANGE_NHEAPS - 1) >> ESET_LG_RANGE_NHEAPS)
+#define ESET_LG_SUMMARY_WORD_NBITS	(LG_SIZEOF_PTR + 3)
+#define ESET_SUMMARY_NWORDS						\
+    ((ESET_NHEAPS + (1U << ESET_LG_SUMMARY_WORD_NBITS) - 1) >>		\
+    ESET_LG_SUMMARY_WORD_NBITS)
+
+typedef struct eset_range_s eset_range_t;
+struct eset_range_s {
+	/*
+	 * Protects the range's heaps, and the state of the extents in them:
+	 * an extent only enters or leaves the eset with its range locked.
+	 */
+	malloc_mutex_t mtx;
+
+	/*
+	 * LRU of all extents in the range's heaps.
+	 *
+	 * Synchronization: mtx.
+	 */
+	extent_list_t lru;
+};
+
 typedef struct eset_s eset_t;
 struct eset_s {
+	/*
+	 * Serializes the insertion of extents into the eset, which coalesces
+	 * them with their neighbors first, and eviction from the eset.
+	 * Removal of an extent for reuse does not need it.
+	 */
 	malloc_mutex_t mtx;
 
 	/*
 	 * Quantized per size class heaps of extents.
 	 *
-	 * Synchronization: mtx.
+	 * Synchronization: the mutex of the range containing the heap.
 	 */
-	extent_heap_t heaps[SC_NPSIZES + 1];
-	atomic_zu_t nextents[SC_NPSIZES + 1];
-	atomic_zu_t nbytes[SC_NPSIZES + 1];
+	extent_heap_t heaps[ESET_NHEAPS];
+	atomic_zu_t nextents[ESET_NHEAPS];
+	atomic_zu_t nbytes[ESET_NHEAPS];
 
 	/*
-	 * Bitmap for which set bits correspond to non-empty heaps.
+	 * Summary bitmap for which set bits correspond to non-empty heaps.
 	 *
-	 * Synchronization: mtx.
+	 * Synchronization: written with the heap's range locked, read
+	 * without any lock.
 	 */
-	bitmap_t bitmap[BITMAP_GROUPS(SC_NPSIZES + 1)];
+	atomic_zu_t summary[ESET_SUMMARY_NWORDS];
+
+	eset_range_t ranges[ESET_NRANGES];
 
 	/*
-	 * LRU of all extents in heaps.
+	 * Number of insertions, which orders the extents of all the range LRUs
+	 * by age.
 	 *
 	 * Synchronization: mtx.
 	 */
-	extent_list_t lru;
+	size_t seq;
 
 	/*
 	 * Page sum for all extents in heaps.
 	 *
-	 * The synchronization here is a little tricky.  Modifications to npages
-	 * must hold mtx, but reads need not (though, a reader who sees npages
-	 * without holding the mutex can't assume anything about the rest of the
-	 * state of the eset_t).
+	 * Modifications hold the mutex of the range the extent is in, but
+	 * readers need not (though, a reader who sees npages without holding
+	 * any mutex can't assume anything about the rest of the state of the
+	 * eset_t).
 	 */
 	atomic_zu_t npages;
 
@@ -67,16 +105,38 @@ size_t eset_nextents_get(eset_t *eset, pszind_t ind);
 /* Get the sum total bytes of the extents in the given page size index. */
 size_t eset_nbytes_get(eset_t *eset, pszind_t ind);
 
-void eset_insert_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent);
+/* Lock the range that an extent of extent's size belongs to. */
+void eset_lock_extent(tsdn_t *tsdn, eset_t *eset, const extent_t *extent);
+void eset_unlock_extent(tsdn_t *tsdn, eset_t *eset, const extent_t *extent);
+
+/*
+ * Insert an active extent, changing its state to the eset's.  The caller holds
+ * eset->mtx.
+ */
+void eset_insert(tsdn_t *tsdn, eset_t *eset, extent_t *extent);
+/*
+ * Remove an extent, changing its state to active.  The caller holds the lock
+ * of its range.
+ */
 void eset_remove_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent);
 /*
- * Select an extent from this eset of the given size and alignment.  Returns
- * null if no such item could be found.
+ * Select and remove an extent from this eset of the given size and alignment.
+ * Returns null if no such item could be found.
  */
-extent_t *eset_fit_locked(tsdn_t *tsdn, eset_t *eset, size_t esize,
+extent_t *eset_fit(tsdn_t *tsdn, eset_t *eset, size_t esize,
     size_t alignment);
+/*
+ * Remove the least recently inserted extent.  Returns null if the eset is
+ * empty.  The caller holds eset->mtx.
+ */
+extent_t *eset_evict(tsdn_t *tsdn, eset_t *eset);
 
-void eset_prefork(tsdn_t *tsdn, eset_t *eset);
+/*
+ * The range locks rank below every other arena lock, so they are acquired
+ * separately, along with the bin locks.
+ */
+void eset_prefork0(tsdn_t *tsdn, eset_t *eset);
+void eset_prefork1(tsdn_t *tsdn, eset_t *eset);
 void eset_postfork_parent(tsdn_t *tsdn, eset_t *eset);
 void eset_postfork_child(tsdn_t *tsdn, eset_t *eset);
 
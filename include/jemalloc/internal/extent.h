@@ -43,9 +43,11 @@ struct extent_s {
 	 * i: szind
 	 * f: nfree
 	 * s: bin_shard
+	 * h: is_head
+	 * p: hpa
 	 * n: sn
 	 *
-	 * nnnnnnnn ... nnnnnnss ssssffff ffffffii iiiiiitt zdcbaaaa aaaaaaaa
+	 * nnnnnnnn ... nnnnphss ssssffff ffffffii iiiiiitt zdcbaaaa aaaaaaaa
 	 *
 	 * arena_ind: Arena from which this extent came, or all 1 bits if
 	 *            unassociated.
@@ -92,6 +94,11 @@ struct extent_s {
 	 *
 	 * bin_shard: the shard of the bin from which this extent came.
 	 *
+	 * is_head: Whether the extent starts a mapping (!maps_coalesce only).
+	 *
+	 * hpa: Whether the extent is a slab from the hugepage regions, which
+	 *      lets deallocation tell without taking hpa->mtx.
+	 *
 	 * sn: Serial number (potentially non-unique).
 	 *
 	 *     Serial numbers may wrap around if !opt_retain, but as long as
@@ -145,7 +152,11 @@ struct extent_s {
 #define EXTENT_BITS_IS_HEAD_SHIFT  (EXTENT_BITS_BINSHARD_WIDTH + EXTENT_BITS_BINSHARD_SHIFT)
 #define EXTENT_BITS_IS_HEAD_MASK  MASK(EXTENT_BITS_IS_HEAD_WIDTH, EXTENT_BITS_IS_HEAD_SHIFT)
 
-#define EXTENT_BITS_SN_SHIFT   (EXTENT_BITS_IS_HEAD_WIDTH + EXTENT_BITS_IS_HEAD_SHIFT)
+#define EXTENT_BITS_HPA_WIDTH  1
+#define EXTENT_BITS_HPA_SHIFT  (EXTENT_BITS_IS_HEAD_WIDTH + EXTENT_BITS_IS_HEAD_SHIFT)
+#define EXTENT_BITS_HPA_MASK  MASK(EXTENT_BITS_HPA_WIDTH, EXTENT_BITS_HPA_SHIFT)
+
+#define EXTENT_BITS_SN_SHIFT   (EXTENT_BITS_HPA_WIDTH + EXTENT_BITS_HPA_SHIFT)
 #define EXTENT_BITS_SN_MASK  (UINT64_MAX << EXTENT_BITS_SN_SHIFT)
 
 	/* Pointer to the extent that this structure is responsible for. */
@@ -166,6 +177,31 @@ struct extent_s {
 		size_t			e_bsize;
 	};
 
+	union {
+		/* Small region slab metadata. */
+		slab_data_t	e_slab_data;
+
+		/* Profiling data, used for large objects. */
+		struct {
+			/* Time when this was allocated. */
+			nstime_t		e_alloc_time;
+			/* Points to a prof_tctx_t. */
+			atomic_p_t		e_prof_tctx;
+		};
+
+		/* Insertion order, while in an eset. */
+		size_t		e_eset_seq;
+	};
+
+	/*
+	 * Fields above are hot on the small allocation paths: slab region
+	 * allocation and deallocation touch e_bits (nfree), e_addr and the
+	 * leading bitmap groups, which share the first cache line of the
+	 * (CACHELINE-aligned) extent for all but the slabs with the most
+	 * regions.  The linkage below is only touched when the extent moves
+	 * between containers, e.g. when a slab becomes full or empty.
+	 */
+
 	/*
 	 * List linkage, used by a variety of lists:
 	 * - bin_t's slabs_full
@@ -180,19 +216,6 @@ struct extent_s {
 	 * for extent_avail
 	 */
 	phn(extent_t)		ph_link;
-
-	union {
-		/* Small region slab metadata. */
-		slab_data_t	e_slab_data;
-
-		/* Profiling data, used for large objects. */
-		struct {
-			/* Time when this was allocated. */
-			nstime_t		e_alloc_time;
-			/* Points to a prof_tctx_t. */
-			atomic_p_t		e_prof_tctx;
-		};
-	};
 };
 
 static inline unsigned
@@ -228,7 +251,7 @@ static inline unsigned
 extent_binshard_get(const extent_t *extent) {
 	unsigned binshard = (unsigned)((extent->e_bits &
 	    EXTENT_BITS_BINSHARD_MASK) >> EXTENT_BITS_BINSHARD_SHIFT);
-	assert(binshard < bin_infos[extent_szind_get(extent)].n_shards);
+	assert(binshard < bin_shards_cap(extent_szind_get(extent)));
 	return binshard;
 }
 
@@ -344,6 +367,11 @@ extent_prof_alloc_time_get(const extent_t *extent) {
 	return extent->e_alloc_time;
 }
 
+static inline size_t
+extent_eset_seq_get(const extent_t *extent) {
+	return extent->e_eset_seq;
+}
+
 static inline void
 extent_arena_ind_set(extent_t *extent, unsigned arena_ind) {
 	extent->e_bits = (extent->e_bits & ~EXTENT_BITS_ARENA_MASK) |
@@ -353,7 +381,7 @@ extent_arena_ind_set(extent_t *extent, unsigned arena_ind) {
 static inline void
 extent_binshard_set(extent_t *extent, unsigned binshard) {
 	/* The assertion assumes szind is set already. */
-	assert(binshard < bin_infos[extent_szind_get(extent)].n_shards);
+	assert(binshard < bin_shards_cap(extent_szind_get(extent)));
 	extent->e_bits = (extent->e_bits & ~EXTENT_BITS_BINSHARD_MASK) |
 	    ((uint64_t)binshard << EXTENT_BITS_BINSHARD_SHIFT);
 }
@@ -397,7 +425,7 @@ extent_nfree_set(extent_t *extent, unsigned nfree) {
 static inline void
 extent_nfree_binshard_set(extent_t *extent, unsigned nfree, unsigned binshard) {
 	/* The assertion assumes szind is set already. */
-	assert(binshard < bin_infos[extent_szind_get(extent)].n_shards);
+	assert(binshard < bin_shards_cap(extent_szind_get(extent)));
 	extent->e_bits = (extent->e_bits &
 	    (~EXTENT_BITS_NFREE_MASK & ~EXTENT_BITS_BINSHARD_MASK)) |
 	    ((uint64_t)binshard << EXTENT_BITS_BINSHARD_SHIFT) |
@@ -468,6 +496,11 @@ extent_prof_alloc_time_set(extent_t *extent, nstime_t t) {
 	nstime_copy(&extent->e_alloc_time, &t);
 }
 
+static inline void
+extent_eset_seq_set(extent_t *extent, size_t seq) {
+	extent->e_eset_seq = seq;
+}
+
 static inline bool
 extent_is_head_get(extent_t *extent) {
 	if (maps_coalesce) {
@@ -488,6 +521,18 @@ extent_is_head_set(extent_t *extent, bool is_head) {
 	    ((uint64_t)is_head << EXTENT_BITS_IS_HEAD_SHIFT);
 }
 
+static inline bool
+extent_hpa_get(const extent_t *extent) {
+	return (bool)((extent->e_bits & EXTENT_BITS_HPA_MASK) >>
+	    EXTENT_BITS_HPA_SHIFT);
+}
+
+static inline void
+extent_hpa_set(extent_t *extent, bool hpa) {
+	extent->e_bits = (extent->e_bits & ~EXTENT_BITS_HPA_MASK) |
+	    ((uint64_t)hpa << EXTENT_BITS_HPA_SHIFT);
+}
+
 static inline void
 extent_init(extent_t *extent, unsigned arena_ind, void *addr, size_t size,
     bool slab, szind_t szind, size_t sn, extent_state_t state, bool zeroed,
@@ -504,6 +549,7 @@ extent_init(extent_t *extent, unsigned arena_ind, void *addr, size_t size,
 	extent_zeroed_set(extent, zeroed);
 	extent_committed_set(extent, committed);
 	extent_dumpable_set(extent, dumpable);
+	extent_hpa_set(extent, false);
 	ql_elm_new(extent, ql_link);
 	if (!maps_coalesce) {
 		extent_is_head_set(extent, (is_head == EXTENT_IS_HEAD) ? true :
@@ -526,6 +572,7 @@ extent_binit(extent_t *extent, void *addr, size_t bsize, size_t sn) {
 	extent_zeroed_set(extent, true);
 	extent_committed_set(extent, true);
 	extent_dumpable_set(extent, true);
+	extent_hpa_set(extent, false);
 }
 
 static inline void
@@ -7,6 +7,8 @@
 #include "jemalloc/internal/rtree.h"
 
 extern size_t opt_lg_extent_max_active_fit;
+extern bool opt_lazy_coalesce;
+extern bool opt_extent_best_fit;
 
 extern rtree_t extents_rtree;
 extern const extent_hooks_t extent_hooks_default;
@@ -14,6 +16,8 @@ extern mutex_pool_t extent_mutex_pool;
 
 extent_t *extent_alloc(tsdn_t *tsdn, arena_t *arena);
 void extent_dalloc(tsdn_t *tsdn, arena_t *arena, extent_t *extent);
+bool extent_register(tsdn_t *tsdn, extent_t *extent);
+void extent_deregister(tsdn_t *tsdn, extent_t *extent);
 
 extent_hooks_t *extent_hooks_get(arena_t *arena);
 extent_hooks_t *extent_hooks_set(tsd_t *tsd, arena_t *arena,
@@ -30,12 +34,50 @@ void extents_dalloc(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, eset_t *eset, extent_t *extent);
 extent_t *extents_evict(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, eset_t *eset, size_t npages_min);
+void extents_coalesce(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, eset_t *eset, size_t nmax);
 extent_t *extent_alloc_wrapper(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, void *new_addr, size_t size, size_t pad,
     size_t alignment, bool slab, szind_t szind, bool *zero, bool *commit);
 void extent_dalloc_gap(tsdn_t *tsdn, arena_t *arena, extent_t *extent);
 void extent_dalloc_wrapper(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, extent_t *extent);
+/* Sort the extents of list by address. */
+void extent_list_sort(extent_list_t *list);
+/*
+ * Move the extents at the head of list, which must be sorted by address, to
+ * run, as long as each is adjacent to the previous one and the two can be
+ * purged or deallocated together.  Returns the number of pages moved.
+ */
+size_t extent_list_run_take(extent_hooks_t *extent_hooks, extent_list_t *list,
+    extent_list_t *run);
+/*
+ * Counterparts of extent_purge_lazy_wrapper() and extent_dalloc_wrapper() for
+ * a run taken by extent_list_run_take(), which purge the whole run at once.
+ * The latter empties the run.
+ */
+bool extent_purge_lazy_run_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *run);
+void extent_dalloc_run_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *run);
+/*
+ * Move up to PAGES_PURGE_BATCH_MAX runs from the head of list, which must be
+ * sorted by address, to runs, as long as they can all be purged or deallocated
+ * with one call.  The runs need not be adjacent.  Stores the number of pages
+ * of each run to run_npages, and returns the number of runs.
+ */
+size_t extent_list_batch_take(extent_hooks_t *extent_hooks, extent_list_t *list,
+    extent_list_t *runs, size_t *run_npages);
+/*
+ * Counterparts of the run wrappers for runs taken by extent_list_batch_take(),
+ * which purge all the runs with one call.  Return true if that isn't possible,
+ * leaving the runs to be purged one by one.  The latter empties the runs
+ * otherwise.
+ */
+bool extent_purge_lazy_batch_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *runs, size_t nruns);
+bool extent_dalloc_batch_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *runs, size_t nruns);
 void extent_destroy_wrapper(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, extent_t *extent);
 bool extent_commit_wrapper(tsdn_t *tsdn, arena_t *arena,
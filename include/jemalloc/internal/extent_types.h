@@ -12,4 +12,17 @@ typedef struct extent_util_stats_verbose_s extent_util_stats_verbose_t;
  */
 #define LG_EXTENT_MAX_ACTIVE_FIT_DEFAULT 6
 
+/*
+ * With opt_lazy_coalesce, the max number of extents that a single pass of
+ * extents_coalesce() looks at in an eset.
+ */
+#define EXTENTS_COALESCE_BATCH 32
+
+/*
+ * The max number of unused extent structures that an arena keeps for reuse;
+ * beyond that, extent_dalloc() returns them to the arena's base, so that the
+ * base blocks they came from can be unmapped after a spike in extent count.
+ */
+#define EXTENT_AVAIL_MAX 1024
+
 #endif /* JEMALLOC_INTERNAL_EXTENT_TYPES_H */
@@ -0,0 +1,102 @@
+#ifndef JEMALLOC_INTERNAL_HPA_H
+#define JEMALLOC_INTERNAL_HPA_H
+
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/extent.h"
+#include "jemalloc/internal/mutex.h"
+#include "jemalloc/internal/pages.h"
+#include "jemalloc/internal/ql.h"
+
+/*
+ * The hpa ("hugepage allocator") carves slab extents out of HUGEPAGE-aligned,
+ * HUGEPAGE-sized regions, so that the slabs of an arena share as few hugepages
+ * as possible.  New slabs go to the fullest region with room for them, and
+ * regions are only purged once they are entirely free, so that a partially
+ * used hugepage is never broken up.
+ */
+
+/* Number of pages in a region. */
+#define HPA_REGION_NPAGES	(HUGEPAGE >> LG_PAGE)
+#define HPA_REGION_NWORDS	((HPA_REGION_NPAGES + 63) >> 6)
+
+/* Non-full regions are bucketed by how many of their pages are active. */
+#define HPA_NBUCKETS		8
+
+/* Maximum number of empty regions kept unpurged, for quick reuse. */
+#define HPA_NDIRTY_MAX		1
+
+typedef struct hpa_region_s hpa_region_t;
+typedef ql_head(hpa_region_t) hpa_region_list_t;
+struct hpa_region_s {
+	/* HUGEPAGE-aligned base address of the region. */
+	void			*addr;
+
+	/*
+	 * The list this region is on (one of hpa_t's nonfull buckets, or its
+	 * empty list), or NULL if the region is full.
+	 */
+	hpa_region_list_t	*list;
+	ql_elm(hpa_region_t)	link;
+
+	/* Number of pages handed out to slabs. */
+	size_t			nactive;
+	/* Length in pages of the longest run of free pages. */
+	size_t			longest_free;
+	/* Whether the region was touched since it was mapped or purged. */
+	bool			dirty;
+
+	/* Set bits correspond to pages handed out to slabs. */
+	uint64_t		used[HPA_REGION_NWORDS];
+};
+
+typedef struct hpa_s hpa_t;
+struct hpa_s {
+	/* Synchronizes all non-atomic fields. */
+	malloc_mutex_t		mtx;
+
+	/*
+	 * Regions with both active and free pages.  Bucket i holds regions
+	 * with between i and i + 1 eighths of their pages active.
+	 */
+	hpa_region_list_t	nonfull[HPA_NBUCKETS];
+	/* Empty regions, the dirty ones first. */
+	hpa_region_list_t	empty;
+	size_t			nempty_dirty;
+
+	/* Region structures whose memory was unmapped, for reuse. */
+	hpa_region_list_t	avail;
+
+	/* All mapped regions, sorted by address. */
+	hpa_region_t		**regions;
+	size_t			nregions;
+	size_t			regions_cap;
+
+	/* Bytes mapped for regions.  Written under mtx; read racily. */
+	atomic_zu_t		mapped;
+};
+
+extern bool opt_hpa;
+
+bool hpa_init(tsdn_t *tsdn, hpa_t *hpa);
+/*
+ * Allocate and register a slab extent of size bytes from the hugepage regions.
+ * Returns NULL if size does not fit in a region or memory is exhausted.
+ */
+extent_t *hpa_alloc(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa, size_t size,
+    szind_t szind);
+/*
+ * Deregister slab and return its pages to their region.  Returns true, without
+ * doing anything or taking hpa->mtx, if slab did not come from hpa_alloc().
+ */
+bool hpa_dalloc(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa, extent_t *slab);
+/* Purge every empty region. */
+void hpa_purge(tsdn_t *tsdn, hpa_t *hpa);
+/* Unmap every region; all slabs must have been returned beforehand. */
+void hpa_destroy(tsdn_t *tsdn, hpa_t *hpa);
+size_t hpa_mapped_get(hpa_t *hpa);
+
+void hpa_prefork(tsdn_t *tsdn, hpa_t *hpa);
+void hpa_postfork_parent(tsdn_t *tsdn, hpa_t *hpa);
+void hpa_postfork_child(tsdn_t *tsdn, hpa_t *hpa);
+
+#endif /* JEMALLOC_INTERNAL_HPA_H */
@@ -44,6 +44,10 @@
 #  include <errno.h>
 #  include <sys/time.h>
 #  include <time.h>
+#  ifdef JEMALLOC_HAVE_RSEQ
+#    include <sys/rseq.h>
+#    include <linux/membarrier.h>
+#  endif
 #  ifdef JEMALLOC_HAVE_MACH_ABSOLUTE_TIME
 #    include <mach/mach_time.h>
 #  endif
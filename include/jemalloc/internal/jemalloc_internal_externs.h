@@ -56,5 +56,8 @@ void jemalloc_postfork_parent(void);
 void jemalloc_postfork_child(void);
 bool malloc_initialized(void);
 void je_sdallocx_noflags(void *ptr, size_t size);
+size_t batch_alloc(tsd_t *tsd, void **ptrs, size_t num, size_t size,
+    int flags);
+void batch_free(tsd_t *tsd, void **ptrs, size_t num, size_t size);
 
 #endif /* JEMALLOC_INTERNAL_EXTERNS_H */
@@ -58,6 +58,15 @@ static const bool pages_can_purge_forced =
 #endif
     ;
 
+/* Most ranges purged by one pages_purge_*_batch() call. */
+#define PAGES_PURGE_BATCH_MAX 64
+
+typedef struct pages_range_s pages_range_t;
+struct pages_range_s {
+	void	*addr;
+	size_t	size;
+};
+
 typedef enum {
 	thp_mode_default       = 0, /* Do not change hugepage settings. */
 	thp_mode_always        = 1, /* Always set MADV_HUGEPAGE. */
@@ -73,11 +82,25 @@ extern thp_mode_t init_system_thp_mode; /* Initial system wide state. */
 extern const char *thp_mode_names[];
 
 void *pages_map(void *addr, size_t size, size_t alignment, bool *commit);
+/*
+ * Map a range of zeroed pages to be populated on demand, without committing
+ * memory for it up front.  Returns NULL if that is not possible.
+ */
+void *pages_map_sparse(size_t size);
 void pages_unmap(void *addr, size_t size);
 bool pages_commit(void *addr, size_t size);
 bool pages_decommit(void *addr, size_t size);
 bool pages_purge_lazy(void *addr, size_t size);
 bool pages_purge_forced(void *addr, size_t size);
+/*
+ * Purge each of the ranges the way pages_purge_lazy() or pages_purge_forced()
+ * does, with a single system call.  Return true if that is not supported, in
+ * which case some of the ranges may have been purged already.
+ */
+bool pages_purge_lazy_batch(const pages_range_t *ranges, size_t nranges);
+bool pages_purge_forced_batch(const pages_range_t *ranges, size_t nranges);
+/* Returns true if pages_decommit() can succeed. */
+bool pages_can_decommit(void);
 bool pages_huge(void *addr, size_t size);
 bool pages_nohuge(void *addr, size_t size);
 bool pages_dontdump(void *addr, size_t size);
@@ -0,0 +1,47 @@
+#ifndef JEMALLOC_INTERNAL_PRESSURE_H
+#define JEMALLOC_INTERNAL_PRESSURE_H
+
+/*
+ * Memory pressure, as reported by Linux: the share of time during which some
+ * tasks of the process's cgroup stalled on memory (PSI, its memory.pressure,
+ * or else the system-wide /proc/pressure/memory), and how close the memory
+ * usage of that cgroup is to its memory.high limit.  With
+ * opt_pressure_purge, background thread 0 polls it, and purges all arenas for
+ * as long as the pressure is high.
+ */
+
+/* Interval between two polls of the memory pressure. */
+#define PRESSURE_CHECK_INTERVAL_NS	KQU(1000000000)
+/*
+ * Memory pressure is high when the "some avg10" PSI metric, in hundredths of a
+ * percent, reaches this threshold ...
+ */
+#define PRESSURE_PSI_THRESHOLD		1000
+/* ... or when memory.current is within 1/8 of memory.high. */
+#define PRESSURE_LG_CGROUP_HEADROOM	3
+
+extern bool opt_pressure_purge;
+
+/*
+ * Parse the "some avg10" metric of the PSI memory file, in hundredths of a
+ * percent.  Returns true on error.
+ */
+bool pressure_psi_parse(const char *buf, uint64_t *r_avg10);
+/*
+ * Parse a cgroup memory limit or usage file; "max" reads as UINT64_MAX.
+ * Returns true on error.
+ */
+bool pressure_cgroup_value_parse(const char *buf, uint64_t *r_value);
+/*
+ * Extract the cgroup v2 path of the process from /proc/self/cgroup, without
+ * trailing slash.  Returns true on error.
+ */
+bool pressure_cgroup_path_parse(const char *buf, char *path, size_t size);
+
+/*
+ * Returns true if the memory pressure is high.  Only called by background
+ * thread 0.
+ */
+bool pressure_high(void);
+
+#endif /* JEMALLOC_INTERNAL_PRESSURE_H */
@@ -0,0 +1,189 @@
+#ifndef JEMALLOC_INTERNAL_RSEQ_H
+#define JEMALLOC_INTERNAL_RSEQ_H
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/cache_bin.h"
+#include "jemalloc/internal/ticker.h"
+
+/*
+ * Restartable sequences, used by the per-CPU tcaches.  A critical section
+ * first checks that it runs on a given CPU, and publishes its effect with a
+ * single final store (the commit).  If the thread is preempted, migrated or
+ * signaled before the commit, the kernel resumes it at the abort handler
+ * instead, so that critical sections on the same CPU never interleave.  The C
+ * library registers the rseq area of each thread at __rseq_offset from the
+ * thread pointer.
+ *
+ * Each critical section below fails, with no effect beyond the ones noted, if
+ * it is aborted, if the thread does not run on cpu, or if *locked is set.  The
+ * owner of a per-CPU cache sets *locked with rseq_lock() while it runs on the
+ * CPU, or else with a store followed by membarrier(2), which restarts the
+ * critical sections in flight.
+ */
+
+#ifdef JEMALLOC_HAVE_RSEQ
+/*
+ * Registers the critical section from label 1 to label 2, which aborts to
+ * label 4, and checks cpu and *locked.  The abort handler is preceded by the
+ * signature, as the operand of a ud1 instruction.
+ */
+#define RSEQ_CS_BEGIN							\
+	".pushsection __rseq_cs, \"aw\"\n\t"				\
+	".balign 32\n\t"						\
+	"3:\n\t"							\
+	".long 0x0, 0x0\n\t"						\
+	".quad 1f, (2f - 1f), 4f\n\t"					\
+	".popsection\n\t"						\
+	"leaq 3b(%%rip), %%rax\n\t"					\
+	"movq %%rax, %%fs:%c[rseq_cs](%[rseq_offset])\n\t"		\
+	"1:\n\t"							\
+	"cmpl %[cpu], %%fs:%c[rseq_cpu_id](%[rseq_offset])\n\t"		\
+	"jne %l[fail]\n\t"						\
+	"cmpb $0, (%[locked])\n\t"					\
+	"jne %l[fail]\n\t"
+#define RSEQ_CS_END							\
+	"2:\n\t"							\
+	".pushsection __rseq_failure, \"ax\"\n\t"			\
+	".byte 0x0f, 0xb9, 0x3d\n\t"					\
+	".long %c[rseq_sig]\n\t"					\
+	"4:\n\t"							\
+	"jmp %l[fail]\n\t"						\
+	".popsection\n\t"
+#define RSEQ_CS_INPUTS(cpu, locked)					\
+	[cpu] "r" (cpu),						\
+	[locked] "r" (locked),						\
+	[rseq_offset] "r" (__rseq_offset),				\
+	[rseq_cs] "i" (offsetof(struct rseq, rseq_cs)),			\
+	[rseq_cpu_id] "i" (offsetof(struct rseq, cpu_id)),		\
+	[rseq_sig] "i" (RSEQ_SIG)
+#endif
+
+/*
+ * The CPU the thread runs on; at least ncpus if the C library did not
+ * register the rseq area of the thread.
+ */
+JEMALLOC_ALWAYS_INLINE uint32_t
+rseq_cpu_get(void) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	uint32_t cpu;
+	__asm__ __volatile__(
+	    "movl %%fs:%c[rseq_cpu_id](%[rseq_offset]), %[cpu]"
+	    : [cpu] "=r" (cpu)
+	    : [rseq_offset] "r" (__rseq_offset),
+	      [rseq_cpu_id] "i" (offsetof(struct rseq, cpu_id)));
+	return cpu;
+#else
+	not_reached();
+	return UINT32_MAX;
+#endif
+}
+
+/* Sets *locked, on cpu.  Returns true on failure. */
+JEMALLOC_ALWAYS_INLINE bool
+rseq_lock(uint32_t cpu, atomic_b_t *locked) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	__asm__ goto (
+	    RSEQ_CS_BEGIN
+	    "movb $1, (%[locked])\n\t"
+	    RSEQ_CS_END
+	    :
+	    : RSEQ_CS_INPUTS(cpu, locked)
+	    : "rax", "memory", "cc"
+	    : fail);
+	return false;
+fail:
+	return true;
+#else
+	not_reached();
+	return true;
+#endif
+}
+
+/*
+ * cache_bin_alloc_easy(), on cpu, counting the request in the bin stats.
+ * Returns NULL on failure, including when the bin is empty.  An aborted attempt
+ * may still have counted the request, or moved the low water mark.
+ */
+JEMALLOC_ALWAYS_INLINE void *
+rseq_cache_bin_alloc(uint32_t cpu, const atomic_b_t *locked,
+    cache_bin_t *bin) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	void *ret JEMALLOC_CC_SILENCE_INIT(NULL);
+	__asm__ goto (
+	    RSEQ_CS_BEGIN
+	    "movq %c[cur](%[bin]), %%rax\n\t"
+	    "cmpl %c[empty](%[bin]), %%eax\n\t"
+	    "je %l[fail]\n\t"
+	    "movq (%%rax), %%rcx\n\t"
+	    "movq %%rcx, (%[ret])\n\t"
+	    "addq $8, %%rax\n\t"
+	    "cmpl %c[low_water](%[bin]), %%eax\n\t"
+	    "jbe 5f\n\t"
+	    "movl %%eax, %c[low_water](%[bin])\n\t"
+	    "5:\n\t"
+	    "addq %[nrequests_incr], %c[nrequests](%[bin])\n\t"
+	    /* Commit. */
+	    "movq %%rax, %c[cur](%[bin])\n\t"
+	    RSEQ_CS_END
+	    :
+	    : RSEQ_CS_INPUTS(cpu, locked),
+	      [bin] "r" (bin),
+	      [ret] "r" (&ret),
+	      [cur] "i" (offsetof(cache_bin_t, cur_ptr)),
+	      [empty] "i" (offsetof(cache_bin_t, empty_position)),
+	      [low_water] "i" (offsetof(cache_bin_t, low_water_position)),
+	      [nrequests] "i" (offsetof(cache_bin_t, tstats.nrequests)),
+	      [nrequests_incr] "i" (config_stats ? 1 : 0)
+	    : "rax", "rcx", "memory", "cc"
+	    : fail);
+	return ret;
+fail:
+	return NULL;
+#else
+	not_reached();
+	return NULL;
+#endif
+}
+
+/*
+ * cache_bin_dalloc_easy(), on cpu, ticking gc_ticker.  Fails if the bin is
+ * full, or if the ticker would fire, leaving that to the caller.  Returns true
+ * on success.  An aborted attempt may still have ticked.
+ */
+JEMALLOC_ALWAYS_INLINE bool
+rseq_cache_bin_dalloc(uint32_t cpu, const atomic_b_t *locked,
+    cache_bin_t *bin, ticker_t *gc_ticker, void *ptr) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	__asm__ goto (
+	    RSEQ_CS_BEGIN
+	    "cmpl $0, (%[tick])\n\t"
+	    "jle %l[fail]\n\t"
+	    "movq %c[cur](%[bin]), %%rax\n\t"
+	    "cmpl %c[full](%[bin]), %%eax\n\t"
+	    "je %l[fail]\n\t"
+	    "subq $8, %%rax\n\t"
+	    "movq %[ptr], (%%rax)\n\t"
+	    "decl (%[tick])\n\t"
+	    /* Commit. */
+	    "movq %%rax, %c[cur](%[bin])\n\t"
+	    RSEQ_CS_END
+	    :
+	    : RSEQ_CS_INPUTS(cpu, locked),
+	      [bin] "r" (bin),
+	      [ptr] "r" (ptr),
+	      [tick] "r" (&gc_ticker->tick),
+	      [cur] "i" (offsetof(cache_bin_t, cur_ptr)),
+	      [full] "i" (offsetof(cache_bin_t, full_position))
+	    : "rax", "memory", "cc"
+	    : fail);
+	return true;
+fail:
+	return false;
+#else
+	not_reached();
+	return false;
+#endif
+}
+
+#endif /* JEMALLOC_INTERNAL_RSEQ_H */
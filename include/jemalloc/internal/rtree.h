@@ -2,6 +2,7 @@
 #define JEMALLOC_INTERNAL_RTREE_H
 
 #include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/bit_util.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/rtree_tsd.h"
 #include "jemalloc/internal/sc.h"
@@ -34,6 +35,13 @@
 #if RTREE_NHIB >= LG_CEIL(SC_NSIZES)
 #  define RTREE_LEAF_COMPACT
 #endif
+/*
+ * Support a flat page map, i.e. one leaf element per page of the virtual
+ * address space in a single sparse array, if it fits comfortably there.
+ */
+#if RTREE_NSB <= 36
+#  define RTREE_FLAT
+#endif
 
 /* Needed for initialization only. */
 #define RTREE_LEAFKEY_INVALID ((uintptr_t)1)
@@ -79,6 +87,14 @@ struct rtree_level_s {
 typedef struct rtree_s rtree_t;
 struct rtree_s {
 	malloc_mutex_t		init_lock;
+#ifdef RTREE_FLAT
+	/*
+	 * If non-NULL, the flat page map used in lieu of the tree: leaf
+	 * elements indexed by page number, populated on demand by the OS.
+	 * Read-only after initialization.
+	 */
+	rtree_leaf_elm_t	*flat;
+#endif
 	/* Number of elements based on rtree_levels[0].bits. */
 #if RTREE_HEIGHT > 1
 	rtree_node_elm_t	root[1U << (RTREE_NSB/RTREE_HEIGHT)];
@@ -109,7 +125,13 @@ static const rtree_level_t rtree_levels[] = {
 #endif
 };
 
-bool rtree_new(rtree_t *rtree, bool zeroed);
+extern bool opt_rtree_flat;
+
+/*
+ * If flat, try to use a flat page map rather than the tree; this silently
+ * falls back to the tree where unsupported.
+ */
+bool rtree_new(rtree_t *rtree, bool zeroed, bool flat);
 
 typedef rtree_node_elm_t *(rtree_node_alloc_t)(tsdn_t *, rtree_t *, size_t);
 extern rtree_node_alloc_t *JET_MUTABLE rtree_node_alloc;
@@ -147,6 +169,12 @@ rtree_cache_direct_map(uintptr_t key) {
 	return (size_t)((key >> maskbits) & (RTREE_CTX_NCACHE - 1));
 }
 
+/* The L2 set that the entries evicted from an L1 slot move to. */
+JEMALLOC_ALWAYS_INLINE size_t
+rtree_cache_l2_set(size_t slot) {
+	return slot & (RTREE_CTX_L2_NSETS - 1);
+}
+
 JEMALLOC_ALWAYS_INLINE uintptr_t
 rtree_subkey(uintptr_t key, unsigned level) {
 	unsigned ptrbits = ZU(1) << (LG_SIZEOF_PTR+3);
@@ -157,6 +185,15 @@ rtree_subkey(uintptr_t key, unsigned level) {
 	return ((key >> shiftbits) & mask);
 }
 
+#ifdef RTREE_FLAT
+#  define RTREE_FLAT_SIZE (sizeof(rtree_leaf_elm_t) << RTREE_NSB)
+
+JEMALLOC_ALWAYS_INLINE rtree_leaf_elm_t *
+rtree_flat_elm(rtree_t *rtree, uintptr_t key) {
+	return &rtree->flat[(key << RTREE_NHIB) >> (RTREE_NHIB + RTREE_NLIB)];
+}
+#endif
+
 /*
  * Atomic getters.
  *
@@ -227,8 +264,12 @@ rtree_leaf_elm_szind_read(tsdn_t *tsdn, rtree_t *rtree,
 	uintptr_t bits = rtree_leaf_elm_bits_read(tsdn, rtree, elm, dependent);
 	return rtree_leaf_elm_bits_szind_get(bits);
 #else
-	return (szind_t)atomic_load_u(&elm->le_szind, dependent ? ATOMIC_RELAXED
-	    : ATOMIC_ACQUIRE);
+	/*
+	 * Constant memory orders only: where debug builds don't inline this,
+	 * GCC warns about the invalid ones atomic_load_u() has cases for.
+	 */
+	return (szind_t)(dependent ? atomic_load_u(&elm->le_szind,
+	    ATOMIC_RELAXED) : atomic_load_u(&elm->le_szind, ATOMIC_ACQUIRE));
 #endif
 }
 
@@ -329,6 +370,12 @@ rtree_leaf_elm_lookup(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 	assert(key != 0);
 	assert(!dependent || !init_missing);
 
+#ifdef RTREE_FLAT
+	if (rtree->flat != NULL) {
+		return rtree_flat_elm(rtree, key);
+	}
+#endif
+
 	size_t slot = rtree_cache_direct_map(key);
 	uintptr_t leafkey = rtree_leafkey(key);
 	assert(leafkey != RTREE_LEAFKEY_INVALID);
@@ -341,42 +388,36 @@ rtree_leaf_elm_lookup(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 		return &leaf[subkey];
 	}
 	/*
-	 * Search the L2 LRU cache.  On hit, swap the matching element into the
-	 * slot in L1 cache, and move the position in L2 up by 1.
+	 * Search the L2 set, comparing all its leafkeys at once.  On hit, swap
+	 * the matching element with the slot in L1 cache, and move the position
+	 * in L2 up by 1.
 	 */
-#define RTREE_CACHE_CHECK_L2(i) do {					\
-	if (likely(rtree_ctx->l2_cache[i].leafkey == leafkey)) {	\
-		rtree_leaf_elm_t *leaf = rtree_ctx->l2_cache[i].leaf;	\
-		assert(leaf != NULL);					\
-		if (i > 0) {						\
-			/* Bubble up by one. */				\
-			rtree_ctx->l2_cache[i].leafkey =		\
-				rtree_ctx->l2_cache[i - 1].leafkey;	\
-			rtree_ctx->l2_cache[i].leaf =			\
-				rtree_ctx->l2_cache[i - 1].leaf;	\
-			rtree_ctx->l2_cache[i - 1].leafkey =		\
-			    rtree_ctx->cache[slot].leafkey;		\
-			rtree_ctx->l2_cache[i - 1].leaf =		\
-			    rtree_ctx->cache[slot].leaf;		\
-		} else {						\
-			rtree_ctx->l2_cache[0].leafkey =		\
-			    rtree_ctx->cache[slot].leafkey;		\
-			rtree_ctx->l2_cache[0].leaf =			\
-			    rtree_ctx->cache[slot].leaf;		\
-		}							\
-		rtree_ctx->cache[slot].leafkey = leafkey;		\
-		rtree_ctx->cache[slot].leaf = leaf;			\
-		uintptr_t subkey = rtree_subkey(key, RTREE_HEIGHT-1);	\
-		return &leaf[subkey];					\
-	}								\
-} while (0)
-	/* Check the first cache entry. */
-	RTREE_CACHE_CHECK_L2(0);
-	/* Search the remaining cache elements. */
-	for (unsigned i = 1; i < RTREE_CTX_NCACHE_L2; i++) {
-		RTREE_CACHE_CHECK_L2(i);
+	size_t set = rtree_cache_l2_set(slot);
+	rtree_ctx_cache_set_t *l2 = &rtree_ctx->l2_cache[set];
+	unsigned match = 0;
+	for (unsigned i = 0; i < RTREE_CTX_L2_NWAYS; i++) {
+		match |= (unsigned)(l2->leafkey[i] == leafkey) << i;
+	}
+	if (likely(match != 0)) {
+		unsigned i = ffs_u(match) - 1;
+		rtree_leaf_elm_t *leaf = l2->leaf[i];
+		assert(leaf != NULL);
+		if (i > 0) {
+			/* Bubble up by one. */
+			l2->leafkey[i] = l2->leafkey[i - 1];
+			l2->leaf[i] = l2->leaf[i - 1];
+			i--;
+		}
+		l2->leafkey[i] = rtree_ctx->cache[slot].leafkey;
+		l2->leaf[i] = rtree_ctx->cache[slot].leaf;
+		rtree_ctx->cache[slot].leafkey = leafkey;
+		rtree_ctx->cache[slot].leaf = leaf;
+		if (config_stats) {
+			rtree_ctx_stat_inc(&rtree_ctx->nhits_l2);
+		}
+		uintptr_t subkey = rtree_subkey(key, RTREE_HEIGHT-1);
+		return &leaf[subkey];
 	}
-#undef RTREE_CACHE_CHECK_L2
 
 	return rtree_leaf_elm_lookup_hard(tsdn, rtree, rtree_ctx, key,
 	    dependent, init_missing);
@@ -453,41 +494,48 @@ rtree_extent_szind_read(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 }
 
 /*
- * Try to read szind_slab from the L1 cache.  Returns true on a hit,
- * and fills in r_szind and r_slab.  Otherwise returns false.
+ * Try to read szind_slab from the flat page map or the L1 cache.  Returns true
+ * on a hit, and fills in r_szind and r_slab.  Otherwise returns false.
  *
  * Key is allowed to be NULL in order to save an extra branch on the
- * fastpath.  returns false in this case.
+ * fastpath.  returns false in this case, except with the flat page map, which
+ * always hits and then fills in a false r_slab.
  */
 JEMALLOC_ALWAYS_INLINE bool
 rtree_szind_slab_read_fast(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 			    uintptr_t key, szind_t *r_szind, bool *r_slab) {
 	rtree_leaf_elm_t *elm;
 
-	size_t slot = rtree_cache_direct_map(key);
-	uintptr_t leafkey = rtree_leafkey(key);
-	assert(leafkey != RTREE_LEAFKEY_INVALID);
-
-	if (likely(rtree_ctx->cache[slot].leafkey == leafkey)) {
+#ifdef RTREE_FLAT
+	if (rtree->flat != NULL) {
+		elm = rtree_flat_elm(rtree, key);
+	} else
+#endif
+	{
+		size_t slot = rtree_cache_direct_map(key);
+		uintptr_t leafkey = rtree_leafkey(key);
+		assert(leafkey != RTREE_LEAFKEY_INVALID);
+
+		if (unlikely(rtree_ctx->cache[slot].leafkey != leafkey)) {
+			return false;
+		}
 		rtree_leaf_elm_t *leaf = rtree_ctx->cache[slot].leaf;
 		assert(leaf != NULL);
 		uintptr_t subkey = rtree_subkey(key, RTREE_HEIGHT-1);
 		elm = &leaf[subkey];
+	}
 
 #ifdef RTREE_LEAF_COMPACT
-		uintptr_t bits = rtree_leaf_elm_bits_read(tsdn, rtree,
-							  elm, true);
-		*r_szind = rtree_leaf_elm_bits_szind_get(bits);
-		*r_slab = rtree_leaf_elm_bits_slab_get(bits);
+	uintptr_t bits = rtree_leaf_elm_bits_read(tsdn, rtree, elm, true);
+	*r_szind = rtree_leaf_elm_bits_szind_get(bits);
+	*r_slab = rtree_leaf_elm_bits_slab_get(bits);
 #else
-		*r_szind = rtree_leaf_elm_szind_read(tsdn, rtree, elm, true);
-		*r_slab = rtree_leaf_elm_slab_read(tsdn, rtree, elm, true);
+	*r_szind = rtree_leaf_elm_szind_read(tsdn, rtree, elm, true);
+	*r_slab = rtree_leaf_elm_slab_read(tsdn, rtree, elm, true);
 #endif
-		return true;
-	} else {
-		return false;
-	}
+	return true;
 }
+
 JEMALLOC_ALWAYS_INLINE bool
 rtree_szind_slab_read(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
     uintptr_t key, bool dependent, szind_t *r_szind, bool *r_slab) {
@@ -1,6 +1,8 @@
 #ifndef JEMALLOC_INTERNAL_RTREE_CTX_H
 #define JEMALLOC_INTERNAL_RTREE_CTX_H
 
+#include "jemalloc/internal/atomic.h"
+
 /*
  * Number of leafkey/leaf pairs to cache in L1 and L2 level respectively.  Each
  * entry supports an entire leaf, so the cache hit rate is typically high even
@@ -13,20 +15,37 @@
  *
  * The L1 direct mapped cache offers consistent and low cost on cache hit.
  * However collision could affect hit rate negatively.  This is resolved by
- * combining with a L2 LRU cache, which requires linear search and re-ordering
- * on access but suffers no collision.  Note that, the cache will itself suffer
- * cache misses if made overly large, plus the cost of linear search in the LRU
- * cache.
+ * combining with a set associative L2 cache, which holds the entries evicted
+ * from L1.  L1 slots map onto L2 sets by the same key bits, so each L1 slot
+ * effectively gains RTREE_CTX_L2_NWAYS victim ways, shared with the other
+ * slots mapping onto the same set.  Within a set, the leafkeys are compared all
+ * at once (with SIMD where the compiler manages it), and entries are kept in
+ * approximate LRU order.  Note that, the cache will itself suffer cache misses
+ * if made overly large.
  */
-#define RTREE_CTX_LG_NCACHE 4
+#define RTREE_CTX_LG_NCACHE LG_RTREE_CTX_NCACHE
 #define RTREE_CTX_NCACHE (1 << RTREE_CTX_LG_NCACHE)
-#define RTREE_CTX_NCACHE_L2 8
+#define RTREE_CTX_L2_LG_NWAYS 2
+#define RTREE_CTX_L2_NWAYS (1 << RTREE_CTX_L2_LG_NWAYS)
+#define RTREE_CTX_L2_NSETS (RTREE_CTX_NCACHE / 2)
+#define RTREE_CTX_NCACHE_L2 (RTREE_CTX_L2_NSETS * RTREE_CTX_L2_NWAYS)
 
 /*
  * Zero initializer required for tsd initialization only.  Proper initialization
  * done via rtree_ctx_data_init().
  */
-#define RTREE_CTX_ZERO_INITIALIZER {{{0, 0}}, {{0, 0}}}
+#define RTREE_CTX_ZERO_INITIALIZER {{{0, 0}}, {{{0}, {NULL}}},		\
+    ATOMIC_INIT(0), ATOMIC_INIT(0)}
+
+/*
+ * Cache stats are written by the owner thread only, but read by others.
+ * Without 64-bit atomics, they are pointer sized, and may wrap around.
+ */
+#ifdef JEMALLOC_ATOMIC_U64
+typedef atomic_u64_t rtree_ctx_stat_t;
+#else
+typedef atomic_zu_t rtree_ctx_stat_t;
+#endif
 
 
 typedef struct rtree_leaf_elm_s rtree_leaf_elm_t;
@@ -37,14 +56,62 @@ struct rtree_ctx_cache_elm_s {
 	rtree_leaf_elm_t	*leaf;
 };
 
+/*
+ * One set of the L2 cache, most recently used way first.  The leafkeys are
+ * contiguous, so that they can be compared at once; with 4 ways on 64-bit
+ * systems, a set fills one cache line.
+ */
+typedef struct rtree_ctx_cache_set_s rtree_ctx_cache_set_t;
+struct rtree_ctx_cache_set_s {
+	uintptr_t		leafkey[RTREE_CTX_L2_NWAYS];
+	rtree_leaf_elm_t	*leaf[RTREE_CTX_L2_NWAYS];
+};
+
 typedef struct rtree_ctx_s rtree_ctx_t;
 struct rtree_ctx_s {
 	/* Direct mapped cache. */
 	rtree_ctx_cache_elm_t	cache[RTREE_CTX_NCACHE];
-	/* L2 LRU cache. */
-	rtree_ctx_cache_elm_t	l2_cache[RTREE_CTX_NCACHE_L2];
+	/* L2 set associative cache. */
+	rtree_ctx_cache_set_t	l2_cache[RTREE_CTX_L2_NSETS];
+	/*
+	 * Lookups that hit in L2, and that missed both levels and walked the
+	 * tree.  L1 hits are not counted, to keep the fast path as is.  Only
+	 * maintained if config_stats.
+	 */
+	rtree_ctx_stat_t	nhits_l2;
+	rtree_ctx_stat_t	nmisses;
 };
 
+static inline uint64_t
+rtree_ctx_stat_read(const rtree_ctx_stat_t *stat) {
+#ifdef JEMALLOC_ATOMIC_U64
+	return atomic_load_u64(stat, ATOMIC_RELAXED);
+#else
+	return (uint64_t)atomic_load_zu(stat, ATOMIC_RELAXED);
+#endif
+}
+
+/* Owner thread only; as the sole writer, it needn't pay for an atomic RMW. */
+static inline void
+rtree_ctx_stat_inc(rtree_ctx_stat_t *stat) {
+#ifdef JEMALLOC_ATOMIC_U64
+	atomic_store_u64(stat, atomic_load_u64(stat, ATOMIC_RELAXED) + 1,
+	    ATOMIC_RELAXED);
+#else
+	atomic_store_zu(stat, atomic_load_zu(stat, ATOMIC_RELAXED) + 1,
+	    ATOMIC_RELAXED);
+#endif
+}
+
+static inline void
+rtree_ctx_stat_reset(rtree_ctx_stat_t *stat) {
+#ifdef JEMALLOC_ATOMIC_U64
+	atomic_store_u64(stat, 0, ATOMIC_RELAXED);
+#else
+	atomic_store_zu(stat, 0, ATOMIC_RELAXED);
+#endif
+}
+
 void rtree_ctx_data_init(rtree_ctx_t *ctx);
 
 #endif /* JEMALLOC_INTERNAL_RTREE_CTX_H */
@@ -0,0 +1,61 @@
+#ifndef JEMALLOC_INTERNAL_SLAB_MAP_H
+#define JEMALLOC_INTERNAL_SLAB_MAP_H
+
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/sc.h"
+
+/*
+ * The slab map: one byte per page of the low 2^SLAB_MAP_LG_VADDR bytes of the
+ * address space, holding szind + 1 for the pages of active slabs, and 0 for
+ * all other pages.  With opt_slab_map, free() reads the size class of small
+ * objects from it with a single dependent load, rather than through the rtree.
+ * The map is a sparse mapping, populated by the OS on demand; each of its
+ * pages covers 2^(2*LG_PAGE) bytes of heap.
+ *
+ * Addresses above the map (rarely handed out even on systems that support
+ * them) are always looked up through the rtree.
+ */
+#if LG_VADDR < 48
+#  define SLAB_MAP_LG_VADDR	LG_VADDR
+#else
+#  define SLAB_MAP_LG_VADDR	48
+#endif
+#define SLAB_MAP_NPAGES		(ZU(1) << (SLAB_MAP_LG_VADDR - LG_PAGE))
+
+#if SC_NBINS > 255
+#  error "szind + 1 of slabs must fit in one byte"
+#endif
+
+extern bool opt_slab_map;
+/* NULL unless opt_slab_map, and the address space could be reserved. */
+extern atomic_u8_t *slab_map;
+
+void slab_map_boot(void);
+/* Record the szind of the pages of a slab that becomes active. */
+void slab_map_set(const void *addr, size_t size, szind_t szind);
+/* Forget the pages of a slab that is no longer active. */
+void slab_map_clear(const void *addr, size_t size);
+
+/*
+ * Returns true and fills in r_szind if key is within an active slab according
+ * to the slab map.  Otherwise returns false, and the rtree has the answer.
+ */
+JEMALLOC_ALWAYS_INLINE bool
+slab_map_lookup(uintptr_t key, szind_t *r_szind) {
+	if (slab_map == NULL) {
+		return false;
+	}
+#if SLAB_MAP_LG_VADDR < (8 << LG_SIZEOF_PTR)
+	if (unlikely((key >> SLAB_MAP_LG_VADDR) != 0)) {
+		return false;
+	}
+#endif
+	uint8_t v = atomic_load_u8(&slab_map[key >> LG_PAGE], ATOMIC_RELAXED);
+	if (v == 0) {
+		return false;
+	}
+	*r_szind = (szind_t)v - 1;
+	return true;
+}
+
+#endif /* JEMALLOC_INTERNAL_SLAB_MAP_H */
@@ -3,6 +3,17 @@
 
 extern bool	opt_tcache;
 extern ssize_t	opt_lg_tcache_max;
+extern bool	opt_tcache_adaptive;
+extern size_t	opt_tcache_bytes_max;
+extern size_t	opt_tcache_global_bytes_max;
+extern bool	opt_percpu_tcache;
+
+/*
+ * With opt_percpu_tcache, ncpus caches set up by tcache_percpu_boot(), and
+ * whether the small bins are used in restartable sequences.
+ */
+extern tcache_percpu_t	**tcache_percpus;
+extern bool	tcache_percpu_rseq;
 
 /*
  * Number of tcache bins.  There are SC_NBINS small-object bins, plus 0 or more
@@ -13,6 +24,12 @@ extern unsigned	nhbins;
 /* Maximum cached size class. */
 extern size_t	tcache_maxclass;
 
+/*
+ * Upper limit on small_cap_bytes of each tcache, enforced when growing bins
+ * with opt_tcache_adaptive.
+ */
+extern size_t	tcache_bytes_max;
+
 /*
  * Explicit tcaches, managed via the tcache.{create,flush,destroy} mallctls and
  * usable via the MALLOCX_TCACHE() flag.  The automatic per thread tcaches are
@@ -41,6 +58,13 @@ void	tcaches_flush(tsd_t *tsd, unsigned ind);
 void	tcaches_destroy(tsd_t *tsd, unsigned ind);
 bool	tcache_boot(tsdn_t *tsdn);
 void tcache_arena_associate(tsdn_t *tsdn, tcache_t *tcache, arena_t *arena);
+void tcache_op_wait(tcache_t *tcache);
+void tcache_reclaim(tsdn_t *tsdn);
+void tcache_reclaim_maybe(tsdn_t *tsdn);
+bool tcache_percpu_boot(tsdn_t *tsdn);
+tcache_t *tcache_percpu_lock(tsd_t *tsd, tcache_percpu_t **r_percpu);
+void tcache_percpu_unlock(tsd_t *tsd, tcache_percpu_t *percpu);
+void tcache_percpu_flush(tsd_t *tsd);
 void tcache_prefork(tsdn_t *tsdn);
 void tcache_postfork_parent(tsdn_t *tsdn);
 void tcache_postfork_child(tsdn_t *tsdn);
@@ -3,8 +3,10 @@
 
 #include "jemalloc/internal/bin.h"
 #include "jemalloc/internal/jemalloc_internal_types.h"
+#include "jemalloc/internal/rseq.h"
 #include "jemalloc/internal/sc.h"
 #include "jemalloc/internal/sz.h"
+#include "jemalloc/internal/tcache_percpu.h"
 #include "jemalloc/internal/ticker.h"
 #include "jemalloc/internal/util.h"
 
@@ -27,6 +29,93 @@ tcache_enabled_set(tsd_t *tsd, bool enabled) {
 	tsd_slow_update(tsd);
 }
 
+/*
+ * Returns the cache of the current CPU, locked, if the calling thread should
+ * use it: with opt_percpu_tcache, for a thread without a tcache of its own.
+ * Returns NULL otherwise.  *r_percpu must be passed to tcache_percpu_unlock()
+ * right after the allocation or deallocation, with nothing in between that
+ * could reenter.
+ */
+JEMALLOC_ALWAYS_INLINE tcache_t *
+tcache_percpu_get(tsd_t *tsd, tcache_percpu_t **r_percpu) {
+	if (likely(!opt_percpu_tcache) || tsd_tcache_enabled_get(tsd) ||
+	    tsd_reentrancy_level_get(tsd) > 0 || !tsd_nominal(tsd)) {
+		return NULL;
+	}
+	return tcache_percpu_lock(tsd, r_percpu);
+}
+
+/*
+ * Like tcache_percpu_get(), but for the restartable sequences: returns the
+ * cache of the current CPU, unlocked, and the CPU.  Returns NULL if the caller
+ * should use tcache_percpu_get() instead.
+ */
+JEMALLOC_ALWAYS_INLINE tcache_percpu_t *
+tcache_percpu_rseq_get(tsd_t *tsd, uint32_t *r_cpu, tcache_t **r_tcache) {
+	if (!have_rseq || likely(!opt_percpu_tcache) || !tcache_percpu_rseq ||
+	    tsd_tcache_enabled_get(tsd) || tsd_reentrancy_level_get(tsd) > 0 ||
+	    !tsd_nominal(tsd)) {
+		return NULL;
+	}
+	uint32_t cpu = rseq_cpu_get();
+	if (unlikely(cpu >= ncpus)) {
+		return NULL;
+	}
+	tcache_percpu_t *percpu = tcache_percpus[cpu];
+	tcache_t *tcache = (tcache_t *)atomic_load_p(&percpu->tcache,
+	    ATOMIC_ACQUIRE);
+	if (unlikely(tcache == NULL)) {
+		return NULL;
+	}
+	*r_cpu = cpu;
+	*r_tcache = tcache;
+	return percpu;
+}
+
+/*
+ * With opt_tcache_global_bytes_max, tcache_reclaim() flushes the auto tcaches
+ * of other threads, including threads that are blocked and never call into the
+ * allocator again.  The owner brackets each use of its cache bins with
+ * tcache_op_begin() and tcache_op_end(), which don't nest.  Each side first
+ * announces itself (reclaim_ops turned odd, or reclaim_busy set), then checks
+ * for the other, so that they never both go ahead.  The reclaimer backs off
+ * from a busy owner, while the owner waits for the flush to finish.
+ *
+ * The limit sets malloc_slow, so that the fast paths (slow_path false) never
+ * pay for the handshake.
+ */
+JEMALLOC_ALWAYS_INLINE void
+tcache_op_begin(tcache_t *tcache, bool slow_path) {
+	if (!slow_path) {
+		assert(opt_tcache_global_bytes_max == 0);
+		return;
+	}
+	if (likely(opt_tcache_global_bytes_max == 0)) {
+		return;
+	}
+	uint32_t ops = atomic_load_u32(&tcache->reclaim_ops, ATOMIC_RELAXED);
+	assert((ops & 1) == 0);
+	atomic_store_u32(&tcache->reclaim_ops, ops + 1, ATOMIC_RELAXED);
+	atomic_fence(ATOMIC_SEQ_CST);
+	if (unlikely(atomic_load_b(&tcache->reclaim_busy, ATOMIC_ACQUIRE))) {
+		tcache_op_wait(tcache);
+	}
+}
+
+JEMALLOC_ALWAYS_INLINE void
+tcache_op_end(tcache_t *tcache, bool slow_path) {
+	if (!slow_path) {
+		assert(opt_tcache_global_bytes_max == 0);
+		return;
+	}
+	if (likely(opt_tcache_global_bytes_max == 0)) {
+		return;
+	}
+	uint32_t ops = atomic_load_u32(&tcache->reclaim_ops, ATOMIC_RELAXED);
+	assert((ops & 1) == 1);
+	atomic_store_u32(&tcache->reclaim_ops, ops + 1, ATOMIC_RELEASE);
+}
+
 JEMALLOC_ALWAYS_INLINE void
 tcache_event(tsd_t *tsd, tcache_t *tcache) {
 	if (TCACHE_GC_INCR == 0) {
@@ -38,33 +127,12 @@ tcache_event(tsd_t *tsd, tcache_t *tcache) {
 	}
 }
 
-JEMALLOC_ALWAYS_INLINE void *
-tcache_alloc_small(tsd_t *tsd, arena_t *arena, tcache_t *tcache,
-    size_t size, szind_t binind, bool zero, bool slow_path) {
-	void *ret;
-	cache_bin_t *bin;
-	bool tcache_success;
+/* Junk or zero fills a small object allocated from a tcache. */
+JEMALLOC_ALWAYS_INLINE void
+tcache_alloc_small_fill(tsd_t *tsd, void *ret, szind_t binind, bool zero,
+    bool slow_path) {
 	size_t usize JEMALLOC_CC_SILENCE_INIT(0);
 
-	assert(binind < SC_NBINS);
-	bin = tcache_small_bin_get(tcache, binind);
-	ret = cache_bin_alloc_easy(bin, &tcache_success, binind);
-	assert(tcache_success == (ret != NULL));
-	if (unlikely(!tcache_success)) {
-		bool tcache_hard_success;
-		arena = arena_choose(tsd, arena);
-		if (unlikely(arena == NULL)) {
-			return NULL;
-		}
-
-		ret = tcache_alloc_small_hard(tsd_tsdn(tsd), arena, tcache,
-		    bin, binind, &tcache_hard_success);
-		if (tcache_hard_success == false) {
-			return NULL;
-		}
-	}
-
-	assert(ret);
 	/*
 	 * Only compute usize if required.  The checks in the following if
 	 * statement are all static.
@@ -89,10 +157,68 @@ tcache_alloc_small(tsd_t *tsd, arena_t *arena, tcache_t *tcache,
 		}
 		memset(ret, 0, usize);
 	}
+}
+
+JEMALLOC_ALWAYS_INLINE void *
+tcache_alloc_small(tsd_t *tsd, arena_t *arena, tcache_t *tcache,
+    size_t size, szind_t binind, bool zero, bool slow_path) {
+	void *ret;
+	cache_bin_t *bin;
+	bool tcache_success;
+
+	assert(binind < SC_NBINS);
+	bin = tcache_small_bin_get(tcache, binind);
+	tcache_op_begin(tcache, slow_path);
+	ret = cache_bin_alloc_easy(bin, &tcache_success, binind);
+	assert(tcache_success == (ret != NULL));
+	if (unlikely(!tcache_success)) {
+		bool tcache_hard_success;
+		/* Choosing the arena may reassociate the tcache. */
+		tcache_op_end(tcache, slow_path);
+		arena = arena_choose(tsd, arena);
+		if (unlikely(arena == NULL)) {
+			return NULL;
+		}
+
+		tcache_op_begin(tcache, slow_path);
+		ret = tcache_alloc_small_hard(tsd_tsdn(tsd), arena, tcache,
+		    bin, binind, &tcache_hard_success);
+		if (tcache_hard_success == false) {
+			tcache_op_end(tcache, slow_path);
+			return NULL;
+		}
+	}
+
+	assert(ret);
+	tcache_alloc_small_fill(tsd, ret, binind, zero, slow_path);
 
 	if (config_stats) {
 		bin->tstats.nrequests++;
 	}
+	tcache_op_end(tcache, slow_path);
+	return ret;
+}
+
+/*
+ * With tcache_percpu_rseq, allocates a small object from the cache of the
+ * current CPU without taking its mutex.  Returns NULL if the caller should go
+ * through tcache_percpu_get() instead.
+ */
+JEMALLOC_ALWAYS_INLINE void *
+tcache_percpu_alloc_small(tsd_t *tsd, szind_t binind, bool zero) {
+	assert(binind < SC_NBINS);
+	uint32_t cpu;
+	tcache_t *tcache;
+	tcache_percpu_t *percpu = tcache_percpu_rseq_get(tsd, &cpu, &tcache);
+	if (percpu == NULL) {
+		return NULL;
+	}
+	void *ret = rseq_cache_bin_alloc(cpu, &percpu->rseq_locked,
+	    tcache_small_bin_get(tcache, binind));
+	if (unlikely(ret == NULL)) {
+		return NULL;
+	}
+	tcache_alloc_small_fill(tsd, ret, binind, zero, true);
 	return ret;
 }
 
@@ -105,9 +231,11 @@ tcache_alloc_large(tsd_t *tsd, arena_t *arena, tcache_t *tcache, size_t size,
 
 	assert(binind >= SC_NBINS &&binind < nhbins);
 	bin = tcache_large_bin_get(tcache, binind);
+	tcache_op_begin(tcache, slow_path);
 	ret = cache_bin_alloc_easy(bin, &tcache_success, binind);
 	assert(tcache_success == (ret != NULL));
 	if (unlikely(!tcache_success)) {
+		tcache_op_end(tcache, slow_path);
 		/*
 		 * Only allocate one large object at a time, because it's quite
 		 * expensive to create one and not use it.
@@ -147,6 +275,7 @@ tcache_alloc_large(tsd_t *tsd, arena_t *arena, tcache_t *tcache, size_t size,
 		if (config_stats) {
 			bin->tstats.nrequests++;
 		}
+		tcache_op_end(tcache, slow_path);
 	}
 
 	return ret;
@@ -165,16 +294,42 @@ tcache_dalloc_small(tsd_t *tsd, tcache_t *tcache, void *ptr, szind_t binind,
 	}
 
 	bin = tcache_small_bin_get(tcache, binind);
+	tcache_op_begin(tcache, slow_path);
 	if (unlikely(!cache_bin_dalloc_easy(bin, ptr))) {
-		unsigned remain = cache_bin_ncached_max_get(binind) >> 1;
+		tcache->bin_flushed[binind] = true;
+		unsigned remain = cache_bin_ncached_cap_get(bin) >> 1;
 		tcache_bin_flush_small(tsd, tcache, bin, binind, remain);
 		bool ret = cache_bin_dalloc_easy(bin, ptr);
 		assert(ret);
 	}
+	tcache_op_end(tcache, slow_path);
 
 	tcache_event(tsd, tcache);
 }
 
+/*
+ * With tcache_percpu_rseq, frees a small object to the cache of the current
+ * CPU without taking its mutex.  Returns false if the caller should go through
+ * tcache_percpu_get() instead.
+ */
+JEMALLOC_ALWAYS_INLINE bool
+tcache_percpu_dalloc_small(tsd_t *tsd, void *ptr, szind_t binind) {
+	assert(binind < SC_NBINS);
+	uint32_t cpu;
+	tcache_t *tcache;
+	tcache_percpu_t *percpu = tcache_percpu_rseq_get(tsd, &cpu, &tcache);
+	if (percpu == NULL) {
+		return false;
+	}
+	assert(tcache_salloc(tsd_tsdn(tsd), ptr) <= SC_SMALL_MAXCLASS);
+
+	if (config_fill && unlikely(opt_junk_free)) {
+		arena_dalloc_junk_small(ptr, &bin_infos[binind]);
+	}
+	return rseq_cache_bin_dalloc(cpu, &percpu->rseq_locked,
+	    tcache_small_bin_get(tcache, binind), &tcache->gc_ticker, ptr);
+}
+
 JEMALLOC_ALWAYS_INLINE void
 tcache_dalloc_large(tsd_t *tsd, tcache_t *tcache, void *ptr, szind_t binind,
     bool slow_path) {
@@ -189,12 +344,14 @@ tcache_dalloc_large(tsd_t *tsd, tcache_t *tcache, void *ptr, szind_t binind,
 	}
 
 	bin = tcache_large_bin_get(tcache, binind);
+	tcache_op_begin(tcache, slow_path);
 	if (unlikely(!cache_bin_dalloc_easy(bin, ptr))) {
-		unsigned remain = cache_bin_ncached_max_get(binind) >> 1;
+		unsigned remain = cache_bin_ncached_cap_get(bin) >> 1;
 		tcache_bin_flush_large(tsd, tcache, bin, binind, remain);
 		bool ret = cache_bin_dalloc_easy(bin, ptr);
 		assert(ret);
 	}
+	tcache_op_end(tcache, slow_path);
 
 	tcache_event(tsd, tcache);
 }
@@ -0,0 +1,28 @@
+#ifndef JEMALLOC_INTERNAL_TCACHE_PERCPU_H
+#define JEMALLOC_INTERNAL_TCACHE_PERCPU_H
+
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/mutex.h"
+#include "jemalloc/internal/tcache_types.h"
+
+/*
+ * Separate from tcache_structs.h, which tsd.h includes before mutexes are
+ * defined.
+ */
+
+/*
+ * With opt_percpu_tcache, the cache shared by the threads running on a CPU.
+ * The mutex is only contended by a thread preempted or migrated while holding
+ * it.  With tcache_percpu_rseq, the threads running on the CPU also use the
+ * small bins without the mutex, in restartable sequences (see rseq.h) that
+ * back off while rseq_locked is set.  The mutex holder sets it after locking,
+ * and clears it before unlocking.
+ */
+struct tcache_percpu_s {
+	malloc_mutex_t	mtx;
+	atomic_b_t	rseq_locked;
+	/* Created on first use, under mtx. */
+	atomic_p_t	tcache;
+};
+
+#endif /* JEMALLOC_INTERNAL_TCACHE_PERCPU_H */
@@ -1,6 +1,7 @@
 #ifndef JEMALLOC_INTERNAL_TCACHE_STRUCTS_H
 #define JEMALLOC_INTERNAL_TCACHE_STRUCTS_H
 
+#include "jemalloc/internal/atomic.h"
 #include "jemalloc/internal/cache_bin.h"
 #include "jemalloc/internal/ql.h"
 #include "jemalloc/internal/sc.h"
@@ -48,10 +49,30 @@ struct tcache_s {
 	arena_t		*arena;
 	/* Next bin to GC. */
 	szind_t		next_gc_bin;
-	/* For small bins, fill (ncached_max >> lg_fill_div). */
+	/* For small bins, fill (ncached_cap >> lg_fill_div). */
 	uint8_t		lg_fill_div[SC_NBINS];
 	/* For small bins, whether has been refilled since last GC. */
 	bool		bin_refilled[SC_NBINS];
+	/* For small bins, whether has overflowed (and flushed) since last GC. */
+	bool		bin_flushed[SC_NBINS];
+	/* Sum of (ncached_cap * usize) over the small bins. */
+	size_t		small_cap_bytes;
+	/* Whether this is the auto tcache of a thread (embedded in TSD). */
+	bool		is_auto;
+	/*
+	 * Handoff between the owner and tcache_reclaim() on other threads, see
+	 * tcache_op_begin().  reclaim_ops is only written by the owner, and is
+	 * odd while it uses the cache bins.  reclaim_busy is set by a reclaimer
+	 * while it flushes them.
+	 */
+	atomic_u32_t	reclaim_ops;
+	atomic_b_t	reclaim_busy;
+	/*
+	 * Only accessed by tcache_reclaim(): reclaim_ops as of the last pass,
+	 * and whether the owner was idle since the pass before.
+	 */
+	uint32_t	reclaim_ops_seen;
+	bool		reclaim_idle;
 	/*
 	 * We put the cache bins for large size classes at the end of the
 	 * struct, since some of them might not get used.  This might end up
@@ -5,6 +5,7 @@
 
 typedef struct tcache_s tcache_t;
 typedef struct tcaches_s tcaches_t;
+typedef struct tcache_percpu_s tcache_percpu_t;
 
 /*
  * tcache pointers close to NULL are used to encode state information that is
@@ -30,6 +31,14 @@ typedef struct tcaches_s tcaches_t;
  */
 #define TCACHE_NSLOTS_SMALL_MAX		200
 
+/*
+ * With opt_tcache_adaptive, the stack of each small bin is grown by this factor
+ * (beyond the ncached_max computed above), and per thread capacities never
+ * shrink below TCACHE_NSLOTS_SMALL_CAP_MIN.
+ */
+#define TCACHE_LG_NSLOTS_SMALL_ADAPTIVE	1
+#define TCACHE_NSLOTS_SMALL_CAP_MIN	4
+
 /* Number of cache slots for large size classes. */
 #define TCACHE_NSLOTS_LARGE		20
 
@@ -50,6 +59,13 @@ typedef struct tcaches_s tcaches_t;
 /* Number of allocation bytes between tcache incremental GCs. */
 #define TCACHE_GC_INCR_BYTES 65536U
 
+/*
+ * Minimum interval between passes of tcache_reclaim(), when enforcing
+ * opt_tcache_global_bytes_max.  A thread is considered idle if it did not
+ * allocate or deallocate between two passes.
+ */
+#define TCACHE_RECLAIM_INTERVAL_NS	KQU(1000000000)
+
 /* Used in TSD static initializer only. Real init in tsd_tcache_data_init(). */
 #define TCACHE_ZERO_INITIALIZER {{0}}
 
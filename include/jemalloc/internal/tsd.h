@@ -150,6 +150,13 @@ void tsd_global_slow_inc(tsdn_t *tsdn);
 void tsd_global_slow_dec(tsdn_t *tsdn);
 bool tsd_global_slow();
 
+/*
+ * Sum the rtree_ctx cache statistics of all threads, including those which
+ * have exited.
+ */
+void tsd_rtree_ctx_stats_read(tsdn_t *tsdn, uint64_t *r_nhits_l2,
+    uint64_t *r_nmisses);
+
 enum {
 	/* Common case --> jnz. */
 	tsd_state_nominal = 0,
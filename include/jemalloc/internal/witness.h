@@ -19,17 +19,19 @@
 #define WITNESS_RANK_INIT		1U
 #define WITNESS_RANK_CTL		1U
 #define WITNESS_RANK_TCACHES		2U
-#define WITNESS_RANK_ARENAS		3U
+#define WITNESS_RANK_TCACHE_PERCPU	3U
+#define WITNESS_RANK_TCACHE_RECLAIM	4U
+#define WITNESS_RANK_ARENAS		5U
 
-#define WITNESS_RANK_BACKGROUND_THREAD_GLOBAL	4U
+#define WITNESS_RANK_BACKGROUND_THREAD_GLOBAL	6U
 
-#define WITNESS_RANK_PROF_DUMP		5U
-#define WITNESS_RANK_PROF_BT2GCTX	6U
-#define WITNESS_RANK_PROF_TDATAS	7U
-#define WITNESS_RANK_PROF_TDATA		8U
-#define WITNESS_RANK_PROF_LOG		9U
-#define WITNESS_RANK_PROF_GCTX		10U
-#define WITNESS_RANK_BACKGROUND_THREAD	11U
+#define WITNESS_RANK_PROF_DUMP		7U
+#define WITNESS_RANK_PROF_BT2GCTX	8U
+#define WITNESS_RANK_PROF_TDATAS	9U
+#define WITNESS_RANK_PROF_TDATA		10U
+#define WITNESS_RANK_PROF_LOG		11U
+#define WITNESS_RANK_PROF_GCTX		12U
+#define WITNESS_RANK_BACKGROUND_THREAD	13U
 
 /*
  * Used as an argument to witness_assert_depth_to_rank() in order to validate
@@ -37,22 +39,24 @@
  * witness_assert_depth_to_rank() is inclusive rather than exclusive, this
  * definition can have the same value as the minimally ranked core lock.
  */
-#define WITNESS_RANK_CORE		12U
+#define WITNESS_RANK_CORE		14U
 
-#define WITNESS_RANK_DECAY		12U
-#define WITNESS_RANK_TCACHE_QL		13U
-#define WITNESS_RANK_EXTENT_GROW	14U
-#define WITNESS_RANK_EXTENTS		15U
-#define WITNESS_RANK_EXTENT_AVAIL	16U
+#define WITNESS_RANK_DECAY		14U
+#define WITNESS_RANK_TCACHE_QL		15U
+#define WITNESS_RANK_EXTENT_GROW	16U
+#define WITNESS_RANK_HPA		17U
+#define WITNESS_RANK_EXTENTS		18U
+#define WITNESS_RANK_EXTENT_AVAIL	19U
 
-#define WITNESS_RANK_EXTENT_POOL	17U
-#define WITNESS_RANK_RTREE		18U
-#define WITNESS_RANK_BASE		19U
-#define WITNESS_RANK_ARENA_LARGE	20U
-#define WITNESS_RANK_HOOK		21U
+#define WITNESS_RANK_EXTENT_POOL	20U
+#define WITNESS_RANK_RTREE		21U
+#define WITNESS_RANK_BASE		22U
+#define WITNESS_RANK_ARENA_LARGE	23U
+#define WITNESS_RANK_HOOK		24U
 
 #define WITNESS_RANK_LEAF		0xffffffffU
 #define WITNESS_RANK_BIN		WITNESS_RANK_LEAF
+#define WITNESS_RANK_EXTENTS_RANGE	WITNESS_RANK_LEAF
 #define WITNESS_RANK_ARENA_STATS	WITNESS_RANK_LEAF
 #define WITNESS_RANK_DSS		WITNESS_RANK_LEAF
 #define WITNESS_RANK_PROF_ACTIVE	WITNESS_RANK_LEAF
@@ -35,17 +35,29 @@ ssize_t opt_muzzy_decay_ms = MUZZY_DECAY_MS_DEFAULT;
 static atomic_zd_t dirty_decay_ms_default;
 static atomic_zd_t muzzy_decay_ms_default;
 
+const char *decay_curve_names[] = {
+	"smoothstep",
+	"exponential",
+	"peak"
+};
+decay_curve_t opt_decay_curve = DECAY_CURVE_DEFAULT;
+
+static atomic_u_t decay_curve_default;
+
 const uint64_t h_steps[SMOOTHSTEP_NSTEPS] = {
 #define STEP(step, h, x, y)			\
 		h,
 		SMOOTHSTEP
 #undef STEP
 };
+/* Same as h_steps, for decay_curve_exponential.  Computed by arena_boot(). */
+static uint64_t h_steps_exp[SMOOTHSTEP_NSTEPS];
 
 static div_info_t arena_binind_div_info[SC_NBINS];
 
 size_t opt_oversize_threshold = OVERSIZE_THRESHOLD_DEFAULT;
 size_t oversize_threshold = OVERSIZE_THRESHOLD_DEFAULT;
+size_t opt_dirty_max = 0;
 static unsigned huge_arena_ind;
 
 /******************************************************************************/
@@ -60,9 +72,12 @@ static void arena_decay_to_limit(tsdn_t *tsdn, arena_t *arena,
 static bool arena_decay_dirty(tsdn_t *tsdn, arena_t *arena,
     bool is_background_thread, bool all);
 static void arena_dalloc_bin_slab(tsdn_t *tsdn, arena_t *arena, extent_t *slab,
-    bin_t *bin);
+    bin_t *bin, bool is_background_thread);
 static void arena_bin_lower_slab(tsdn_t *tsdn, arena_t *arena, extent_t *slab,
     bin_t *bin);
+static void arena_dalloc_bin_locked_impl(tsdn_t *tsdn, arena_t *arena,
+    bin_t *bin, szind_t binind, extent_t *slab, void *ptr, bool junked,
+    bool is_background_thread);
 
 /******************************************************************************/
 
@@ -79,6 +94,31 @@ arena_basic_stats_merge(tsdn_t *tsdn, arena_t *arena, unsigned *nthreads,
 	*nmuzzy += eset_npages_get(&arena->eset_muzzy);
 }
 
+static void
+arena_stats_decay_merge(tsdn_t *tsdn, arena_t *arena,
+    arena_stats_decay_t *dst, arena_stats_decay_t *src) {
+	arena_stats_accum_u64(&dst->npurge,
+	    arena_stats_read_u64(tsdn, &arena->stats, &src->npurge));
+	arena_stats_accum_u64(&dst->nmadvise,
+	    arena_stats_read_u64(tsdn, &arena->stats, &src->nmadvise));
+	arena_stats_accum_u64(&dst->purged,
+	    arena_stats_read_u64(tsdn, &arena->stats, &src->purged));
+	for (unsigned i = 0; i < ARENA_DECAY_NHIST; i++) {
+		arena_stats_accum_u64(&dst->npurge_hist[i],
+		    arena_stats_read_u64(tsdn, &arena->stats,
+		    &src->npurge_hist[i]));
+		arena_stats_accum_u64(&dst->npurge_app_hist[i],
+		    arena_stats_read_u64(tsdn, &arena->stats,
+		    &src->npurge_app_hist[i]));
+		arena_stats_accum_u64(&dst->nlocked_hist[i],
+		    arena_stats_read_u64(tsdn, &arena->stats,
+		    &src->nlocked_hist[i]));
+		arena_stats_accum_u64(&dst->nmadvise_hist[i],
+		    arena_stats_read_u64(tsdn, &arena->stats,
+		    &src->nmadvise_hist[i]));
+	}
+}
+
 void
 arena_stats_merge(tsdn_t *tsdn, arena_t *arena, unsigned *nthreads,
     const char **dss, ssize_t *dirty_decay_ms, ssize_t *muzzy_decay_ms,
@@ -97,7 +137,8 @@ arena_stats_merge(tsdn_t *tsdn, arena_t *arena, unsigned *nthreads,
 	arena_stats_lock(tsdn, &arena->stats);
 
 	arena_stats_accum_zu(&astats->mapped, base_mapped
-	    + arena_stats_read_zu(tsdn, &arena->stats, &arena->stats.mapped));
+	    + arena_stats_read_zu(tsdn, &arena->stats, &arena->stats.mapped)
+	    + hpa_mapped_get(&arena->hpa));
 	arena_stats_accum_zu(&astats->retained,
 	    eset_npages_get(&arena->eset_retained) << LG_PAGE);
 
@@ -105,25 +146,10 @@ arena_stats_merge(tsdn_t *tsdn, arena_t *arena, unsigned *nthreads,
 	    atomic_load_zu(&arena->extent_avail_cnt, ATOMIC_RELAXED),
 	    ATOMIC_RELAXED);
 
-	arena_stats_accum_u64(&astats->decay_dirty.npurge,
-	    arena_stats_read_u64(tsdn, &arena->stats,
-	    &arena->stats.decay_dirty.npurge));
-	arena_stats_accum_u64(&astats->decay_dirty.nmadvise,
-	    arena_stats_read_u64(tsdn, &arena->stats,
-	    &arena->stats.decay_dirty.nmadvise));
-	arena_stats_accum_u64(&astats->decay_dirty.purged,
-	    arena_stats_read_u64(tsdn, &arena->stats,
-	    &arena->stats.decay_dirty.purged));
-
-	arena_stats_accum_u64(&astats->decay_muzzy.npurge,
-	    arena_stats_read_u64(tsdn, &arena->stats,
-	    &arena->stats.decay_muzzy.npurge));
-	arena_stats_accum_u64(&astats->decay_muzzy.nmadvise,
-	    arena_stats_read_u64(tsdn, &arena->stats,
-	    &arena->stats.decay_muzzy.nmadvise));
-	arena_stats_accum_u64(&astats->decay_muzzy.purged,
-	    arena_stats_read_u64(tsdn, &arena->stats,
-	    &arena->stats.decay_muzzy.purged));
+	arena_stats_decay_merge(tsdn, arena, &astats->decay_dirty,
+	    &arena->stats.decay_dirty);
+	arena_stats_decay_merge(tsdn, arena, &astats->decay_muzzy,
+	    &arena->stats.decay_muzzy);
 
 	arena_stats_accum_zu(&astats->base, base_allocated);
 	arena_stats_accum_zu(&astats->internal, arena_internal_get(arena));
@@ -244,28 +270,45 @@ arena_stats_merge(tsdn_t *tsdn, arena_t *arena, unsigned *nthreads,
 	nstime_subtract(&astats->uptime, &arena->create_time);
 
 	for (szind_t i = 0; i < SC_NBINS; i++) {
-		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+		unsigned nshards = bins_nshards_get(&arena->bins[i]);
+		for (unsigned j = 0; j < nshards; j++) {
 			bin_stats_merge(tsdn, &bstats[i],
 			    &arena->bins[i].bin_shards[j]);
 		}
+		bstats[i].nshards = (uint32_t)nshards;
 	}
 }
 
-void
-arena_extents_dirty_dalloc(tsdn_t *tsdn, arena_t *arena,
-    extent_hooks_t **r_extent_hooks, extent_t *extent) {
+static void
+arena_extents_dirty_dalloc_impl(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_t *extent,
+    bool is_background_thread) {
 	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
 	    WITNESS_RANK_CORE, 0);
 
 	extents_dalloc(tsdn, arena, r_extent_hooks, &arena->eset_dirty,
 	    extent);
 	if (arena_dirty_decay_ms_get(arena) == 0) {
-		arena_decay_dirty(tsdn, arena, false, true);
+		arena_decay_dirty(tsdn, arena, is_background_thread, true);
 	} else {
-		arena_background_thread_inactivity_check(tsdn, arena, false);
+		arena_background_thread_inactivity_check(tsdn, arena,
+		    is_background_thread);
 	}
 }
 
+void
+arena_extents_dirty_dalloc(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_t *extent) {
+	arena_extents_dirty_dalloc_impl(tsdn, arena, r_extent_hooks, extent,
+	    false);
+}
+
+/* Geometry of slab, which may differ from bin_infos[binind] if autotuned. */
+static const bin_info_t *
+arena_slab_info_get(const extent_t *slab, szind_t binind) {
+	return bin_slab_info_get(binind, extent_size_get(slab));
+}
+
 static void *
 arena_slab_reg_alloc(extent_t *slab, const bin_info_t *bin_info) {
 	void *ret;
@@ -349,7 +392,7 @@ arena_slab_regind(extent_t *slab, szind_t binind, const void *ptr) {
 	/* Avoid doing division with a variable divisor. */
 	regind = div_compute(&arena_binind_div_info[binind], diff);
 
-	assert(regind < bin_infos[binind].nregs);
+	assert(regind < arena_slab_info_get(slab, binind)->nregs);
 
 	return regind;
 }
@@ -357,7 +400,7 @@ arena_slab_regind(extent_t *slab, szind_t binind, const void *ptr) {
 static void
 arena_slab_reg_dalloc(extent_t *slab, slab_data_t *slab_data, void *ptr) {
 	szind_t binind = extent_szind_get(slab);
-	const bin_info_t *bin_info = &bin_infos[binind];
+	const bin_info_t *bin_info = arena_slab_info_get(slab, binind);
 	size_t regind = arena_slab_regind(slab, binind, ptr);
 
 	assert(extent_nfree_get(slab) < bin_info->nregs);
@@ -546,26 +589,73 @@ arena_decay_deadline_reached(const arena_decay_t *decay, const nstime_t *time) {
 	return (nstime_compare(&decay->deadline, time) <= 0);
 }
 
+const uint64_t *
+arena_decay_h_steps(arena_decay_t *decay) {
+	if (atomic_load_u(&decay->curve, ATOMIC_RELAXED) ==
+	    decay_curve_exponential) {
+		return h_steps_exp;
+	}
+	return h_steps;
+}
+
 static size_t
-arena_decay_backlog_npages_limit(const arena_decay_t *decay) {
+arena_decay_backlog_npages_limit(arena_decay_t *decay) {
 	uint64_t sum;
 	size_t npages_limit_backlog;
 	unsigned i;
 
 	/*
 	 * For each element of decay_backlog, multiply by the corresponding
-	 * fixed-point smoothstep decay factor.  Sum the products, then divide
-	 * to round down to the nearest whole number of pages.
+	 * fixed-point decay factor.  Sum the products, then divide to round
+	 * down to the nearest whole number of pages.
 	 */
+	const uint64_t *steps = arena_decay_h_steps(decay);
 	sum = 0;
 	for (i = 0; i < SMOOTHSTEP_NSTEPS; i++) {
-		sum += decay->backlog[i] * h_steps[i];
+		sum += decay->backlog[i] * steps[i];
 	}
 	npages_limit_backlog = (size_t)(sum >> SMOOTHSTEP_BFP);
 
 	return npages_limit_backlog;
 }
 
+/* Raise the backlog based npages_limit as needed for decay_curve_peak. */
+static size_t
+arena_decay_peak_npages_limit(arena_t *arena, arena_decay_t *decay,
+    size_t npages_limit) {
+	if (atomic_load_u(&decay->curve, ATOMIC_RELAXED) != decay_curve_peak) {
+		return npages_limit;
+	}
+
+	/*
+	 * Keep enough unused pages for the arena to get back to its recent peak
+	 * of active pages without faulting in new ones.  Unused dirty pages
+	 * count towards that for muzzy decay.
+	 */
+	size_t nactive_peak = 0;
+	for (unsigned i = 0; i < SMOOTHSTEP_NSTEPS; i++) {
+		if (decay->nactive_backlog[i] > nactive_peak) {
+			nactive_peak = decay->nactive_backlog[i];
+		}
+	}
+	size_t nkept = atomic_load_zu(&arena->nactive, ATOMIC_RELAXED);
+	if (decay == &arena->decay_muzzy) {
+		nkept += eset_npages_get(&arena->eset_dirty);
+	}
+	if (nactive_peak > nkept && nactive_peak - nkept > npages_limit) {
+		npages_limit = nactive_peak - nkept;
+	}
+	return npages_limit;
+}
+
+static void
+arena_decay_nactive_sample(arena_t *arena, arena_decay_t *decay) {
+	size_t nactive = atomic_load_zu(&arena->nactive, ATOMIC_RELAXED);
+	if (nactive > decay->nactive_backlog[SMOOTHSTEP_NSTEPS-1]) {
+		decay->nactive_backlog[SMOOTHSTEP_NSTEPS-1] = nactive;
+	}
+}
+
 static void
 arena_decay_backlog_update_last(arena_decay_t *decay, size_t current_npages) {
 	size_t npages_delta = (current_npages > decay->nunpurged) ?
@@ -585,23 +675,29 @@ arena_decay_backlog_update_last(arena_decay_t *decay, size_t current_npages) {
 }
 
 static void
-arena_decay_backlog_update(arena_decay_t *decay, uint64_t nadvance_u64,
-    size_t current_npages) {
+arena_decay_backlog_shift(size_t *backlog, uint64_t nadvance_u64) {
 	if (nadvance_u64 >= SMOOTHSTEP_NSTEPS) {
-		memset(decay->backlog, 0, (SMOOTHSTEP_NSTEPS-1) *
-		    sizeof(size_t));
+		memset(backlog, 0, (SMOOTHSTEP_NSTEPS-1) * sizeof(size_t));
 	} else {
 		size_t nadvance_z = (size_t)nadvance_u64;
 
 		assert((uint64_t)nadvance_z == nadvance_u64);
 
-		memmove(decay->backlog, &decay->backlog[nadvance_z],
+		memmove(backlog, &backlog[nadvance_z],
 		    (SMOOTHSTEP_NSTEPS - nadvance_z) * sizeof(size_t));
 		if (nadvance_z > 1) {
-			memset(&decay->backlog[SMOOTHSTEP_NSTEPS -
-			    nadvance_z], 0, (nadvance_z-1) * sizeof(size_t));
+			memset(&backlog[SMOOTHSTEP_NSTEPS - nadvance_z], 0,
+			    (nadvance_z-1) * sizeof(size_t));
 		}
 	}
+}
+
+static void
+arena_decay_backlog_update(arena_decay_t *decay, uint64_t nadvance_u64,
+    size_t current_npages) {
+	arena_decay_backlog_shift(decay->backlog, nadvance_u64);
+	arena_decay_backlog_shift(decay->nactive_backlog, nadvance_u64);
+	decay->nactive_backlog[SMOOTHSTEP_NSTEPS-1] = 0;
 
 	arena_decay_backlog_update_last(decay, current_npages);
 }
@@ -646,11 +742,14 @@ arena_decay_epoch_advance(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
     eset_t *eset, const nstime_t *time, bool is_background_thread) {
 	size_t current_npages = eset_npages_get(eset);
 	arena_decay_epoch_advance_helper(decay, time, current_npages);
+	arena_decay_nactive_sample(arena, decay);
 
 	size_t npages_limit = arena_decay_backlog_npages_limit(decay);
 	/* We may unlock decay->mtx when try_purge(). Finish logging first. */
 	decay->nunpurged = (npages_limit > current_npages) ? npages_limit :
 	    current_npages;
+	npages_limit = arena_decay_peak_npages_limit(arena, decay,
+	    npages_limit);
 
 	if (!background_thread_enabled() || is_background_thread) {
 		arena_decay_try_purge(tsdn, arena, decay, eset,
@@ -673,10 +772,11 @@ arena_decay_reinit(arena_decay_t *decay, ssize_t decay_ms) {
 	arena_decay_deadline_init(decay);
 	decay->nunpurged = 0;
 	memset(decay->backlog, 0, SMOOTHSTEP_NSTEPS * sizeof(size_t));
+	memset(decay->nactive_backlog, 0, SMOOTHSTEP_NSTEPS * sizeof(size_t));
 }
 
 static bool
-arena_decay_init(arena_decay_t *decay, ssize_t decay_ms,
+arena_decay_init(arena_decay_t *decay, ssize_t decay_ms, decay_curve_t curve,
     arena_stats_decay_t *stats) {
 	if (config_debug) {
 		for (size_t i = 0; i < sizeof(arena_decay_t); i++) {
@@ -689,6 +789,7 @@ arena_decay_init(arena_decay_t *decay, ssize_t decay_ms,
 		return true;
 	}
 	decay->purging = false;
+	atomic_store_u(&decay->curve, curve, ATOMIC_RELAXED);
 	arena_decay_reinit(decay, decay_ms);
 	/* Memory is zeroed, so there is no need to clear stats. */
 	if (config_stats) {
@@ -709,6 +810,68 @@ arena_decay_ms_valid(ssize_t decay_ms) {
 	return false;
 }
 
+static void
+arena_decay_hist_add(tsdn_t *tsdn, arena_t *arena, arena_stats_u64_t *hist,
+    uint64_t value) {
+	cassert(config_stats);
+
+	arena_stats_lock(tsdn, &arena->stats);
+	arena_stats_add_u64(tsdn, &arena->stats,
+	    &hist[arena_decay_hist_ind(value)], 1);
+	arena_stats_unlock(tsdn, &arena->stats);
+}
+
+/* Microseconds elapsed since start. */
+static uint64_t
+arena_decay_elapsed_us(const nstime_t *start) {
+	nstime_t time;
+	nstime_copy(&time, start);
+	/* Leaves time unchanged if the clock went backwards. */
+	nstime_update(&time);
+	nstime_subtract(&time, start);
+	return nstime_ns(&time) / 1000;
+}
+
+/*
+ * Lock and unlock decay->mtx, recording how long it is held for at once in the
+ * decay stats.
+ */
+static void
+arena_decay_locked_time_init(arena_decay_t *decay) {
+	if (config_stats) {
+		nstime_init(&decay->locked_time, 0);
+		nstime_update(&decay->locked_time);
+	}
+}
+
+static void
+arena_decay_lock(tsdn_t *tsdn, arena_decay_t *decay) {
+	malloc_mutex_lock(tsdn, &decay->mtx);
+	arena_decay_locked_time_init(decay);
+}
+
+static bool
+arena_decay_trylock(tsdn_t *tsdn, arena_decay_t *decay) {
+	if (malloc_mutex_trylock(tsdn, &decay->mtx)) {
+		return true;
+	}
+	arena_decay_locked_time_init(decay);
+	return false;
+}
+
+static void
+arena_decay_unlock(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay) {
+	uint64_t locked_us;
+	if (config_stats) {
+		locked_us = arena_decay_elapsed_us(&decay->locked_time);
+	}
+	malloc_mutex_unlock(tsdn, &decay->mtx);
+	if (config_stats) {
+		arena_decay_hist_add(tsdn, arena, decay->stats->nlocked_hist,
+		    locked_us);
+	}
+}
+
 static bool
 arena_maybe_decay(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
     eset_t *eset, bool is_background_thread) {
@@ -753,6 +916,7 @@ arena_maybe_decay(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 	 * epoch, so as a result purging only happens during epoch advances, or
 	 * being triggered by background threads (scheduled event).
 	 */
+	arena_decay_nactive_sample(arena, decay);
 	bool advance_epoch = arena_decay_deadline_reached(decay, &time);
 	if (advance_epoch) {
 		arena_decay_epoch_advance(tsdn, arena, decay, eset, &time,
@@ -760,7 +924,8 @@ arena_maybe_decay(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 	} else if (is_background_thread) {
 		arena_decay_try_purge(tsdn, arena, decay, eset,
 		    eset_npages_get(eset),
-		    arena_decay_backlog_npages_limit(decay),
+		    arena_decay_peak_npages_limit(arena, decay,
+		    arena_decay_backlog_npages_limit(decay)),
 		    is_background_thread);
 	}
 
@@ -789,7 +954,7 @@ arena_decay_ms_set(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 		return true;
 	}
 
-	malloc_mutex_lock(tsdn, &decay->mtx);
+	arena_decay_lock(tsdn, decay);
 	/*
 	 * Restart decay backlog from scratch, which may cause many dirty pages
 	 * to be immediately purged.  It would conceptually be possible to map
@@ -800,7 +965,7 @@ arena_decay_ms_set(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 	 */
 	arena_decay_reinit(decay, decay_ms);
 	arena_maybe_decay(tsdn, arena, decay, eset, false);
-	malloc_mutex_unlock(tsdn, &decay->mtx);
+	arena_decay_unlock(tsdn, arena, decay);
 
 	return false;
 }
@@ -819,6 +984,35 @@ arena_muzzy_decay_ms_set(tsdn_t *tsdn, arena_t *arena,
 	    &arena->eset_muzzy, decay_ms);
 }
 
+decay_curve_t
+arena_decay_curve_get(arena_t *arena) {
+	return (decay_curve_t)atomic_load_u(&arena->decay_dirty.curve,
+	    ATOMIC_RELAXED);
+}
+
+static void
+arena_decay_curve_set_impl(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
+    eset_t *eset, decay_curve_t curve) {
+	arena_decay_lock(tsdn, decay);
+	/* As for decay_ms changes, restart the backlog from scratch. */
+	atomic_store_u(&decay->curve, curve, ATOMIC_RELAXED);
+	arena_decay_reinit(decay, arena_decay_ms_read(decay));
+	arena_maybe_decay(tsdn, arena, decay, eset, false);
+	arena_decay_unlock(tsdn, arena, decay);
+}
+
+bool
+arena_decay_curve_set(tsdn_t *tsdn, arena_t *arena, decay_curve_t curve) {
+	if (curve >= decay_curve_names_limit) {
+		return true;
+	}
+	arena_decay_curve_set_impl(tsdn, arena, &arena->decay_dirty,
+	    &arena->eset_dirty, curve);
+	arena_decay_curve_set_impl(tsdn, arena, &arena->decay_muzzy,
+	    &arena->eset_muzzy, curve);
+	return false;
+}
+
 static size_t
 arena_stash_decayed(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, eset_t *eset, size_t npages_limit,
@@ -844,51 +1038,84 @@ arena_decay_stashed(tsdn_t *tsdn, arena_t *arena,
     bool all, extent_list_t *decay_extents, bool is_background_thread) {
 	size_t nmadvise, nunmapped;
 	size_t npurged;
+	nstime_t start;
+	uint64_t nmadvise_hist[ARENA_DECAY_NHIST];
 
 	if (config_stats) {
 		nmadvise = 0;
 		nunmapped = 0;
+		nstime_init(&start, 0);
+		nstime_update(&start);
+		memset(nmadvise_hist, 0, sizeof(nmadvise_hist));
 	}
 	npurged = 0;
 
 	ssize_t muzzy_decay_ms = arena_muzzy_decay_ms_get(arena);
-	for (extent_t *extent = extent_list_first(decay_extents); extent !=
-	    NULL; extent = extent_list_first(decay_extents)) {
-		if (config_stats) {
+	bool lazy = (eset_state_get(eset) == extent_state_dirty && !all &&
+	    muzzy_decay_ms != 0);
+	assert(lazy || eset_state_get(eset) == extent_state_dirty ||
+	    eset_state_get(eset) == extent_state_muzzy);
+	/*
+	 * Purge runs of adjacent extents with one call each rather than one
+	 * call per extent, and batches of runs with one call where the system
+	 * allows it, which matters when dirty memory is fragmented.
+	 */
+	extent_list_sort(decay_extents);
+	while (extent_list_first(decay_extents) != NULL) {
+		extent_list_t runs[PAGES_PURGE_BATCH_MAX];
+		size_t run_npages[PAGES_PURGE_BATCH_MAX];
+		size_t nruns = extent_list_batch_take(*r_extent_hooks,
+		    decay_extents, runs, run_npages);
+		bool batched = false;
+		if (nruns > 1) {
+			batched = lazy ? !extent_purge_lazy_batch_wrapper(tsdn,
+			    arena, r_extent_hooks, runs, nruns) :
+			    !extent_dalloc_batch_wrapper(tsdn, arena,
+			    r_extent_hooks, runs, nruns);
+		}
+		if (config_stats && batched) {
+			size_t npages = 0;
+			for (size_t i = 0; i < nruns; i++) {
+				npages += run_npages[i];
+			}
 			nmadvise++;
+			nmadvise_hist[arena_decay_hist_ind(npages)]++;
 		}
-		size_t npages = extent_size_get(extent) >> LG_PAGE;
-		npurged += npages;
-		extent_list_remove(decay_extents, extent);
-		switch (eset_state_get(eset)) {
-		case extent_state_active:
-			not_reached();
-		case extent_state_dirty:
-			if (!all && muzzy_decay_ms != 0 &&
-			    !extent_purge_lazy_wrapper(tsdn, arena,
-			    r_extent_hooks, extent, 0,
-			    extent_size_get(extent))) {
-				extents_dalloc(tsdn, arena, r_extent_hooks,
-				    &arena->eset_muzzy, extent);
+		for (size_t i = 0; i < nruns; i++) {
+			extent_list_t *run = &runs[i];
+			size_t npages = run_npages[i];
+			npurged += npages;
+			if (config_stats && !batched) {
+				nmadvise++;
+				nmadvise_hist[arena_decay_hist_ind(npages)]++;
+			}
+			if (lazy && (batched || !extent_purge_lazy_run_wrapper(
+			    tsdn, arena, r_extent_hooks, run))) {
+				for (extent_t *extent = extent_list_first(run);
+				    extent != NULL;
+				    extent = extent_list_first(run)) {
+					extent_list_remove(run, extent);
+					extents_dalloc(tsdn, arena,
+					    r_extent_hooks, &arena->eset_muzzy,
+					    extent);
+				}
 				arena_background_thread_inactivity_check(tsdn,
 				    arena, is_background_thread);
-				break;
+				continue;
+			}
+			if (!batched) {
+				extent_dalloc_run_wrapper(tsdn, arena,
+				    r_extent_hooks, run);
 			}
-			JEMALLOC_FALLTHROUGH;
-		case extent_state_muzzy:
-			extent_dalloc_wrapper(tsdn, arena, r_extent_hooks,
-			    extent);
 			if (config_stats) {
 				nunmapped += npages;
 			}
-			break;
-		case extent_state_retained:
-		default:
-			not_reached();
 		}
 	}
 
 	if (config_stats) {
+		unsigned purge_ind = arena_decay_hist_ind(
+		    arena_decay_elapsed_us(&start));
 		arena_stats_lock(tsdn, &arena->stats);
 		arena_stats_add_u64(tsdn, &arena->stats, &decay->stats->npurge,
 		    1);
@@ -896,6 +1123,19 @@ arena_decay_stashed(tsdn_t *tsdn, arena_t *arena,
 		    &decay->stats->nmadvise, nmadvise);
 		arena_stats_add_u64(tsdn, &arena->stats, &decay->stats->purged,
 		    npurged);
+		arena_stats_add_u64(tsdn, &arena->stats,
+		    &decay->stats->npurge_hist[purge_ind], 1);
+		if (!is_background_thread) {
+			arena_stats_add_u64(tsdn, &arena->stats,
+			    &decay->stats->npurge_app_hist[purge_ind], 1);
+		}
+		for (unsigned i = 0; i < ARENA_DECAY_NHIST; i++) {
+			if (nmadvise_hist[i] != 0) {
+				arena_stats_add_u64(tsdn, &arena->stats,
+				    &decay->stats->nmadvise_hist[i],
+				    nmadvise_hist[i]);
+			}
+		}
 		arena_stats_sub_zu(tsdn, &arena->stats, &arena->stats.mapped,
 		    nunmapped << LG_PAGE);
 		arena_stats_unlock(tsdn, &arena->stats);
@@ -923,7 +1163,7 @@ arena_decay_to_limit(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 		return;
 	}
 	decay->purging = true;
-	malloc_mutex_unlock(tsdn, &decay->mtx);
+	arena_decay_unlock(tsdn, arena, decay);
 
 	extent_hooks_t *extent_hooks = extent_hooks_get(arena);
 
@@ -939,7 +1179,7 @@ arena_decay_to_limit(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 		assert(npurged == npurge);
 	}
 
-	malloc_mutex_lock(tsdn, &decay->mtx);
+	arena_decay_lock(tsdn, decay);
 	decay->purging = false;
 }
 
@@ -947,15 +1187,15 @@ static bool
 arena_decay_impl(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
     eset_t *eset, bool is_background_thread, bool all) {
 	if (all) {
-		malloc_mutex_lock(tsdn, &decay->mtx);
+		arena_decay_lock(tsdn, decay);
 		arena_decay_to_limit(tsdn, arena, decay, eset, all, 0,
 		    eset_npages_get(eset), is_background_thread);
-		malloc_mutex_unlock(tsdn, &decay->mtx);
+		arena_decay_unlock(tsdn, arena, decay);
 
 		return false;
 	}
 
-	if (malloc_mutex_trylock(tsdn, &decay->mtx)) {
+	if (arena_decay_trylock(tsdn, decay)) {
 		/* No need to wait if another thread is in progress. */
 		return true;
 	}
@@ -967,7 +1207,7 @@ arena_decay_impl(tsdn_t *tsdn, arena_t *arena, arena_decay_t *decay,
 		/* Backlog is updated on epoch advance. */
 		npages_new = decay->backlog[SMOOTHSTEP_NSTEPS-1];
 	}
-	malloc_mutex_unlock(tsdn, &decay->mtx);
+	arena_decay_unlock(tsdn, arena, decay);
 
 	if (have_background_thread && background_thread_enabled() &&
 	    epoch_advanced && !is_background_thread) {
@@ -996,20 +1236,186 @@ arena_decay_muzzy(tsdn_t *tsdn, arena_t *arena, bool is_background_thread,
 	    &arena->eset_muzzy, is_background_thread, all);
 }
 
+/*
+ * With opt_lazy_coalesce, extents are put into the esets as is, and coalesced
+ * here in bounded batches instead.  This is left to the background thread if
+ * there is one, so that application threads never do it.
+ */
+static void
+arena_coalesce(tsdn_t *tsdn, arena_t *arena, bool is_background_thread) {
+	if (!opt_lazy_coalesce || (have_background_thread &&
+	    background_thread_enabled() && !is_background_thread)) {
+		return;
+	}
+	extent_hooks_t *extent_hooks = extent_hooks_get(arena);
+	extents_coalesce(tsdn, arena, &extent_hooks, &arena->eset_dirty,
+	    EXTENTS_COALESCE_BATCH);
+	extents_coalesce(tsdn, arena, &extent_hooks, &arena->eset_muzzy,
+	    EXTENTS_COALESCE_BATCH);
+	extents_coalesce(tsdn, arena, &extent_hooks, &arena->eset_retained,
+	    EXTENTS_COALESCE_BATCH);
+}
+
+/* Purge npages_excess unused pages of arena, dirty ones first. */
+static void
+arena_decay_excess(tsdn_t *tsdn, arena_t *arena, size_t npages_excess,
+    bool is_background_thread) {
+	arena_decay_t *decays[] = {&arena->decay_dirty, &arena->decay_muzzy};
+	eset_t *esets[] = {&arena->eset_dirty, &arena->eset_muzzy};
+	for (unsigned i = 0; i < 2 && npages_excess > 0; i++) {
+		size_t npages = eset_npages_get(esets[i]);
+		size_t npurge = (npages < npages_excess) ? npages :
+		    npages_excess;
+		if (npurge == 0) {
+			continue;
+		}
+		arena_decay_lock(tsdn, decays[i]);
+		arena_decay_to_limit(tsdn, arena, decays[i], esets[i], true,
+		    npages - npurge, npurge, is_background_thread);
+		arena_decay_unlock(tsdn, arena, decays[i]);
+		npages_excess -= npurge;
+	}
+}
+
+/*
+ * With opt_dirty_max, purge the arenas with the most unused dirty pages first,
+ * until the unused dirty and muzzy pages of all arenas fit in opt_dirty_max.
+ * Application threads only count and purge automatic arenas and their own,
+ * since other manual arenas may be reset or destroyed concurrently; background
+ * threads are paused while that happens.
+ */
+static void
+arena_dirty_max_enforce(tsdn_t *tsdn, arena_t *arena,
+    bool is_background_thread) {
+	size_t npages_max = opt_dirty_max >> LG_PAGE;
+	unsigned narenas = narenas_total_get();
+	size_t npages_prev = SIZE_T_MAX;
+	while (true) {
+		size_t npages = 0;
+		arena_t *victim = NULL;
+		size_t victim_ndirty = 0;
+		size_t victim_nmuzzy = 0;
+		for (unsigned i = 0; i < narenas; i++) {
+			arena_t *a = arena_get(tsdn, i, false);
+			/* Not even read, as it may be destroyed meanwhile. */
+			if (a == NULL || (!is_background_thread &&
+			    !arena_is_auto(a) && a != arena)) {
+				continue;
+			}
+			size_t ndirty = eset_npages_get(&a->eset_dirty);
+			size_t nmuzzy = eset_npages_get(&a->eset_muzzy);
+			npages += ndirty + nmuzzy;
+			if (victim == NULL || ndirty > victim_ndirty ||
+			    (ndirty == victim_ndirty && nmuzzy >
+			    victim_nmuzzy)) {
+				victim = a;
+				victim_ndirty = ndirty;
+				victim_nmuzzy = nmuzzy;
+			}
+		}
+		/*
+		 * Also give up when the last round made no progress, e.g.
+		 * because another thread was purging the victim already.
+		 */
+		if (npages <= npages_max || npages >= npages_prev ||
+		    victim == NULL || victim_ndirty + victim_nmuzzy == 0) {
+			return;
+		}
+		arena_decay_excess(tsdn, victim, npages - npages_max,
+		    is_background_thread);
+		npages_prev = npages;
+	}
+}
+
+/*
+ * Drain the remote free lists of all the bins of arena, which would otherwise
+ * wait for a thread that locks the exact bin shard, possibly forever.
+ */
+static void
+arena_bins_remote_drain(tsdn_t *tsdn, arena_t *arena,
+    bool is_background_thread) {
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		unsigned nshards = bins_nshards_get(&arena->bins[i]);
+		for (unsigned j = 0; j < nshards; j++) {
+			bin_t *bin = &arena->bins[i].bin_shards[j];
+			if (atomic_load_p(&bin->remote_free, ATOMIC_RELAXED) ==
+			    NULL) {
+				continue;
+			}
+			malloc_mutex_lock(tsdn, &bin->lock);
+			arena_bin_remote_dalloc_locked(tsdn, arena, bin, i,
+			    bin_remote_free_take(tsdn, bin),
+			    is_background_thread);
+			malloc_mutex_unlock(tsdn, &bin->lock);
+		}
+	}
+}
+
+/*
+ * Return the stashed regions of the bins of arena to their slabs, if the stash
+ * went unused since the last pass (or regardless, with all), so that idle size
+ * classes don't pin them, along with their slabs.
+ */
+static void
+arena_bins_stash_drain(tsdn_t *tsdn, arena_t *arena, bool all,
+    bool is_background_thread) {
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		unsigned nshards = bins_nshards_get(&arena->bins[i]);
+		for (unsigned j = 0; j < nshards; j++) {
+			bin_t *bin = &arena->bins[i].bin_shards[j];
+			if ((atomic_load_zu(&bin->stash_state, ATOMIC_RELAXED) &
+			    BIN_STASH_COUNT_MASK) == 0) {
+				continue;
+			}
+			void *stashed[BIN_STASH_MAX];
+			unsigned n = 0;
+			malloc_mutex_lock(tsdn, &bin->lock);
+			if (all || atomic_load_zu(&bin->stash_state,
+			    ATOMIC_RELAXED) == bin->stash_state_seen) {
+				n = bin_stash_take(tsdn, bin, stashed);
+			}
+			bin->stash_state_seen = atomic_load_zu(
+			    &bin->stash_state, ATOMIC_RELAXED);
+			for (unsigned k = 0; k < n; k++) {
+				arena_dalloc_bin_locked_impl(tsdn, arena, bin,
+				    i, iealloc(tsdn, stashed[k]), stashed[k],
+				    true, is_background_thread);
+			}
+			malloc_mutex_unlock(tsdn, &bin->lock);
+		}
+	}
+}
+
 void
 arena_decay(tsdn_t *tsdn, arena_t *arena, bool is_background_thread, bool all) {
-	if (arena_decay_dirty(tsdn, arena, is_background_thread, all)) {
-		return;
+	if (opt_hpa && all) {
+		hpa_purge(tsdn, &arena->hpa);
+	}
+	/* Draining may free slabs, which the decay below can then purge. */
+	arena_bins_remote_drain(tsdn, arena, is_background_thread);
+	if (opt_bin_stash > 0) {
+		arena_bins_stash_drain(tsdn, arena, all, is_background_thread);
+	}
+	arena_coalesce(tsdn, arena, is_background_thread);
+	if (!arena_decay_dirty(tsdn, arena, is_background_thread, all)) {
+		arena_decay_muzzy(tsdn, arena, is_background_thread, all);
+	}
+	if (opt_dirty_max != 0) {
+		arena_dirty_max_enforce(tsdn, arena, is_background_thread);
 	}
-	arena_decay_muzzy(tsdn, arena, is_background_thread, all);
 }
 
 static void
-arena_slab_dalloc(tsdn_t *tsdn, arena_t *arena, extent_t *slab) {
+arena_slab_dalloc(tsdn_t *tsdn, arena_t *arena, extent_t *slab,
+    bool is_background_thread) {
 	arena_nactive_sub(arena, extent_size_get(slab) >> LG_PAGE);
 
+	if (opt_hpa && !hpa_dalloc(tsdn, arena, &arena->hpa, slab)) {
+		return;
+	}
 	extent_hooks_t *extent_hooks = EXTENT_HOOKS_INITIALIZER;
-	arena_extents_dirty_dalloc(tsdn, arena, &extent_hooks, slab);
+	arena_extents_dirty_dalloc_impl(tsdn, arena, &extent_hooks, slab,
+	    is_background_thread);
 }
 
 static void
@@ -1069,25 +1475,33 @@ arena_bin_reset(tsd_t *tsd, arena_t *arena, bin_t *bin) {
 	extent_t *slab;
 
 	malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
+	/*
+	 * The regions on the remote free list and in the stash go away with
+	 * their slabs.
+	 */
+	atomic_store_p(&bin->remote_free, NULL, ATOMIC_RELAXED);
+	void *stashed[BIN_STASH_MAX];
+	bin_stash_take(tsd_tsdn(tsd), bin, stashed);
 	if (bin->slabcur != NULL) {
 		slab = bin->slabcur;
 		bin->slabcur = NULL;
 		malloc_mutex_unlock(tsd_tsdn(tsd), &bin->lock);
-		arena_slab_dalloc(tsd_tsdn(tsd), arena, slab);
+		arena_slab_dalloc(tsd_tsdn(tsd), arena, slab, false);
 		malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
 	}
 	while ((slab = extent_heap_remove_first(&bin->slabs_nonfull)) != NULL) {
 		malloc_mutex_unlock(tsd_tsdn(tsd), &bin->lock);
-		arena_slab_dalloc(tsd_tsdn(tsd), arena, slab);
+		arena_slab_dalloc(tsd_tsdn(tsd), arena, slab, false);
 		malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
 	}
 	for (slab = extent_list_first(&bin->slabs_full); slab != NULL;
 	     slab = extent_list_first(&bin->slabs_full)) {
 		arena_bin_slabs_full_remove(arena, bin, slab);
 		malloc_mutex_unlock(tsd_tsdn(tsd), &bin->lock);
-		arena_slab_dalloc(tsd_tsdn(tsd), arena, slab);
+		arena_slab_dalloc(tsd_tsdn(tsd), arena, slab, false);
 		malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
 	}
+	bin_slab_tune_init(&bin->slab_tune);
 	if (config_stats) {
 		bin->stats.curregs = 0;
 		bin->stats.curslabs = 0;
@@ -1141,7 +1555,8 @@ arena_reset(tsd_t *tsd, arena_t *arena) {
 
 	/* Bins. */
 	for (unsigned i = 0; i < SC_NBINS; i++) {
-		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+		for (unsigned j = 0; j < bins_nshards_get(&arena->bins[i]);
+		    j++) {
 			arena_bin_reset(tsd, arena,
 			    &arena->bins[i].bin_shards[j]);
 		}
@@ -1185,6 +1600,7 @@ arena_destroy(tsd_t *tsd, arena_t *arena) {
 
 	/* Deallocate retained memory. */
 	arena_destroy_retained(tsd_tsdn(tsd), arena);
+	hpa_destroy(tsd_tsdn(tsd), &arena->hpa);
 
 	/*
 	 * Remove the arena pointer from the arenas array.  We rely on the fact
@@ -1238,9 +1654,18 @@ arena_slab_alloc(tsdn_t *tsdn, arena_t *arena, szind_t binind, unsigned binshard
 	szind_t szind = sz_size2index(bin_info->reg_size);
 	bool zero = false;
 	bool commit = true;
-	extent_t *slab = extents_alloc(tsdn, arena, &extent_hooks,
-	    &arena->eset_dirty, NULL, bin_info->slab_size, 0, PAGE, true,
-	    binind, &zero, &commit);
+	extent_t *slab = NULL;
+	/* Custom extent hooks expect to see all of the arena's memory. */
+	if (opt_hpa && extent_hooks_get(arena) ==
+	    (extent_hooks_t *)&extent_hooks_default) {
+		slab = hpa_alloc(tsdn, arena, &arena->hpa, bin_info->slab_size,
+		    binind);
+	}
+	if (slab == NULL) {
+		slab = extents_alloc(tsdn, arena, &extent_hooks,
+		    &arena->eset_dirty, NULL, bin_info->slab_size, 0, PAGE,
+		    true, binind, &zero, &commit);
+	}
 	if (slab == NULL && arena_may_have_muzzy(arena)) {
 		slab = extents_alloc(tsdn, arena, &extent_hooks,
 		    &arena->eset_muzzy, NULL, bin_info->slab_size, 0, PAGE,
@@ -1265,6 +1690,55 @@ arena_slab_alloc(tsdn_t *tsdn, arena_t *arena, szind_t binind, unsigned binshard
 	return slab;
 }
 
+/*
+ * Choose the geometry of a new slab for bin.  Every BIN_SLAB_TUNE_NSLABS new
+ * slabs, the choice is reconsidered from the lowest utilization the bin went
+ * through since: if it fell below BIN_SLAB_TUNE_UTIL_LOW, the bin's slabs are
+ * poorly packed, and smaller ones limit the memory they strand; if it stayed
+ * above BIN_SLAB_TUNE_UTIL_HIGH, the bin is kept busy, and larger slabs mean
+ * fewer trips to arena_slab_alloc().
+ */
+static const bin_info_t *
+arena_bin_slab_info_choose(bin_t *bin, szind_t binind) {
+	if (!config_stats || likely(!opt_slab_autotune)) {
+		return &bin_infos[binind];
+	}
+	bin_slab_tune_t *tune = &bin->slab_tune;
+	if (++tune->nslabs >= BIN_SLAB_TUNE_NSLABS) {
+		if (tune->util_min < BIN_SLAB_TUNE_UTIL_LOW) {
+			if (tune->size > 0) {
+				tune->size--;
+			}
+		} else if (tune->util_min >= BIN_SLAB_TUNE_UTIL_HIGH) {
+			if (tune->size < BIN_SLAB_NSIZES - 1) {
+				tune->size++;
+			}
+		}
+		tune->nslabs = 0;
+		tune->util_min = BIN_SLAB_TUNE_UTIL_ONE;
+	}
+	return &bin_slab_infos[binind][tune->size];
+}
+
+/*
+ * Sample the utilization of bin, at points where it has just dropped: a slab
+ * turning non-full or being freed.
+ */
+static void
+arena_bin_slab_tune_sample(bin_t *bin) {
+	assert(config_stats && opt_slab_autotune);
+	bin_slab_tune_t *tune = &bin->slab_tune;
+	if (tune->nregs == 0) {
+		return;
+	}
+	assert(bin->stats.curregs <= tune->nregs);
+	unsigned util = (unsigned)(bin->stats.curregs *
+	    BIN_SLAB_TUNE_UTIL_ONE / tune->nregs);
+	if (util < tune->util_min) {
+		tune->util_min = util;
+	}
+}
+
 static extent_t *
 arena_bin_nonfull_slab_get(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
     szind_t binind, unsigned binshard) {
@@ -1278,7 +1752,7 @@ arena_bin_nonfull_slab_get(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 	}
 	/* No existing slabs have any space available. */
 
-	bin_info = &bin_infos[binind];
+	bin_info = arena_bin_slab_info_choose(bin, binind);
 
 	/* Allocate a new slab. */
 	malloc_mutex_unlock(tsdn, &bin->lock);
@@ -1287,6 +1761,7 @@ arena_bin_nonfull_slab_get(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 	/********************************/
 	malloc_mutex_lock(tsdn, &bin->lock);
 	if (slab != NULL) {
+		bin->slab_tune.nregs += bin_info->nregs;
 		if (config_stats) {
 			bin->stats.nslabs++;
 			bin->stats.curslabs++;
@@ -1311,10 +1786,8 @@ arena_bin_nonfull_slab_get(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 static void *
 arena_bin_malloc_hard(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
     szind_t binind, unsigned binshard) {
-	const bin_info_t *bin_info;
 	extent_t *slab;
 
-	bin_info = &bin_infos[binind];
 	if (!arena_is_auto(arena) && bin->slabcur != NULL) {
 		arena_bin_slabs_full_insert(arena, bin, bin->slabcur);
 		bin->slabcur = NULL;
@@ -1327,7 +1800,7 @@ arena_bin_malloc_hard(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 		 */
 		if (extent_nfree_get(bin->slabcur) > 0) {
 			void *ret = arena_slab_reg_alloc(bin->slabcur,
-			    bin_info);
+			    arena_slab_info_get(bin->slabcur, binind));
 			if (slab != NULL) {
 				/*
 				 * arena_slab_alloc() may have allocated slab,
@@ -1338,9 +1811,10 @@ arena_bin_malloc_hard(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 				 * arena_bin_lower_slab() must be called, as if
 				 * a region were just deallocated from the slab.
 				 */
-				if (extent_nfree_get(slab) == bin_info->nregs) {
+				if (extent_nfree_get(slab) ==
+				    arena_slab_info_get(slab, binind)->nregs) {
 					arena_dalloc_bin_slab(tsdn, arena, slab,
-					    bin);
+					    bin, false);
 				} else {
 					arena_bin_lower_slab(tsdn, arena, slab,
 					    bin);
@@ -1360,26 +1834,123 @@ arena_bin_malloc_hard(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 
 	assert(extent_nfree_get(bin->slabcur) > 0);
 
-	return arena_slab_reg_alloc(slab, bin_info);
+	return arena_slab_reg_alloc(slab, arena_slab_info_get(slab, binind));
 }
 
-/* Choose a bin shard and return the locked bin. */
+/* Choose a bin shard and return the (unlocked) bin. */
 bin_t *
-arena_bin_choose_lock(tsdn_t *tsdn, arena_t *arena, szind_t binind,
+arena_bin_choose(tsdn_t *tsdn, arena_t *arena, szind_t binind,
     unsigned *binshard) {
-	bin_t *bin;
 	if (tsdn_null(tsdn) || tsd_arena_get(tsdn_tsd(tsdn)) == NULL) {
 		*binshard = 0;
+	} else if (opt_bin_shards_max > 0) {
+		/* Spread the threads over however many shards there are now. */
+		*binshard = tsd_binshardsp_get(tsdn_tsd(tsdn))->ticket %
+		    bins_nshards_get(&arena->bins[binind]);
 	} else {
 		*binshard = tsd_binshardsp_get(tsdn_tsd(tsdn))->binshard[binind];
 	}
-	assert(*binshard < bin_infos[binind].n_shards);
-	bin = &arena->bins[binind].bin_shards[*binshard];
+	assert(*binshard < bins_nshards_get(&arena->bins[binind]));
+	return &arena->bins[binind].bin_shards[*binshard];
+}
+
+/*
+ * Add a shard to size class binind, unless it has no room left or another
+ * thread is already at it.
+ */
+static void
+arena_bin_shard_add(arena_t *arena, szind_t binind) {
+	bins_t *bins = &arena->bins[binind];
+	unsigned nshards = bins_nshards_get(bins);
+	if (nshards >= bin_shards_cap(binind)) {
+		return;
+	}
+	unsigned expected = nshards;
+	if (!atomic_compare_exchange_strong_u(&bins->nshards_claimed,
+	    &expected, nshards + 1, ATOMIC_ACQ_REL, ATOMIC_RELAXED)) {
+		return;
+	}
+	if (bin_init(&bins->bin_shards[nshards])) {
+		atomic_store_u(&bins->nshards_claimed, nshards,
+		    ATOMIC_RELEASE);
+		return;
+	}
+	atomic_store_u(&bins->nshards, nshards + 1, ATOMIC_RELEASE);
+}
+
+/*
+ * Check, with bin locked, whether its lock has been contended enough for long
+ * enough to warrant another shard for its size class.  The threads then get
+ * spread over the shards anew by arena_bin_choose().  Holding bin->lock while
+ * adding the shard keeps it from racing with arena_prefork8().
+ */
+static void
+arena_bin_contention_check(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
+    szind_t binind) {
+	malloc_mutex_assert_owner(tsdn, &bin->lock);
+	mutex_prof_data_t *data = &bin->lock.prof_data;
+	bin_contention_t *contention = &bin->contention;
+	uint64_t ncontended = data->n_spin_acquired + data->n_wait_times;
+	if (unlikely(data->n_lock_ops < contention->nlock_ops ||
+	    ncontended < contention->ncontended)) {
+		/* The mutex stats were reset. */
+		contention->nlock_ops = data->n_lock_ops;
+		contention->ncontended = ncontended;
+		return;
+	}
+	uint64_t nlock_ops = data->n_lock_ops - contention->nlock_ops;
+	if (likely(nlock_ops < BIN_CONTENTION_NLOCK_OPS)) {
+		return;
+	}
+	bool contended = (ncontended - contention->ncontended) *
+	    BIN_CONTENTION_RATIO_INV >= nlock_ops;
+	contention->nlock_ops = data->n_lock_ops;
+	contention->ncontended = ncontended;
+	if (!contended) {
+		contention->nstrikes = 0;
+	} else if (++contention->nstrikes >= BIN_CONTENTION_NSTRIKES) {
+		contention->nstrikes = 0;
+		arena_bin_shard_add(arena, binind);
+	}
+}
+
+/* Choose a bin shard and return the locked bin. */
+bin_t *
+arena_bin_choose_lock(tsdn_t *tsdn, arena_t *arena, szind_t binind,
+    unsigned *binshard) {
+	bin_t *bin = arena_bin_choose(tsdn, arena, binind, binshard);
 	malloc_mutex_lock(tsdn, &bin->lock);
+	if (config_stats && opt_bin_shards_max > 0) {
+		arena_bin_contention_check(tsdn, arena, bin, binind);
+	}
 
 	return bin;
 }
 
+/*
+ * Move up to nfill regions from the remote free list of bin into ptrs, and
+ * deallocate the rest.  Recycled regions go straight from the thread that freed
+ * them to the one filling, without touching their slabs.  Returns the number of
+ * regions moved; they are accounted for as freed, and the caller accounts for
+ * them as allocated along with the rest of its fill.
+ */
+static unsigned
+arena_bin_remote_fill_locked(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
+    szind_t binind, void **ptrs, size_t nfill) {
+	void *ptr = bin_remote_free_take(tsdn, bin);
+	unsigned i;
+	for (i = 0; i < nfill && ptr != NULL; i++) {
+		ptrs[i] = ptr;
+		ptr = *(void **)ptr;
+	}
+	if (config_stats) {
+		bin->stats.ndalloc += i;
+		bin->stats.curregs -= i;
+	}
+	arena_bin_remote_dalloc_locked(tsdn, arena, bin, binind, ptr, false);
+	return i;
+}
+
 void
 arena_tcache_fill_small(tsdn_t *tsdn, arena_t *arena, tcache_t *tcache,
     cache_bin_t *tbin, szind_t binind) {
@@ -1392,8 +1963,17 @@ arena_tcache_fill_small(tsdn_t *tsdn, arena_t *arena, tcache_t *tcache,
 	bin_t *bin = arena_bin_choose_lock(tsdn, arena, binind, &binshard);
 
 	void **empty_position = cache_bin_empty_position_get(tbin, binind);
-	for (i = 0, nfill = (cache_bin_ncached_max_get(binind) >>
-	    tcache->lg_fill_div[binind]); i < nfill; i += cnt) {
+	nfill = cache_bin_ncached_cap_get(tbin) >> tcache->lg_fill_div[binind];
+	/* Reuse regions freed remotely first. */
+	i = arena_bin_remote_fill_locked(tsdn, arena, bin, binind,
+	    empty_position - nfill, nfill);
+	if (config_fill && unlikely(opt_junk_alloc)) {
+		for (unsigned j = 0; j < i; j++) {
+			arena_alloc_junk_small(*(empty_position - nfill + j),
+			    &bin_infos[binind], true);
+		}
+	}
+	for (; i < nfill; i += cnt) {
 		extent_t *slab;
 		if ((slab = bin->slabcur) != NULL && extent_nfree_get(slab) >
 		    0) {
@@ -1401,7 +1981,7 @@ arena_tcache_fill_small(tsdn_t *tsdn, arena_t *arena, tcache_t *tcache,
 			cnt = tofill < extent_nfree_get(slab) ?
 				tofill : extent_nfree_get(slab);
 			arena_slab_reg_alloc_batch(
-			   slab, &bin_infos[binind], cnt,
+			   slab, arena_slab_info_get(slab, binind), cnt,
 			   empty_position - nfill + i);
 		} else {
 			cnt = 1;
@@ -1443,6 +2023,73 @@ arena_tcache_fill_small(tsdn_t *tsdn, arena_t *arena, tcache_t *tcache,
 	arena_decay_tick(tsdn, arena);
 }
 
+/*
+ * Fill ptrs with up to nfill regions of size class binind, taking the bin lock
+ * only once.  Returns the number of regions filled, which is less than nfill
+ * only on OOM.
+ */
+size_t
+arena_fill_small_batch(tsdn_t *tsdn, arena_t *arena, szind_t binind,
+    void **ptrs, size_t nfill, bool zero) {
+	const bin_info_t *bin_info = &bin_infos[binind];
+	size_t i, cnt;
+
+	assert(binind < SC_NBINS);
+	unsigned binshard;
+	bin_t *bin = arena_bin_choose_lock(tsdn, arena, binind, &binshard);
+
+	/* Reuse regions freed remotely first. */
+	i = arena_bin_remote_fill_locked(tsdn, arena, bin, binind, ptrs, nfill);
+	for (; i < nfill; i += cnt) {
+		extent_t *slab;
+		if ((slab = bin->slabcur) != NULL && extent_nfree_get(slab) >
+		    0) {
+			size_t tofill = nfill - i;
+			cnt = tofill < extent_nfree_get(slab) ?
+				tofill : extent_nfree_get(slab);
+			arena_slab_reg_alloc_batch(slab,
+			    arena_slab_info_get(slab, binind), (unsigned)cnt,
+			    ptrs + i);
+		} else {
+			cnt = 1;
+			void *ptr = arena_bin_malloc_hard(tsdn, arena, bin,
+			    binind, binshard);
+			if (ptr == NULL) {
+				break;
+			}
+			ptrs[i] = ptr;
+		}
+	}
+	if (config_stats) {
+		bin->stats.nmalloc += i;
+		bin->stats.nrequests += i;
+		bin->stats.curregs += i;
+	}
+	malloc_mutex_unlock(tsdn, &bin->lock);
+
+	for (size_t j = 0; j < i; j++) {
+		if (!zero) {
+			if (config_fill) {
+				if (unlikely(opt_junk_alloc)) {
+					arena_alloc_junk_small(ptrs[j],
+					    bin_info, false);
+				} else if (unlikely(opt_zero)) {
+					memset(ptrs[j], 0, bin_info->reg_size);
+				}
+			}
+		} else {
+			if (config_fill && unlikely(opt_junk_alloc)) {
+				arena_alloc_junk_small(ptrs[j], bin_info,
+				    true);
+			}
+			memset(ptrs[j], 0, bin_info->reg_size);
+		}
+	}
+
+	arena_decay_ticks(tsdn, arena, (unsigned)i);
+	return i;
+}
+
 void
 arena_alloc_junk_small(void *ptr, const bin_info_t *bin_info, bool zero) {
 	if (!zero) {
@@ -1457,6 +2104,34 @@ arena_dalloc_junk_small_impl(void *ptr, const bin_info_t *bin_info) {
 arena_dalloc_junk_small_t *JET_MUTABLE arena_dalloc_junk_small =
     arena_dalloc_junk_small_impl;
 
+/*
+ * Claim up to opt_bin_stash more regions from slabcur, if the stash of bin is
+ * empty, for later allocations to pop without the lock.  Stashing never
+ * switches slabcur, so that the lock-free regions only come from a slab that
+ * is being allocated from anyway.
+ */
+static void
+arena_bin_stash_fill_locked(tsdn_t *tsdn, bin_t *bin, szind_t binind) {
+	extent_t *slab = bin->slabcur;
+	if (slab == NULL || extent_nfree_get(slab) == 0 ||
+	    !bin_stash_empty(tsdn, bin)) {
+		return;
+	}
+	unsigned n = extent_nfree_get(slab);
+	if (n > opt_bin_stash) {
+		n = opt_bin_stash;
+	}
+	void *ptrs[BIN_STASH_MAX];
+	arena_slab_reg_alloc_batch(slab, arena_slab_info_get(slab, binind), n,
+	    ptrs);
+	bin_stash_fill(tsdn, bin, ptrs, n);
+	if (config_stats) {
+		bin->stats.nmalloc += n;
+		bin->stats.nrequests += n;
+		bin->stats.curregs += n;
+	}
+}
+
 static void *
 arena_malloc_small(tsdn_t *tsdn, arena_t *arena, szind_t binind, bool zero) {
 	void *ret;
@@ -1467,26 +2142,39 @@ arena_malloc_small(tsdn_t *tsdn, arena_t *arena, szind_t binind, bool zero) {
 	assert(binind < SC_NBINS);
 	usize = sz_index2size(binind);
 	unsigned binshard;
-	bin = arena_bin_choose_lock(tsdn, arena, binind, &binshard);
-
-	if ((slab = bin->slabcur) != NULL && extent_nfree_get(slab) > 0) {
-		ret = arena_slab_reg_alloc(slab, &bin_infos[binind]);
-	} else {
-		ret = arena_bin_malloc_hard(tsdn, arena, bin, binind, binshard);
-	}
+	bin = arena_bin_choose(tsdn, arena, binind, &binshard);
 
+	ret = (opt_bin_stash > 0) ? bin_stash_pop(bin) : NULL;
 	if (ret == NULL) {
-		malloc_mutex_unlock(tsdn, &bin->lock);
-		return NULL;
-	}
+		malloc_mutex_lock(tsdn, &bin->lock);
+		if (config_stats && opt_bin_shards_max > 0) {
+			arena_bin_contention_check(tsdn, arena, bin, binind);
+		}
+		if ((slab = bin->slabcur) != NULL &&
+		    extent_nfree_get(slab) > 0) {
+			ret = arena_slab_reg_alloc(slab,
+			    arena_slab_info_get(slab, binind));
+		} else {
+			ret = arena_bin_malloc_hard(tsdn, arena, bin, binind,
+			    binshard);
+		}
 
-	if (config_stats) {
-		bin->stats.nmalloc++;
-		bin->stats.nrequests++;
-		bin->stats.curregs++;
-	}
+		if (ret == NULL) {
+			malloc_mutex_unlock(tsdn, &bin->lock);
+			return NULL;
+		}
 
-	malloc_mutex_unlock(tsdn, &bin->lock);
+		if (config_stats) {
+			bin->stats.nmalloc++;
+			bin->stats.nrequests++;
+			bin->stats.curregs++;
+		}
+		if (opt_bin_stash > 0) {
+			arena_bin_stash_fill_locked(tsdn, bin, binind);
+		}
+
+		malloc_mutex_unlock(tsdn, &bin->lock);
+	}
 
 	if (!zero) {
 		if (config_fill) {
@@ -1623,7 +2311,7 @@ arena_dissociate_bin_slab(arena_t *arena, extent_t *slab, bin_t *bin) {
 		bin->slabcur = NULL;
 	} else {
 		szind_t binind = extent_szind_get(slab);
-		const bin_info_t *bin_info = &bin_infos[binind];
+		const bin_info_t *bin_info = arena_slab_info_get(slab, binind);
 
 		/*
 		 * The following block's conditional is necessary because if the
@@ -1640,14 +2328,18 @@ arena_dissociate_bin_slab(arena_t *arena, extent_t *slab, bin_t *bin) {
 
 static void
 arena_dalloc_bin_slab(tsdn_t *tsdn, arena_t *arena, extent_t *slab,
-    bin_t *bin) {
+    bin_t *bin, bool is_background_thread) {
 	assert(slab != bin->slabcur);
+	uint32_t nregs = arena_slab_info_get(slab,
+	    extent_szind_get(slab))->nregs;
 
 	malloc_mutex_unlock(tsdn, &bin->lock);
 	/******************************/
-	arena_slab_dalloc(tsdn, arena, slab);
+	arena_slab_dalloc(tsdn, arena, slab, is_background_thread);
 	/****************************/
 	malloc_mutex_lock(tsdn, &bin->lock);
+	assert(bin->slab_tune.nregs >= nregs);
+	bin->slab_tune.nregs -= nregs;
 	if (config_stats) {
 		bin->stats.curslabs--;
 	}
@@ -1682,9 +2374,10 @@ arena_bin_lower_slab(tsdn_t *tsdn, arena_t *arena, extent_t *slab,
 
 static void
 arena_dalloc_bin_locked_impl(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
-    szind_t binind, extent_t *slab, void *ptr, bool junked) {
+    szind_t binind, extent_t *slab, void *ptr, bool junked,
+    bool is_background_thread) {
 	slab_data_t *slab_data = extent_slab_data_get(slab);
-	const bin_info_t *bin_info = &bin_infos[binind];
+	const bin_info_t *bin_info = arena_slab_info_get(slab, binind);
 
 	if (!junked && config_fill && unlikely(opt_junk_free)) {
 		arena_dalloc_junk_small(ptr, bin_info);
@@ -1694,7 +2387,8 @@ arena_dalloc_bin_locked_impl(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 	unsigned nfree = extent_nfree_get(slab);
 	if (nfree == bin_info->nregs) {
 		arena_dissociate_bin_slab(arena, slab, bin);
-		arena_dalloc_bin_slab(tsdn, arena, slab, bin);
+		arena_dalloc_bin_slab(tsdn, arena, slab, bin,
+		    is_background_thread);
 	} else if (nfree == 1 && slab != bin->slabcur) {
 		arena_bin_slabs_full_remove(arena, bin, slab);
 		arena_bin_lower_slab(tsdn, arena, slab, bin);
@@ -1703,6 +2397,10 @@ arena_dalloc_bin_locked_impl(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 	if (config_stats) {
 		bin->stats.ndalloc++;
 		bin->stats.curregs--;
+		if (unlikely(opt_slab_autotune) && (nfree == 1 ||
+		    nfree == bin_info->nregs)) {
+			arena_bin_slab_tune_sample(bin);
+		}
 	}
 }
 
@@ -1710,7 +2408,43 @@ void
 arena_dalloc_bin_junked_locked(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
     szind_t binind, extent_t *extent, void *ptr) {
 	arena_dalloc_bin_locked_impl(tsdn, arena, bin, binind, extent, ptr,
-	    true);
+	    true, false);
+}
+
+/*
+ * Deallocate the (already junked) regions on list, linked through their first
+ * words, to bin.  Returns the number of regions deallocated.
+ */
+unsigned
+arena_bin_remote_dalloc_locked(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
+    szind_t binind, void *list, bool is_background_thread) {
+	unsigned n = 0;
+	while (list != NULL) {
+		void *ptr = list;
+		list = *(void **)ptr;
+		arena_dalloc_bin_locked_impl(tsdn, arena, bin, binind,
+		    iealloc(tsdn, ptr), ptr, true, is_background_thread);
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Drain the remote free list of the calling thread's shard of arena's bin
+ * binind, if it is not empty.
+ */
+void
+arena_bin_remote_drain(tsdn_t *tsdn, arena_t *arena, szind_t binind) {
+	unsigned binshard;
+	bin_t *bin = arena_bin_choose(tsdn, arena, binind, &binshard);
+	if (atomic_load_p(&bin->remote_free, ATOMIC_RELAXED) == NULL) {
+		return;
+	}
+	malloc_mutex_lock(tsdn, &bin->lock);
+	unsigned n = arena_bin_remote_dalloc_locked(tsdn, arena, bin, binind,
+	    bin_remote_free_take(tsdn, bin), false);
+	malloc_mutex_unlock(tsdn, &bin->lock);
+	arena_decay_ticks(tsdn, arena, n);
 }
 
 static void
@@ -1721,8 +2455,14 @@ arena_dalloc_bin(tsdn_t *tsdn, arena_t *arena, extent_t *extent, void *ptr) {
 
 	malloc_mutex_lock(tsdn, &bin->lock);
 	arena_dalloc_bin_locked_impl(tsdn, arena, bin, binind, extent, ptr,
-	    false);
+	    false, false);
+	/* Drain remote frees while holding the lock anyway. */
+	unsigned ndrained = arena_bin_remote_dalloc_locked(tsdn, arena, bin,
+	    binind, bin_remote_free_take(tsdn, bin), false);
 	malloc_mutex_unlock(tsdn, &bin->lock);
+	if (ndrained != 0) {
+		arena_decay_ticks(tsdn, arena, ndrained);
+	}
 }
 
 void
@@ -1734,6 +2474,50 @@ arena_dalloc_small(tsdn_t *tsdn, void *ptr) {
 	arena_decay_tick(tsdn, arena);
 }
 
+/*
+ * Deallocate the n small regions in ptrs, whose extents have already been
+ * looked up, taking each bin lock once per group of regions that belong to it.
+ * Both arrays are used as scratch space.
+ */
+void
+arena_dalloc_small_batch(tsdn_t *tsdn, void **ptrs, extent_t **extents,
+    size_t n) {
+	while (n > 0) {
+		/* Lock the arena bin associated with the first object. */
+		extent_t *extent = extents[0];
+		unsigned bin_arena_ind = extent_arena_ind_get(extent);
+		arena_t *bin_arena = arena_get_from_extent(extent);
+		szind_t binind = extent_szind_get(extent);
+		unsigned binshard = extent_binshard_get(extent);
+		assert(binind < SC_NBINS);
+		assert(binshard < bins_nshards_get(&bin_arena->bins[binind]));
+		bin_t *bin = &bin_arena->bins[binind].bin_shards[binshard];
+
+		malloc_mutex_lock(tsdn, &bin->lock);
+		size_t ndeferred = 0;
+		for (size_t i = 0; i < n; i++) {
+			extent = extents[i];
+			if (extent_arena_ind_get(extent) == bin_arena_ind &&
+			    extent_szind_get(extent) == binind &&
+			    extent_binshard_get(extent) == binshard) {
+				arena_dalloc_bin_locked_impl(tsdn, bin_arena,
+				    bin, binind, extent, ptrs[i], false, false);
+			} else {
+				/*
+				 * Belongs to a different bin; stash it for a
+				 * future pass.
+				 */
+				ptrs[ndeferred] = ptrs[i];
+				extents[ndeferred] = extent;
+				ndeferred++;
+			}
+		}
+		malloc_mutex_unlock(tsdn, &bin->lock);
+		arena_decay_ticks(tsdn, bin_arena, (unsigned)(n - ndeferred));
+		n = ndeferred;
+	}
+}
+
 bool
 arena_ralloc_no_move(tsdn_t *tsdn, void *ptr, size_t oldsize, size_t size,
     size_t extra, bool zero, size_t *newsize) {
@@ -1891,6 +2675,21 @@ arena_muzzy_decay_ms_default_set(ssize_t decay_ms) {
 	return false;
 }
 
+decay_curve_t
+arena_decay_curve_default_get(void) {
+	return (decay_curve_t)atomic_load_u(&decay_curve_default,
+	    ATOMIC_RELAXED);
+}
+
+bool
+arena_decay_curve_default_set(decay_curve_t curve) {
+	if (curve >= decay_curve_names_limit) {
+		return true;
+	}
+	atomic_store_u(&decay_curve_default, curve, ATOMIC_RELAXED);
+	return false;
+}
+
 bool
 arena_retain_grow_limit_get_set(tsd_t *tsd, arena_t *arena, size_t *old_limit,
     size_t *new_limit) {
@@ -1954,9 +2753,10 @@ arena_new(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks) {
 
 	unsigned nbins_total = 0;
 	for (i = 0; i < SC_NBINS; i++) {
-		nbins_total += bin_infos[i].n_shards;
+		nbins_total += bin_shards_cap(i);
 	}
-	size_t arena_size = sizeof(arena_t) + sizeof(bin_t) * nbins_total;
+	size_t arena_size = sizeof(arena_t) + sizeof(bin_t) * nbins_total +
+	    sizeof(atomic_p_t) * opt_bin_stash * nbins_total;
 	arena = (arena_t *)base_alloc(tsdn, base, arena_size, CACHELINE);
 	if (arena == NULL) {
 		goto label_error;
@@ -1970,13 +2770,13 @@ arena_new(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks) {
 		if (arena_stats_init(tsdn, &arena->stats)) {
 			goto label_error;
 		}
+	}
 
-		ql_new(&arena->tcache_ql);
-		ql_new(&arena->cache_bin_array_descriptor_ql);
-		if (malloc_mutex_init(&arena->tcache_ql_mtx, "tcache_ql",
-		    WITNESS_RANK_TCACHE_QL, malloc_mutex_rank_exclusive)) {
-			goto label_error;
-		}
+	ql_new(&arena->tcache_ql);
+	ql_new(&arena->cache_bin_array_descriptor_ql);
+	if (malloc_mutex_init(&arena->tcache_ql_mtx, "tcache_ql",
+	    WITNESS_RANK_TCACHE_QL, malloc_mutex_rank_exclusive)) {
+		goto label_error;
 	}
 
 	if (config_prof) {
@@ -2026,16 +2826,22 @@ arena_new(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks) {
 	}
 
 	if (arena_decay_init(&arena->decay_dirty,
-	    arena_dirty_decay_ms_default_get(), &arena->stats.decay_dirty)) {
+	    arena_dirty_decay_ms_default_get(),
+	    arena_decay_curve_default_get(), &arena->stats.decay_dirty)) {
 		goto label_error;
 	}
 	if (arena_decay_init(&arena->decay_muzzy,
-	    arena_muzzy_decay_ms_default_get(), &arena->stats.decay_muzzy)) {
+	    arena_muzzy_decay_ms_default_get(),
+	    arena_decay_curve_default_get(), &arena->stats.decay_muzzy)) {
 		goto label_error;
 	}
 
 	arena->extent_grow_next = sz_psz2ind(HUGEPAGE);
 	arena->retain_grow_limit = sz_psz2ind(SC_LARGE_MAXCLASS);
+	if (hpa_init(tsdn, &arena->hpa)) {
+		goto label_error;
+	}
+
 	if (malloc_mutex_init(&arena->extent_grow_mtx, "extent_grow",
 	    WITNESS_RANK_EXTENT_GROW, malloc_mutex_rank_exclusive)) {
 		goto label_error;
@@ -2047,21 +2853,31 @@ arena_new(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks) {
 		goto label_error;
 	}
 
-	/* Initialize bins. */
+	/* Initialize bins, followed by their stashes, if any. */
 	uintptr_t bin_addr = (uintptr_t)arena + sizeof(arena_t);
+	uintptr_t stash_addr = bin_addr + sizeof(bin_t) * nbins_total;
 	atomic_store_u(&arena->binshard_next, 0, ATOMIC_RELEASE);
 	for (i = 0; i < SC_NBINS; i++) {
 		unsigned nshards = bin_infos[i].n_shards;
 		arena->bins[i].bin_shards = (bin_t *)bin_addr;
-		bin_addr += nshards * sizeof(bin_t);
+		bin_addr += bin_shards_cap(i) * sizeof(bin_t);
+		for (unsigned j = 0; j < bin_shards_cap(i); j++) {
+			arena->bins[i].bin_shards[j].stash = (opt_bin_stash >
+			    0) ? (atomic_p_t *)stash_addr : NULL;
+			stash_addr += sizeof(atomic_p_t) * opt_bin_stash;
+		}
 		for (unsigned j = 0; j < nshards; j++) {
 			bool err = bin_init(&arena->bins[i].bin_shards[j]);
 			if (err) {
 				goto label_error;
 			}
 		}
+		atomic_store_u(&arena->bins[i].nshards, nshards,
+		    ATOMIC_RELAXED);
+		atomic_store_u(&arena->bins[i].nshards_claimed, nshards,
+		    ATOMIC_RELAXED);
 	}
-	assert(bin_addr == (uintptr_t)arena + arena_size);
+	assert(stash_addr == (uintptr_t)arena + arena_size);
 
 	arena->base = base;
 	/* Set arena before creating background threads. */
@@ -2156,6 +2972,15 @@ void
 arena_boot(sc_data_t *sc_data) {
 	arena_dirty_decay_ms_default_set(opt_dirty_decay_ms);
 	arena_muzzy_decay_ms_default_set(opt_muzzy_decay_ms);
+	arena_decay_curve_default_set(opt_decay_curve);
+	/*
+	 * Each step multiplies by 35/36, which halves the factor about every
+	 * SMOOTHSTEP_NSTEPS/8 steps.
+	 */
+	h_steps_exp[SMOOTHSTEP_NSTEPS-1] = KQU(1) << SMOOTHSTEP_BFP;
+	for (unsigned i = SMOOTHSTEP_NSTEPS - 1; i > 0; i--) {
+		h_steps_exp[i - 1] = h_steps_exp[i] - h_steps_exp[i] / 36;
+	}
 	for (unsigned i = 0; i < SC_NBINS; i++) {
 		sc_t *sc = &sc_data->sc[i];
 		div_init(&arena_binind_div_info[i],
@@ -2171,9 +2996,7 @@ arena_prefork0(tsdn_t *tsdn, arena_t *arena) {
 
 void
 arena_prefork1(tsdn_t *tsdn, arena_t *arena) {
-	if (config_stats) {
-		malloc_mutex_prefork(tsdn, &arena->tcache_ql_mtx);
-	}
+	malloc_mutex_prefork(tsdn, &arena->tcache_ql_mtx);
 }
 
 void
@@ -2183,33 +3006,42 @@ arena_prefork2(tsdn_t *tsdn, arena_t *arena) {
 
 void
 arena_prefork3(tsdn_t *tsdn, arena_t *arena) {
-	eset_prefork(tsdn, &arena->eset_dirty);
-	eset_prefork(tsdn, &arena->eset_muzzy);
-	eset_prefork(tsdn, &arena->eset_retained);
+	hpa_prefork(tsdn, &arena->hpa);
 }
 
 void
 arena_prefork4(tsdn_t *tsdn, arena_t *arena) {
-	malloc_mutex_prefork(tsdn, &arena->extent_avail_mtx);
+	eset_prefork0(tsdn, &arena->eset_dirty);
+	eset_prefork0(tsdn, &arena->eset_muzzy);
+	eset_prefork0(tsdn, &arena->eset_retained);
 }
 
 void
 arena_prefork5(tsdn_t *tsdn, arena_t *arena) {
-	base_prefork(tsdn, arena->base);
+	malloc_mutex_prefork(tsdn, &arena->extent_avail_mtx);
 }
 
 void
 arena_prefork6(tsdn_t *tsdn, arena_t *arena) {
-	malloc_mutex_prefork(tsdn, &arena->large_mtx);
+	base_prefork(tsdn, arena->base);
 }
 
 void
 arena_prefork7(tsdn_t *tsdn, arena_t *arena) {
+	malloc_mutex_prefork(tsdn, &arena->large_mtx);
+}
+
+void
+arena_prefork8(tsdn_t *tsdn, arena_t *arena) {
 	for (unsigned i = 0; i < SC_NBINS; i++) {
-		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+		for (unsigned j = 0; j < bins_nshards_get(&arena->bins[i]);
+		    j++) {
 			bin_prefork(tsdn, &arena->bins[i].bin_shards[j]);
 		}
 	}
+	eset_prefork1(tsdn, &arena->eset_dirty);
+	eset_prefork1(tsdn, &arena->eset_muzzy);
+	eset_prefork1(tsdn, &arena->eset_retained);
 }
 
 void
@@ -2217,7 +3049,8 @@ arena_postfork_parent(tsdn_t *tsdn, arena_t *arena) {
 	unsigned i;
 
 	for (i = 0; i < SC_NBINS; i++) {
-		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+		for (unsigned j = 0; j < bins_nshards_get(&arena->bins[i]);
+		    j++) {
 			bin_postfork_parent(tsdn,
 			    &arena->bins[i].bin_shards[j]);
 		}
@@ -2228,12 +3061,11 @@ arena_postfork_parent(tsdn_t *tsdn, arena_t *arena) {
 	eset_postfork_parent(tsdn, &arena->eset_dirty);
 	eset_postfork_parent(tsdn, &arena->eset_muzzy);
 	eset_postfork_parent(tsdn, &arena->eset_retained);
+	hpa_postfork_parent(tsdn, &arena->hpa);
 	malloc_mutex_postfork_parent(tsdn, &arena->extent_grow_mtx);
 	malloc_mutex_postfork_parent(tsdn, &arena->decay_dirty.mtx);
 	malloc_mutex_postfork_parent(tsdn, &arena->decay_muzzy.mtx);
-	if (config_stats) {
-		malloc_mutex_postfork_parent(tsdn, &arena->tcache_ql_mtx);
-	}
+	malloc_mutex_postfork_parent(tsdn, &arena->tcache_ql_mtx);
 }
 
 void
@@ -2248,23 +3080,22 @@ arena_postfork_child(tsdn_t *tsdn, arena_t *arena) {
 	if (tsd_iarena_get(tsdn_tsd(tsdn)) == arena) {
 		arena_nthreads_inc(arena, true);
 	}
-	if (config_stats) {
-		ql_new(&arena->tcache_ql);
-		ql_new(&arena->cache_bin_array_descriptor_ql);
-		tcache_t *tcache = tcache_get(tsdn_tsd(tsdn));
-		if (tcache != NULL && tcache->arena == arena) {
-			ql_elm_new(tcache, link);
-			ql_tail_insert(&arena->tcache_ql, tcache, link);
-			cache_bin_array_descriptor_init(
-			    &tcache->cache_bin_array_descriptor,
-			    tcache->bins_small, tcache->bins_large);
-			ql_tail_insert(&arena->cache_bin_array_descriptor_ql,
-			    &tcache->cache_bin_array_descriptor, link);
-		}
+	ql_new(&arena->tcache_ql);
+	ql_new(&arena->cache_bin_array_descriptor_ql);
+	tcache_t *tcache = tcache_get(tsdn_tsd(tsdn));
+	if (tcache != NULL && tcache->arena == arena) {
+		ql_elm_new(tcache, link);
+		ql_tail_insert(&arena->tcache_ql, tcache, link);
+		cache_bin_array_descriptor_init(
+		    &tcache->cache_bin_array_descriptor, tcache->bins_small,
+		    tcache->bins_large);
+		ql_tail_insert(&arena->cache_bin_array_descriptor_ql,
+		    &tcache->cache_bin_array_descriptor, link);
 	}
 
 	for (i = 0; i < SC_NBINS; i++) {
-		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+		for (unsigned j = 0; j < bins_nshards_get(&arena->bins[i]);
+		    j++) {
 			bin_postfork_child(tsdn, &arena->bins[i].bin_shards[j]);
 		}
 	}
@@ -2274,10 +3105,9 @@ arena_postfork_child(tsdn_t *tsdn, arena_t *arena) {
 	eset_postfork_child(tsdn, &arena->eset_dirty);
 	eset_postfork_child(tsdn, &arena->eset_muzzy);
 	eset_postfork_child(tsdn, &arena->eset_retained);
+	hpa_postfork_child(tsdn, &arena->hpa);
 	malloc_mutex_postfork_child(tsdn, &arena->extent_grow_mtx);
 	malloc_mutex_postfork_child(tsdn, &arena->decay_dirty.mtx);
 	malloc_mutex_postfork_child(tsdn, &arena->decay_muzzy.mtx);
-	if (config_stats) {
-		malloc_mutex_postfork_child(tsdn, &arena->tcache_ql_mtx);
-	}
+	malloc_mutex_postfork_child(tsdn, &arena->tcache_ql_mtx);
 }
@@ -3,6 +3,7 @@
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 
 #include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/pressure.h"
 
 JEMALLOC_DIAGNOSTIC_DISABLE_SPURIOUS
 
@@ -71,6 +72,9 @@ static bool background_thread_enabled_at_fork;
 static void
 background_thread_info_init(tsdn_t *tsdn, background_thread_info_t *info) {
 	background_thread_wakeup_time_set(tsdn, info, 0);
+	atomic_store_b(&info->idle, false, ATOMIC_RELAXED);
+	atomic_store_b(&info->busy, false, ATOMIC_RELAXED);
+	atomic_store_zu(&info->work_range, 0, ATOMIC_RELAXED);
 	info->npages_to_purge_new = 0;
 	if (config_stats) {
 		info->tot_n_runs = 0;
@@ -100,13 +104,14 @@ set_current_thread_affinity(int cpu) {
 
 static inline size_t
 decay_npurge_after_interval(arena_decay_t *decay, size_t interval) {
+	const uint64_t *steps = arena_decay_h_steps(decay);
 	size_t i;
 	uint64_t sum = 0;
 	for (i = 0; i < interval; i++) {
-		sum += decay->backlog[i] * h_steps[i];
+		sum += decay->backlog[i] * steps[i];
 	}
 	for (; i < SMOOTHSTEP_NSTEPS; i++) {
-		sum += decay->backlog[i] * (h_steps[i] - h_steps[i - interval]);
+		sum += decay->backlog[i] * (steps[i] - steps[i - interval]);
 	}
 
 	return (size_t)(sum >> SMOOTHSTEP_BFP);
@@ -229,8 +234,10 @@ background_thread_sleep(tsdn_t *tsdn, background_thread_info_t *info,
 	int ret;
 	if (interval == BACKGROUND_THREAD_INDEFINITE_SLEEP) {
 		assert(background_thread_indefinite_sleep(info));
+		atomic_store_b(&info->idle, true, ATOMIC_RELEASE);
 		ret = pthread_cond_wait(&info->cond, &info->mtx.lock);
 		assert(ret == 0);
+		atomic_store_b(&info->idle, false, ATOMIC_RELEASE);
 	} else {
 		assert(interval >= BACKGROUND_THREAD_MIN_INTERVAL_NS &&
 		    interval <= BACKGROUND_THREAD_INDEFINITE_SLEEP);
@@ -252,8 +259,10 @@ background_thread_sleep(tsdn_t *tsdn, background_thread_info_t *info,
 		ts.tv_nsec = (size_t)nstime_nsec(&ts_wakeup);
 
 		assert(!background_thread_indefinite_sleep(info));
+		atomic_store_b(&info->idle, true, ATOMIC_RELEASE);
 		ret = pthread_cond_timedwait(&info->cond, &info->mtx.lock, &ts);
 		assert(ret == ETIMEDOUT || ret == 0);
+		atomic_store_b(&info->idle, false, ATOMIC_RELEASE);
 		background_thread_wakeup_time_set(tsdn, info,
 		    BACKGROUND_THREAD_INDEFINITE_SLEEP);
 	}
@@ -282,17 +291,163 @@ background_thread_pause_check(tsdn_t *tsdn, background_thread_info_t *info) {
 	return false;
 }
 
+/*
+ * Wake up an idle background thread, so that it helps the busy thread ind with
+ * its arenas.  The caller's info->mtx is dropped meanwhile, since the mutexes of
+ * two background threads can't be held together.
+ */
+static void
+background_thread_help_request(tsdn_t *tsdn, unsigned ind) {
+	background_thread_info_t *info = &background_thread_info[ind];
+	malloc_mutex_unlock(tsdn, &info->mtx);
+	for (unsigned i = 1; i < max_background_threads; i++) {
+		background_thread_info_t *helper = &background_thread_info[(ind +
+		    i) % max_background_threads];
+		if (!atomic_load_b(&helper->idle, ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		malloc_mutex_lock(tsdn, &helper->mtx);
+		/* Idle is only set under the mutex, while waiting on cond. */
+		bool signaled = (helper->state == background_thread_started &&
+		    atomic_load_b(&helper->idle, ATOMIC_RELAXED));
+		if (signaled) {
+			pthread_cond_signal(&helper->cond);
+		}
+		malloc_mutex_unlock(tsdn, &helper->mtx);
+		if (signaled) {
+			break;
+		}
+	}
+	malloc_mutex_lock(tsdn, &info->mtx);
+}
+
+#define BACKGROUND_WORK_RANGE_SHIFT (sizeof(size_t) << 2)
+#define BACKGROUND_WORK_RANGE_MASK						\
+    (((size_t)1 << BACKGROUND_WORK_RANGE_SHIFT) - 1)
+
+/*
+ * Claim the next arena left in the current run of info, either at the owner's
+ * cursor or at the end of the run.  Returns true when nothing is left.
+ */
+static bool
+background_work_claim(background_thread_info_t *info, bool from_end,
+    unsigned *r_slot) {
+	size_t range = atomic_load_zu(&info->work_range, ATOMIC_ACQUIRE);
+	size_t new_range;
+	do {
+		size_t cursor = range & BACKGROUND_WORK_RANGE_MASK;
+		size_t end = range >> BACKGROUND_WORK_RANGE_SHIFT;
+		if (cursor == end) {
+			return true;
+		}
+		if (from_end) {
+			*r_slot = (unsigned)(end - 1);
+			new_range = range - ((size_t)1 <<
+			    BACKGROUND_WORK_RANGE_SHIFT);
+		} else {
+			*r_slot = (unsigned)cursor;
+			new_range = range + 1;
+		}
+	} while (!atomic_compare_exchange_weak_zu(&info->work_range, &range,
+	    new_range, ATOMIC_ACQ_REL, ATOMIC_ACQUIRE));
+	return false;
+}
+
+/*
+ * Decay the arenas the busy background threads other than ind have left in
+ * their current runs.  Arenas are taken from the end of each run, and never at
+ * or before the owner's cursor.
+ */
+static void
+background_work_steal(tsdn_t *tsdn, unsigned ind) {
+	for (unsigned owner = 0; owner < max_background_threads; owner++) {
+		background_thread_info_t *info = &background_thread_info[owner];
+		if (owner == ind || !atomic_load_b(&info->busy,
+		    ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		unsigned slot;
+		while (!background_work_claim(info, true, &slot)) {
+			arena_t *arena = arena_get(tsdn, owner + slot *
+			    max_background_threads, false);
+			if (arena != NULL) {
+				arena_decay(tsdn, arena, true, false);
+			}
+		}
+	}
+}
+
 static inline void
 background_work_sleep_once(tsdn_t *tsdn, background_thread_info_t *info, unsigned ind) {
 	uint64_t min_interval = BACKGROUND_THREAD_INDEFINITE_SLEEP;
 	unsigned narenas = narenas_total_get();
 
-	for (unsigned i = ind; i < narenas; i += max_background_threads) {
-		arena_t *arena = arena_get(tsdn, i, false);
+	if (ind == 0 && opt_tcache_global_bytes_max != 0) {
+		/*
+		 * Flushing tcaches may check on the background threads of the
+		 * arenas, this one included, so info->mtx is dropped.
+		 */
+		malloc_mutex_unlock(tsdn, &info->mtx);
+		tcache_reclaim_maybe(tsdn);
+		malloc_mutex_lock(tsdn, &info->mtx);
+		if (info->state != background_thread_started) {
+			return;
+		}
+		min_interval = TCACHE_RECLAIM_INTERVAL_NS;
+	}
+	if (ind == 0 && opt_pressure_purge) {
+		if (pressure_high()) {
+			/* Purge everything until the pressure drops. */
+			for (unsigned i = 0; i < narenas; i++) {
+				arena_t *arena = arena_get(tsdn, i, false);
+				if (arena != NULL) {
+					arena_decay(tsdn, arena, true, true);
+				}
+			}
+		}
+		if (min_interval > PRESSURE_CHECK_INTERVAL_NS) {
+			min_interval = PRESSURE_CHECK_INTERVAL_NS;
+		}
+	}
+
+	unsigned nslots = (narenas > ind) ? (narenas - ind - 1) /
+	    max_background_threads + 1 : 0;
+	atomic_store_zu(&info->work_range, (size_t)nslots <<
+	    BACKGROUND_WORK_RANGE_SHIFT, ATOMIC_RELEASE);
+	nstime_t start;
+	nstime_init(&start, 0);
+	nstime_update(&start);
+	unsigned slot;
+	while (!background_work_claim(info, false, &slot)) {
+		arena_t *arena = arena_get(tsdn, ind + slot *
+		    max_background_threads, false);
 		if (!arena) {
 			continue;
 		}
 		arena_decay(tsdn, arena, true, false);
+		if (max_background_threads > 1 && !atomic_load_b(&info->busy,
+		    ATOMIC_RELAXED) && slot + 1 < nslots) {
+			/*
+			 * Ask for help with the remaining arenas once this run
+			 * has gone on for longer than the minimal interval.
+			 */
+			nstime_t now;
+			nstime_init(&now, 0);
+			nstime_update(&now);
+			if (nstime_compare(&now, &start) > 0) {
+				nstime_subtract(&now, &start);
+				if (nstime_ns(&now) >
+				    BACKGROUND_THREAD_MIN_INTERVAL_NS) {
+					atomic_store_b(&info->busy, true,
+					    ATOMIC_RELEASE);
+					background_thread_help_request(tsdn,
+					    ind);
+				}
+				if (info->state != background_thread_started) {
+					break;
+				}
+			}
+		}
 		if (min_interval == BACKGROUND_THREAD_MIN_INTERVAL_NS) {
 			/* Min interval will be used. */
 			continue;
@@ -304,6 +459,31 @@ background_work_sleep_once(tsdn_t *tsdn, background_thread_info_t *info, unsigne
 			min_interval = interval;
 		}
 	}
+	atomic_store_b(&info->busy, false, ATOMIC_RELEASE);
+	if (info->state != background_thread_started) {
+		/* Stopped or paused while the mutex was dropped for help. */
+		atomic_store_zu(&info->work_range, 0, ATOMIC_RELEASE);
+		return;
+	}
+	/* The arenas past the cursor were taken by helpers. */
+	size_t range = atomic_load_zu(&info->work_range, ATOMIC_ACQUIRE);
+	for (slot = (unsigned)(range >> BACKGROUND_WORK_RANGE_SHIFT);
+	    slot < nslots && min_interval > BACKGROUND_THREAD_MIN_INTERVAL_NS;
+	    slot++) {
+		arena_t *arena = arena_get(tsdn, ind + slot *
+		    max_background_threads, false);
+		if (arena == NULL) {
+			continue;
+		}
+		uint64_t interval = arena_decay_compute_purge_interval(tsdn,
+		    arena);
+		if (min_interval > interval) {
+			min_interval = interval;
+		}
+	}
+	if (max_background_threads > 1) {
+		background_work_steal(tsdn, ind);
+	}
 	background_thread_sleep(tsdn, info, min_interval);
 }
 
@@ -704,11 +884,12 @@ background_thread_interval_check(tsdn_t *tsdn, arena_t *arena,
 		if (n_epoch >= SMOOTHSTEP_NSTEPS) {
 			npurge_new = npages_new;
 		} else {
-			uint64_t h_steps_max = h_steps[SMOOTHSTEP_NSTEPS - 1];
+			const uint64_t *steps = arena_decay_h_steps(decay);
+			uint64_t h_steps_max = steps[SMOOTHSTEP_NSTEPS - 1];
 			assert(h_steps_max >=
-			    h_steps[SMOOTHSTEP_NSTEPS - 1 - n_epoch]);
+			    steps[SMOOTHSTEP_NSTEPS - 1 - n_epoch]);
 			npurge_new = npages_new * (h_steps_max -
-			    h_steps[SMOOTHSTEP_NSTEPS - 1 - n_epoch]);
+			    steps[SMOOTHSTEP_NSTEPS - 1 - n_epoch]);
 			npurge_new >>= SMOOTHSTEP_BFP;
 		}
 		info->npages_to_purge_new += npurge_new;
@@ -59,7 +59,8 @@ base_unmap(tsdn_t *tsdn, extent_hooks_t *extent_hooks, unsigned ind, void *addr,
 	 * stopping at first success.  This cascade is performed for consistency
 	 * with the cascade in extent_dalloc_wrapper() because an application's
 	 * custom hooks may not support e.g. dalloc.  This function is only ever
-	 * called as a side effect of arena destruction, so although it might
+	 * called as a side effect of arena destruction, or once a block has
+	 * been entirely returned via base_dalloc(), so although it might
 	 * seem pointless to do anything besides dalloc here, the application
 	 * may in fact want the end state of all associated virtual memory to be
 	 * in some consistent-but-allocated state.
@@ -294,6 +295,7 @@ base_block_alloc(tsdn_t *tsdn, base_t *base, extent_hooks_t *extent_hooks,
 	*pind_last = sz_psz2ind(block_size);
 	block->size = block_size;
 	block->next = NULL;
+	block->allocated = 0;
 	assert(block_size >= header_size);
 	base_extent_init(extent_sn_next, &block->extent,
 	    (void *)((uintptr_t)block + header_size), block_size - header_size);
@@ -374,7 +376,11 @@ base_new(tsdn_t *tsdn, unsigned ind, extent_hooks_t *extent_hooks) {
 	base->auto_thp_switched = false;
 	for (szind_t i = 0; i < SC_NSIZES; i++) {
 		extent_heap_new(&base->avail[i]);
+		base->free[i] = NULL;
 	}
+	base->nfree = 0;
+	/* The base_t itself is never freed, which pins the first block. */
+	block->allocated = base_size;
 	if (config_stats) {
 		base->allocated = sizeof(base_block_t);
 		base->resident = PAGE_CEILING(sizeof(base_block_t));
@@ -417,6 +423,68 @@ base_extent_hooks_set(base_t *base, extent_hooks_t *extent_hooks) {
 	return old_extent_hooks;
 }
 
+static base_block_t *
+base_extent2block(extent_t *extent) {
+	return (base_block_t *)((uintptr_t)extent - offsetof(base_block_t,
+	    extent));
+}
+
+static base_block_t *
+base_block_lookup(base_t *base, const void *ptr) {
+	for (base_block_t *block = base->blocks; block != NULL;
+	    block = block->next) {
+		if ((uintptr_t)ptr - (uintptr_t)block < block->size) {
+			return block;
+		}
+	}
+	not_reached();
+	return NULL;
+}
+
+static void
+base_free_insert(base_t *base, void *addr, size_t size) {
+	assert(size == QUANTUM_CEILING(size));
+	/* Same index computation as for the avail heaps. */
+	szind_t index_floor = sz_size2index(size + 1) - 1;
+	base_free_t *region = (base_free_t *)addr;
+	region->next = base->free[index_floor];
+	region->size = size;
+	base->free[index_floor] = region;
+	base->nfree++;
+}
+
+/*
+ * First fit among the freed regions that are at least usize bytes large, and
+ * suitably aligned.  The unused tail of the region is freed anew.
+ */
+static void *
+base_free_alloc(base_t *base, size_t usize, size_t alignment) {
+	if (base->nfree == 0) {
+		return NULL;
+	}
+	for (szind_t i = sz_size2index(usize + 1) - 1; i < SC_NSIZES; i++) {
+		base_free_t **linkp = &base->free[i];
+		while (*linkp != NULL) {
+			base_free_t *region = *linkp;
+			if (region->size < usize || ((uintptr_t)region &
+			    (alignment - 1)) != 0) {
+				linkp = &region->next;
+				continue;
+			}
+			*linkp = region->next;
+			base->nfree--;
+			if (region->size > usize) {
+				base_free_insert(base, (void *)((uintptr_t)region
+				    + usize), region->size - usize);
+			}
+			/* Unlike fresh space, freed regions aren't zeroed. */
+			memset(region, 0, usize);
+			return region;
+		}
+	}
+	return NULL;
+}
+
 static void *
 base_alloc_impl(tsdn_t *tsdn, base_t *base, size_t size, size_t alignment,
     size_t *esn) {
@@ -425,7 +493,20 @@ base_alloc_impl(tsdn_t *tsdn, base_t *base, size_t size, size_t alignment,
 	size_t asize = usize + alignment - QUANTUM;
 
 	extent_t *extent = NULL;
+	void *ret;
 	malloc_mutex_lock(tsdn, &base->mtx);
+	ret = base_free_alloc(base, usize, alignment);
+	if (ret != NULL) {
+		base_block_t *block = base_block_lookup(base, ret);
+		block->allocated += usize;
+		if (config_stats) {
+			base->allocated += usize;
+		}
+		if (esn != NULL) {
+			*esn = extent_sn_get(&block->extent);
+		}
+		goto label_return;
+	}
 	for (szind_t i = sz_size2index(asize); i < SC_NSIZES; i++) {
 		extent = extent_heap_remove_first(&base->avail[i]);
 		if (extent != NULL) {
@@ -437,13 +518,12 @@ base_alloc_impl(tsdn_t *tsdn, base_t *base, size_t size, size_t alignment,
 		/* Try to allocate more space. */
 		extent = base_extent_alloc(tsdn, base, usize, alignment);
 	}
-	void *ret;
 	if (extent == NULL) {
-		ret = NULL;
 		goto label_return;
 	}
 
 	ret = base_extent_bump_alloc(base, extent, usize, alignment);
+	base_extent2block(extent)->allocated += usize;
 	if (esn != NULL) {
 		*esn = extent_sn_get(extent);
 	}
@@ -477,6 +557,110 @@ base_alloc_extent(tsdn_t *tsdn, base_t *base) {
 	return extent;
 }
 
+/*
+ * Unlink a block whose allocations have all been freed, and forget about the
+ * freed regions and the unused trailing space within it.
+ */
+static void
+base_block_remove(tsdn_t *tsdn, base_t *base, base_block_t *block) {
+	malloc_mutex_assert_owner(tsdn, &base->mtx);
+	assert(block->allocated == 0);
+
+	for (szind_t i = 0; i < SC_NSIZES; i++) {
+		base_free_t **linkp = &base->free[i];
+		while (*linkp != NULL) {
+			if ((uintptr_t)*linkp - (uintptr_t)block <
+			    block->size) {
+				*linkp = (*linkp)->next;
+				base->nfree--;
+			} else {
+				linkp = &(*linkp)->next;
+			}
+		}
+	}
+	extent_t *extent = &block->extent;
+	if (extent_bsize_get(extent) > 0) {
+		szind_t index_floor =
+		    sz_size2index(extent_bsize_get(extent) + 1) - 1;
+		extent_heap_remove(&base->avail[index_floor], extent);
+	}
+
+	/*
+	 * Let the next block be sized after the remaining ones, so that
+	 * repeated growth and shrinkage doesn't map ever larger blocks.
+	 */
+	pszind_t pind_last = 0;
+	base_block_t **linkp = &base->blocks;
+	while (*linkp != NULL) {
+		if (*linkp == block) {
+			*linkp = block->next;
+			continue;
+		}
+		pszind_t pind = sz_psz2ind((*linkp)->size);
+		if (pind > pind_last) {
+			pind_last = pind;
+		}
+		linkp = &(*linkp)->next;
+	}
+	assert(base->blocks != NULL);
+	base->pind_last = pind_last;
+
+	if (config_stats) {
+		/* Undo the accounting of the header and of the bump allocs. */
+		uintptr_t used = (uintptr_t)extent_addr_get(extent) -
+		    (uintptr_t)block;
+		base->allocated -= sizeof(base_block_t);
+		base->resident -= PAGE_CEILING(used);
+		base->mapped -= block->size;
+		if (metadata_thp_madvise() && (opt_metadata_thp ==
+		    metadata_thp_always || base->auto_thp_switched)) {
+			assert(base->n_thp >= HUGEPAGE_CEILING(used) >>
+			    LG_HUGEPAGE);
+			base->n_thp -= HUGEPAGE_CEILING(used) >> LG_HUGEPAGE;
+		}
+		assert(base->allocated <= base->resident);
+		assert(base->resident <= base->mapped);
+	}
+}
+
+/*
+ * Return an allocation made via base_alloc() with the same size and alignment.
+ * The memory is recycled by subsequent base_alloc() calls, and a block is
+ * unmapped as soon as everything allocated from it has been returned.
+ */
+void
+base_dalloc(tsdn_t *tsdn, base_t *base, void *ptr, size_t size,
+    size_t alignment) {
+	alignment = QUANTUM_CEILING(alignment);
+	size_t usize = ALIGNMENT_CEILING(size, alignment);
+	assert(ALIGNMENT_ADDR2BASE(ptr, alignment) == ptr);
+
+	malloc_mutex_lock(tsdn, &base->mtx);
+	base_block_t *block = base_block_lookup(base, ptr);
+	assert(block->allocated >= usize);
+	block->allocated -= usize;
+	if (config_stats) {
+		assert(base->allocated >= usize);
+		base->allocated -= usize;
+	}
+	if (block->allocated != 0) {
+		base_free_insert(base, ptr, usize);
+		malloc_mutex_unlock(tsdn, &base->mtx);
+		return;
+	}
+	base_block_remove(tsdn, base, block);
+	malloc_mutex_unlock(tsdn, &base->mtx);
+
+	/* As in base_extent_alloc(), don't hold the mutex across the hooks. */
+	base_unmap(tsdn, base_extent_hooks_get(base), base_ind_get(base),
+	    block, block->size);
+}
+
+void
+base_dalloc_extent(tsdn_t *tsdn, base_t *base, extent_t *extent) {
+	base_dalloc(tsdn, base, extent, sizeof(extent_t), CACHELINE);
+}
+
 void
 base_stats_get(tsdn_t *tsdn, base_t *base, size_t *allocated, size_t *resident,
     size_t *mapped, size_t *n_thp) {
@@ -6,6 +6,8 @@
 #include "jemalloc/internal/sc.h"
 #include "jemalloc/internal/witness.h"
 
+unsigned opt_bin_stash = 0;
+
 bool
 bin_update_shard_size(unsigned bin_shard_sizes[SC_NBINS], size_t start_size,
     size_t end_size, size_t nshards) {
@@ -44,15 +46,28 @@ bin_init(bin_t *bin) {
 	    malloc_mutex_rank_exclusive)) {
 		return true;
 	}
+	atomic_store_p(&bin->remote_free, NULL, ATOMIC_RELAXED);
+	atomic_store_zu(&bin->stash_state, 0, ATOMIC_RELAXED);
+	bin->stash_state_seen = 0;
 	bin->slabcur = NULL;
 	extent_heap_new(&bin->slabs_nonfull);
 	extent_list_init(&bin->slabs_full);
+	bin_slab_tune_init(&bin->slab_tune);
+	memset(&bin->contention, 0, sizeof(bin_contention_t));
 	if (config_stats) {
 		memset(&bin->stats, 0, sizeof(bin_stats_t));
 	}
 	return false;
 }
 
+void
+bin_slab_tune_init(bin_slab_tune_t *slab_tune) {
+	slab_tune->size = BIN_SLAB_SIZE_DEFAULT;
+	slab_tune->nslabs = 0;
+	slab_tune->util_min = BIN_SLAB_TUNE_UTIL_ONE;
+	slab_tune->nregs = 0;
+}
+
 void
 bin_prefork(tsdn_t *tsdn, bin_t *bin) {
 	malloc_mutex_prefork(tsdn, &bin->lock);
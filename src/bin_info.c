@@ -3,7 +3,11 @@
 
 #include "jemalloc/internal/bin_info.h"
 
+bool opt_slab_autotune = false;
+unsigned opt_bin_shards_max = 0;
+
 bin_info_t bin_infos[SC_NBINS];
+bin_info_t bin_slab_infos[SC_NBINS][BIN_SLAB_NSIZES];
 
 static void
 bin_infos_init(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
@@ -23,8 +27,56 @@ bin_infos_init(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 	}
 }
 
+static void
+bin_slab_info_init(bin_info_t *bin_info, size_t reg_size, size_t pgs) {
+	bin_info->reg_size = reg_size;
+	bin_info->slab_size = (pgs << LG_PAGE);
+	bin_info->nregs = (uint32_t)(bin_info->slab_size / reg_size);
+	bin_info->n_shards = 0;
+	bitmap_info_t bitmap_info = BITMAP_INFO_INITIALIZER(bin_info->nregs);
+	bin_info->bitmap_info = bitmap_info;
+}
+
+static void
+bin_slab_infos_init(bin_info_t bin_infos[SC_NBINS],
+    bin_info_t bin_slab_infos[SC_NBINS][BIN_SLAB_NSIZES]) {
+	for (unsigned i = 0; i < SC_NBINS; i++) {
+		size_t reg_size = bin_infos[i].reg_size;
+		size_t pgs = bin_infos[i].slab_size >> LG_PAGE;
+		/* Same bounds as sc_data_update_slab_size() enforces. */
+		size_t min_pgs = (reg_size + PAGE - 1) >> LG_PAGE;
+		size_t max_pgs = BITMAP_MAXBITS * reg_size / PAGE;
+		for (unsigned j = 0; j < BIN_SLAB_NSIZES; j++) {
+			size_t try_pgs = (j < BIN_SLAB_SIZE_DEFAULT) ?
+			    pgs >> (BIN_SLAB_SIZE_DEFAULT - j) :
+			    pgs << (j - BIN_SLAB_SIZE_DEFAULT);
+			if (try_pgs < min_pgs) {
+				try_pgs = min_pgs;
+			} else if (try_pgs > max_pgs) {
+				try_pgs = max_pgs;
+			}
+			if (j == BIN_SLAB_SIZE_DEFAULT) {
+				try_pgs = pgs;
+			}
+			bin_slab_info_init(&bin_slab_infos[i][j], reg_size,
+			    try_pgs);
+		}
+	}
+}
+
 void
 bin_info_boot(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS]) {
 	assert(sc_data->initialized);
 	bin_infos_init(sc_data, bin_shard_sizes, bin_infos);
+	if (opt_slab_autotune && !config_stats) {
+		opt_slab_autotune = false;
+		malloc_write("<jemalloc>: slab_autotune requires stats "
+		    "support.  Using fixed slab sizes.\n");
+		if (opt_abort) {
+			abort();
+		}
+	}
+	if (opt_slab_autotune) {
+		bin_slab_infos_init(bin_infos, bin_slab_infos);
+	}
 }
@@ -8,6 +8,8 @@
 #include "jemalloc/internal/extent_mmap.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/nstime.h"
+#include "jemalloc/internal/pressure.h"
+#include "jemalloc/internal/slab_map.h"
 #include "jemalloc/internal/sc.h"
 #include "jemalloc/internal/util.h"
 
@@ -67,6 +69,8 @@ CTL_PROTO(thread_allocated)
 CTL_PROTO(thread_allocatedp)
 CTL_PROTO(thread_deallocated)
 CTL_PROTO(thread_deallocatedp)
+CTL_PROTO(thread_rtree_ctx_nhits_l2)
+CTL_PROTO(thread_rtree_ctx_nmisses)
 CTL_PROTO(config_cache_oblivious)
 CTL_PROTO(config_debug)
 CTL_PROTO(config_fill)
@@ -101,7 +105,22 @@ CTL_PROTO(opt_xmalloc)
 CTL_PROTO(opt_tcache)
 CTL_PROTO(opt_thp)
 CTL_PROTO(opt_lg_extent_max_active_fit)
+CTL_PROTO(opt_slab_autotune)
+CTL_PROTO(opt_bin_stash)
+CTL_PROTO(opt_bin_shards_max)
+CTL_PROTO(opt_hpa)
+CTL_PROTO(opt_lazy_coalesce)
+CTL_PROTO(opt_extent_best_fit)
+CTL_PROTO(opt_decay_curve)
+CTL_PROTO(opt_pressure_purge)
+CTL_PROTO(opt_dirty_max)
+CTL_PROTO(opt_rtree_flat)
+CTL_PROTO(opt_slab_map)
 CTL_PROTO(opt_lg_tcache_max)
+CTL_PROTO(opt_tcache_adaptive)
+CTL_PROTO(opt_tcache_bytes_max)
+CTL_PROTO(opt_tcache_global_bytes_max)
+CTL_PROTO(opt_percpu_tcache)
 CTL_PROTO(opt_prof)
 CTL_PROTO(opt_prof_prefix)
 CTL_PROTO(opt_prof_active)
@@ -124,6 +143,7 @@ CTL_PROTO(arena_i_destroy)
 CTL_PROTO(arena_i_dss)
 CTL_PROTO(arena_i_dirty_decay_ms)
 CTL_PROTO(arena_i_muzzy_decay_ms)
+CTL_PROTO(arena_i_decay_curve)
 CTL_PROTO(arena_i_extent_hooks)
 CTL_PROTO(arena_i_retain_grow_limit)
 INDEX_PROTO(arena_i)
@@ -177,6 +197,7 @@ CTL_PROTO(stats_arenas_i_bins_j_nslabs)
 CTL_PROTO(stats_arenas_i_bins_j_nreslabs)
 CTL_PROTO(stats_arenas_i_bins_j_curslabs)
 CTL_PROTO(stats_arenas_i_bins_j_nonfull_slabs)
+CTL_PROTO(stats_arenas_i_bins_j_nshards)
 INDEX_PROTO(stats_arenas_i_bins_j)
 CTL_PROTO(stats_arenas_i_lextents_j_nmalloc)
 CTL_PROTO(stats_arenas_i_lextents_j_ndalloc)
@@ -190,6 +211,15 @@ CTL_PROTO(stats_arenas_i_extents_j_dirty_bytes)
 CTL_PROTO(stats_arenas_i_extents_j_muzzy_bytes)
 CTL_PROTO(stats_arenas_i_extents_j_retained_bytes)
 INDEX_PROTO(stats_arenas_i_extents_j)
+CTL_PROTO(stats_arenas_i_decay_hist_j_dirty_npurge)
+CTL_PROTO(stats_arenas_i_decay_hist_j_dirty_npurge_app)
+CTL_PROTO(stats_arenas_i_decay_hist_j_dirty_nlocked)
+CTL_PROTO(stats_arenas_i_decay_hist_j_dirty_nmadvise)
+CTL_PROTO(stats_arenas_i_decay_hist_j_muzzy_npurge)
+CTL_PROTO(stats_arenas_i_decay_hist_j_muzzy_npurge_app)
+CTL_PROTO(stats_arenas_i_decay_hist_j_muzzy_nlocked)
+CTL_PROTO(stats_arenas_i_decay_hist_j_muzzy_nmadvise)
+INDEX_PROTO(stats_arenas_i_decay_hist_j)
 CTL_PROTO(stats_arenas_i_nthreads)
 CTL_PROTO(stats_arenas_i_uptime)
 CTL_PROTO(stats_arenas_i_dss)
@@ -225,12 +255,16 @@ CTL_PROTO(stats_resident)
 CTL_PROTO(stats_mapped)
 CTL_PROTO(stats_retained)
 CTL_PROTO(stats_zero_reallocs)
+CTL_PROTO(stats_rtree_ctx_nhits_l2)
+CTL_PROTO(stats_rtree_ctx_nmisses)
 CTL_PROTO(experimental_hooks_install)
 CTL_PROTO(experimental_hooks_remove)
 CTL_PROTO(experimental_utilization_query)
 CTL_PROTO(experimental_utilization_batch_query)
 CTL_PROTO(experimental_arenas_i_pactivep)
 INDEX_PROTO(experimental_arenas_i)
+CTL_PROTO(experimental_batch_alloc)
+CTL_PROTO(experimental_batch_free)
 
 #define MUTEX_STATS_CTL_PROTO_GEN(n)					\
 CTL_PROTO(stats_##n##_num_ops)						\
@@ -283,6 +317,11 @@ static const ctl_named_node_t	thread_prof_node[] = {
 	{NAME("active"),	CTL(thread_prof_active)}
 };
 
+static const ctl_named_node_t	thread_rtree_ctx_node[] = {
+	{NAME("nhits_l2"),	CTL(thread_rtree_ctx_nhits_l2)},
+	{NAME("nmisses"),	CTL(thread_rtree_ctx_nmisses)}
+};
+
 static const ctl_named_node_t	thread_node[] = {
 	{NAME("arena"),		CTL(thread_arena)},
 	{NAME("allocated"),	CTL(thread_allocated)},
@@ -290,7 +329,8 @@ static const ctl_named_node_t	thread_node[] = {
 	{NAME("deallocated"),	CTL(thread_deallocated)},
 	{NAME("deallocatedp"),	CTL(thread_deallocatedp)},
 	{NAME("tcache"),	CHILD(named, thread_tcache)},
-	{NAME("prof"),		CHILD(named, thread_prof)}
+	{NAME("prof"),		CHILD(named, thread_prof)},
+	{NAME("rtree_ctx"),	CHILD(named, thread_rtree_ctx)}
 };
 
 static const ctl_named_node_t	config_node[] = {
@@ -331,7 +371,22 @@ static const ctl_named_node_t opt_node[] = {
 	{NAME("tcache"),	CTL(opt_tcache)},
 	{NAME("thp"),		CTL(opt_thp)},
 	{NAME("lg_extent_max_active_fit"), CTL(opt_lg_extent_max_active_fit)},
+	{NAME("slab_autotune"),	CTL(opt_slab_autotune)},
+	{NAME("bin_stash"),	CTL(opt_bin_stash)},
+	{NAME("bin_shards_max"),	CTL(opt_bin_shards_max)},
+	{NAME("hpa"),		CTL(opt_hpa)},
+	{NAME("lazy_coalesce"),	CTL(opt_lazy_coalesce)},
+	{NAME("extent_best_fit"),	CTL(opt_extent_best_fit)},
+	{NAME("decay_curve"),	CTL(opt_decay_curve)},
+	{NAME("pressure_purge"),	CTL(opt_pressure_purge)},
+	{NAME("dirty_max"),	CTL(opt_dirty_max)},
+	{NAME("rtree_flat"),	CTL(opt_rtree_flat)},
+	{NAME("slab_map"),	CTL(opt_slab_map)},
 	{NAME("lg_tcache_max"),	CTL(opt_lg_tcache_max)},
+	{NAME("tcache_adaptive"),	CTL(opt_tcache_adaptive)},
+	{NAME("tcache_bytes_max"),	CTL(opt_tcache_bytes_max)},
+	{NAME("tcache_global_bytes_max"),	CTL(opt_tcache_global_bytes_max)},
+	{NAME("percpu_tcache"),	CTL(opt_percpu_tcache)},
 	{NAME("prof"),		CTL(opt_prof)},
 	{NAME("prof_prefix"),	CTL(opt_prof_prefix)},
 	{NAME("prof_active"),	CTL(opt_prof_active)},
@@ -360,6 +415,7 @@ static const ctl_named_node_t arena_i_node[] = {
 	{NAME("dss"),		CTL(arena_i_dss)},
 	{NAME("dirty_decay_ms"), CTL(arena_i_dirty_decay_ms)},
 	{NAME("muzzy_decay_ms"), CTL(arena_i_muzzy_decay_ms)},
+	{NAME("decay_curve"),	CTL(arena_i_decay_curve)},
 	{NAME("extent_hooks"),	CTL(arena_i_extent_hooks)},
 	{NAME("retain_grow_limit"),	CTL(arena_i_retain_grow_limit)}
 };
@@ -474,6 +530,7 @@ static const ctl_named_node_t stats_arenas_i_bins_j_node[] = {
 	{NAME("nreslabs"),	CTL(stats_arenas_i_bins_j_nreslabs)},
 	{NAME("curslabs"),	CTL(stats_arenas_i_bins_j_curslabs)},
 	{NAME("nonfull_slabs"),	CTL(stats_arenas_i_bins_j_nonfull_slabs)},
+	{NAME("nshards"),	CTL(stats_arenas_i_bins_j_nshards)},
 	{NAME("mutex"),		CHILD(named, stats_arenas_i_bins_j_mutex)}
 };
 
@@ -516,6 +573,28 @@ static const ctl_indexed_node_t stats_arenas_i_extents_node[] = {
 	{INDEX(stats_arenas_i_extents_j)}
 };
 
+static const ctl_named_node_t stats_arenas_i_decay_hist_j_node[] = {
+	{NAME("dirty_npurge"),	CTL(stats_arenas_i_decay_hist_j_dirty_npurge)},
+	{NAME("dirty_npurge_app"),
+	    CTL(stats_arenas_i_decay_hist_j_dirty_npurge_app)},
+	{NAME("dirty_nlocked"),	CTL(stats_arenas_i_decay_hist_j_dirty_nlocked)},
+	{NAME("dirty_nmadvise"),
+	    CTL(stats_arenas_i_decay_hist_j_dirty_nmadvise)},
+	{NAME("muzzy_npurge"),	CTL(stats_arenas_i_decay_hist_j_muzzy_npurge)},
+	{NAME("muzzy_npurge_app"),
+	    CTL(stats_arenas_i_decay_hist_j_muzzy_npurge_app)},
+	{NAME("muzzy_nlocked"),	CTL(stats_arenas_i_decay_hist_j_muzzy_nlocked)},
+	{NAME("muzzy_nmadvise"),
+	    CTL(stats_arenas_i_decay_hist_j_muzzy_nmadvise)}
+};
+static const ctl_named_node_t super_stats_arenas_i_decay_hist_j_node[] = {
+	{NAME(""),		CHILD(named, stats_arenas_i_decay_hist_j)}
+};
+
+static const ctl_indexed_node_t stats_arenas_i_decay_hist_node[] = {
+	{INDEX(stats_arenas_i_decay_hist_j)}
+};
+
 #define OP(mtx)  MUTEX_PROF_DATA_NODE(arenas_i_mutexes_##mtx)
 MUTEX_PROF_ARENA_MUTEXES
 #undef OP
@@ -555,6 +634,7 @@ static const ctl_named_node_t stats_arenas_i_node[] = {
 	{NAME("bins"),		CHILD(indexed, stats_arenas_i_bins)},
 	{NAME("lextents"),	CHILD(indexed, stats_arenas_i_lextents)},
 	{NAME("extents"),	CHILD(indexed, stats_arenas_i_extents)},
+	{NAME("decay_hist"),	CHILD(indexed, stats_arenas_i_decay_hist)},
 	{NAME("mutexes"),	CHILD(named, stats_arenas_i_mutexes)}
 };
 static const ctl_named_node_t super_stats_arenas_i_node[] = {
@@ -583,6 +663,11 @@ MUTEX_PROF_GLOBAL_MUTEXES
 };
 #undef MUTEX_PROF_DATA_NODE
 
+static const ctl_named_node_t stats_rtree_ctx_node[] = {
+	{NAME("nhits_l2"),	CTL(stats_rtree_ctx_nhits_l2)},
+	{NAME("nmisses"),	CTL(stats_rtree_ctx_nmisses)}
+};
+
 static const ctl_named_node_t stats_node[] = {
 	{NAME("allocated"),	CTL(stats_allocated)},
 	{NAME("active"),	CTL(stats_active)},
@@ -596,6 +681,7 @@ static const ctl_named_node_t stats_node[] = {
 	{NAME("mutexes"),	CHILD(named, stats_mutexes)},
 	{NAME("arenas"),	CHILD(indexed, stats_arenas)},
 	{NAME("zero_reallocs"),	CTL(stats_zero_reallocs)},
+	{NAME("rtree_ctx"),	CHILD(named, stats_rtree_ctx)}
 };
 
 static const ctl_named_node_t experimental_hooks_node[] = {
@@ -622,7 +708,9 @@ static const ctl_indexed_node_t experimental_arenas_node[] = {
 static const ctl_named_node_t experimental_node[] = {
 	{NAME("hooks"),		CHILD(named, experimental_hooks)},
 	{NAME("utilization"),	CHILD(named, experimental_utilization)},
-	{NAME("arenas"),	CHILD(indexed, experimental_arenas)}
+	{NAME("arenas"),	CHILD(indexed, experimental_arenas)},
+	{NAME("batch_alloc"),	CTL(experimental_batch_alloc)},
+	{NAME("batch_free"),	CTL(experimental_batch_free)}
 };
 
 static const ctl_named_node_t	root_node[] = {
@@ -683,6 +771,24 @@ accum_atomic_zu(atomic_zu_t *dst, atomic_zu_t *src) {
 	atomic_store_zu(dst, cur_dst + cur_src, ATOMIC_RELAXED);
 }
 
+static void
+ctl_accum_arena_stats_decay(arena_stats_decay_t *dst,
+    arena_stats_decay_t *src) {
+	ctl_accum_arena_stats_u64(&dst->npurge, &src->npurge);
+	ctl_accum_arena_stats_u64(&dst->nmadvise, &src->nmadvise);
+	ctl_accum_arena_stats_u64(&dst->purged, &src->purged);
+	for (unsigned i = 0; i < ARENA_DECAY_NHIST; i++) {
+		ctl_accum_arena_stats_u64(&dst->npurge_hist[i],
+		    &src->npurge_hist[i]);
+		ctl_accum_arena_stats_u64(&dst->npurge_app_hist[i],
+		    &src->npurge_app_hist[i]);
+		ctl_accum_arena_stats_u64(&dst->nlocked_hist[i],
+		    &src->nlocked_hist[i]);
+		ctl_accum_arena_stats_u64(&dst->nmadvise_hist[i],
+		    &src->nmadvise_hist[i]);
+	}
+}
+
 /******************************************************************************/
 
 static unsigned
@@ -862,19 +968,10 @@ ctl_arena_stats_sdmerge(ctl_arena_t *ctl_sdarena, ctl_arena_t *ctl_arena,
 			    &astats->astats.extent_avail);
 		}
 
-		ctl_accum_arena_stats_u64(&sdstats->astats.decay_dirty.npurge,
-		    &astats->astats.decay_dirty.npurge);
-		ctl_accum_arena_stats_u64(&sdstats->astats.decay_dirty.nmadvise,
-		    &astats->astats.decay_dirty.nmadvise);
-		ctl_accum_arena_stats_u64(&sdstats->astats.decay_dirty.purged,
-		    &astats->astats.decay_dirty.purged);
-
-		ctl_accum_arena_stats_u64(&sdstats->astats.decay_muzzy.npurge,
-		    &astats->astats.decay_muzzy.npurge);
-		ctl_accum_arena_stats_u64(&sdstats->astats.decay_muzzy.nmadvise,
-		    &astats->astats.decay_muzzy.nmadvise);
-		ctl_accum_arena_stats_u64(&sdstats->astats.decay_muzzy.purged,
-		    &astats->astats.decay_muzzy.purged);
+		ctl_accum_arena_stats_decay(&sdstats->astats.decay_dirty,
+		    &astats->astats.decay_dirty);
+		ctl_accum_arena_stats_decay(&sdstats->astats.decay_muzzy,
+		    &astats->astats.decay_muzzy);
 
 #define OP(mtx) malloc_mutex_prof_merge(				\
 		    &(sdstats->astats.mutex_prof_data[			\
@@ -955,6 +1052,12 @@ MUTEX_PROF_ARENA_MUTEXES
 				    astats->bstats[i].curslabs;
 				sdstats->bstats[i].nonfull_slabs +=
 				    astats->bstats[i].nonfull_slabs;
+				/* Shards are per arena, so the max is kept. */
+				if (astats->bstats[i].nshards >
+				    sdstats->bstats[i].nshards) {
+					sdstats->bstats[i].nshards =
+					    astats->bstats[i].nshards;
+				}
 			} else {
 				assert(astats->bstats[i].curslabs == 0);
 				assert(astats->bstats[i].nonfull_slabs == 0);
@@ -1097,6 +1200,8 @@ ctl_refresh(tsdn_t *tsdn) {
 		    &ctl_sarena->astats->astats.retained, ATOMIC_RELAXED);
 
 		ctl_background_thread_stats_read(tsdn);
+		tsd_rtree_ctx_stats_read(tsdn, &ctl_stats->rtree_ctx_nhits_l2,
+		    &ctl_stats->rtree_ctx_nmisses);
 
 #define READ_GLOBAL_MUTEX_PROF_DATA(i, mtx)				\
     malloc_mutex_lock(tsdn, &mtx);					\
@@ -1785,7 +1890,24 @@ CTL_RO_NL_GEN(opt_tcache, opt_tcache, bool)
 CTL_RO_NL_GEN(opt_thp, thp_mode_names[opt_thp], const char *)
 CTL_RO_NL_GEN(opt_lg_extent_max_active_fit, opt_lg_extent_max_active_fit,
     size_t)
+CTL_RO_NL_GEN(opt_slab_autotune, opt_slab_autotune, bool)
+CTL_RO_NL_GEN(opt_bin_stash, opt_bin_stash, unsigned)
+CTL_RO_NL_GEN(opt_bin_shards_max, opt_bin_shards_max, unsigned)
+CTL_RO_NL_GEN(opt_hpa, opt_hpa, bool)
+CTL_RO_NL_GEN(opt_lazy_coalesce, opt_lazy_coalesce, bool)
+CTL_RO_NL_GEN(opt_extent_best_fit, opt_extent_best_fit, bool)
+CTL_RO_NL_GEN(opt_decay_curve, decay_curve_names[opt_decay_curve],
+    const char *)
+CTL_RO_NL_GEN(opt_pressure_purge, opt_pressure_purge, bool)
+CTL_RO_NL_GEN(opt_dirty_max, opt_dirty_max, size_t)
+CTL_RO_NL_GEN(opt_rtree_flat, opt_rtree_flat, bool)
+CTL_RO_NL_GEN(opt_slab_map, opt_slab_map, bool)
 CTL_RO_NL_GEN(opt_lg_tcache_max, opt_lg_tcache_max, ssize_t)
+CTL_RO_NL_GEN(opt_tcache_adaptive, opt_tcache_adaptive, bool)
+CTL_RO_NL_GEN(opt_tcache_bytes_max, opt_tcache_bytes_max, size_t)
+CTL_RO_NL_GEN(opt_tcache_global_bytes_max, opt_tcache_global_bytes_max,
+    size_t)
+CTL_RO_NL_GEN(opt_percpu_tcache, opt_percpu_tcache, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof, opt_prof, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_prefix, opt_prof_prefix, const char *)
 CTL_RO_NL_CGEN(config_prof, opt_prof_active, opt_prof_active, bool)
@@ -1862,6 +1984,10 @@ CTL_RO_NL_GEN(thread_allocated, tsd_thread_allocated_get(tsd), uint64_t)
 CTL_RO_NL_GEN(thread_allocatedp, tsd_thread_allocatedp_get(tsd), uint64_t *)
 CTL_RO_NL_GEN(thread_deallocated, tsd_thread_deallocated_get(tsd), uint64_t)
 CTL_RO_NL_GEN(thread_deallocatedp, tsd_thread_deallocatedp_get(tsd), uint64_t *)
+CTL_RO_NL_CGEN(config_stats, thread_rtree_ctx_nhits_l2,
+    rtree_ctx_stat_read(&tsd_rtree_ctx(tsd)->nhits_l2), uint64_t)
+CTL_RO_NL_CGEN(config_stats, thread_rtree_ctx_nmisses,
+    rtree_ctx_stat_read(&tsd_rtree_ctx(tsd)->nmisses), uint64_t)
 
 static int
 thread_tcache_enabled_ctl(tsd_t *tsd, const size_t *mib,
@@ -1891,7 +2017,9 @@ thread_tcache_flush_ctl(tsd_t *tsd, const size_t *mib,
     size_t newlen) {
 	int ret;
 
-	if (!tcache_available(tsd)) {
+	/* Without a tcache of its own, a thread uses the per-CPU caches. */
+	bool percpu = !tcache_available(tsd);
+	if (percpu && !opt_percpu_tcache) {
 		ret = EFAULT;
 		goto label_return;
 	}
@@ -1899,7 +2027,11 @@ thread_tcache_flush_ctl(tsd_t *tsd, const size_t *mib,
 	READONLY();
 	WRITEONLY();
 
-	tcache_flush(tsd);
+	if (percpu) {
+		tcache_percpu_flush(tsd);
+	} else {
+		tcache_flush(tsd);
+	}
 
 	ret = 0;
 label_return:
@@ -2366,6 +2498,59 @@ arena_i_muzzy_decay_ms_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
 	    newlen, false);
 }
 
+static int
+arena_i_decay_curve_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
+    void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+	const char *decay_curve = NULL;
+	unsigned arena_ind;
+	decay_curve_t curve_old;
+	decay_curve_t curve = decay_curve_names_limit;
+
+	malloc_mutex_lock(tsd_tsdn(tsd), &ctl_mtx);
+	WRITE(decay_curve, const char *);
+	MIB_UNSIGNED(arena_ind, 1);
+	if (decay_curve != NULL) {
+		int i;
+		for (i = 0; i < decay_curve_names_limit; i++) {
+			if (strcmp(decay_curve_names[i], decay_curve) == 0) {
+				curve = i;
+				break;
+			}
+		}
+		if (curve == decay_curve_names_limit) {
+			ret = EINVAL;
+			goto label_return;
+		}
+	}
+
+	if (arena_ind == MALLCTL_ARENAS_ALL) {
+		/* Set the default for arenas created from now on. */
+		if (curve != decay_curve_names_limit &&
+		    arena_decay_curve_default_set(curve)) {
+			ret = EFAULT;
+			goto label_return;
+		}
+		curve_old = arena_decay_curve_default_get();
+	} else {
+		arena_t *arena = arena_get(tsd_tsdn(tsd), arena_ind, false);
+		if (arena == NULL || (curve != decay_curve_names_limit &&
+		    arena_decay_curve_set(tsd_tsdn(tsd), arena, curve))) {
+			ret = EFAULT;
+			goto label_return;
+		}
+		curve_old = arena_decay_curve_get(arena);
+	}
+
+	decay_curve = decay_curve_names[curve_old];
+	READ(decay_curve, const char *);
+
+	ret = 0;
+label_return:
+	malloc_mutex_unlock(tsd_tsdn(tsd), &ctl_mtx);
+	return ret;
+}
+
 static int
 arena_i_extent_hooks_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
     void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
@@ -2846,6 +3031,11 @@ CTL_RO_CGEN(config_stats, stats_background_thread_run_interval,
 CTL_RO_CGEN(config_stats, stats_zero_reallocs,
     atomic_load_zu(&zero_realloc_count, ATOMIC_RELAXED), size_t)
 
+CTL_RO_CGEN(config_stats, stats_rtree_ctx_nhits_l2,
+    ctl_stats->rtree_ctx_nhits_l2, uint64_t)
+CTL_RO_CGEN(config_stats, stats_rtree_ctx_nmisses,
+    ctl_stats->rtree_ctx_nmisses, uint64_t)
+
 CTL_RO_GEN(stats_arenas_i_dss, arenas_i(mib[2])->dss, const char *)
 CTL_RO_GEN(stats_arenas_i_dirty_decay_ms, arenas_i(mib[2])->dirty_decay_ms,
     ssize_t)
@@ -3024,7 +3214,8 @@ stats_mutexes_reset_ctl(tsd_t *tsd, const size_t *mib,
 		MUTEX_PROF_RESET(arena->base->mtx);
 
 		for (szind_t i = 0; i < SC_NBINS; i++) {
-			for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+			for (unsigned j = 0;
+			    j < bins_nshards_get(&arena->bins[i]); j++) {
 				bin_t *bin = &arena->bins[i].bin_shards[j];
 				MUTEX_PROF_RESET(bin->lock);
 			}
@@ -3054,6 +3245,8 @@ CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_curslabs,
     arenas_i(mib[2])->astats->bstats[mib[4]].curslabs, size_t)
 CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_nonfull_slabs,
     arenas_i(mib[2])->astats->bstats[mib[4]].nonfull_slabs, size_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_nshards,
+    arenas_i(mib[2])->astats->bstats[mib[4]].nshards, uint32_t)
 
 static const ctl_named_node_t *
 stats_arenas_i_bins_j_index(tsdn_t *tsdn, const size_t *mib,
@@ -3119,6 +3312,48 @@ stats_arenas_i_extents_j_index(tsdn_t *tsdn, const size_t *mib,
 	return super_stats_arenas_i_extents_j_node;
 }
 
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_dirty_npurge,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_dirty.npurge_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_dirty_npurge_app,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_dirty.npurge_app_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_dirty_nlocked,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_dirty.nlocked_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_dirty_nmadvise,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_dirty.nmadvise_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_muzzy_npurge,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_muzzy.npurge_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_muzzy_npurge_app,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_muzzy.npurge_app_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_muzzy_nlocked,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_muzzy.nlocked_hist[mib[4]]),
+    uint64_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_decay_hist_j_muzzy_nmadvise,
+    ctl_arena_stats_read_u64(
+    &arenas_i(mib[2])->astats->astats.decay_muzzy.nmadvise_hist[mib[4]]),
+    uint64_t)
+
+static const ctl_named_node_t *
+stats_arenas_i_decay_hist_j_index(tsdn_t *tsdn, const size_t *mib,
+    size_t miblen, size_t j) {
+	if (j >= ARENA_DECAY_NHIST) {
+		return NULL;
+	}
+	return super_stats_arenas_i_decay_hist_j_node;
+}
+
 static bool
 ctl_arenas_i_verify(size_t i) {
 	size_t a = arenas_i2a_impl(i, true, true);
@@ -3464,3 +3699,101 @@ label_return:
 	malloc_mutex_unlock(tsd_tsdn(tsd), &ctl_mtx);
 	return ret;
 }
+
+/*
+ * Allocate a batch of same-sized objects with a single call.  The input is a
+ * batch_alloc_packet_t passed in via newp, and the number of objects actually
+ * allocated is returned as a size_t via oldp, e.g.:
+ *
+ *     batch_alloc_packet_t packet = {ptrs, num, size, flags};
+ *     size_t filled;
+ *     size_t len = sizeof(size_t);
+ *     mallctl("experimental.batch_alloc", &filled, &len, &packet,
+ *         sizeof(packet));
+ *
+ * size must be non-zero, and flags are interpreted as for mallocx().  On
+ * success, ptrs[0 .. filled) hold the allocations; filled < num indicates OOM.
+ * Each allocation can be freed individually in the usual ways.
+ *
+ * Like the hooks interface above, the packet layout is private and may change
+ * at any time.
+ */
+typedef struct batch_alloc_packet_s batch_alloc_packet_t;
+struct batch_alloc_packet_s {
+	void **ptrs;
+	size_t num;
+	size_t size;
+	int flags;
+};
+
+static int
+experimental_batch_alloc_ctl(tsd_t *tsd, const size_t *mib,
+    size_t miblen, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+
+	if (oldp == NULL || oldlenp == NULL || *oldlenp != sizeof(size_t) ||
+	    newp == NULL || newlen != sizeof(batch_alloc_packet_t)) {
+		ret = EINVAL;
+		goto label_return;
+	}
+
+	batch_alloc_packet_t packet;
+	WRITE(packet, batch_alloc_packet_t);
+	if (packet.ptrs == NULL || packet.size == 0) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	size_t filled = batch_alloc(tsd, packet.ptrs, packet.num, packet.size,
+	    packet.flags);
+	READ(filled, size_t);
+	ret = 0;
+
+label_return:
+	return ret;
+}
+
+/*
+ * Free a batch of pointers with a single call; the counterpart of
+ * experimental.batch_alloc.  The input is a batch_free_packet_t passed in via
+ * newp, e.g.:
+ *
+ *     batch_free_packet_t packet = {ptrs, num, size};
+ *     mallctl("experimental.batch_free", NULL, NULL, &packet,
+ *         sizeof(packet));
+ *
+ * NULL entries in ptrs are skipped.  size may be 0 if the pointers were not
+ * all allocated with the same size; otherwise it is the size passed at
+ * allocation time, as for sdallocx().  Small objects are returned directly to
+ * their arena bins, taking each bin lock once per group of pointers that
+ * belong to it.
+ */
+typedef struct batch_free_packet_s batch_free_packet_t;
+struct batch_free_packet_s {
+	void **ptrs;
+	size_t num;
+	size_t size;
+};
+
+static int
+experimental_batch_free_ctl(tsd_t *tsd, const size_t *mib,
+    size_t miblen, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+
+	WRITEONLY();
+	if (newp == NULL || newlen != sizeof(batch_free_packet_t)) {
+		ret = EINVAL;
+		goto label_return;
+	}
+
+	batch_free_packet_t packet;
+	WRITE(packet, batch_free_packet_t);
+	if (packet.ptrs == NULL) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	batch_free(tsd, packet.ptrs, packet.num, packet.size);
+	ret = 0;
+
+label_return:
+	return ret;
+}
@@ -5,9 +5,6 @@
 /* For opt_retain */
 #include "jemalloc/internal/extent_mmap.h"
 
-const bitmap_info_t eset_bitmap_info =
-    BITMAP_INFO_INITIALIZER(SC_NPSIZES+1);
-
 bool
 eset_init(tsdn_t *tsdn, eset_t *eset, extent_state_t state,
     bool delay_coalesce) {
@@ -15,11 +12,21 @@ eset_init(tsdn_t *tsdn, eset_t *eset, extent_state_t state,
 	    malloc_mutex_rank_exclusive)) {
 		return true;
 	}
-	for (unsigned i = 0; i < SC_NPSIZES + 1; i++) {
+	for (unsigned i = 0; i < ESET_NRANGES; i++) {
+		eset_range_t *range = &eset->ranges[i];
+		if (malloc_mutex_init(&range->mtx, "extents_range",
+		    WITNESS_RANK_EXTENTS_RANGE, malloc_mutex_rank_exclusive)) {
+			return true;
+		}
+		extent_list_init(&range->lru);
+	}
+	for (unsigned i = 0; i < ESET_NHEAPS; i++) {
 		extent_heap_new(&eset->heaps[i]);
 	}
-	bitmap_init(eset->bitmap, &eset_bitmap_info, true);
-	extent_list_init(&eset->lru);
+	for (unsigned i = 0; i < ESET_SUMMARY_NWORDS; i++) {
+		atomic_store_zu(&eset->summary[i], 0, ATOMIC_RELAXED);
+	}
+	eset->seq = 0;
 	atomic_store_zu(&eset->npages, 0, ATOMIC_RELAXED);
 	eset->state = state;
 	eset->delay_coalesce = delay_coalesce;
@@ -46,6 +53,10 @@ eset_nbytes_get(eset_t *eset, pszind_t pind) {
 	return atomic_load_zu(&eset->nbytes[pind], ATOMIC_RELAXED);
 }
 
+/*
+ * The heaps of a range are only modified with the range locked, so stats
+ * updates can get by with a load followed by a store.
+ */
 static void
 eset_stats_add(eset_t *eset, pszind_t pind, size_t sz) {
 	size_t cur = atomic_load_zu(&eset->nextents[pind], ATOMIC_RELAXED);
@@ -62,17 +73,81 @@ eset_stats_sub(eset_t *eset, pszind_t pind, size_t sz) {
 	atomic_store_zu(&eset->nbytes[pind], cur - sz, ATOMIC_RELAXED);
 }
 
+static pszind_t
+eset_extent_pind(const extent_t *extent) {
+	size_t psz = sz_psz_quantize_floor(extent_size_get(extent));
+	return sz_psz2ind(psz);
+}
+
+static eset_range_t *
+eset_range_get(eset_t *eset, pszind_t pind) {
+	assert(pind < ESET_NHEAPS);
+	return &eset->ranges[pind >> ESET_LG_RANGE_NHEAPS];
+}
+
+static void
+eset_summary_set(eset_t *eset, pszind_t pind) {
+	atomic_fetch_or_zu(&eset->summary[pind >> ESET_LG_SUMMARY_WORD_NBITS],
+	    ZU(1) << (pind & ((ZU(1) << ESET_LG_SUMMARY_WORD_NBITS) - 1)),
+	    ATOMIC_RELAXED);
+}
+
+static void
+eset_summary_unset(eset_t *eset, pszind_t pind) {
+	atomic_fetch_and_zu(&eset->summary[pind >> ESET_LG_SUMMARY_WORD_NBITS],
+	    ~(ZU(1) << (pind & ((ZU(1) << ESET_LG_SUMMARY_WORD_NBITS) - 1))),
+	    ATOMIC_RELAXED);
+}
+
+/*
+ * Returns the index of the first heap at or after pind that was non-empty
+ * when looked at, or ESET_NHEAPS if there is none.  The heap must be checked
+ * again once its range is locked.
+ */
+static pszind_t
+eset_summary_ffs(eset_t *eset, pszind_t pind) {
+	size_t i = pind >> ESET_LG_SUMMARY_WORD_NBITS;
+	if (i >= ESET_SUMMARY_NWORDS) {
+		return ESET_NHEAPS;
+	}
+	size_t word = atomic_load_zu(&eset->summary[i], ATOMIC_RELAXED) &
+	    (~ZU(0) << (pind & ((ZU(1) << ESET_LG_SUMMARY_WORD_NBITS) - 1)));
+	while (word == 0) {
+		if (++i == ESET_SUMMARY_NWORDS) {
+			return ESET_NHEAPS;
+		}
+		word = atomic_load_zu(&eset->summary[i], ATOMIC_RELAXED);
+	}
+	return (pszind_t)((i << ESET_LG_SUMMARY_WORD_NBITS) + ffs_zu(word) -
+	    1);
+}
+
 void
-eset_insert_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent) {
-	malloc_mutex_assert_owner(tsdn, &eset->mtx);
-	assert(extent_state_get(extent) == eset->state);
+eset_lock_extent(tsdn_t *tsdn, eset_t *eset, const extent_t *extent) {
+	malloc_mutex_lock(tsdn,
+	    &eset_range_get(eset, eset_extent_pind(extent))->mtx);
+}
+
+void
+eset_unlock_extent(tsdn_t *tsdn, eset_t *eset, const extent_t *extent) {
+	malloc_mutex_unlock(tsdn,
+	    &eset_range_get(eset, eset_extent_pind(extent))->mtx);
+}
+
+void
+eset_insert(tsdn_t *tsdn, eset_t *eset, extent_t *extent) {
+	assert(extent_state_get(extent) == extent_state_active);
 
 	size_t size = extent_size_get(extent);
-	size_t psz = sz_psz_quantize_floor(size);
-	pszind_t pind = sz_psz2ind(psz);
+	pszind_t pind = eset_extent_pind(extent);
+	eset_range_t *range = eset_range_get(eset, pind);
+	malloc_mutex_assert_owner(tsdn, &eset->mtx);
+
+	malloc_mutex_lock(tsdn, &range->mtx);
+	extent_state_set(extent, eset->state);
+	extent_eset_seq_set(extent, eset->seq++);
 	if (extent_heap_empty(&eset->heaps[pind])) {
-		bitmap_unset(eset->bitmap, &eset_bitmap_info,
-		    (size_t)pind);
+		eset_summary_set(eset, pind);
 	}
 	extent_heap_insert(&eset->heaps[pind], extent);
 
@@ -80,27 +155,20 @@ eset_insert_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent) {
 		eset_stats_add(eset, pind, size);
 	}
 
-	extent_list_append(&eset->lru, extent);
-	size_t npages = size >> LG_PAGE;
-	/*
-	 * All modifications to npages hold the mutex (as asserted above), so we
-	 * don't need an atomic fetch-add; we can get by with a load followed by
-	 * a store.
-	 */
-	size_t cur_eset_npages =
-	    atomic_load_zu(&eset->npages, ATOMIC_RELAXED);
-	atomic_store_zu(&eset->npages, cur_eset_npages + npages,
-	    ATOMIC_RELAXED);
+	extent_list_append(&range->lru, extent);
+	atomic_fetch_add_zu(&eset->npages, size >> LG_PAGE, ATOMIC_RELAXED);
+	malloc_mutex_unlock(tsdn, &range->mtx);
 }
 
 void
 eset_remove_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent) {
-	malloc_mutex_assert_owner(tsdn, &eset->mtx);
 	assert(extent_state_get(extent) == eset->state);
 
 	size_t size = extent_size_get(extent);
-	size_t psz = sz_psz_quantize_floor(size);
-	pszind_t pind = sz_psz2ind(psz);
+	pszind_t pind = eset_extent_pind(extent);
+	eset_range_t *range = eset_range_get(eset, pind);
+	malloc_mutex_assert_owner(tsdn, &range->mtx);
+
 	extent_heap_remove(&eset->heaps[pind], extent);
 
 	if (config_stats) {
@@ -108,20 +176,13 @@ eset_remove_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent) {
 	}
 
 	if (extent_heap_empty(&eset->heaps[pind])) {
-		bitmap_set(eset->bitmap, &eset_bitmap_info,
-		    (size_t)pind);
-	}
-	extent_list_remove(&eset->lru, extent);
-	size_t npages = size >> LG_PAGE;
-	/*
-	 * As in eset_insert_locked, we hold eset->mtx and so don't need atomic
-	 * operations for updating eset->npages.
-	 */
-	size_t cur_extents_npages =
-	    atomic_load_zu(&eset->npages, ATOMIC_RELAXED);
-	assert(cur_extents_npages >= npages);
-	atomic_store_zu(&eset->npages,
-	    cur_extents_npages - (size >> LG_PAGE), ATOMIC_RELAXED);
+		eset_summary_unset(eset, pind);
+	}
+	extent_list_remove(&range->lru, extent);
+	assert(atomic_load_zu(&eset->npages, ATOMIC_RELAXED) >=
+	    (size >> LG_PAGE));
+	atomic_fetch_sub_zu(&eset->npages, size >> LG_PAGE, ATOMIC_RELAXED);
+	extent_state_set(extent, extent_state_active);
 }
 
 /*
@@ -129,17 +190,20 @@ eset_remove_locked(tsdn_t *tsdn, eset_t *eset, extent_t *extent) {
  * requirement.  For each size, try only the first extent in the heap.
  */
 static extent_t *
-eset_fit_alignment(eset_t *eset, size_t min_size, size_t max_size,
-    size_t alignment) {
+eset_fit_alignment(tsdn_t *tsdn, eset_t *eset, size_t min_size,
+    size_t max_size, size_t alignment) {
         pszind_t pind = sz_psz2ind(sz_psz_quantize_ceil(min_size));
         pszind_t pind_max = sz_psz2ind(sz_psz_quantize_ceil(max_size));
 
-	for (pszind_t i = (pszind_t)bitmap_ffu(eset->bitmap,
-	    &eset_bitmap_info, (size_t)pind); i < pind_max; i =
-	    (pszind_t)bitmap_ffu(eset->bitmap, &eset_bitmap_info,
-	    (size_t)i+1)) {
+	for (pszind_t i = eset_summary_ffs(eset, pind); i < pind_max;
+	    i = eset_summary_ffs(eset, i + 1)) {
 		assert(i < SC_NPSIZES);
-		assert(!extent_heap_empty(&eset->heaps[i]));
+		eset_range_t *range = eset_range_get(eset, i);
+		malloc_mutex_lock(tsdn, &range->mtx);
+		if (extent_heap_empty(&eset->heaps[i])) {
+			malloc_mutex_unlock(tsdn, &range->mtx);
+			continue;
+		}
 		extent_t *extent = extent_heap_first(&eset->heaps[i]);
 		uintptr_t base = (uintptr_t)extent_base_get(extent);
 		size_t candidate_size = extent_size_get(extent);
@@ -149,78 +213,160 @@ eset_fit_alignment(eset_t *eset, size_t min_size, size_t max_size,
 		    PAGE_CEILING(alignment));
 		if (base > next_align || base + candidate_size <= next_align) {
 			/* Overflow or not crossing the next alignment. */
+			malloc_mutex_unlock(tsdn, &range->mtx);
 			continue;
 		}
 
 		size_t leadsize = next_align - base;
 		if (candidate_size - leadsize >= min_size) {
+			eset_remove_locked(tsdn, eset, extent);
+			malloc_mutex_unlock(tsdn, &range->mtx);
 			return extent;
 		}
+		malloc_mutex_unlock(tsdn, &range->mtx);
 	}
 
 	return NULL;
 }
 
+static pszind_t
+eset_range_end(pszind_t pind) {
+	pszind_t range_end = ((pind >> ESET_LG_RANGE_NHEAPS) + 1) <<
+	    ESET_LG_RANGE_NHEAPS;
+	return range_end < ESET_NHEAPS ? range_end : ESET_NHEAPS;
+}
+
 /*
- * Do first-fit extent selection, i.e. select the oldest/lowest extent that is
- * large enough.
+ * Returns the oldest/lowest extent that is large enough in the heaps from pind
+ * to the end of its range, which the caller has locked, or NULL.  Sets
+ * *r_limited if the search stopped at the max active fit limit, which no later
+ * heap passes either.  With opt_extent_best_fit, returns the first extent that
+ * is large enough instead.
  */
 static extent_t *
-eset_first_fit_locked(tsdn_t *tsdn, eset_t *eset, size_t size) {
+eset_range_first_fit(eset_t *eset, pszind_t pind, size_t size,
+    bool *r_limited) {
+	pszind_t range_end = eset_range_end(pind);
 	extent_t *ret = NULL;
 
-	pszind_t pind = sz_psz2ind(sz_psz_quantize_ceil(size));
-
-	if (!maps_coalesce && !opt_retain) {
-		/*
-		 * No split / merge allowed (Windows w/o retain). Try exact fit
-		 * only.
-		 */
-		return extent_heap_empty(&eset->heaps[pind]) ? NULL :
-		    extent_heap_first(&eset->heaps[pind]);
-	}
-
-	for (pszind_t i = (pszind_t)bitmap_ffu(eset->bitmap,
-	    &eset_bitmap_info, (size_t)pind);
-	    i < SC_NPSIZES + 1;
-	    i = (pszind_t)bitmap_ffu(eset->bitmap, &eset_bitmap_info,
-	    (size_t)i+1)) {
-		assert(!extent_heap_empty(&eset->heaps[i]));
-		extent_t *extent = extent_heap_first(&eset->heaps[i]);
-		assert(extent_size_get(extent) >= size);
+	*r_limited = false;
+	for (pszind_t i = pind; i < range_end; i++) {
+		if (extent_heap_empty(&eset->heaps[i])) {
+			continue;
+		}
 		/*
-		 * In order to reduce fragmentation, avoid reusing and splitting
-		 * large eset for much smaller sizes.
+		 * In order to reduce fragmentation, avoid reusing and
+		 * splitting large eset for much smaller sizes.
 		 *
 		 * Only do check for dirty eset (delay_coalesce).
 		 */
 		if (eset->delay_coalesce &&
 		    (sz_pind2sz(i) >> opt_lg_extent_max_active_fit) > size) {
+			*r_limited = true;
 			break;
 		}
+		extent_t *extent = extent_heap_first(&eset->heaps[i]);
+		assert(extent_size_get(extent) >= size);
+		if (opt_extent_best_fit) {
+			return extent;
+		}
 		if (ret == NULL || extent_snad_comp(extent, ret) < 0) {
 			ret = extent;
 		}
-		if (i == SC_NPSIZES) {
-			break;
+	}
+	return ret;
+}
+
+/*
+ * Do first-fit extent selection, i.e. select the oldest/lowest extent that is
+ * large enough.  With opt_extent_best_fit, do best-fit selection instead, i.e.
+ * select the oldest/lowest extent of the smallest size class that is large
+ * enough.
+ *
+ * Only one range is locked at a time, so first fit compares the candidates of
+ * the ranges by serial number and address, then locks the range of the best
+ * one again to remove it.  Should the range have run out of candidates
+ * meanwhile, the search starts over.
+ */
+static extent_t *
+eset_first_fit(tsdn_t *tsdn, eset_t *eset, size_t size) {
+	pszind_t pind = sz_psz2ind(sz_psz_quantize_ceil(size));
+	eset_range_t *range;
+	extent_t *ret;
+	bool limited;
+
+	if (!maps_coalesce && !opt_retain) {
+		/*
+		 * No split / merge allowed (Windows w/o retain). Try exact fit
+		 * only.
+		 */
+		range = eset_range_get(eset, pind);
+		malloc_mutex_lock(tsdn, &range->mtx);
+		ret = extent_heap_empty(&eset->heaps[pind]) ? NULL :
+		    extent_heap_first(&eset->heaps[pind]);
+		if (ret != NULL) {
+			eset_remove_locked(tsdn, eset, ret);
 		}
-		assert(i < SC_NPSIZES);
+		malloc_mutex_unlock(tsdn, &range->mtx);
+		return ret;
 	}
 
-	return ret;
+	while (true) {
+		pszind_t best = ESET_NHEAPS;
+		size_t best_sn JEMALLOC_CC_SILENCE_INIT(0);
+		uintptr_t best_addr JEMALLOC_CC_SILENCE_INIT(0);
+
+		limited = false;
+		for (pszind_t i = eset_summary_ffs(eset, pind); !limited &&
+		    i < ESET_NHEAPS; i = eset_summary_ffs(eset,
+		    eset_range_end(i))) {
+			range = eset_range_get(eset, i);
+			malloc_mutex_lock(tsdn, &range->mtx);
+			ret = eset_range_first_fit(eset, i, size, &limited);
+			if (ret != NULL && opt_extent_best_fit) {
+				eset_remove_locked(tsdn, eset, ret);
+				malloc_mutex_unlock(tsdn, &range->mtx);
+				return ret;
+			}
+			if (ret != NULL) {
+				size_t sn = extent_sn_get(ret);
+				uintptr_t addr =
+				    (uintptr_t)extent_addr_get(ret);
+				if (best == ESET_NHEAPS || sn < best_sn ||
+				    (sn == best_sn && addr < best_addr)) {
+					best = i;
+					best_sn = sn;
+					best_addr = addr;
+				}
+			}
+			malloc_mutex_unlock(tsdn, &range->mtx);
+		}
+		if (best == ESET_NHEAPS) {
+			return NULL;
+		}
+
+		range = eset_range_get(eset, best);
+		malloc_mutex_lock(tsdn, &range->mtx);
+		ret = eset_range_first_fit(eset, best, size, &limited);
+		if (ret != NULL) {
+			eset_remove_locked(tsdn, eset, ret);
+		}
+		malloc_mutex_unlock(tsdn, &range->mtx);
+		if (ret != NULL) {
+			return ret;
+		}
+	}
 }
 
 extent_t *
-eset_fit_locked(tsdn_t *tsdn, eset_t *eset, size_t esize, size_t alignment) {
-	malloc_mutex_assert_owner(tsdn, &eset->mtx);
-
+eset_fit(tsdn_t *tsdn, eset_t *eset, size_t esize, size_t alignment) {
 	size_t max_size = esize + PAGE_CEILING(alignment) - PAGE;
 	/* Beware size_t wrap-around. */
 	if (max_size < esize) {
 		return NULL;
 	}
 
-	extent_t *extent = eset_first_fit_locked(tsdn, eset, max_size);
+	extent_t *extent = eset_first_fit(tsdn, eset, max_size);
 
 	if (alignment > PAGE && extent == NULL) {
 		/*
@@ -228,23 +374,91 @@ eset_fit_locked(tsdn_t *tsdn, eset_t *eset, size_t esize, size_t alignment) {
 		 * pessimistic.  Next we try to satisfy the aligned allocation
 		 * with sizes in [esize, max_size).
 		 */
-		extent = eset_fit_alignment(eset, esize, max_size, alignment);
+		extent = eset_fit_alignment(tsdn, eset, esize, max_size,
+		    alignment);
 	}
 
 	return extent;
 }
 
+/*
+ * The extents of each range LRU are in insertion order, so the oldest extent
+ * is the oldest of the range LRU heads.  Only insertion, under eset->mtx as
+ * eviction is, adds to the LRUs, but extents may still be removed for reuse
+ * until the range of the oldest one is locked again, in which case the search
+ * starts over.
+ */
+extent_t *
+eset_evict(tsdn_t *tsdn, eset_t *eset) {
+	malloc_mutex_assert_owner(tsdn, &eset->mtx);
+
+	while (true) {
+		unsigned oldest = ESET_NRANGES;
+		size_t oldest_age JEMALLOC_CC_SILENCE_INIT(0);
+
+		for (unsigned r = 0; r < ESET_NRANGES; r++) {
+			pszind_t range_begin = (pszind_t)(r <<
+			    ESET_LG_RANGE_NHEAPS);
+			if (eset_summary_ffs(eset, range_begin) >=
+			    range_begin + ESET_RANGE_NHEAPS) {
+				continue;
+			}
+			eset_range_t *range = &eset->ranges[r];
+			malloc_mutex_lock(tsdn, &range->mtx);
+			extent_t *extent = extent_list_first(&range->lru);
+			if (extent != NULL) {
+				/* Wrap-around safe, unlike the seq itself. */
+				size_t age = eset->seq -
+				    extent_eset_seq_get(extent);
+				if (oldest == ESET_NRANGES ||
+				    age > oldest_age) {
+					oldest = r;
+					oldest_age = age;
+				}
+			}
+			malloc_mutex_unlock(tsdn, &range->mtx);
+		}
+		if (oldest == ESET_NRANGES) {
+			return NULL;
+		}
+
+		eset_range_t *range = &eset->ranges[oldest];
+		malloc_mutex_lock(tsdn, &range->mtx);
+		extent_t *extent = extent_list_first(&range->lru);
+		if (extent != NULL) {
+			eset_remove_locked(tsdn, eset, extent);
+		}
+		malloc_mutex_unlock(tsdn, &range->mtx);
+		if (extent != NULL) {
+			return extent;
+		}
+	}
+}
+
 void
-eset_prefork(tsdn_t *tsdn, eset_t *eset) {
+eset_prefork0(tsdn_t *tsdn, eset_t *eset) {
 	malloc_mutex_prefork(tsdn, &eset->mtx);
 }
 
+void
+eset_prefork1(tsdn_t *tsdn, eset_t *eset) {
+	for (unsigned i = 0; i < ESET_NRANGES; i++) {
+		malloc_mutex_prefork(tsdn, &eset->ranges[i].mtx);
+	}
+}
+
 void
 eset_postfork_parent(tsdn_t *tsdn, eset_t *eset) {
+	for (unsigned i = 0; i < ESET_NRANGES; i++) {
+		malloc_mutex_postfork_parent(tsdn, &eset->ranges[i].mtx);
+	}
 	malloc_mutex_postfork_parent(tsdn, &eset->mtx);
 }
 
 void
 eset_postfork_child(tsdn_t *tsdn, eset_t *eset) {
+	for (unsigned i = 0; i < ESET_NRANGES; i++) {
+		malloc_mutex_postfork_child(tsdn, &eset->ranges[i].mtx);
+	}
 	malloc_mutex_postfork_child(tsdn, &eset->mtx);
 }
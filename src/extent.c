@@ -7,6 +7,7 @@
 #include "jemalloc/internal/extent_mmap.h"
 #include "jemalloc/internal/ph.h"
 #include "jemalloc/internal/rtree.h"
+#include "jemalloc/internal/slab_map.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/mutex_pool.h"
 
@@ -18,6 +19,8 @@ rtree_t		extents_rtree;
 mutex_pool_t	extent_mutex_pool;
 
 size_t opt_lg_extent_max_active_fit = LG_EXTENT_MAX_ACTIVE_FIT_DEFAULT;
+bool opt_lazy_coalesce = false;
+bool opt_extent_best_fit = false;
 
 static void *extent_alloc_default(extent_hooks_t *extent_hooks, void *new_addr,
     size_t size, size_t alignment, bool *zero, bool *commit,
@@ -96,7 +99,6 @@ static atomic_zu_t highpages;
  * definition.
  */
 
-static void extent_deregister(tsdn_t *tsdn, extent_t *extent);
 static extent_t *extent_recycle(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, eset_t *eset, void *new_addr,
     size_t usize, size_t pad, size_t alignment, bool slab, szind_t szind,
@@ -107,6 +109,7 @@ static extent_t *extent_try_coalesce(tsdn_t *tsdn, arena_t *arena,
 static void extent_record(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, eset_t *eset, extent_t *extent,
     bool growing_retained);
+static void extent_deregister_no_gdump_sub(tsdn_t *tsdn, extent_t *extent);
 
 /******************************************************************************/
 
@@ -216,6 +219,12 @@ extent_alloc(tsdn_t *tsdn, arena_t *arena) {
 void
 extent_dalloc(tsdn_t *tsdn, arena_t *arena, extent_t *extent) {
 	malloc_mutex_lock(tsdn, &arena->extent_avail_mtx);
+	if (atomic_load_zu(&arena->extent_avail_cnt, ATOMIC_RELAXED) >=
+	    EXTENT_AVAIL_MAX) {
+		malloc_mutex_unlock(tsdn, &arena->extent_avail_mtx);
+		base_dalloc_extent(tsdn, arena->base, extent);
+		return;
+	}
 	extent_avail_insert(&arena->extent_avail, extent);
 	atomic_fetch_add_zu(&arena->extent_avail_cnt, 1, ATOMIC_RELAXED);
 	malloc_mutex_unlock(tsdn, &arena->extent_avail_mtx);
@@ -250,21 +259,21 @@ extent_hooks_assure_initialized(arena_t *arena,
 }
 
 ph_gen(, extent_heap_, extent_heap_t, extent_t, ph_link, extent_snad_comp)
+ph_gen(static UNUSED, extent_addr_heap_, extent_heap_t, extent_t, ph_link,
+    extent_ad_comp)
 
 static bool
 extent_try_delayed_coalesce(tsdn_t *tsdn, arena_t *arena,
     extent_hooks_t **r_extent_hooks, rtree_ctx_t *rtree_ctx, eset_t *eset,
     extent_t *extent) {
-	extent_state_set(extent, extent_state_active);
 	bool coalesced;
 	extent = extent_try_coalesce(tsdn, arena, r_extent_hooks, rtree_ctx,
 	    eset, extent, &coalesced, false);
-	extent_state_set(extent, eset_state_get(eset));
 
 	if (!coalesced) {
 		return true;
 	}
-	eset_insert_locked(tsdn, eset, extent);
+	eset_insert(tsdn, eset, extent);
 	return false;
 }
 
@@ -312,20 +321,18 @@ extents_evict(tsdn_t *tsdn, arena_t *arena, extent_hooks_t **r_extent_hooks,
 	 */
 	extent_t *extent;
 	while (true) {
-		/* Get the LRU extent, if any. */
-		extent = extent_list_first(&eset->lru);
-		if (extent == NULL) {
-			goto label_return;
-		}
 		/* Check the eviction limit. */
-		size_t extents_npages = atomic_load_zu(&eset->npages,
-		    ATOMIC_RELAXED);
+		size_t extents_npages = eset_npages_get(eset);
 		if (extents_npages <= npages_min) {
 			extent = NULL;
 			goto label_return;
 		}
-		eset_remove_locked(tsdn, eset, extent);
-		if (!eset->delay_coalesce) {
+		/* Get the LRU extent, if any. */
+		extent = eset_evict(tsdn, eset);
+		if (extent == NULL) {
+			goto label_return;
+		}
+		if (!eset->delay_coalesce || opt_lazy_coalesce) {
 			break;
 		}
 		/* Try to coalesce. */
@@ -334,24 +341,29 @@ extents_evict(tsdn_t *tsdn, arena_t *arena, extent_hooks_t **r_extent_hooks,
 			break;
 		}
 		/*
-		 * The LRU extent was just coalesced and the result placed in
-		 * the LRU at its neighbor's position.  Start over.
+		 * The LRU extent was just coalesced and the result placed at
+		 * the end of the LRU.  Start over.
 		 */
 	}
 
 	/*
-	 * Either mark the extent active or deregister it to protect against
-	 * concurrent operations.
+	 * The extent was marked active on its removal from the eset; retained
+	 * extents are also deregistered to protect against concurrent
+	 * operations.
 	 */
 	switch (eset_state_get(eset)) {
 	case extent_state_active:
 		not_reached();
 	case extent_state_dirty:
 	case extent_state_muzzy:
-		extent_state_set(extent, extent_state_active);
 		break;
 	case extent_state_retained:
-		extent_deregister(tsdn, extent);
+		/*
+		 * Removal from the eset made the extent active, but its pages
+		 * were never counted in curpages, so plain extent_deregister()
+		 * would make gdump subtract them.
+		 */
+		extent_deregister_no_gdump_sub(tsdn, extent);
 		break;
 	default:
 		not_reached();
@@ -362,6 +374,36 @@ label_return:
 	return extent;
 }
 
+/*
+ * Coalesce up to nmax of the least recently used extents of eset with their
+ * neighbors.  The extents looked at, coalesced or not, move to the most
+ * recently used end of the LRU, so that successive passes walk all of eset.
+ */
+void
+extents_coalesce(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, eset_t *eset, size_t nmax) {
+	rtree_ctx_t rtree_ctx_fallback;
+	rtree_ctx_t *rtree_ctx = tsdn_rtree_ctx(tsdn, &rtree_ctx_fallback);
+
+	malloc_mutex_lock(tsdn, &eset->mtx);
+	extent_hooks_assure_initialized(arena, r_extent_hooks);
+	for (size_t i = 0; i < nmax; i++) {
+		extent_t *extent = eset_evict(tsdn, eset);
+		if (extent == NULL) {
+			break;
+		}
+		bool coalesced;
+		do {
+			coalesced = false;
+			extent = extent_try_coalesce(tsdn, arena,
+			    r_extent_hooks, rtree_ctx, eset, extent,
+			    &coalesced, false);
+		} while (coalesced);
+		eset_insert(tsdn, eset, extent);
+	}
+	malloc_mutex_unlock(tsdn, &eset->mtx);
+}
+
 /*
  * This can only happen when we fail to allocate a new extent struct (which
  * indicates OOM), e.g. when trying to split an existing extent.
@@ -394,8 +436,7 @@ extent_deactivate_locked(tsdn_t *tsdn, arena_t *arena, eset_t *eset,
 	assert(extent_arena_ind_get(extent) == arena_ind_get(arena));
 	assert(extent_state_get(extent) == extent_state_active);
 
-	extent_state_set(extent, eset_state_get(eset));
-	eset_insert_locked(tsdn, eset, extent);
+	eset_insert(tsdn, eset, extent);
 }
 
 static void
@@ -406,16 +447,6 @@ extent_deactivate(tsdn_t *tsdn, arena_t *arena, eset_t *eset,
 	malloc_mutex_unlock(tsdn, &eset->mtx);
 }
 
-static void
-extent_activate_locked(tsdn_t *tsdn, arena_t *arena, eset_t *eset,
-    extent_t *extent) {
-	assert(extent_arena_ind_get(extent) == arena_ind_get(arena));
-	assert(extent_state_get(extent) == eset_state_get(eset));
-
-	eset_remove_locked(tsdn, eset, extent);
-	extent_state_set(extent, extent_state_active);
-}
-
 static bool
 extent_rtree_leaf_elms_lookup(tsdn_t *tsdn, rtree_ctx_t *rtree_ctx,
     const extent_t *extent, bool dependent, bool init_missing,
@@ -458,6 +489,8 @@ extent_interior_register(tsdn_t *tsdn, rtree_ctx_t *rtree_ctx, extent_t *extent,
 		    (uintptr_t)extent_base_get(extent) + (uintptr_t)(i <<
 		    LG_PAGE), extent, szind, true);
 	}
+	/* And all of the slab, head and tail included, in the slab map. */
+	slab_map_set(extent_base_get(extent), extent_size_get(extent), szind);
 }
 
 static void
@@ -531,7 +564,7 @@ extent_register_impl(tsdn_t *tsdn, extent_t *extent, bool gdump_add) {
 	return false;
 }
 
-static bool
+bool
 extent_register(tsdn_t *tsdn, extent_t *extent) {
 	return extent_register_impl(tsdn, extent, true);
 }
@@ -552,7 +585,8 @@ extent_reregister(tsdn_t *tsdn, extent_t *extent) {
  * its interior.  This is relevant for slab extents, for which we need to do
  * metadata lookups at places other than the head of the extent.  We deregister
  * on the interior, then, when an extent moves from being an active slab to an
- * inactive state.
+ * inactive state.  The whole slab is removed from the slab map at the same
+ * time.
  */
 static void
 extent_interior_deregister(tsdn_t *tsdn, rtree_ctx_t *rtree_ctx,
@@ -566,6 +600,7 @@ extent_interior_deregister(tsdn_t *tsdn, rtree_ctx_t *rtree_ctx,
 		    (uintptr_t)extent_base_get(extent) + (uintptr_t)(i <<
 		    LG_PAGE));
 	}
+	slab_map_clear(extent_base_get(extent), extent_size_get(extent));
 }
 
 /*
@@ -594,7 +629,7 @@ extent_deregister_impl(tsdn_t *tsdn, extent_t *extent, bool gdump) {
 	}
 }
 
-static void
+void
 extent_deregister(tsdn_t *tsdn, extent_t *extent) {
 	extent_deregister_impl(tsdn, extent, true);
 }
@@ -634,8 +669,11 @@ extent_recycle_extract(tsdn_t *tsdn, arena_t *arena,
 	}
 
 	size_t esize = size + pad;
-	malloc_mutex_lock(tsdn, &eset->mtx);
 	extent_hooks_assure_initialized(arena, r_extent_hooks);
+	/*
+	 * Extents are taken out of eset under the lock of their size range
+	 * only; eset->mtx is left to insertion and eviction.
+	 */
 	extent_t *extent;
 	if (new_addr != NULL) {
 		extent = extent_lock_from_addr(tsdn, rtree_ctx, new_addr,
@@ -649,23 +687,25 @@ extent_recycle_extract(tsdn_t *tsdn, arena_t *arena,
 			assert(extent_base_get(extent) == new_addr);
 			if (extent_arena_ind_get(extent)
 			    != arena_ind_get(arena) ||
-			    extent_size_get(extent) < esize ||
-			    extent_state_get(extent) !=
-			    eset_state_get(eset)) {
+			    extent_size_get(extent) < esize) {
 				extent = NULL;
+			} else {
+				eset_lock_extent(tsdn, eset, extent);
+				if (extent_state_get(extent) ==
+				    eset_state_get(eset)) {
+					eset_remove_locked(tsdn, eset, extent);
+				} else {
+					extent = NULL;
+				}
+				eset_unlock_extent(tsdn, eset, unlock_extent);
 			}
 			extent_unlock(tsdn, unlock_extent);
 		}
 	} else {
-		extent = eset_fit_locked(tsdn, eset, esize, alignment);
-	}
-	if (extent == NULL) {
-		malloc_mutex_unlock(tsdn, &eset->mtx);
-		return NULL;
+		extent = eset_fit(tsdn, eset, esize, alignment);
 	}
-
-	extent_activate_locked(tsdn, arena, eset, extent);
-	malloc_mutex_unlock(tsdn, &eset->mtx);
+	assert(extent == NULL ||
+	    extent_arena_ind_get(extent) == arena_ind_get(arena));
 
 	return extent;
 }
@@ -1296,13 +1336,27 @@ extent_can_coalesce(arena_t *arena, eset_t *eset, const extent_t *inner,
 	return true;
 }
 
+/*
+ * Takes outer out of eset if it can be coalesced with inner.  The caller holds
+ * the pool lock of outer, which keeps its size stable.
+ */
+static bool
+extent_coalesce_prepare(tsdn_t *tsdn, arena_t *arena, eset_t *eset,
+    const extent_t *inner, extent_t *outer) {
+	eset_lock_extent(tsdn, eset, outer);
+	bool can_coalesce = extent_can_coalesce(arena, eset, inner, outer);
+	if (can_coalesce) {
+		eset_remove_locked(tsdn, eset, outer);
+	}
+	eset_unlock_extent(tsdn, eset, outer);
+	return can_coalesce;
+}
+
 static bool
 extent_coalesce(tsdn_t *tsdn, arena_t *arena, extent_hooks_t **r_extent_hooks,
     eset_t *eset, extent_t *inner, extent_t *outer, bool forward,
     bool growing_retained) {
-	assert(extent_can_coalesce(arena, eset, inner, outer));
-
-	extent_activate_locked(tsdn, arena, eset, outer);
+	assert(extent_state_get(outer) == extent_state_active);
 
 	malloc_mutex_unlock(tsdn, &eset->mtx);
 	bool err = extent_merge_impl(tsdn, arena, r_extent_hooks,
@@ -1339,12 +1393,12 @@ extent_try_coalesce_impl(tsdn_t *tsdn, arena_t *arena,
 		    extent_past_get(extent), inactive_only);
 		if (next != NULL) {
 			/*
-			 * eset->mtx only protects against races for
-			 * like-state eset, so call extent_can_coalesce()
-			 * before releasing next's pool lock.
+			 * The range locks of eset only protect against races
+			 * for like-state eset, so take next out of eset before
+			 * releasing its pool lock.
 			 */
-			bool can_coalesce = extent_can_coalesce(arena, eset,
-			    extent, next);
+			bool can_coalesce = extent_coalesce_prepare(tsdn,
+			    arena, eset, extent, next);
 
 			extent_unlock(tsdn, next);
 
@@ -1364,8 +1418,8 @@ extent_try_coalesce_impl(tsdn_t *tsdn, arena_t *arena,
 		extent_t *prev = extent_lock_from_addr(tsdn, rtree_ctx,
 		    extent_before_get(extent), inactive_only);
 		if (prev != NULL) {
-			bool can_coalesce = extent_can_coalesce(arena, eset,
-			    extent, prev);
+			bool can_coalesce = extent_coalesce_prepare(tsdn,
+			    arena, eset, extent, prev);
 			extent_unlock(tsdn, prev);
 
 			if (can_coalesce && !extent_coalesce(tsdn, arena,
@@ -1430,7 +1484,9 @@ extent_record(tsdn_t *tsdn, arena_t *arena, extent_hooks_t **r_extent_hooks,
 	assert(rtree_extent_read(tsdn, &extents_rtree, rtree_ctx,
 	    (uintptr_t)extent_base_get(extent), true) == extent);
 
-	if (!eset->delay_coalesce) {
+	if (opt_lazy_coalesce) {
+		/* Coalescing is left to extents_coalesce(). */
+	} else if (!eset->delay_coalesce) {
 		extent = extent_try_coalesce(tsdn, arena, r_extent_hooks,
 		    rtree_ctx, eset, extent, NULL, growing_retained);
 	} else if (extent_size_get(extent) >= SC_LARGE_MINCLASS) {
@@ -1443,12 +1499,14 @@ extent_record(tsdn_t *tsdn, arena_t *arena, extent_hooks_t **r_extent_hooks,
 			    r_extent_hooks, rtree_ctx, eset, extent,
 			    &coalesced, growing_retained);
 		} while (coalesced);
-		if (extent_size_get(extent) >= oversize_threshold) {
-			/* Shortcut to purge the oversize extent eagerly. */
-			malloc_mutex_unlock(tsdn, &eset->mtx);
-			arena_decay_extent(tsdn, arena, r_extent_hooks, extent);
-			return;
-		}
+	}
+	if (eset == &arena->eset_dirty &&
+	    extent_size_get(extent) >= SC_LARGE_MINCLASS &&
+	    extent_size_get(extent) >= oversize_threshold) {
+		/* Shortcut to purge the oversize extent eagerly. */
+		malloc_mutex_unlock(tsdn, &eset->mtx);
+		arena_decay_extent(tsdn, arena, r_extent_hooks, extent);
+		return;
 	}
 	extent_deactivate_locked(tsdn, arena, eset, extent);
 
@@ -1581,6 +1639,220 @@ extent_dalloc_wrapper(tsdn_t *tsdn, arena_t *arena,
 	    extent, false);
 }
 
+void
+extent_list_sort(extent_list_t *list) {
+	extent_heap_t heap;
+	extent_addr_heap_new(&heap);
+	for (extent_t *extent = extent_list_first(list); extent != NULL;
+	    extent = extent_list_first(list)) {
+		extent_list_remove(list, extent);
+		extent_addr_heap_insert(&heap, extent);
+	}
+	while (!extent_addr_heap_empty(&heap)) {
+		extent_list_append(list, extent_addr_heap_remove_first(&heap));
+	}
+}
+
+/*
+ * Returns true if the default hooks can purge or deallocate b along with a,
+ * which immediately precedes it, in one call.
+ */
+static bool
+extent_run_mergeable(extent_hooks_t *extent_hooks, extent_t *a,
+    extent_t *b) {
+	if (extent_hooks != &extent_hooks_default || extent_may_dalloc()) {
+		return false;
+	}
+	if (extent_past_get(a) != extent_base_get(b)) {
+		return false;
+	}
+	if (!extent_committed_get(a) || !extent_committed_get(b)) {
+		return false;
+	}
+	if (!maps_coalesce || (have_dss &&
+	    !extent_dss_mergeable(extent_base_get(a), extent_base_get(b)))) {
+		return false;
+	}
+	return true;
+}
+
+size_t
+extent_list_run_take(extent_hooks_t *extent_hooks, extent_list_t *list,
+    extent_list_t *run) {
+	extent_t *extent = extent_list_first(list);
+	assert(extent != NULL);
+	size_t npages = 0;
+	extent_t *prev;
+	do {
+		extent_list_remove(list, extent);
+		extent_list_append(run, extent);
+		npages += extent_size_get(extent) >> LG_PAGE;
+		prev = extent;
+		extent = extent_list_first(list);
+	} while (extent != NULL && extent_run_mergeable(extent_hooks, prev,
+	    extent));
+	return npages;
+}
+
+static void
+extent_run_range_get(extent_list_t *run, void **r_addr, size_t *r_size) {
+	extent_t *first = extent_list_first(run);
+	extent_t *last = extent_list_last(run);
+	*r_addr = extent_base_get(first);
+	*r_size = (uintptr_t)extent_past_get(last) - (uintptr_t)*r_addr;
+}
+
+/* Record the extents of a purged run as retained, and empty the run. */
+static void
+extent_run_record(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *run, bool committed,
+    bool zeroed) {
+	for (extent_t *extent = extent_list_first(run); extent != NULL;
+	    extent = extent_list_first(run)) {
+		assert(extent_dumpable_get(extent));
+		extent_list_remove(run, extent);
+		extent_committed_set(extent, committed);
+		extent_zeroed_set(extent, zeroed);
+		if (config_prof) {
+			extent_gdump_sub(tsdn, extent);
+		}
+		extent_record(tsdn, arena, r_extent_hooks,
+		    &arena->eset_retained, extent, false);
+	}
+}
+
+bool
+extent_purge_lazy_run_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *run) {
+	extent_t *extent = extent_list_first(run);
+	if (extent == extent_list_last(run)) {
+		return extent_purge_lazy_wrapper(tsdn, arena, r_extent_hooks,
+		    extent, 0, extent_size_get(extent));
+	}
+	assert(*r_extent_hooks == &extent_hooks_default);
+	if ((*r_extent_hooks)->purge_lazy == NULL) {
+		return true;
+	}
+	void *addr;
+	size_t size;
+	extent_run_range_get(run, &addr, &size);
+	return (*r_extent_hooks)->purge_lazy(*r_extent_hooks, addr, size, 0,
+	    size, arena_ind_get(arena));
+}
+
+void
+extent_dalloc_run_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *run) {
+	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
+	    WITNESS_RANK_CORE, 0);
+
+	extent_t *extent = extent_list_first(run);
+	if (extent != extent_list_last(run)) {
+		/*
+		 * Decommit or purge the whole run the way extent_dalloc_wrapper()
+		 * does each extent, which with the default hooks involves no
+		 * other step.  Fall back to doing it extent by extent on
+		 * failure.
+		 */
+		assert(*r_extent_hooks == &extent_hooks_default);
+		void *addr;
+		size_t size;
+		extent_run_range_get(run, &addr, &size);
+		bool committed, zeroed;
+		if (!(*r_extent_hooks)->decommit(*r_extent_hooks, addr, size, 0,
+		    size, arena_ind_get(arena))) {
+			committed = false;
+			zeroed = true;
+		} else if ((*r_extent_hooks)->purge_forced != NULL &&
+		    !(*r_extent_hooks)->purge_forced(*r_extent_hooks, addr,
+		    size, 0, size, arena_ind_get(arena))) {
+			committed = true;
+			zeroed = true;
+		} else {
+			goto label_fallback;
+		}
+		extent_run_record(tsdn, arena, r_extent_hooks, run, committed,
+		    zeroed);
+		return;
+	}
+label_fallback:
+	for (; extent != NULL; extent = extent_list_first(run)) {
+		extent_list_remove(run, extent);
+		extent_dalloc_wrapper(tsdn, arena, r_extent_hooks, extent);
+	}
+}
+
+/*
+ * Returns true if the default hooks can purge or deallocate the run starting
+ * with extent along with other runs, in one system call.
+ */
+static bool
+extent_run_batchable(extent_hooks_t *extent_hooks, extent_t *extent) {
+	return (extent_hooks == &extent_hooks_default && !extent_may_dalloc() &&
+	    extent_committed_get(extent));
+}
+
+size_t
+extent_list_batch_take(extent_hooks_t *extent_hooks, extent_list_t *list,
+    extent_list_t *runs, size_t *run_npages) {
+	bool batchable = extent_run_batchable(extent_hooks,
+	    extent_list_first(list));
+	size_t nruns = 0;
+	do {
+		extent_list_init(&runs[nruns]);
+		run_npages[nruns] = extent_list_run_take(extent_hooks, list,
+		    &runs[nruns]);
+		nruns++;
+	} while (batchable && nruns < PAGES_PURGE_BATCH_MAX &&
+	    extent_list_first(list) != NULL &&
+	    extent_run_batchable(extent_hooks, extent_list_first(list)));
+	return nruns;
+}
+
+static void
+extent_batch_ranges_get(extent_list_t *runs, size_t nruns,
+    pages_range_t *ranges) {
+	for (size_t i = 0; i < nruns; i++) {
+		extent_run_range_get(&runs[i], &ranges[i].addr,
+		    &ranges[i].size);
+	}
+}
+
+bool
+extent_purge_lazy_batch_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *runs, size_t nruns) {
+	assert(*r_extent_hooks == &extent_hooks_default);
+	pages_range_t ranges[PAGES_PURGE_BATCH_MAX];
+	extent_batch_ranges_get(runs, nruns, ranges);
+	return pages_purge_lazy_batch(ranges, nruns);
+}
+
+bool
+extent_dalloc_batch_wrapper(tsdn_t *tsdn, arena_t *arena,
+    extent_hooks_t **r_extent_hooks, extent_list_t *runs, size_t nruns) {
+	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
+	    WITNESS_RANK_CORE, 0);
+	assert(*r_extent_hooks == &extent_hooks_default);
+
+	/*
+	 * The default hooks decommit rather than purge where they can, which
+	 * can't be batched.
+	 */
+	if (pages_can_decommit()) {
+		return true;
+	}
+	pages_range_t ranges[PAGES_PURGE_BATCH_MAX];
+	extent_batch_ranges_get(runs, nruns, ranges);
+	if (pages_purge_forced_batch(ranges, nruns)) {
+		return true;
+	}
+	for (size_t i = 0; i < nruns; i++) {
+		extent_run_record(tsdn, arena, r_extent_hooks, &runs[i], true,
+		    true);
+	}
+	return false;
+}
+
 static void
 extent_destroy_default_impl(void *addr, size_t size) {
 	if (!have_dss || !extent_in_dss(addr)) {
@@ -2043,7 +2315,7 @@ extent_merge_wrapper(tsdn_t *tsdn, arena_t *arena,
 
 bool
 extent_boot(void) {
-	if (rtree_new(&extents_rtree, true)) {
+	if (rtree_new(&extents_rtree, true, opt_rtree_flat)) {
 		return true;
 	}
 
@@ -2076,7 +2348,8 @@ extent_util_stats_get(tsdn_t *tsdn, const void *ptr,
 		*nregs = 1;
 	} else {
 		*nfree = extent_nfree_get(extent);
-		*nregs = bin_infos[extent_szind_get(extent)].nregs;
+		*nregs = bin_slab_info_get(extent_szind_get(extent),
+		    extent_size_get(extent))->nregs;
 		assert(*nfree <= *nregs);
 		assert(*nfree * extent_usize_get(extent) <= *size);
 	}
@@ -2106,7 +2379,7 @@ extent_util_stats_verbose_get(tsdn_t *tsdn, const void *ptr,
 
 	*nfree = extent_nfree_get(extent);
 	const szind_t szind = extent_szind_get(extent);
-	*nregs = bin_infos[szind].nregs;
+	*nregs = bin_slab_info_get(szind, extent_size_get(extent))->nregs;
 	assert(*nfree <= *nregs);
 	assert(*nfree * extent_usize_get(extent) <= *size);
 
@@ -2118,7 +2391,7 @@ extent_util_stats_verbose_get(tsdn_t *tsdn, const void *ptr,
 
 	malloc_mutex_lock(tsdn, &bin->lock);
 	if (config_stats) {
-		*bin_nregs = *nregs * bin->stats.curslabs;
+		*bin_nregs = bin->slab_tune.nregs;
 		assert(*bin_nregs >= bin->stats.curregs);
 		*bin_nfree = *bin_nregs - bin->stats.curregs;
 	} else {
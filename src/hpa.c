@@ -0,0 +1,416 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/hpa.h"
+/* For opt_retain */
+#include "jemalloc/internal/extent_mmap.h"
+
+/* Initial capacity of hpa_t's regions array. */
+#define HPA_REGIONS_CAP_MIN	16
+
+bool opt_hpa = false;
+
+static bool
+hpa_region_page_used(const hpa_region_t *region, size_t i) {
+	return ((region->used[i >> 6] >> (i & 63)) & 1) != 0;
+}
+
+static void
+hpa_region_pages_set(hpa_region_t *region, size_t first, size_t npages,
+    bool used) {
+	for (size_t i = first; i < first + npages; i++) {
+		uint64_t bit = (uint64_t)1 << (i & 63);
+		assert(hpa_region_page_used(region, i) != used);
+		if (used) {
+			region->used[i >> 6] |= bit;
+		} else {
+			region->used[i >> 6] &= ~bit;
+		}
+	}
+}
+
+/*
+ * Returns the first page of the lowest addressed run of at least npages free
+ * pages, or HPA_REGION_NPAGES if there is none.
+ */
+static size_t
+hpa_region_first_fit(const hpa_region_t *region, size_t npages) {
+	size_t run = 0;
+	for (size_t i = 0; i < HPA_REGION_NPAGES; i++) {
+		if ((i & 63) == 0 && region->used[i >> 6] == UINT64_MAX) {
+			/* Skip over fully used words. */
+			run = 0;
+			i += 63;
+			continue;
+		}
+		if (hpa_region_page_used(region, i)) {
+			run = 0;
+		} else if (++run == npages) {
+			return i + 1 - npages;
+		}
+	}
+	return HPA_REGION_NPAGES;
+}
+
+static size_t
+hpa_region_longest_free(const hpa_region_t *region) {
+	size_t run = 0;
+	size_t longest = 0;
+	for (size_t i = 0; i < HPA_REGION_NPAGES; i++) {
+		if ((i & 63) == 0 && region->used[i >> 6] == UINT64_MAX) {
+			run = 0;
+			i += 63;
+			continue;
+		}
+		if (hpa_region_page_used(region, i)) {
+			run = 0;
+		} else if (++run > longest) {
+			longest = run;
+		}
+	}
+	return longest;
+}
+
+static void
+hpa_region_list_insert(hpa_t *hpa, hpa_region_t *region) {
+	assert(region->list == NULL);
+
+	if (region->nactive == HPA_REGION_NPAGES) {
+		return;
+	}
+	if (region->nactive == 0) {
+		region->list = &hpa->empty;
+		if (region->dirty) {
+			ql_head_insert(&hpa->empty, region, link);
+			hpa->nempty_dirty++;
+		} else {
+			ql_tail_insert(&hpa->empty, region, link);
+		}
+		return;
+	}
+	region->list = &hpa->nonfull[region->nactive * HPA_NBUCKETS /
+	    HPA_REGION_NPAGES];
+	ql_tail_insert(region->list, region, link);
+}
+
+static void
+hpa_region_list_remove(hpa_t *hpa, hpa_region_t *region) {
+	if (region->list == NULL) {
+		return;
+	}
+	ql_remove(region->list, region, link);
+	if (region->list == &hpa->empty && region->dirty) {
+		assert(hpa->nempty_dirty > 0);
+		hpa->nempty_dirty--;
+	}
+	region->list = NULL;
+}
+
+/* Returns the index at which a region based at addr is, or would be. */
+static size_t
+hpa_regions_search(const hpa_t *hpa, const void *addr) {
+	size_t lo = 0;
+	size_t hi = hpa->nregions;
+	while (lo < hi) {
+		size_t mid = (lo + hi) >> 1;
+		if ((uintptr_t)hpa->regions[mid]->addr < (uintptr_t)addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static hpa_region_t *
+hpa_region_lookup(const hpa_t *hpa, const void *addr) {
+	size_t i = hpa_regions_search(hpa, addr);
+	if (i < hpa->nregions && hpa->regions[i]->addr == addr) {
+		return hpa->regions[i];
+	}
+	return NULL;
+}
+
+static bool
+hpa_regions_grow(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa) {
+	size_t cap = (hpa->regions_cap == 0) ? HPA_REGIONS_CAP_MIN :
+	    hpa->regions_cap << 1;
+	/*
+	 * Base memory is never freed, so the old array is abandoned.  Since
+	 * capacity doubles, this wastes at most as much as the array in use.
+	 */
+	hpa_region_t **regions = (hpa_region_t **)base_alloc(tsdn, arena->base,
+	    cap * sizeof(hpa_region_t *), CACHELINE);
+	if (regions == NULL) {
+		return true;
+	}
+	if (hpa->nregions > 0) {
+		memcpy(regions, hpa->regions,
+		    hpa->nregions * sizeof(hpa_region_t *));
+	}
+	hpa->regions = regions;
+	hpa->regions_cap = cap;
+	return false;
+}
+
+static hpa_region_t *
+hpa_region_map(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa) {
+	malloc_mutex_assert_owner(tsdn, &hpa->mtx);
+
+	if (hpa->nregions == hpa->regions_cap && hpa_regions_grow(tsdn, arena,
+	    hpa)) {
+		return NULL;
+	}
+	hpa_region_t *region = ql_first(&hpa->avail);
+	if (region != NULL) {
+		ql_remove(&hpa->avail, region, link);
+	} else {
+		region = (hpa_region_t *)base_alloc(tsdn, arena->base,
+		    sizeof(hpa_region_t), CACHELINE);
+		if (region == NULL) {
+			return NULL;
+		}
+	}
+	ql_elm_new(region, link);
+
+	bool commit = true;
+	void *addr = pages_map(NULL, HUGEPAGE, HUGEPAGE, &commit);
+	if (addr == NULL) {
+		ql_tail_insert(&hpa->avail, region, link);
+		return NULL;
+	}
+	assert(commit);
+	if (opt_thp != thp_mode_never) {
+		pages_huge(addr, HUGEPAGE);
+	}
+
+	region->addr = addr;
+	region->list = NULL;
+	region->nactive = 0;
+	region->longest_free = HPA_REGION_NPAGES;
+	region->dirty = false;
+	memset(region->used, 0, sizeof(region->used));
+
+	size_t i = hpa_regions_search(hpa, addr);
+	memmove(&hpa->regions[i + 1], &hpa->regions[i],
+	    (hpa->nregions - i) * sizeof(hpa_region_t *));
+	hpa->regions[i] = region;
+	hpa->nregions++;
+	atomic_store_zu(&hpa->mapped, atomic_load_zu(&hpa->mapped,
+	    ATOMIC_RELAXED) + HUGEPAGE, ATOMIC_RELAXED);
+
+	hpa_region_list_insert(hpa, region);
+	return region;
+}
+
+static void
+hpa_region_unmap(tsdn_t *tsdn, hpa_t *hpa, hpa_region_t *region) {
+	malloc_mutex_assert_owner(tsdn, &hpa->mtx);
+	assert(region->list == NULL);
+	assert(region->nactive == 0);
+
+	size_t i = hpa_regions_search(hpa, region->addr);
+	assert(i < hpa->nregions && hpa->regions[i] == region);
+	memmove(&hpa->regions[i], &hpa->regions[i + 1],
+	    (hpa->nregions - i - 1) * sizeof(hpa_region_t *));
+	hpa->nregions--;
+	atomic_store_zu(&hpa->mapped, atomic_load_zu(&hpa->mapped,
+	    ATOMIC_RELAXED) - HUGEPAGE, ATOMIC_RELAXED);
+
+	pages_unmap(region->addr, HUGEPAGE);
+	ql_tail_insert(&hpa->avail, region, link);
+}
+
+/*
+ * Purge an empty region that is on no list, all of it at once.  Without
+ * opt_retain, the region is unmapped instead, and true is returned.
+ */
+static bool
+hpa_region_purge(tsdn_t *tsdn, hpa_t *hpa, hpa_region_t *region) {
+	assert(region->list == NULL);
+	assert(region->nactive == 0);
+
+	if (!opt_retain) {
+		hpa_region_unmap(tsdn, hpa, region);
+		return true;
+	}
+	/*
+	 * If purging is unsupported there is nothing more to be done with the
+	 * region, so it is considered clean either way.
+	 */
+	pages_purge_forced(region->addr, HUGEPAGE);
+	region->dirty = false;
+	return false;
+}
+
+/*
+ * Choose the region to carve npages from: the fullest one with a long enough
+ * free run, so that partially used hugepages fill up before empty ones are
+ * touched.
+ */
+static hpa_region_t *
+hpa_region_choose(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa, size_t npages) {
+	malloc_mutex_assert_owner(tsdn, &hpa->mtx);
+
+	hpa_region_t *region;
+	for (unsigned i = HPA_NBUCKETS; i > 0; i--) {
+		ql_foreach(region, &hpa->nonfull[i - 1], link) {
+			if (region->longest_free >= npages) {
+				return region;
+			}
+		}
+	}
+	region = ql_first(&hpa->empty);
+	if (region != NULL) {
+		return region;
+	}
+	return hpa_region_map(tsdn, arena, hpa);
+}
+
+static void
+hpa_region_pages_release(tsdn_t *tsdn, hpa_t *hpa, hpa_region_t *region,
+    size_t first, size_t npages) {
+	malloc_mutex_assert_owner(tsdn, &hpa->mtx);
+	assert(region->nactive >= npages);
+
+	hpa_region_list_remove(hpa, region);
+	hpa_region_pages_set(region, first, npages, false);
+	region->nactive -= npages;
+	region->longest_free = hpa_region_longest_free(region);
+	if (region->nactive == 0 && hpa->nempty_dirty >= HPA_NDIRTY_MAX &&
+	    hpa_region_purge(tsdn, hpa, region)) {
+		return;
+	}
+	hpa_region_list_insert(hpa, region);
+}
+
+bool
+hpa_init(tsdn_t *tsdn, hpa_t *hpa) {
+	if (malloc_mutex_init(&hpa->mtx, "hpa", WITNESS_RANK_HPA,
+	    malloc_mutex_rank_exclusive)) {
+		return true;
+	}
+	for (unsigned i = 0; i < HPA_NBUCKETS; i++) {
+		ql_new(&hpa->nonfull[i]);
+	}
+	ql_new(&hpa->empty);
+	hpa->nempty_dirty = 0;
+	ql_new(&hpa->avail);
+	hpa->regions = NULL;
+	hpa->nregions = 0;
+	hpa->regions_cap = 0;
+	atomic_store_zu(&hpa->mapped, 0, ATOMIC_RELAXED);
+	return false;
+}
+
+extent_t *
+hpa_alloc(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa, size_t size,
+    szind_t szind) {
+	assert(size != 0 && PAGE_CEILING(size) == size);
+
+	size_t npages = size >> LG_PAGE;
+	if (npages > HPA_REGION_NPAGES) {
+		return NULL;
+	}
+	extent_t *slab = extent_alloc(tsdn, arena);
+	if (slab == NULL) {
+		return NULL;
+	}
+
+	malloc_mutex_lock(tsdn, &hpa->mtx);
+	hpa_region_t *region = hpa_region_choose(tsdn, arena, hpa, npages);
+	if (region == NULL) {
+		malloc_mutex_unlock(tsdn, &hpa->mtx);
+		extent_dalloc(tsdn, arena, slab);
+		return NULL;
+	}
+	size_t first = hpa_region_first_fit(region, npages);
+	assert(first < HPA_REGION_NPAGES);
+	hpa_region_list_remove(hpa, region);
+	hpa_region_pages_set(region, first, npages, true);
+	region->nactive += npages;
+	region->longest_free = hpa_region_longest_free(region);
+	region->dirty = true;
+	hpa_region_list_insert(hpa, region);
+	void *addr = (void *)((uintptr_t)region->addr + (first << LG_PAGE));
+	malloc_mutex_unlock(tsdn, &hpa->mtx);
+
+	extent_init(slab, arena_ind_get(arena), addr, size, true, szind,
+	    arena_extent_sn_next(arena), extent_state_active, false, true, true,
+	    EXTENT_NOT_HEAD);
+	extent_hpa_set(slab, true);
+	if (extent_register(tsdn, slab)) {
+		malloc_mutex_lock(tsdn, &hpa->mtx);
+		hpa_region_pages_release(tsdn, hpa, region, first, npages);
+		malloc_mutex_unlock(tsdn, &hpa->mtx);
+		extent_dalloc(tsdn, arena, slab);
+		return NULL;
+	}
+	return slab;
+}
+
+bool
+hpa_dalloc(tsdn_t *tsdn, arena_t *arena, hpa_t *hpa, extent_t *slab) {
+	if (!extent_hpa_get(slab)) {
+		return true;
+	}
+	void *addr = extent_base_get(slab);
+	size_t npages = extent_size_get(slab) >> LG_PAGE;
+	extent_deregister(tsdn, slab);
+
+	malloc_mutex_lock(tsdn, &hpa->mtx);
+	hpa_region_t *region = hpa_region_lookup(hpa, HUGEPAGE_ADDR2BASE(addr));
+	assert(region != NULL);
+	hpa_region_pages_release(tsdn, hpa, region,
+	    ((uintptr_t)addr - (uintptr_t)region->addr) >> LG_PAGE, npages);
+	malloc_mutex_unlock(tsdn, &hpa->mtx);
+
+	extent_dalloc(tsdn, arena, slab);
+	return false;
+}
+
+void
+hpa_purge(tsdn_t *tsdn, hpa_t *hpa) {
+	malloc_mutex_lock(tsdn, &hpa->mtx);
+	hpa_region_t *region;
+	while ((region = ql_first(&hpa->empty)) != NULL && region->dirty) {
+		hpa_region_list_remove(hpa, region);
+		if (!hpa_region_purge(tsdn, hpa, region)) {
+			hpa_region_list_insert(hpa, region);
+		}
+	}
+	malloc_mutex_unlock(tsdn, &hpa->mtx);
+}
+
+void
+hpa_destroy(tsdn_t *tsdn, hpa_t *hpa) {
+	malloc_mutex_lock(tsdn, &hpa->mtx);
+	while (hpa->nregions > 0) {
+		hpa_region_t *region = hpa->regions[hpa->nregions - 1];
+		hpa_region_list_remove(hpa, region);
+		hpa_region_unmap(tsdn, hpa, region);
+	}
+	assert(hpa->nempty_dirty == 0);
+	malloc_mutex_unlock(tsdn, &hpa->mtx);
+}
+
+size_t
+hpa_mapped_get(hpa_t *hpa) {
+	return atomic_load_zu(&hpa->mapped, ATOMIC_RELAXED);
+}
+
+void
+hpa_prefork(tsdn_t *tsdn, hpa_t *hpa) {
+	malloc_mutex_prefork(tsdn, &hpa->mtx);
+}
+
+void
+hpa_postfork_parent(tsdn_t *tsdn, hpa_t *hpa) {
+	malloc_mutex_postfork_parent(tsdn, &hpa->mtx);
+}
+
+void
+hpa_postfork_child(tsdn_t *tsdn, hpa_t *hpa) {
+	malloc_mutex_postfork_child(tsdn, &hpa->mtx);
+}
@@ -12,7 +12,9 @@
 #include "jemalloc/internal/log.h"
 #include "jemalloc/internal/malloc_io.h"
 #include "jemalloc/internal/mutex.h"
+#include "jemalloc/internal/pressure.h"
 #include "jemalloc/internal/rtree.h"
+#include "jemalloc/internal/slab_map.h"
 #include "jemalloc/internal/safety_check.h"
 #include "jemalloc/internal/sc.h"
 #include "jemalloc/internal/spin.h"
@@ -123,7 +125,8 @@ enum {
 	flag_opt_junk_free	= (1U << 1),
 	flag_opt_zero		= (1U << 2),
 	flag_opt_utrace		= (1U << 3),
-	flag_opt_xmalloc	= (1U << 4)
+	flag_opt_xmalloc	= (1U << 4),
+	flag_opt_tcache_global_bytes_max = (1U << 5)
 };
 static uint8_t	malloc_slow_flags;
 
@@ -397,6 +400,7 @@ arena_bind(tsd_t *tsd, unsigned ind, bool internal) {
 		unsigned shard = atomic_fetch_add_u(&arena->binshard_next, 1,
 		    ATOMIC_RELAXED);
 		tsd_binshards_t *bins = tsd_binshardsp_get(tsd);
+		bins->ticket = shard;
 		for (unsigned i = 0; i < SC_NBINS; i++) {
 			assert(bin_infos[i].n_shards > 0 &&
 			    bin_infos[i].n_shards <= BIN_SHARDS_MAX);
@@ -948,7 +952,9 @@ malloc_slow_flag_init(void) {
 	    | (opt_junk_free ? flag_opt_junk_free : 0)
 	    | (opt_zero ? flag_opt_zero : 0)
 	    | (opt_utrace ? flag_opt_utrace : 0)
-	    | (opt_xmalloc ? flag_opt_xmalloc : 0);
+	    | (opt_xmalloc ? flag_opt_xmalloc : 0)
+	    | (opt_tcache_global_bytes_max != 0 ?
+	    flag_opt_tcache_global_bytes_max : 0);
 
 	malloc_slow = (malloc_slow_flags != 0);
 }
@@ -1312,6 +1318,14 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 			CONF_HANDLE_BOOL(opt_tcache, "tcache")
 			CONF_HANDLE_SSIZE_T(opt_lg_tcache_max, "lg_tcache_max",
 			    -1, (sizeof(size_t) << 3) - 1)
+			CONF_HANDLE_BOOL(opt_tcache_adaptive, "tcache_adaptive")
+			CONF_HANDLE_SIZE_T(opt_tcache_bytes_max,
+			    "tcache_bytes_max", 0, 0, CONF_DONT_CHECK_MIN,
+			    CONF_DONT_CHECK_MAX, false)
+			CONF_HANDLE_SIZE_T(opt_tcache_global_bytes_max,
+			    "tcache_global_bytes_max", 0, 0,
+			    CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX, false)
+			CONF_HANDLE_BOOL(opt_percpu_tcache, "percpu_tcache")
 
 			/*
 			 * The runtime option of oversize_threshold remains
@@ -1382,6 +1396,37 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 				} while (!err && vlen_left > 0);
 				CONF_CONTINUE;
 			}
+			CONF_HANDLE_BOOL(opt_slab_autotune, "slab_autotune")
+			CONF_HANDLE_UNSIGNED(opt_bin_stash, "bin_stash", 0,
+			    BIN_STASH_MAX, CONF_DONT_CHECK_MIN, CONF_CHECK_MAX,
+			    true)
+			CONF_HANDLE_UNSIGNED(opt_bin_shards_max,
+			    "bin_shards_max", 0, BIN_SHARDS_MAX,
+			    CONF_DONT_CHECK_MIN, CONF_CHECK_MAX, true)
+			CONF_HANDLE_BOOL(opt_hpa, "hpa")
+			CONF_HANDLE_BOOL(opt_lazy_coalesce, "lazy_coalesce")
+			CONF_HANDLE_BOOL(opt_extent_best_fit, "extent_best_fit")
+			if (CONF_MATCH("decay_curve")) {
+				int i;
+				for (i = 0; i < decay_curve_names_limit; i++) {
+					if (strncmp(decay_curve_names[i], v,
+					    vlen) == 0) {
+						opt_decay_curve = i;
+						break;
+					}
+				}
+				if (i == decay_curve_names_limit) {
+					CONF_ERROR("Invalid conf value",
+					    k, klen, v, vlen);
+				}
+				CONF_CONTINUE;
+			}
+			CONF_HANDLE_BOOL(opt_pressure_purge, "pressure_purge")
+			CONF_HANDLE_SIZE_T(opt_dirty_max, "dirty_max", 0,
+			    SIZE_T_MAX, CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX,
+			    false)
+			CONF_HANDLE_BOOL(opt_rtree_flat, "rtree_flat")
+			CONF_HANDLE_BOOL(opt_slab_map, "slab_map")
 			if (config_prof) {
 				CONF_HANDLE_BOOL(opt_prof, "prof")
 				CONF_HANDLE_CHAR_P(opt_prof_prefix,
@@ -1563,6 +1608,7 @@ malloc_init_hard_a0_locked() {
 	if (extent_boot()) {
 		return true;
 	}
+	slab_map_boot();
 	if (ctl_boot()) {
 		return true;
 	}
@@ -1807,6 +1853,9 @@ malloc_init_hard(void) {
 	if (malloc_init_narenas() || background_thread_boot1(tsd_tsdn(tsd))) {
 		UNLOCK_RETURN(tsd_tsdn(tsd), true, true)
 	}
+	if (tcache_percpu_boot(tsd_tsdn(tsd))) {
+		UNLOCK_RETURN(tsd_tsdn(tsd), true, true)
+	}
 	if (config_prof && prof_boot2(tsd)) {
 		UNLOCK_RETURN(tsd_tsdn(tsd), true, true)
 	}
@@ -1951,6 +2000,7 @@ JEMALLOC_ALWAYS_INLINE void *
 imalloc_no_sample(static_opts_t *sopts, dynamic_opts_t *dopts, tsd_t *tsd,
     size_t size, size_t usize, szind_t ind) {
 	tcache_t *tcache;
+	tcache_percpu_t *percpu = NULL;
 	arena_t *arena;
 
 	/* Fill in the tcache. */
@@ -1961,6 +2011,17 @@ imalloc_no_sample(static_opts_t *sopts, dynamic_opts_t *dopts, tsd_t *tsd,
 			assert(tcache == tcache_get(tsd));
 		} else {
 			tcache = tcache_get(tsd);
+			if (tcache == NULL && dopts->alignment == 0 &&
+			    ind < SC_NBINS) {
+				void *ret = tcache_percpu_alloc_small(tsd, ind,
+				    dopts->zero);
+				if (ret != NULL) {
+					return ret;
+				}
+			}
+			if (tcache == NULL) {
+				tcache = tcache_percpu_get(tsd, &percpu);
+			}
 		}
 	} else if (dopts->tcache_ind == TCACHE_IND_NONE) {
 		tcache = NULL;
@@ -1980,13 +2041,18 @@ imalloc_no_sample(static_opts_t *sopts, dynamic_opts_t *dopts, tsd_t *tsd,
 		arena = arena_get(tsd_tsdn(tsd), dopts->arena_ind, true);
 	}
 
+	void *ret;
 	if (unlikely(dopts->alignment != 0)) {
-		return ipalloct(tsd_tsdn(tsd), usize, dopts->alignment,
+		ret = ipalloct(tsd_tsdn(tsd), usize, dopts->alignment,
 		    dopts->zero, tcache, arena);
+	} else {
+		ret = iallocztm(tsd_tsdn(tsd), size, ind, dopts->zero, tcache,
+		    false, arena, sopts->slow);
 	}
-
-	return iallocztm(tsd_tsdn(tsd), size, ind, dopts->zero, tcache, false,
-	    arena, sopts->slow);
+	if (percpu != NULL) {
+		tcache_percpu_unlock(tsd, percpu);
+	}
+	return ret;
 }
 
 JEMALLOC_ALWAYS_INLINE void *
@@ -2384,6 +2450,10 @@ je_malloc(size_t size) {
 	tcache_t *tcache = tsd_tcachep_get(tsd);
 	cache_bin_t *bin = tcache_small_bin_get(tcache, ind);
 	bool tcache_success;
+	/*
+	 * No tcache_op_begin() here: opt_tcache_global_bytes_max sets
+	 * malloc_slow, which keeps all threads off this path.
+	 */
 	void *ret = cache_bin_alloc_easy_reduced(bin, &tcache_success);
 
 	if (tcache_success) {
@@ -2515,8 +2585,12 @@ je_calloc(size_t num, size_t size) {
 	return ret;
 }
 
+/*
+ * If percpu, a NULL tcache stands for the automatic choice, which may be the
+ * per-CPU cache (see tcache_percpu_get()).
+ */
 JEMALLOC_ALWAYS_INLINE void
-ifree(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path) {
+ifree(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path, bool percpu) {
 	if (!slow_path) {
 		tsd_assert_fast(tsd);
 	}
@@ -2544,13 +2618,26 @@ ifree(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path) {
 		idalloctm(tsd_tsdn(tsd), ptr, tcache, &alloc_ctx, false,
 		    false);
 	} else {
+		tcache_percpu_t *tcache_percpu = NULL;
+		if (percpu && tcache == NULL) {
+			if (alloc_ctx.slab && tcache_percpu_dalloc_small(tsd,
+			    ptr, alloc_ctx.szind)) {
+				return;
+			}
+			tcache = tcache_percpu_get(tsd, &tcache_percpu);
+		}
 		idalloctm(tsd_tsdn(tsd), ptr, tcache, &alloc_ctx, false,
 		    true);
+		if (tcache_percpu != NULL) {
+			tcache_percpu_unlock(tsd, tcache_percpu);
+		}
 	}
 }
 
+/* See ifree() for percpu. */
 JEMALLOC_ALWAYS_INLINE void
-isfree(tsd_t *tsd, void *ptr, size_t usize, tcache_t *tcache, bool slow_path) {
+isfree(tsd_t *tsd, void *ptr, size_t usize, tcache_t *tcache, bool slow_path,
+    bool percpu) {
 	if (!slow_path) {
 		tsd_assert_fast(tsd);
 	}
@@ -2600,7 +2687,23 @@ isfree(tsd_t *tsd, void *ptr, size_t usize, tcache_t *tcache, bool slow_path) {
 	if (likely(!slow_path)) {
 		isdalloct(tsd_tsdn(tsd), ptr, usize, tcache, ctx, false);
 	} else {
+		tcache_percpu_t *tcache_percpu = NULL;
+		if (percpu && tcache == NULL) {
+			/* As arena_sdalloc() finds the size class. */
+			szind_t szind = (ctx != NULL) ? ctx->szind :
+			    sz_size2index(usize);
+			bool slab = (ctx != NULL) ? ctx->slab :
+			    (szind < SC_NBINS);
+			if (slab && tcache_percpu_dalloc_small(tsd, ptr,
+			    szind)) {
+				return;
+			}
+			tcache = tcache_percpu_get(tsd, &tcache_percpu);
+		}
 		isdalloct(tsd_tsdn(tsd), ptr, usize, tcache, ctx, true);
+		if (tcache_percpu != NULL) {
+			tcache_percpu_unlock(tsd, tcache_percpu);
+		}
 	}
 }
 
@@ -2625,7 +2728,7 @@ free_default(void *ptr) {
 			tsd_assert_fast(tsd);
 			/* Unconditionally get tcache ptr on fast path. */
 			tcache = tsd_tcachep_get(tsd);
-			ifree(tsd, ptr, tcache, false);
+			ifree(tsd, ptr, tcache, false, false);
 		} else {
 			if (likely(tsd_reentrancy_level_get(tsd) == 0)) {
 				tcache = tcache_get(tsd);
@@ -2634,7 +2737,7 @@ free_default(void *ptr) {
 			}
 			uintptr_t args_raw[3] = {(uintptr_t)ptr};
 			hook_invoke_dalloc(hook_dalloc_free, ptr, args_raw);
-			ifree(tsd, ptr, tcache, true);
+			ifree(tsd, ptr, tcache, true, true);
 		}
 		check_entry_exit_locking(tsd_tsdn(tsd));
 	}
@@ -2649,33 +2752,65 @@ bool free_fastpath(void *ptr, size_t size, bool size_hint) {
 
 	szind_t szind;
 	/*
-	 * If !config_cache_oblivious, we can check PAGE alignment to
-	 * detect sampled objects.  Otherwise addresses are
-	 * randomized, and we have to look it up in the rtree anyway.
-	 * See also isfree().
+	 * With a size hint, the size class only needs to be looked up in the
+	 * rtree if there may be sampled objects, i.e. if opt_prof, and they
+	 * can't be told apart by their address.  If !config_cache_oblivious,
+	 * we can check PAGE alignment to detect them.  Otherwise addresses are
+	 * randomized, and we have to look it up in the rtree anyway.  See also
+	 * isfree().
 	 */
-	if (!size_hint || config_cache_oblivious) {
-		bool slab;
-		rtree_ctx_t *rtree_ctx = tsd_rtree_ctx(tsd);
-		bool res = rtree_szind_slab_read_fast(tsd_tsdn(tsd),
-		    &extents_rtree, rtree_ctx, (uintptr_t)ptr, &szind, &slab);
+	bool sampled_possible = config_prof && opt_prof;
+	if (!size_hint || (sampled_possible && config_cache_oblivious)) {
+		/*
+		 * The slab map, if any, knows the size class of small objects
+		 * (but not of sampled ones, which are not on slabs) with a
+		 * single load.  Anything else goes through the rtree.
+		 */
+		if (slab_map_lookup((uintptr_t)ptr, &szind)) {
+			if (config_debug) {
+				szind_t dbg_szind;
+				bool dbg_slab;
+				rtree_ctx_t *rtree_ctx = tsd_rtree_ctx(tsd);
+				rtree_szind_slab_read(tsd_tsdn(tsd),
+				    &extents_rtree, rtree_ctx, (uintptr_t)ptr,
+				    true, &dbg_szind, &dbg_slab);
+				assert(dbg_slab && szind == dbg_szind);
+			}
+		} else {
+			bool slab;
+			rtree_ctx_t *rtree_ctx = tsd_rtree_ctx(tsd);
+			bool res = rtree_szind_slab_read_fast(tsd_tsdn(tsd),
+			    &extents_rtree, rtree_ctx, (uintptr_t)ptr, &szind,
+			    &slab);
 
-		/* Note: profiled objects will have alloc_ctx.slab set */
-		if (unlikely(!res || !slab)) {
-			return false;
+			/* Note: profiled objects will have alloc_ctx.slab set */
+			if (unlikely(!res || !slab)) {
+				return false;
+			}
 		}
 		assert(szind != SC_NSIZES);
 	} else {
 		/*
 		 * Check for both sizes that are too large, and for sampled
-		 * objects.  Sampled objects are always page-aligned.  The
-		 * sampled object check will also check for null ptr.
+		 * objects.  Sampled objects are always page-aligned here.  The
+		 * sampled object check will also check for null ptr, which
+		 * otherwise needs checking on its own.
 		 */
-		if (unlikely(size > SC_LOOKUP_MAXCLASS ||
-		    (((uintptr_t)ptr & PAGE_MASK) == 0))) {
+		if (unlikely(size > SC_LOOKUP_MAXCLASS || (sampled_possible ?
+		    (((uintptr_t)ptr & PAGE_MASK) == 0) : ptr == NULL))) {
 			return false;
 		}
 		szind = sz_size2index_lookup(size);
+		if (config_debug) {
+			szind_t dbg_szind;
+			bool dbg_slab;
+			rtree_ctx_t *rtree_ctx = tsd_rtree_ctx(tsd);
+			rtree_szind_slab_read(tsd_tsdn(tsd), &extents_rtree,
+			    rtree_ctx, (uintptr_t)ptr, true, &dbg_szind,
+			    &dbg_slab);
+			assert(dbg_szind == szind);
+			assert(dbg_slab);
+		}
 	}
 
 	tcache_t *tcache = tsd_tcachep_get(tsd);
@@ -2980,6 +3115,193 @@ je_mallocx(size_t size, int flags) {
 	return ret;
 }
 
+/*
+ * Whether a batch operation may skip the per-object path.  Hooks and
+ * reentrancy need to observe every object, and profiling needs per-object
+ * sampling; junk filling and opt_zero are handled by the batched paths.
+ */
+JEMALLOC_ALWAYS_INLINE bool
+batch_fast_path_available(tsd_t *tsd) {
+	return tsd_nominal(tsd) && tsd_reentrancy_level_get(tsd) == 0 &&
+	    !tsd_global_slow() && !(config_prof && opt_prof);
+}
+
+/*
+ * Allocate num objects of the given size and mallocx() flags into ptrs, and
+ * return the number of objects actually allocated (less than num only on OOM).
+ *
+ * Small size classes are served by first draining the tcache bin for the class,
+ * and then filling the remainder directly from the arena bin under a single
+ * bin lock acquisition.  If an arena is specified via MALLOCX_ARENA(), the
+ * tcache is bypassed so that all objects come from that arena.  Large sizes,
+ * and the cases rejected by batch_fast_path_available(), fall back to one
+ * mallocx() per object.
+ */
+size_t
+batch_alloc(tsd_t *tsd, void **ptrs, size_t num, size_t size, int flags) {
+	size_t filled = 0;
+
+	LOG("core.batch_alloc.entry", "ptrs: %p, num: %zu, size: %zu, "
+	    "flags: %d", ptrs, num, size, flags);
+
+	size_t alignment = MALLOCX_ALIGN_GET(flags);
+	size_t usize = (alignment == 0) ? sz_s2u(size) :
+	    sz_sa2u(size, alignment);
+	if (!batch_fast_path_available(tsd) || usize == 0 ||
+	    usize > SC_SMALL_MAXCLASS) {
+		for (; filled < num; filled++) {
+			ptrs[filled] = je_mallocx(size, flags);
+			if (ptrs[filled] == NULL) {
+				break;
+			}
+		}
+		goto label_done;
+	}
+
+	check_entry_exit_locking(tsd_tsdn(tsd));
+	szind_t ind = sz_size2index(usize);
+	bool zero = MALLOCX_ZERO_GET(flags);
+
+	arena_t *arena = NULL;
+	tcache_t *tcache;
+	if ((flags & MALLOCX_ARENA_MASK) != 0) {
+		arena = arena_get(tsd_tsdn(tsd), MALLOCX_ARENA_GET(flags),
+		    true);
+		if (unlikely(arena == NULL)) {
+			goto label_done;
+		}
+		tcache = NULL;
+	} else if ((flags & MALLOCX_TCACHE_MASK) == 0) {
+		tcache = tcache_get(tsd);
+	} else if ((flags & MALLOCX_TCACHE_MASK) == MALLOCX_TCACHE_NONE) {
+		tcache = NULL;
+	} else {
+		tcache = tcaches_get(tsd, MALLOCX_TCACHE_GET(flags));
+	}
+
+	if (tcache != NULL) {
+		cache_bin_t *bin = tcache_small_bin_get(tcache, ind);
+		tcache_op_begin(tcache, true);
+		filled = cache_bin_alloc_batch(bin, ind, num, ptrs);
+		if (config_stats) {
+			bin->tstats.nrequests += filled;
+		}
+		tcache_op_end(tcache, true);
+		for (size_t i = 0; i < filled; i++) {
+			if (!zero) {
+				if (config_fill) {
+					if (unlikely(opt_junk_alloc)) {
+						arena_alloc_junk_small(ptrs[i],
+						    &bin_infos[ind], false);
+					} else if (unlikely(opt_zero)) {
+						memset(ptrs[i], 0, usize);
+					}
+				}
+			} else {
+				memset(ptrs[i], 0, usize);
+			}
+		}
+	}
+	if (filled < num) {
+		arena = arena_choose(tsd, arena);
+		if (likely(arena != NULL)) {
+			filled += arena_fill_small_batch(tsd_tsdn(tsd), arena,
+			    ind, ptrs + filled, num - filled, zero);
+		}
+	}
+	if (filled > 0) {
+		thread_event(tsd, usize * filled);
+	}
+	check_entry_exit_locking(tsd_tsdn(tsd));
+
+label_done:
+	LOG("core.batch_alloc.exit", "result: %zu", filled);
+	return filled;
+}
+
+/* Number of pointers looked up and grouped per pass of batch_free(). */
+#define BATCH_FREE_NMAX 256
+
+/*
+ * Free the num pointers in ptrs (NULL entries are skipped).  If size is
+ * non-zero, all pointers must have been allocated with that size, as for
+ * sdallocx().
+ *
+ * On the fast path, extents are looked up once per pointer through the
+ * thread's rtree_ctx, and small regions are released straight to their arena
+ * bins, grouped so that each bin lock is taken once per group rather than once
+ * per pointer (see also tcache_bin_flush_small()).  Large objects, and the
+ * cases rejected by batch_fast_path_available(), fall back to one dallocx()
+ * per pointer.
+ */
+void
+batch_free(tsd_t *tsd, void **ptrs, size_t num, size_t size) {
+	LOG("core.batch_free.entry", "ptrs: %p, num: %zu, size: %zu", ptrs,
+	    num, size);
+
+	if (!batch_fast_path_available(tsd) || (size != 0 &&
+	    sz_size2index(size) >= SC_NBINS)) {
+		for (size_t i = 0; i < num; i++) {
+			if (ptrs[i] == NULL) {
+				continue;
+			}
+			if (size != 0) {
+				je_sdallocx(ptrs[i], size, MALLOCX_TCACHE_NONE);
+			} else {
+				je_dallocx(ptrs[i], MALLOCX_TCACHE_NONE);
+			}
+		}
+		goto label_done;
+	}
+
+	check_entry_exit_locking(tsd_tsdn(tsd));
+	tcache_t *tcache = tcache_get(tsd);
+	bool slow_path = !tsd_fast(tsd);
+	rtree_ctx_t *rtree_ctx = tsd_rtree_ctx(tsd);
+	void *batch_ptrs[BATCH_FREE_NMAX];
+	extent_t *batch_extents[BATCH_FREE_NMAX];
+	for (size_t base = 0; base < num; base += BATCH_FREE_NMAX) {
+		size_t nbatch = num - base < BATCH_FREE_NMAX ? num - base :
+		    BATCH_FREE_NMAX;
+		size_t nsmall = 0;
+		size_t freed = 0;
+		for (size_t i = 0; i < nbatch; i++) {
+			void *ptr = ptrs[base + i];
+			if (ptr == NULL) {
+				continue;
+			}
+			extent_t *extent;
+			szind_t szind;
+			rtree_extent_szind_read(tsd_tsdn(tsd), &extents_rtree,
+			    rtree_ctx, (uintptr_t)ptr, true, &extent, &szind);
+			assert(szind < SC_NSIZES);
+			if (config_opt_safety_checks && size != 0 &&
+			    unlikely(szind != sz_size2index(size))) {
+				safety_check_fail("<jemalloc>: size mismatch "
+				    "detected in batch free, likely caused by "
+				    "sized deallocation bugs by application. "
+				    "Abort.\n");
+				abort();
+			}
+			if (likely(extent_slab_get(extent))) {
+				batch_ptrs[nsmall] = ptr;
+				batch_extents[nsmall] = extent;
+				nsmall++;
+				freed += sz_index2size(szind);
+			} else {
+				ifree(tsd, ptr, tcache, slow_path, false);
+			}
+		}
+		arena_dalloc_small_batch(tsd_tsdn(tsd), batch_ptrs,
+		    batch_extents, nsmall);
+		*tsd_thread_deallocatedp_get(tsd) += freed;
+	}
+	check_entry_exit_locking(tsd_tsdn(tsd));
+
+label_done:
+	LOG("core.batch_free.exit", "");
+}
+
 static void *
 irallocx_prof_sample(tsdn_t *tsdn, void *old_ptr, size_t old_usize,
     size_t usize, size_t alignment, bool zero, tcache_t *tcache, arena_t *arena,
@@ -3172,7 +3494,7 @@ do_realloc_nonnull_zero(void *ptr) {
 		uintptr_t args[3] = {(uintptr_t)ptr, 0};
 		hook_invoke_dalloc(hook_dalloc_realloc, ptr, args);
 
-		ifree(tsd, ptr, tcache, true);
+		ifree(tsd, ptr, tcache, true, true);
 
 		check_entry_exit_locking(tsd_tsdn(tsd));
 		return NULL;
@@ -3456,11 +3778,12 @@ je_dallocx(void *ptr, int flags) {
 	UTRACE(ptr, 0, 0);
 	if (likely(fast)) {
 		tsd_assert_fast(tsd);
-		ifree(tsd, ptr, tcache, false);
+		ifree(tsd, ptr, tcache, false, false);
 	} else {
 		uintptr_t args_raw[3] = {(uintptr_t)ptr, flags};
 		hook_invoke_dalloc(hook_dalloc_dallocx, ptr, args_raw);
-		ifree(tsd, ptr, tcache, true);
+		ifree(tsd, ptr, tcache, true,
+		    (flags & MALLOCX_TCACHE_MASK) == 0);
 	}
 	check_entry_exit_locking(tsd_tsdn(tsd));
 
@@ -3517,11 +3840,12 @@ sdallocx_default(void *ptr, size_t size, int flags) {
 	UTRACE(ptr, 0, 0);
 	if (likely(fast)) {
 		tsd_assert_fast(tsd);
-		isfree(tsd, ptr, usize, tcache, false);
+		isfree(tsd, ptr, usize, tcache, false, false);
 	} else {
 		uintptr_t args_raw[3] = {(uintptr_t)ptr, size, flags};
 		hook_invoke_dalloc(hook_dalloc_sdallocx, ptr, args_raw);
-		isfree(tsd, ptr, usize, tcache, true);
+		isfree(tsd, ptr, usize, tcache, true,
+		    (flags & MALLOCX_TCACHE_MASK) == 0);
 	}
 	check_entry_exit_locking(tsd_tsdn(tsd));
 
@@ -3764,7 +4088,7 @@ _malloc_prefork(void)
 		background_thread_prefork1(tsd_tsdn(tsd));
 	}
 	/* Break arena prefork into stages to preserve lock order. */
-	for (i = 0; i < 8; i++) {
+	for (i = 0; i < 9; i++) {
 		for (j = 0; j < narenas; j++) {
 			if ((arena = arena_get(tsd_tsdn(tsd), j, false)) !=
 			    NULL) {
@@ -3793,6 +4117,9 @@ _malloc_prefork(void)
 				case 7:
 					arena_prefork7(tsd_tsdn(tsd), arena);
 					break;
+				case 8:
+					arena_prefork8(tsd_tsdn(tsd), arena);
+					break;
 				default: not_reached();
 				}
 			}
@@ -40,6 +40,15 @@ thp_mode_t init_system_thp_mode;
 /* Runtime support for lazy purge. Irrelevant when !pages_can_purge_lazy. */
 static bool pages_can_purge_lazy_runtime = true;
 
+#ifdef JEMALLOC_HAVE_PROCESS_MADVISE
+/*
+ * Runtime support for process_madvise(2) with the purge advice values, which
+ * needs Linux 6.13 or later.  Cleared on the first call that fails for lack of
+ * it.
+ */
+static atomic_b_t pages_can_purge_batch_runtime = ATOMIC_INIT(true);
+#endif
+
 /******************************************************************************/
 /*
  * Function prototypes for static functions that are referenced prior to
@@ -343,6 +352,94 @@ pages_purge_forced(void *addr, size_t size) {
 #endif
 }
 
+static bool
+pages_purge_batch_impl(const pages_range_t *ranges, size_t nranges,
+    int advice) {
+	assert(nranges <= PAGES_PURGE_BATCH_MAX);
+#ifdef JEMALLOC_HAVE_PROCESS_MADVISE
+	if (!atomic_load_b(&pages_can_purge_batch_runtime, ATOMIC_RELAXED)) {
+		return true;
+	}
+	struct iovec iov[PAGES_PURGE_BATCH_MAX];
+	size_t size = 0;
+	for (size_t i = 0; i < nranges; i++) {
+		assert(PAGE_ADDR2BASE(ranges[i].addr) == ranges[i].addr);
+		assert(PAGE_CEILING(ranges[i].size) == ranges[i].size);
+		iov[i].iov_base = ranges[i].addr;
+		iov[i].iov_len = ranges[i].size;
+		size += ranges[i].size;
+	}
+
+	/*
+	 * Open a pidfd for the calling process each time, rather than keeping
+	 * one, which would refer to the parent after fork(2).
+	 */
+	int pidfd = (int)syscall(SYS_pidfd_open, getpid(), 0);
+	if (pidfd == -1) {
+		if (errno == ENOSYS) {
+			atomic_store_b(&pages_can_purge_batch_runtime, false,
+			    ATOMIC_RELAXED);
+		}
+		return true;
+	}
+	ssize_t ret = (ssize_t)syscall(SYS_process_madvise, pidfd, iov,
+	    nranges, advice, 0);
+	int err = errno;
+#if defined(JEMALLOC_USE_SYSCALL) && defined(SYS_close)
+	syscall(SYS_close, pidfd);
+#else
+	close(pidfd);
+#endif
+	if (ret == -1 && (err == EINVAL || err == ENOSYS || err == EPERM)) {
+		/* Older kernel, or process_madvise(2) filtered out. */
+		atomic_store_b(&pages_can_purge_batch_runtime, false,
+		    ATOMIC_RELAXED);
+	}
+	return (ret != (ssize_t)size);
+#else
+	return true;
+#endif
+}
+
+bool
+pages_purge_lazy_batch(const pages_range_t *ranges, size_t nranges) {
+	if (!pages_can_purge_lazy || !pages_can_purge_lazy_runtime) {
+		return true;
+	}
+#if defined(_WIN32)
+	return true;
+#elif defined(JEMALLOC_PURGE_MADVISE_FREE)
+	return pages_purge_batch_impl(ranges, nranges,
+#  ifdef MADV_FREE
+	    MADV_FREE
+#  else
+	    JEMALLOC_MADV_FREE
+#  endif
+	    );
+#elif defined(JEMALLOC_PURGE_MADVISE_DONTNEED) && \
+    !defined(JEMALLOC_PURGE_MADVISE_DONTNEED_ZEROS)
+	return pages_purge_batch_impl(ranges, nranges, MADV_DONTNEED);
+#else
+	not_reached();
+#endif
+}
+
+bool
+pages_purge_forced_batch(const pages_range_t *ranges, size_t nranges) {
+#if defined(JEMALLOC_PURGE_MADVISE_DONTNEED) && \
+    defined(JEMALLOC_PURGE_MADVISE_DONTNEED_ZEROS)
+	return pages_purge_batch_impl(ranges, nranges, MADV_DONTNEED);
+#else
+	/* Overlaying new mappings can't be batched. */
+	return true;
+#endif
+}
+
+bool
+pages_can_decommit(void) {
+	return !os_overcommits;
+}
+
 static bool
 pages_huge_impl(void *addr, size_t size, bool aligned) {
 	if (aligned) {
@@ -412,6 +509,25 @@ pages_dodump(void *addr, size_t size) {
 #endif
 }
 
+void *
+pages_map_sparse(size_t size) {
+	/*
+	 * Only where the OS overcommits; mappings are then MAP_NORESERVE if
+	 * available, so that no swap space is reserved for them either.
+	 */
+	if (!os_overcommits) {
+		return NULL;
+	}
+	bool commit = true;
+	void *ret = pages_map(NULL, size, PAGE, &commit);
+	if (ret == NULL) {
+		return NULL;
+	}
+	/* Don't let a single write populate a whole huge page. */
+	pages_nohuge_unaligned(ret, size);
+	return ret;
+}
+
 
 static size_t
 os_page_detect(void) {
@@ -0,0 +1,221 @@
+#define JEMALLOC_PRESSURE_C_
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/malloc_io.h"
+#include "jemalloc/internal/pressure.h"
+
+/******************************************************************************/
+/* Data. */
+
+bool opt_pressure_purge = false;
+
+#ifdef JEMALLOC_PROC_PRESSURE_MEMORY
+#define PRESSURE_PSI_PATH	"/proc/pressure/memory"
+#define PRESSURE_CGROUP_ROOT	"/sys/fs/cgroup"
+/* Large enough for the PSI and cgroup memory files. */
+#define PRESSURE_BUFSIZE	256
+
+static bool pressure_initialized = false;
+static bool pressure_psi_enabled;
+/* The PSI file of the process's cgroup, or else the system-wide one. */
+static char pressure_psi_path[PATH_MAX + 1];
+static bool pressure_cgroup_enabled;
+static char pressure_cgroup_current_path[PATH_MAX + 1];
+static char pressure_cgroup_high_path[PATH_MAX + 1];
+#endif
+
+/******************************************************************************/
+
+bool
+pressure_psi_parse(const char *buf, uint64_t *r_avg10) {
+	static const char prefix[] = "some avg10=";
+	const char *p = buf;
+	while (strncmp(p, prefix, sizeof(prefix) - 1) != 0) {
+		p = strchr(p, '\n');
+		if (p == NULL) {
+			return true;
+		}
+		p++;
+	}
+	p += sizeof(prefix) - 1;
+
+	char *end;
+	uintmax_t whole = malloc_strtoumax(p, &end, 10);
+	if (end == p || *end != '.') {
+		return true;
+	}
+	p = end + 1;
+	uint64_t hundredths = 0;
+	for (unsigned i = 0; i < 2; i++) {
+		hundredths *= 10;
+		if (*p >= '0' && *p <= '9') {
+			hundredths += (uint64_t)(*p - '0');
+			p++;
+		}
+	}
+	*r_avg10 = (uint64_t)whole * 100 + hundredths;
+	return false;
+}
+
+bool
+pressure_cgroup_value_parse(const char *buf, uint64_t *r_value) {
+	if (strncmp(buf, "max", 3) == 0) {
+		*r_value = UINT64_MAX;
+		return false;
+	}
+	char *end;
+	uintmax_t value = malloc_strtoumax(buf, &end, 10);
+	if (end == buf || (*end != '\n' && *end != '\0')) {
+		return true;
+	}
+	*r_value = (uint64_t)value;
+	return false;
+}
+
+bool
+pressure_cgroup_path_parse(const char *buf, char *path, size_t size) {
+	/* The cgroup v2 hierarchy is listed as "0::<path>". */
+	static const char prefix[] = "0::";
+	const char *p = buf;
+	while (strncmp(p, prefix, sizeof(prefix) - 1) != 0) {
+		p = strchr(p, '\n');
+		if (p == NULL) {
+			return true;
+		}
+		p++;
+	}
+	p += sizeof(prefix) - 1;
+
+	const char *end = strchr(p, '\n');
+	size_t len = (end != NULL) ? (size_t)(end - p) : strlen(p);
+	while (len > 0 && p[len - 1] == '/') {
+		len--;
+	}
+	if (len >= size) {
+		return true;
+	}
+	memcpy(path, p, len);
+	path[len] = '\0';
+	return false;
+}
+
+#ifdef JEMALLOC_PROC_PRESSURE_MEMORY
+/* Read a whole (small) file into buf, nul-terminated.  Returns true on error. */
+static bool
+pressure_read(const char *path, char *buf, size_t size) {
+#if defined(JEMALLOC_USE_SYSCALL) && defined(SYS_open)
+	int fd = (int)syscall(SYS_open, path, O_RDONLY | O_CLOEXEC);
+#elif defined(JEMALLOC_USE_SYSCALL) && defined(SYS_openat)
+	int fd = (int)syscall(SYS_openat, AT_FDCWD, path, O_RDONLY | O_CLOEXEC);
+#else
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+#endif
+	if (fd == -1) {
+		return true;
+	}
+
+	ssize_t nread = malloc_read_fd(fd, buf, size - 1);
+#if defined(JEMALLOC_USE_SYSCALL) && defined(SYS_close)
+	syscall(SYS_close, fd);
+#else
+	close(fd);
+#endif
+
+	if (nread <= 0) {
+		return true;
+	}
+	buf[nread] = '\0';
+	return false;
+}
+
+static bool
+pressure_read_value(const char *path, uint64_t *r_value) {
+	char buf[PRESSURE_BUFSIZE];
+	return pressure_read(path, buf, sizeof(buf)) ||
+	    pressure_cgroup_value_parse(buf, r_value);
+}
+
+/* Poll the PSI file at path, if it reads.  Returns true on error. */
+static bool
+pressure_psi_init(const char *path) {
+	char buf[PRESSURE_BUFSIZE];
+	uint64_t avg10;
+	if (malloc_snprintf(pressure_psi_path, sizeof(pressure_psi_path), "%s",
+	    path) >= sizeof(pressure_psi_path)) {
+		return true;
+	}
+	return pressure_read(pressure_psi_path, buf, sizeof(buf)) ||
+	    pressure_psi_parse(buf, &avg10);
+}
+
+static void
+pressure_init(void) {
+	pressure_psi_enabled = false;
+	pressure_cgroup_enabled = false;
+	char cgroup_buf[PATH_MAX + 1];
+	char path[PATH_MAX + 1];
+	if (pressure_read("/proc/self/cgroup", cgroup_buf, sizeof(cgroup_buf))
+	    || pressure_cgroup_path_parse(cgroup_buf, path, sizeof(path))) {
+		pressure_psi_enabled = !pressure_psi_init(PRESSURE_PSI_PATH);
+		return;
+	}
+
+	/*
+	 * Stalls of other cgroups say nothing about this one, so prefer its own
+	 * PSI file, which the root cgroup and older kernels lack.
+	 */
+	char psi_path[PATH_MAX + 1];
+	pressure_psi_enabled = (malloc_snprintf(psi_path, sizeof(psi_path),
+	    "%s%s/memory.pressure", PRESSURE_CGROUP_ROOT, path) <
+	    sizeof(psi_path) && !pressure_psi_init(psi_path)) ||
+	    !pressure_psi_init(PRESSURE_PSI_PATH);
+
+	if (malloc_snprintf(pressure_cgroup_current_path,
+	    sizeof(pressure_cgroup_current_path), "%s%s/memory.current",
+	    PRESSURE_CGROUP_ROOT, path) >=
+	    sizeof(pressure_cgroup_current_path) ||
+	    malloc_snprintf(pressure_cgroup_high_path,
+	    sizeof(pressure_cgroup_high_path), "%s%s/memory.high",
+	    PRESSURE_CGROUP_ROOT, path) >= sizeof(pressure_cgroup_high_path)) {
+		return;
+	}
+	/* The root cgroup has no memory.high. */
+	uint64_t value;
+	pressure_cgroup_enabled = !pressure_read_value(
+	    pressure_cgroup_high_path, &value) &&
+	    !pressure_read_value(pressure_cgroup_current_path, &value);
+}
+#endif
+
+bool
+pressure_high(void) {
+#ifdef JEMALLOC_PROC_PRESSURE_MEMORY
+	if (!pressure_initialized) {
+		pressure_init();
+		pressure_initialized = true;
+	}
+
+	if (pressure_psi_enabled) {
+		char buf[PRESSURE_BUFSIZE];
+		uint64_t avg10;
+		if (!pressure_read(pressure_psi_path, buf, sizeof(buf)) &&
+		    !pressure_psi_parse(buf, &avg10) &&
+		    avg10 >= PRESSURE_PSI_THRESHOLD) {
+			return true;
+		}
+	}
+	if (pressure_cgroup_enabled) {
+		uint64_t high, current;
+		if (!pressure_read_value(pressure_cgroup_high_path, &high) &&
+		    high != UINT64_MAX &&
+		    !pressure_read_value(pressure_cgroup_current_path,
+		    &current) &&
+		    current > high - (high >> PRESSURE_LG_CGROUP_HEADROOM)) {
+			return true;
+		}
+	}
+#endif
+	return false;
+}
@@ -5,12 +5,14 @@
 #include "jemalloc/internal/assert.h"
 #include "jemalloc/internal/mutex.h"
 
+bool opt_rtree_flat = false;
+
 /*
  * Only the most significant bits of keys passed to rtree_{read,write}() are
  * used.
  */
 bool
-rtree_new(rtree_t *rtree, bool zeroed) {
+rtree_new(rtree_t *rtree, bool zeroed, bool flat) {
 #ifdef JEMALLOC_JET
 	if (!zeroed) {
 		memset(rtree, 0, sizeof(rtree_t)); /* Clear root. */
@@ -24,6 +26,17 @@ rtree_new(rtree_t *rtree, bool zeroed) {
 		return true;
 	}
 
+#ifdef RTREE_FLAT
+	if (flat) {
+		/*
+		 * Only the pages of the map covering extents are ever touched.
+		 * If the address space can't be had that way, keep the tree.
+		 */
+		rtree->flat = (rtree_leaf_elm_t *)pages_map_sparse(
+		    RTREE_FLAT_SIZE);
+	}
+#endif
+
 	return false;
 }
 
@@ -92,6 +105,12 @@ rtree_delete_subtree(tsdn_t *tsdn, rtree_t *rtree, rtree_node_elm_t *subtree,
 
 void
 rtree_delete(tsdn_t *tsdn, rtree_t *rtree) {
+#  ifdef RTREE_FLAT
+	if (rtree->flat != NULL) {
+		pages_unmap(rtree->flat, RTREE_FLAT_SIZE);
+		return;
+	}
+#  endif
 #  if RTREE_HEIGHT > 1
 	rtree_delete_subtree(tsdn, rtree, rtree->root, 0);
 #  endif
@@ -235,10 +254,16 @@ rtree_leaf_elm_lookup_hard(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 		for (unsigned i = 0; i < RTREE_CTX_NCACHE; i++) {
 			assert(rtree_ctx->cache[i].leafkey != leafkey);
 		}
-		for (unsigned i = 0; i < RTREE_CTX_NCACHE_L2; i++) {
-			assert(rtree_ctx->l2_cache[i].leafkey != leafkey);
+		for (unsigned i = 0; i < RTREE_CTX_L2_NSETS; i++) {
+			for (unsigned j = 0; j < RTREE_CTX_L2_NWAYS; j++) {
+				assert(rtree_ctx->l2_cache[i].leafkey[j] !=
+				    leafkey);
+			}
 		}
 	}
+	if (config_stats) {
+		rtree_ctx_stat_inc(&rtree_ctx->nmisses);
+	}
 
 #define RTREE_GET_CHILD(level) {					\
 		assert(level < RTREE_HEIGHT-1);				\
@@ -263,25 +288,23 @@ rtree_leaf_elm_lookup_hard(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 	}
 	/*
 	 * Cache replacement upon hard lookup (i.e. L1 & L2 rtree cache miss):
-	 * (1) evict last entry in L2 cache; (2) move the collision slot from L1
-	 * cache down to L2; and 3) fill L1.
+	 * (1) evict last way in the L2 set; (2) move the collision slot from L1
+	 * cache down to the set; and 3) fill L1.
 	 */
 #define RTREE_GET_LEAF(level) {						\
 		assert(level == RTREE_HEIGHT-1);			\
 		if (!dependent && unlikely(!rtree_leaf_valid(leaf))) {	\
 			return NULL;					\
 		}							\
-		if (RTREE_CTX_NCACHE_L2 > 1) {				\
-			memmove(&rtree_ctx->l2_cache[1],		\
-			    &rtree_ctx->l2_cache[0],			\
-			    sizeof(rtree_ctx_cache_elm_t) *		\
-			    (RTREE_CTX_NCACHE_L2 - 1));			\
-		}							\
 		size_t slot = rtree_cache_direct_map(key);		\
-		rtree_ctx->l2_cache[0].leafkey =			\
-		    rtree_ctx->cache[slot].leafkey;			\
-		rtree_ctx->l2_cache[0].leaf =				\
-		    rtree_ctx->cache[slot].leaf;			\
+		rtree_ctx_cache_set_t *l2 =				\
+		    &rtree_ctx->l2_cache[rtree_cache_l2_set(slot)];	\
+		memmove(&l2->leafkey[1], &l2->leafkey[0],		\
+		    sizeof(uintptr_t) * (RTREE_CTX_L2_NWAYS - 1));	\
+		memmove(&l2->leaf[1], &l2->leaf[0],			\
+		    sizeof(rtree_leaf_elm_t *) * (RTREE_CTX_L2_NWAYS - 1));\
+		l2->leafkey[0] = rtree_ctx->cache[slot].leafkey;	\
+		l2->leaf[0] = rtree_ctx->cache[slot].leaf;		\
 		uintptr_t leafkey = rtree_leafkey(key);			\
 		rtree_ctx->cache[slot].leafkey = leafkey;		\
 		rtree_ctx->cache[slot].leaf = leaf;			\
@@ -312,9 +335,12 @@ rtree_ctx_data_init(rtree_ctx_t *ctx) {
 		cache->leafkey = RTREE_LEAFKEY_INVALID;
 		cache->leaf = NULL;
 	}
-	for (unsigned i = 0; i < RTREE_CTX_NCACHE_L2; i++) {
-		rtree_ctx_cache_elm_t *cache = &ctx->l2_cache[i];
-		cache->leafkey = RTREE_LEAFKEY_INVALID;
-		cache->leaf = NULL;
+	for (unsigned i = 0; i < RTREE_CTX_L2_NSETS; i++) {
+		for (unsigned j = 0; j < RTREE_CTX_L2_NWAYS; j++) {
+			ctx->l2_cache[i].leafkey[j] = RTREE_LEAFKEY_INVALID;
+			ctx->l2_cache[i].leaf[j] = NULL;
+		}
 	}
+	rtree_ctx_stat_reset(&ctx->nhits_l2);
+	rtree_ctx_stat_reset(&ctx->nmisses);
 }
@@ -0,0 +1,60 @@
+#define JEMALLOC_SLAB_MAP_C_
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/slab_map.h"
+
+/******************************************************************************/
+/* Data. */
+
+bool opt_slab_map = false;
+atomic_u8_t *slab_map = NULL;
+
+/******************************************************************************/
+
+void
+slab_map_boot(void) {
+	if (!opt_slab_map) {
+		return;
+	}
+	/* If the address space can't be had that way, keep using the rtree. */
+	slab_map = (atomic_u8_t *)pages_map_sparse(SLAB_MAP_NPAGES *
+	    sizeof(atomic_u8_t));
+}
+
+static void
+slab_map_write(const void *addr, size_t size, uint8_t v) {
+	assert(slab_map != NULL);
+	assert(PAGE_ADDR2BASE(addr) == addr);
+	assert((size & PAGE_MASK) == 0);
+
+#if SLAB_MAP_LG_VADDR < (8 << LG_SIZEOF_PTR)
+	/* Leave slabs (partly) above the map to the rtree. */
+	if ((((uintptr_t)addr + size - 1) >> SLAB_MAP_LG_VADDR) != 0) {
+		return;
+	}
+#endif
+	size_t first = (uintptr_t)addr >> LG_PAGE;
+	size_t npages = size >> LG_PAGE;
+	for (size_t i = 0; i < npages; i++) {
+		atomic_store_u8(&slab_map[first + i], v, ATOMIC_RELAXED);
+	}
+}
+
+void
+slab_map_set(const void *addr, size_t size, szind_t szind) {
+	assert(szind < SC_NBINS);
+	if (slab_map == NULL) {
+		return;
+	}
+	slab_map_write(addr, size, (uint8_t)(szind + 1));
+}
+
+void
+slab_map_clear(const void *addr, size_t size) {
+	if (slab_map == NULL) {
+		return;
+	}
+	slab_map_write(addr, size, 0);
+}
@@ -368,7 +368,8 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i, uint64_t upti
 		CTL_M2_GET("arenas.bin.0.size", j, &reg_size, size_t);
 		CTL_M2_GET("arenas.bin.0.nregs", j, &nregs, uint32_t);
 		CTL_M2_GET("arenas.bin.0.slab_size", j, &slab_size, size_t);
-		CTL_M2_GET("arenas.bin.0.nshards", j, &nshards, uint32_t);
+		CTL_M2_M4_GET("stats.arenas.0.bins.0.nshards", i, j, &nshards,
+		    uint32_t);
 
 		CTL_M2_M4_GET("stats.arenas.0.bins.0.nmalloc", i, j, &nmalloc,
 		    uint64_t);
@@ -413,6 +414,8 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i, uint64_t upti
 		    &curslabs);
 		emitter_json_kv(emitter, "nonfull_slabs", emitter_type_size,
 		    &nonfull_slabs);
+		emitter_json_kv(emitter, "nshards", emitter_type_uint32,
+		    &nshards);
 		if (mutex) {
 			emitter_json_object_kv_begin(emitter, "mutex");
 			mutex_stats_emit(emitter, NULL, col_mutex64,
@@ -644,6 +647,104 @@ stats_arena_extents_print(emitter_t *emitter, unsigned i) {
 	}
 }
 
+static void
+stats_arena_decay_hist_print(emitter_t *emitter, unsigned i) {
+	unsigned j;
+	bool in_gap, in_gap_prev;
+	emitter_row_t header_row;
+	emitter_row_init(&header_row);
+	emitter_row_t row;
+	emitter_row_init(&row);
+
+	COL_HDR(row, bucket, "us/pages", right, 20, uint64)
+	COL_HDR(row, ind, NULL, right, 4, unsigned)
+	COL_HDR(row, dirty_npurge, NULL, right, 17, uint64)
+	COL_HDR(row, dirty_npurge_app, NULL, right, 17, uint64)
+	COL_HDR(row, dirty_nlocked, NULL, right, 17, uint64)
+	COL_HDR(row, dirty_nmadvise, NULL, right, 17, uint64)
+	COL_HDR(row, muzzy_npurge, NULL, right, 17, uint64)
+	COL_HDR(row, muzzy_npurge_app, NULL, right, 17, uint64)
+	COL_HDR(row, muzzy_nlocked, NULL, right, 17, uint64)
+	COL_HDR(row, muzzy_nmadvise, NULL, right, 17, uint64)
+
+	/* Label this section. */
+	header_bucket.width -= 11;
+	emitter_table_printf(emitter, "decay_hist:");
+	emitter_table_row(emitter, &header_row);
+	emitter_json_array_kv_begin(emitter, "decay_hist");
+
+	in_gap = false;
+	for (j = 0; j < ARENA_DECAY_NHIST; j++) {
+		uint64_t dirty_npurge, dirty_npurge_app, dirty_nlocked,
+		    dirty_nmadvise, muzzy_npurge, muzzy_npurge_app,
+		    muzzy_nlocked, muzzy_nmadvise;
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.dirty_npurge", i, j,
+		    &dirty_npurge, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.dirty_npurge_app",
+		    i, j, &dirty_npurge_app, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.dirty_nlocked", i,
+		    j, &dirty_nlocked, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.dirty_nmadvise", i,
+		    j, &dirty_nmadvise, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.muzzy_npurge", i, j,
+		    &muzzy_npurge, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.muzzy_npurge_app",
+		    i, j, &muzzy_npurge_app, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.muzzy_nlocked", i,
+		    j, &muzzy_nlocked, uint64_t);
+		CTL_M2_M4_GET("stats.arenas.0.decay_hist.0.muzzy_nmadvise", i,
+		    j, &muzzy_nmadvise, uint64_t);
+
+		in_gap_prev = in_gap;
+		in_gap = (dirty_npurge == 0 && dirty_nlocked == 0 &&
+		    dirty_nmadvise == 0 && muzzy_npurge == 0 &&
+		    muzzy_nlocked == 0 && muzzy_nmadvise == 0);
+
+		if (in_gap_prev && !in_gap) {
+			emitter_table_printf(emitter,
+			    "                     ---\n");
+		}
+
+		emitter_json_object_begin(emitter);
+		emitter_json_kv(emitter, "dirty_npurge", emitter_type_uint64,
+		    &dirty_npurge);
+		emitter_json_kv(emitter, "dirty_npurge_app",
+		    emitter_type_uint64, &dirty_npurge_app);
+		emitter_json_kv(emitter, "dirty_nlocked", emitter_type_uint64,
+		    &dirty_nlocked);
+		emitter_json_kv(emitter, "dirty_nmadvise", emitter_type_uint64,
+		    &dirty_nmadvise);
+		emitter_json_kv(emitter, "muzzy_npurge", emitter_type_uint64,
+		    &muzzy_npurge);
+		emitter_json_kv(emitter, "muzzy_npurge_app",
+		    emitter_type_uint64, &muzzy_npurge_app);
+		emitter_json_kv(emitter, "muzzy_nlocked", emitter_type_uint64,
+		    &muzzy_nlocked);
+		emitter_json_kv(emitter, "muzzy_nmadvise", emitter_type_uint64,
+		    &muzzy_nmadvise);
+		emitter_json_object_end(emitter);
+
+		/* Lower bound of the bucket. */
+		col_bucket.uint64_val = (j == 0) ? 0 : (KQU(1) << (j - 1));
+		col_ind.unsigned_val = j;
+		col_dirty_npurge.uint64_val = dirty_npurge;
+		col_dirty_npurge_app.uint64_val = dirty_npurge_app;
+		col_dirty_nlocked.uint64_val = dirty_nlocked;
+		col_dirty_nmadvise.uint64_val = dirty_nmadvise;
+		col_muzzy_npurge.uint64_val = muzzy_npurge;
+		col_muzzy_npurge_app.uint64_val = muzzy_npurge_app;
+		col_muzzy_nlocked.uint64_val = muzzy_nlocked;
+		col_muzzy_nmadvise.uint64_val = muzzy_nmadvise;
+		if (!in_gap) {
+			emitter_table_row(emitter, &row);
+		}
+	}
+	emitter_json_array_end(emitter); /* Close "decay_hist". */
+	if (in_gap) {
+		emitter_table_printf(emitter, "                     ---\n");
+	}
+}
+
 static void
 stats_arena_mutexes_print(emitter_t *emitter, unsigned arena_ind, uint64_t uptime) {
 	emitter_row_t row;
@@ -817,6 +918,8 @@ stats_arena_print(emitter_t *emitter, unsigned i, bool bins, bool large,
 
 	emitter_table_row(emitter, &decay_row);
 
+	stats_arena_decay_hist_print(emitter, i);
+
 	/* Small / large / total allocation counts. */
 	emitter_row_t alloc_count_row;
 	emitter_row_init(&alloc_count_row);
@@ -1089,12 +1192,27 @@ stats_general_print(emitter_t *emitter) {
 	OPT_WRITE_SSIZE_T_MUTABLE("dirty_decay_ms", "arenas.dirty_decay_ms")
 	OPT_WRITE_SSIZE_T_MUTABLE("muzzy_decay_ms", "arenas.muzzy_decay_ms")
 	OPT_WRITE_SIZE_T("lg_extent_max_active_fit")
+	OPT_WRITE_BOOL("slab_autotune")
+	OPT_WRITE_UNSIGNED("bin_stash")
+	OPT_WRITE_UNSIGNED("bin_shards_max")
+	OPT_WRITE_BOOL("hpa")
+	OPT_WRITE_BOOL("lazy_coalesce")
+	OPT_WRITE_BOOL("extent_best_fit")
+	OPT_WRITE_CHAR_P("decay_curve")
+	OPT_WRITE_BOOL("pressure_purge")
+	OPT_WRITE_SIZE_T("dirty_max")
+	OPT_WRITE_BOOL("rtree_flat")
+	OPT_WRITE_BOOL("slab_map")
 	OPT_WRITE_CHAR_P("junk")
 	OPT_WRITE_BOOL("zero")
 	OPT_WRITE_BOOL("utrace")
 	OPT_WRITE_BOOL("xmalloc")
 	OPT_WRITE_BOOL("tcache")
 	OPT_WRITE_SSIZE_T("lg_tcache_max")
+	OPT_WRITE_BOOL("tcache_adaptive")
+	OPT_WRITE_SIZE_T("tcache_bytes_max")
+	OPT_WRITE_SIZE_T("tcache_global_bytes_max")
+	OPT_WRITE_BOOL("percpu_tcache")
 	OPT_WRITE_CHAR_P("thp")
 	OPT_WRITE_BOOL("prof")
 	OPT_WRITE_CHAR_P("prof_prefix")
@@ -1254,6 +1372,7 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 	size_t num_background_threads;
 	size_t zero_reallocs;
 	uint64_t background_thread_num_runs, background_thread_run_interval;
+	uint64_t rtree_ctx_nhits_l2, rtree_ctx_nmisses;
 
 	CTL_GET("stats.allocated", &allocated, size_t);
 	CTL_GET("stats.active", &active, size_t);
@@ -1265,6 +1384,9 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 
 	CTL_GET("stats.zero_reallocs", &zero_reallocs, size_t);
 
+	CTL_GET("stats.rtree_ctx.nhits_l2", &rtree_ctx_nhits_l2, uint64_t);
+	CTL_GET("stats.rtree_ctx.nmisses", &rtree_ctx_nmisses, uint64_t);
+
 	if (have_background_thread) {
 		CTL_GET("stats.background_thread.num_threads",
 		    &num_background_threads, size_t);
@@ -1315,6 +1437,17 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 	    num_background_threads, background_thread_num_runs,
 	    background_thread_run_interval);
 
+	/* rtree_ctx cache stats. */
+	emitter_json_object_kv_begin(emitter, "rtree_ctx");
+	emitter_json_kv(emitter, "nhits_l2", emitter_type_uint64,
+	    &rtree_ctx_nhits_l2);
+	emitter_json_kv(emitter, "nmisses", emitter_type_uint64,
+	    &rtree_ctx_nmisses);
+	emitter_json_object_end(emitter); /* Close "rtree_ctx". */
+
+	emitter_table_printf(emitter, "rtree_ctx cache: L2 hits: %"FMTu64
+	    ", misses: %"FMTu64"\n", rtree_ctx_nhits_l2, rtree_ctx_nmisses);
+
 	if (mutex) {
 		emitter_row_t row;
 		emitter_col_t name;
@@ -6,12 +6,17 @@
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/safety_check.h"
 #include "jemalloc/internal/sc.h"
+#include "jemalloc/internal/spin.h"
 
 /******************************************************************************/
 /* Data. */
 
 bool	opt_tcache = true;
 ssize_t	opt_lg_tcache_max = LG_TCACHE_MAXCLASS_DEFAULT;
+bool	opt_tcache_adaptive = false;
+size_t	opt_tcache_bytes_max = 0;
+size_t	opt_tcache_global_bytes_max = 0;
+bool	opt_percpu_tcache = false;
 
 cache_bin_info_t	*tcache_bin_info;
 /*
@@ -27,6 +32,7 @@ static uint32_t total_stack_bytes;
 
 unsigned		nhbins;
 size_t			tcache_maxclass;
+size_t			tcache_bytes_max;
 
 tcaches_t		*tcaches;
 
@@ -39,6 +45,15 @@ static tcaches_t	*tcaches_avail;
 /* Protects tcaches{,_past,_avail}. */
 static malloc_mutex_t	tcaches_mtx;
 
+/* Serializes tcache_reclaim() passes, and protects tcache_reclaim_next. */
+static malloc_mutex_t	tcache_reclaim_mtx;
+
+/* Earliest time for the next pass of tcache_reclaim_maybe(). */
+static nstime_t		tcache_reclaim_next;
+
+tcache_percpu_t	**tcache_percpus;
+bool		tcache_percpu_rseq = false;
+
 /******************************************************************************/
 
 size_t
@@ -46,17 +61,74 @@ tcache_salloc(tsdn_t *tsdn, const void *ptr) {
 	return arena_salloc(tsdn, ptr);
 }
 
+/*
+ * Resize a small bin based on what it went through since the last GC visit.  A
+ * bin that both ran empty (refilled) and overflowed (flushed) is thrashing
+ * between the arena and the tcache, so its capacity is doubled as far as the
+ * tcache byte budget allows.
+ *
+ * A bin that kept at least half its capacity cached throughout (low_water),
+ * without overflowing, is cold: all its traffic fit in the other half, which
+ * is what remains after its capacity is halved.  That returns budget for the
+ * hot bins.  Not refilling or flushing on its own says nothing, as a hot bin's
+ * allocations and frees may well balance out within the cache.
+ */
+static void
+tcache_bin_ncached_cap_adapt(tsd_t *tsd, tcache_t *tcache, cache_bin_t *tbin,
+    szind_t binind, bool refilled, bool flushed, cache_bin_sz_t low_water) {
+	assert(binind < SC_NBINS);
+	cache_bin_sz_t cap = cache_bin_ncached_cap_get(tbin);
+	cache_bin_sz_t new_cap;
+	size_t usize = sz_index2size(binind);
+
+	if (refilled && flushed) {
+		cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(binind);
+		new_cap = (cap << 1) < ncached_max ? (cap << 1) : ncached_max;
+		size_t avail = (tcache->small_cap_bytes < tcache_bytes_max) ?
+		    tcache_bytes_max - tcache->small_cap_bytes : 0;
+		if ((size_t)(new_cap - cap) * usize > avail) {
+			new_cap = cap + (cache_bin_sz_t)(avail / usize);
+		}
+		if (new_cap == cap) {
+			return;
+		}
+	} else if (!refilled && !flushed && low_water >= (cap >> 1)) {
+		if (cap <= TCACHE_NSLOTS_SMALL_CAP_MIN) {
+			return;
+		}
+		new_cap = (cap >> 1) > TCACHE_NSLOTS_SMALL_CAP_MIN ? (cap >> 1) :
+		    TCACHE_NSLOTS_SMALL_CAP_MIN;
+		if (cache_bin_ncached_get(tbin, binind) > new_cap) {
+			tcache_bin_flush_small(tsd, tcache, tbin, binind,
+			    new_cap);
+		}
+		/* Keep the fill count at least 1. */
+		while ((new_cap >> tcache->lg_fill_div[binind]) == 0) {
+			tcache->lg_fill_div[binind]--;
+		}
+	} else {
+		return;
+	}
+
+	cache_bin_ncached_cap_set(tbin, binind, new_cap);
+	tcache->small_cap_bytes = tcache->small_cap_bytes - cap * usize +
+	    new_cap * usize;
+}
+
 void
 tcache_event_hard(tsd_t *tsd, tcache_t *tcache) {
 	szind_t binind = tcache->next_gc_bin;
 	cache_bin_t *tbin;
-	bool is_small;
+	bool is_small, refilled;
+	tcache_op_begin(tcache, true);
 	if (binind < SC_NBINS) {
 		tbin = tcache_small_bin_get(tcache, binind);
 		is_small = true;
+		refilled = tcache->bin_refilled[binind];
 	} else {
 		tbin = tcache_large_bin_get(tcache, binind);
 		is_small = false;
+		refilled = false;
 	}
 
 	cache_bin_sz_t low_water = cache_bin_low_water_get(tbin, binind);
@@ -73,7 +145,7 @@ tcache_event_hard(tsd_t *tsd, tcache_t *tcache) {
 			 * Reduce fill count by 2X.  Limit lg_fill_div such that
 			 * the fill count is always at least 1.
 			 */
-			if ((cache_bin_ncached_max_get(binind) >>
+			if ((cache_bin_ncached_cap_get(tbin) >>
 			     (tcache->lg_fill_div[binind] + 1)) >= 1) {
 				tcache->lg_fill_div[binind]++;
 			}
@@ -92,11 +164,31 @@ tcache_event_hard(tsd_t *tsd, tcache_t *tcache) {
 		}
 		tcache->bin_refilled[binind] = false;
 	}
+	if (is_small) {
+		if (opt_tcache_adaptive) {
+			tcache_bin_ncached_cap_adapt(tsd, tcache, tbin, binind,
+			    refilled, tcache->bin_flushed[binind], low_water);
+		}
+		tcache->bin_flushed[binind] = false;
+		/*
+		 * Objects freed remotely to an idle bin would otherwise wait
+		 * for the next fill.
+		 */
+		arena_bin_remote_drain(tsd_tsdn(tsd), tcache->arena, binind);
+	}
 	tbin->low_water_position = tbin->cur_ptr.lowbits;
+	tcache_op_end(tcache, true);
 
 	tcache->next_gc_bin++;
 	if (tcache->next_gc_bin == nhbins) {
 		tcache->next_gc_bin = 0;
+		/*
+		 * The background thread reclaims when enabled.  Skip per-CPU
+		 * caches, whose mutex is held here.
+		 */
+		if (tcache->is_auto && !background_thread_enabled()) {
+			tcache_reclaim_maybe(tsd_tsdn(tsd));
+		}
 	}
 }
 
@@ -167,6 +259,9 @@ tcache_bin_flush_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *tbin,
 			    *(bottom_item - i));
 		}
 	}
+	unsigned own_binshard;
+	bin_t *own_bin = arena_bin_choose(tsd_tsdn(tsd), arena, binind,
+	    &own_binshard);
 	while (nflush > 0) {
 		/* Lock the arena bin associated with the first object. */
 		extent_t *extent = item_extent[0];
@@ -174,16 +269,31 @@ tcache_bin_flush_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *tbin,
 		arena_t *bin_arena = arena_get(tsd_tsdn(tsd), bin_arena_ind,
 		    false);
 		unsigned binshard = extent_binshard_get(extent);
-		assert(binshard < bin_infos[binind].n_shards);
+		assert(binshard < bins_nshards_get(&bin_arena->bins[binind]));
 		bin_t *bin = &bin_arena->bins[binind].bin_shards[binshard];
 
-		malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
-		if (config_stats && bin_arena == arena && !merged_stats) {
+		/*
+		 * Don't wait on a contended bin that this thread doesn't fill
+		 * from; instead, push the objects onto its remote free list,
+		 * for whoever takes the lock next.
+		 */
+		bool locked;
+		if (bin == own_bin) {
+			malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
+			locked = true;
+		} else {
+			locked = !malloc_mutex_trylock(tsd_tsdn(tsd),
+			    &bin->lock);
+		}
+		if (locked && config_stats && bin_arena == arena &&
+		    !merged_stats) {
 			merged_stats = true;
 			bin->stats.nflushes++;
 			bin->stats.nrequests += tbin->tstats.nrequests;
 			tbin->tstats.nrequests = 0;
 		}
+		void *remote_first = NULL;
+		void *remote_last = NULL;
 		unsigned ndeferred = 0;
 		for (unsigned i = 0; i < nflush; i++) {
 			void *ptr = *(bottom_item - i);
@@ -192,8 +302,17 @@ tcache_bin_flush_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *tbin,
 
 			if (extent_arena_ind_get(extent) == bin_arena_ind
 			    && extent_binshard_get(extent) == binshard) {
-				arena_dalloc_bin_junked_locked(tsd_tsdn(tsd),
-				    bin_arena, bin, binind, extent, ptr);
+				if (locked) {
+					arena_dalloc_bin_junked_locked(
+					    tsd_tsdn(tsd), bin_arena, bin,
+					    binind, extent, ptr);
+					continue;
+				}
+				*(void **)ptr = remote_first;
+				remote_first = ptr;
+				if (remote_last == NULL) {
+					remote_last = ptr;
+				}
 			} else {
 				/*
 				 * This object was allocated via a different
@@ -206,8 +325,16 @@ tcache_bin_flush_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *tbin,
 				ndeferred++;
 			}
 		}
-		malloc_mutex_unlock(tsd_tsdn(tsd), &bin->lock);
-		arena_decay_ticks(tsd_tsdn(tsd), bin_arena, nflush - ndeferred);
+		if (locked) {
+			unsigned ndrained = arena_bin_remote_dalloc_locked(
+			    tsd_tsdn(tsd), bin_arena, bin, binind,
+			    bin_remote_free_take(tsd_tsdn(tsd), bin), false);
+			malloc_mutex_unlock(tsd_tsdn(tsd), &bin->lock);
+			arena_decay_ticks(tsd_tsdn(tsd), bin_arena,
+			    nflush - ndeferred + ndrained);
+		} else {
+			bin_remote_free_push(bin, remote_first, remote_last);
+		}
 		nflush = ndeferred;
 	}
 	if (config_stats && !merged_stats) {
@@ -337,62 +464,63 @@ tcache_arena_associate(tsdn_t *tsdn, tcache_t *tcache, arena_t *arena) {
 	assert(tcache->arena == NULL);
 	tcache->arena = arena;
 
-	if (config_stats) {
-		/* Link into list of extant tcaches. */
-		malloc_mutex_lock(tsdn, &arena->tcache_ql_mtx);
+	/* Link into list of extant tcaches. */
+	malloc_mutex_lock(tsdn, &arena->tcache_ql_mtx);
 
-		ql_elm_new(tcache, link);
-		ql_tail_insert(&arena->tcache_ql, tcache, link);
-		cache_bin_array_descriptor_init(
-		    &tcache->cache_bin_array_descriptor, tcache->bins_small,
-		    tcache->bins_large);
-		ql_tail_insert(&arena->cache_bin_array_descriptor_ql,
-		    &tcache->cache_bin_array_descriptor, link);
+	ql_elm_new(tcache, link);
+	ql_tail_insert(&arena->tcache_ql, tcache, link);
+	cache_bin_array_descriptor_init(&tcache->cache_bin_array_descriptor,
+	    tcache->bins_small, tcache->bins_large);
+	ql_tail_insert(&arena->cache_bin_array_descriptor_ql,
+	    &tcache->cache_bin_array_descriptor, link);
 
-		malloc_mutex_unlock(tsdn, &arena->tcache_ql_mtx);
-	}
+	malloc_mutex_unlock(tsdn, &arena->tcache_ql_mtx);
 }
 
 static void
 tcache_arena_dissociate(tsdn_t *tsdn, tcache_t *tcache) {
 	arena_t *arena = tcache->arena;
 	assert(arena != NULL);
-	if (config_stats) {
-		/* Unlink from list of extant tcaches. */
-		malloc_mutex_lock(tsdn, &arena->tcache_ql_mtx);
-		if (config_debug) {
-			bool in_ql = false;
-			tcache_t *iter;
-			ql_foreach(iter, &arena->tcache_ql, link) {
-				if (iter == tcache) {
-					in_ql = true;
-					break;
-				}
+	/* Unlink from list of extant tcaches. */
+	malloc_mutex_lock(tsdn, &arena->tcache_ql_mtx);
+	if (config_debug) {
+		bool in_ql = false;
+		tcache_t *iter;
+		ql_foreach(iter, &arena->tcache_ql, link) {
+			if (iter == tcache) {
+				in_ql = true;
+				break;
 			}
-			assert(in_ql);
 		}
-		ql_remove(&arena->tcache_ql, tcache, link);
-		ql_remove(&arena->cache_bin_array_descriptor_ql,
-		    &tcache->cache_bin_array_descriptor, link);
+		assert(in_ql);
+	}
+	ql_remove(&arena->tcache_ql, tcache, link);
+	ql_remove(&arena->cache_bin_array_descriptor_ql,
+	    &tcache->cache_bin_array_descriptor, link);
+	if (config_stats) {
 		tcache_stats_merge(tsdn, tcache, arena);
-		malloc_mutex_unlock(tsdn, &arena->tcache_ql_mtx);
 	}
+	malloc_mutex_unlock(tsdn, &arena->tcache_ql_mtx);
 	tcache->arena = NULL;
 }
 
 void
 tcache_arena_reassociate(tsdn_t *tsdn, tcache_t *tcache, arena_t *arena) {
+	/* A reclaimer flushes to tcache->arena. */
+	tcache_op_begin(tcache, true);
 	tcache_arena_dissociate(tsdn, tcache);
 	tcache_arena_associate(tsdn, tcache, arena);
+	tcache_op_end(tcache, true);
 }
 
 bool
 tsd_tcache_enabled_data_init(tsd_t *tsd) {
 	/* Called upon tsd initialization. */
-	tsd_tcache_enabled_set(tsd, opt_tcache);
+	bool enabled = opt_tcache && !opt_percpu_tcache;
+	tsd_tcache_enabled_set(tsd, enabled);
 	tsd_slow_update(tsd);
 
-	if (opt_tcache) {
+	if (enabled) {
 		/* Trigger tcache init. */
 		tsd_tcache_data_init(tsd);
 	}
@@ -404,11 +532,12 @@ static bool
 tcache_bin_init(cache_bin_t *bin, szind_t ind, uintptr_t *stack_cur) {
 	cassert(sizeof(bin->cur_ptr) == sizeof(void *));
 	/*
-	 * The full_position points to the lowest available space.  Allocations
-	 * will access the slots toward higher addresses (for the benefit of
-	 * adjacent prefetch).
+	 * The stack starts at the lowest available space.  Allocations will
+	 * access the slots toward higher addresses (for the benefit of adjacent
+	 * prefetch).  The full_position is set according to the initial
+	 * capacity, which may leave the bottom of the stack unused.
 	 */
-	void *full_position = (void *)*stack_cur;
+	void *stack_begin = (void *)*stack_cur;
 	uint32_t bin_stack_size = tcache_bin_info[ind].stack_size;
 
 	*stack_cur += bin_stack_size;
@@ -417,8 +546,13 @@ tcache_bin_init(cache_bin_t *bin, szind_t ind, uintptr_t *stack_cur) {
 	/* Init to the empty position. */
 	bin->cur_ptr.ptr = empty_position;
 	bin->low_water_position = bin->cur_ptr.lowbits;
-	bin->full_position = (uint32_t)(uintptr_t)full_position;
-	assert(bin->cur_ptr.lowbits - bin->full_position == bin_stack_size);
+	bin->empty_position = bin->cur_ptr.lowbits;
+	bin->full_position = bin->empty_position -
+	    tcache_bin_info[ind].ncached_cap_init * sizeof(void *);
+	assert(bin->empty_position - (uint32_t)(uintptr_t)stack_begin ==
+	    bin_stack_size);
+	assert(cache_bin_ncached_cap_get(bin) ==
+	    tcache_bin_info[ind].ncached_cap_init);
 	assert(cache_bin_ncached_get(bin, ind) == 0);
 	assert(cache_bin_empty_position_get(bin, ind) == empty_position);
 
@@ -439,6 +573,11 @@ tcache_init(tsd_t *tsd, tcache_t *tcache, void *avail_stack) {
 	memset(&tcache->link, 0, sizeof(ql_elm(tcache_t)));
 	tcache->next_gc_bin = 0;
 	tcache->arena = NULL;
+	tcache->is_auto = false;
+	atomic_store_u32(&tcache->reclaim_ops, 0, ATOMIC_RELAXED);
+	atomic_store_b(&tcache->reclaim_busy, false, ATOMIC_RELAXED);
+	tcache->reclaim_ops_seen = 0;
+	tcache->reclaim_idle = false;
 
 	ticker_init(&tcache->gc_ticker, TCACHE_GC_INCR);
 
@@ -448,11 +587,15 @@ tcache_init(tsd_t *tsd, tcache_t *tcache, void *avail_stack) {
 
 	unsigned i = 0;
 	uintptr_t stack_cur = (uintptr_t)avail_stack;
+	tcache->small_cap_bytes = 0;
 	for (; i < SC_NBINS; i++) {
 		tcache->lg_fill_div[i] = 1;
 		tcache->bin_refilled[i] = false;
+		tcache->bin_flushed[i] = false;
 		cache_bin_t *bin = tcache_small_bin_get(tcache, i);
 		tcache_bin_init(bin, i, &stack_cur);
+		tcache->small_cap_bytes += cache_bin_ncached_cap_get(bin) *
+		    sz_index2size(i);
 	}
 	for (; i < nhbins; i++) {
 		cache_bin_t *bin = tcache_large_bin_get(tcache, i);
@@ -493,6 +636,7 @@ tsd_tcache_data_init(tsd_t *tsd) {
 	}
 
 	tcache_init(tsd, tcache, avail_array);
+	tcache->is_auto = true;
 	/*
 	 * Initialization is a bit tricky here.  After malloc init is done, all
 	 * threads can rely on arena_choose and associate tcache accordingly.
@@ -569,7 +713,10 @@ tcache_flush_cache(tsd_t *tsd, tcache_t *tcache) {
 void
 tcache_flush(tsd_t *tsd) {
 	assert(tcache_available(tsd));
-	tcache_flush_cache(tsd, tsd_tcachep_get(tsd));
+	tcache_t *tcache = tsd_tcachep_get(tsd);
+	tcache_op_begin(tcache, true);
+	tcache_flush_cache(tsd, tcache);
+	tcache_op_end(tcache, true);
 }
 
 static void
@@ -625,7 +772,10 @@ tcache_cleanup(tsd_t *tsd) {
 	assert(tsd_tcache_enabled_get(tsd));
 	assert(tcache_small_bin_get(tcache, 0)->cur_ptr.ptr != NULL);
 
+	/* Once unlinked, the tcache is out of reach of reclaimers. */
+	tcache_op_begin(tcache, true);
 	tcache_destroy(tsd, tcache, true);
+	tcache_op_end(tcache, true);
 	if (config_debug) {
 		tcache_small_bin_get(tcache, 0)->cur_ptr.ptr = NULL;
 	}
@@ -655,6 +805,331 @@ tcache_stats_merge(tsdn_t *tsdn, tcache_t *tcache, arena_t *arena) {
 	}
 }
 
+/*
+ * Enforcement of opt_tcache_global_bytes_max.  tcache_reclaim() estimates the
+ * bytes cached by all auto tcaches, walking the tcache lists of the arenas.  If
+ * over the limit, it flushes tcaches itself until enough was released: first
+ * those of threads that were idle since the previous pass, then any that is not
+ * in use at the moment.  This relies on the handoff described above
+ * tcache_op_begin(), so threads that are blocked, or never call into the
+ * allocator again, get their caches flushed too.  Explicit and per-CPU tcaches
+ * are not accounted for.
+ */
+
+void
+tcache_op_wait(tcache_t *tcache) {
+	/*
+	 * reclaim_ops stays odd meanwhile, so the reclaimer either already
+	 * took the cache bins, or is about to back off.
+	 */
+	spin_t spinner = SPIN_INITIALIZER;
+	while (atomic_load_b(&tcache->reclaim_busy, ATOMIC_ACQUIRE)) {
+		spin_adaptive(&spinner);
+	}
+}
+
+static size_t
+tcache_bytes_cached_racy(tcache_t *tcache) {
+	size_t bytes = 0;
+	unsigned i;
+	for (i = 0; i < SC_NBINS; i++) {
+		bytes += cache_bin_ncached_get_racy(
+		    tcache_small_bin_get(tcache, i), i) * sz_index2size(i);
+	}
+	for (; i < nhbins; i++) {
+		bytes += cache_bin_ncached_get_racy(
+		    tcache_large_bin_get(tcache, i), i) * sz_index2size(i);
+	}
+	return bytes;
+}
+
+/* Returns false if the cache bins were taken over from the owner. */
+static bool
+tcache_reclaim_trylock(tcache_t *tcache) {
+	atomic_store_b(&tcache->reclaim_busy, true, ATOMIC_RELAXED);
+	atomic_fence(ATOMIC_SEQ_CST);
+	if ((atomic_load_u32(&tcache->reclaim_ops, ATOMIC_ACQUIRE) & 1) != 0) {
+		atomic_store_b(&tcache->reclaim_busy, false, ATOMIC_RELAXED);
+		return true;
+	}
+	return false;
+}
+
+static void
+tcache_reclaim_unlock(tcache_t *tcache) {
+	atomic_store_b(&tcache->reclaim_busy, false, ATOMIC_RELEASE);
+}
+
+/*
+ * Returns the bytes cached by the auto tcaches of arena, and notes which of
+ * their owners were idle since the previous pass.
+ */
+static size_t
+tcache_reclaim_scan(tsdn_t *tsdn, arena_t *arena) {
+	size_t total = 0;
+	tcache_t *tcache;
+
+	malloc_mutex_lock(tsdn, &arena->tcache_ql_mtx);
+	ql_foreach(tcache, &arena->tcache_ql, link) {
+		if (!tcache->is_auto) {
+			continue;
+		}
+		uint32_t ops = atomic_load_u32(&tcache->reclaim_ops,
+		    ATOMIC_RELAXED);
+		tcache->reclaim_idle = (ops == tcache->reclaim_ops_seen);
+		tcache->reclaim_ops_seen = ops;
+		total += tcache_bytes_cached_racy(tcache);
+	}
+	malloc_mutex_unlock(tsdn, &arena->tcache_ql_mtx);
+
+	return total;
+}
+
+/*
+ * Flush the auto tcaches of arena that can be taken over from their owners
+ * (only those of idle owners if idle_only), until *excess bytes were released.
+ * The tcache list can't stay locked during a flush, so the walk starts over
+ * after each; the flushed tcaches are empty by then.
+ */
+static void
+tcache_reclaim_arena(tsd_t *tsd, arena_t *arena, bool idle_only,
+    size_t *excess) {
+	tsdn_t *tsdn = tsd_tsdn(tsd);
+	while (*excess > 0) {
+		tcache_t *tcache;
+		size_t bytes = 0;
+
+		malloc_mutex_lock(tsdn, &arena->tcache_ql_mtx);
+		ql_foreach(tcache, &arena->tcache_ql, link) {
+			if (!tcache->is_auto || (idle_only &&
+			    !tcache->reclaim_idle) ||
+			    tcache_bytes_cached_racy(tcache) == 0 ||
+			    tcache_reclaim_trylock(tcache)) {
+				continue;
+			}
+			/* Exact, now that the owner is kept out. */
+			bytes = tcache_bytes_cached_racy(tcache);
+			if (bytes != 0) {
+				break;
+			}
+			tcache_reclaim_unlock(tcache);
+		}
+		/* The owner can't unlink it before the unlock below. */
+		malloc_mutex_unlock(tsdn, &arena->tcache_ql_mtx);
+		if (bytes == 0) {
+			return;
+		}
+		assert(tcache->arena == arena);
+		tcache_flush_cache(tsd, tcache);
+		tcache_reclaim_unlock(tcache);
+		*excess -= (bytes < *excess) ? bytes : *excess;
+	}
+}
+
+static void
+tcache_reclaim_locked(tsdn_t *tsdn) {
+	malloc_mutex_assert_owner(tsdn, &tcache_reclaim_mtx);
+	if (opt_tcache_global_bytes_max == 0) {
+		return;
+	}
+
+	unsigned narenas = narenas_total_get();
+	size_t total = 0;
+	for (unsigned i = 0; i < narenas; i++) {
+		arena_t *arena = arena_get(tsdn, i, false);
+		if (arena != NULL) {
+			total += tcache_reclaim_scan(tsdn, arena);
+		}
+	}
+	if (total <= opt_tcache_global_bytes_max) {
+		return;
+	}
+	size_t excess = total - opt_tcache_global_bytes_max;
+	/* Idle threads first, then threads just not in the allocator. */
+	for (unsigned pass = 0; pass < 2 && excess > 0; pass++) {
+		for (unsigned i = 0; i < narenas && excess > 0; i++) {
+			arena_t *arena = arena_get(tsdn, i, false);
+			if (arena != NULL) {
+				tcache_reclaim_arena(tsdn_tsd(tsdn), arena,
+				    pass == 0, &excess);
+			}
+		}
+	}
+}
+
+void
+tcache_reclaim(tsdn_t *tsdn) {
+	malloc_mutex_lock(tsdn, &tcache_reclaim_mtx);
+	tcache_reclaim_locked(tsdn);
+	malloc_mutex_unlock(tsdn, &tcache_reclaim_mtx);
+}
+
+/* Rate limited to one pass per TCACHE_RECLAIM_INTERVAL_NS. */
+void
+tcache_reclaim_maybe(tsdn_t *tsdn) {
+	if (opt_tcache_global_bytes_max == 0 ||
+	    malloc_mutex_trylock(tsdn, &tcache_reclaim_mtx)) {
+		return;
+	}
+	nstime_t now;
+	nstime_init(&now, 0);
+	nstime_update(&now);
+	if (nstime_compare(&now, &tcache_reclaim_next) >= 0) {
+		tcache_reclaim_locked(tsdn);
+		nstime_copy(&tcache_reclaim_next, &now);
+		nstime_iadd(&tcache_reclaim_next, TCACHE_RECLAIM_INTERVAL_NS);
+	}
+	malloc_mutex_unlock(tsdn, &tcache_reclaim_mtx);
+}
+
+/*
+ * With opt_percpu_tcache, threads do not get a tcache of their own (unless they
+ * enable it via thread.tcache.enabled).  Instead, they allocate from and free
+ * to the cache of the CPU they run on, under its mutex, so that cached memory
+ * scales with the number of CPUs rather than threads.  The per-CPU caches are
+ * only used on the malloc and free paths, through tcache_percpu_get().
+ *
+ * With tcache_percpu_rseq, small objects are allocated and freed without the
+ * mutex, through tcache_percpu_{alloc,dalloc}_small(), by the threads running
+ * on the CPU of the cache (its index).  Whenever the mutex is held, wherever
+ * its holder runs, rseq_locked keeps these threads out.
+ */
+
+static bool
+tcache_percpu_rseq_init(void) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	if (__rseq_size == 0) {
+		/* The C library did not register rseq areas. */
+		return true;
+	}
+	return syscall(SYS_membarrier,
+	    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0, 0) != 0;
+#else
+	return true;
+#endif
+}
+
+/*
+ * Restarts the critical sections running on the CPU, or on all CPUs if cpu is
+ * negative, so that they see rseq_locked set.
+ */
+static void
+tcache_percpu_rseq_fence(int cpu) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	if (syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ,
+	    (cpu < 0) ? 0 : MEMBARRIER_CMD_FLAG_CPU, cpu) != 0) {
+		malloc_write("<jemalloc>: Error in membarrier()\n");
+		abort();
+	}
+#else
+	not_reached();
+#endif
+}
+
+/* Sets rseq_locked, with the mutex held. */
+static void
+tcache_percpu_rseq_lock(tcache_percpu_t *percpu, unsigned ind) {
+	if (!tcache_percpu_rseq) {
+		return;
+	}
+	/* A critical section on the CPU needs no fence. */
+	if (rseq_lock(ind, &percpu->rseq_locked)) {
+		atomic_store_b(&percpu->rseq_locked, true, ATOMIC_RELAXED);
+		tcache_percpu_rseq_fence((int)ind);
+	}
+}
+
+static void
+tcache_percpu_rseq_unlock(tcache_percpu_t *percpu) {
+	if (tcache_percpu_rseq) {
+		atomic_store_b(&percpu->rseq_locked, false, ATOMIC_RELEASE);
+	}
+}
+
+bool
+tcache_percpu_boot(tsdn_t *tsdn) {
+	if (!opt_percpu_tcache) {
+		return false;
+	}
+	tcache_percpu_t **percpus = (tcache_percpu_t **)base_alloc(tsdn,
+	    b0get(), ncpus * sizeof(tcache_percpu_t *), CACHELINE);
+	if (percpus == NULL) {
+		return true;
+	}
+	for (unsigned i = 0; i < ncpus; i++) {
+		/* Separately, to keep the mutexes on distinct cachelines. */
+		percpus[i] = (tcache_percpu_t *)base_alloc(tsdn, b0get(),
+		    sizeof(tcache_percpu_t), CACHELINE);
+		if (percpus[i] == NULL) {
+			return true;
+		}
+		if (malloc_mutex_init(&percpus[i]->mtx, "tcache_percpu",
+		    WITNESS_RANK_TCACHE_PERCPU, malloc_mutex_rank_exclusive)) {
+			return true;
+		}
+		atomic_store_b(&percpus[i]->rseq_locked, false,
+		    ATOMIC_RELAXED);
+		atomic_store_p(&percpus[i]->tcache, NULL, ATOMIC_RELAXED);
+	}
+	tcache_percpus = percpus;
+	tcache_percpu_rseq = have_rseq && !tcache_percpu_rseq_init();
+	return false;
+}
+
+tcache_t *
+tcache_percpu_lock(tsd_t *tsd, tcache_percpu_t **r_percpu) {
+	assert(opt_percpu_tcache);
+	if (unlikely(tcache_percpus == NULL)) {
+		/* Allocating during bootstrapping. */
+		return NULL;
+	}
+	unsigned ind = tcache_percpu_rseq ? rseq_cpu_get() : ncpus;
+	if (ind >= ncpus) {
+		malloc_cpuid_t cpuid = malloc_getcpu();
+		assert(cpuid >= 0);
+		/* CPU ids may exceed ncpus if some are offline. */
+		ind = (unsigned)cpuid % ncpus;
+	}
+	tcache_percpu_t *percpu = tcache_percpus[ind];
+
+	malloc_mutex_lock(tsd_tsdn(tsd), &percpu->mtx);
+	tcache_percpu_rseq_lock(percpu, ind);
+	tcache_t *tcache = (tcache_t *)atomic_load_p(&percpu->tcache,
+	    ATOMIC_RELAXED);
+	if (unlikely(tcache == NULL)) {
+		tcache = tcache_create_explicit(tsd);
+		if (tcache == NULL) {
+			tcache_percpu_unlock(tsd, percpu);
+			return NULL;
+		}
+		atomic_store_p(&percpu->tcache, tcache, ATOMIC_RELEASE);
+	}
+	*r_percpu = percpu;
+	return tcache;
+}
+
+void
+tcache_percpu_unlock(tsd_t *tsd, tcache_percpu_t *percpu) {
+	tcache_percpu_rseq_unlock(percpu);
+	malloc_mutex_unlock(tsd_tsdn(tsd), &percpu->mtx);
+}
+
+void
+tcache_percpu_flush(tsd_t *tsd) {
+	assert(opt_percpu_tcache && tcache_percpus != NULL);
+	for (unsigned i = 0; i < ncpus; i++) {
+		tcache_percpu_t *percpu = tcache_percpus[i];
+		malloc_mutex_lock(tsd_tsdn(tsd), &percpu->mtx);
+		tcache_percpu_rseq_lock(percpu, i);
+		tcache_t *tcache = (tcache_t *)atomic_load_p(&percpu->tcache,
+		    ATOMIC_RELAXED);
+		if (tcache != NULL) {
+			tcache_flush_cache(tsd, tcache);
+		}
+		tcache_percpu_unlock(tsd, percpu);
+	}
+}
+
 static bool
 tcaches_create_prep(tsd_t *tsd) {
 	bool err;
@@ -777,6 +1252,22 @@ tcache_boot(tsdn_t *tsdn) {
 	    malloc_mutex_rank_exclusive)) {
 		return true;
 	}
+	if (opt_percpu_tcache && !opt_tcache) {
+		opt_percpu_tcache = false;
+	} else if (opt_percpu_tcache && (!have_percpu_arena ||
+	    malloc_getcpu() < 0)) {
+		opt_percpu_tcache = false;
+		malloc_printf("<jemalloc>: perCPU tcache getcpu() not "
+		    "available.  Using per thread tcaches.\n");
+		if (opt_abort) {
+			abort();
+		}
+	}
+	if (malloc_mutex_init(&tcache_reclaim_mtx, "tcache_reclaim",
+	    WITNESS_RANK_TCACHE_RECLAIM, malloc_mutex_rank_exclusive)) {
+		return true;
+	}
+	nstime_init(&tcache_reclaim_next, 0);
 
 	nhbins = sz_size2index(tcache_maxclass) + 1;
 
@@ -787,6 +1278,7 @@ tcache_boot(tsdn_t *tsdn) {
 		return true;
 	}
 	unsigned i, ncached_max;
+	size_t small_cap_bytes = 0;
 	total_stack_bytes = 0;
 	for (i = 0; i < SC_NBINS; i++) {
 		if ((bin_infos[i].nregs << 1) <= TCACHE_NSLOTS_SMALL_MIN) {
@@ -797,6 +1289,12 @@ tcache_boot(tsdn_t *tsdn) {
 		} else {
 			ncached_max = TCACHE_NSLOTS_SMALL_MAX;
 		}
+		tcache_bin_info[i].ncached_cap_init = ncached_max;
+		small_cap_bytes += ncached_max * sz_index2size(i);
+		/* Reserve room for adaptive bins to grow into. */
+		if (opt_tcache_adaptive) {
+			ncached_max <<= TCACHE_LG_NSLOTS_SMALL_ADAPTIVE;
+		}
 		unsigned stack_size = ncached_max * sizeof(void *);
 		assert(stack_size < ((uint64_t)1 <<
 		    (sizeof(cache_bin_sz_t) * 8)));
@@ -806,24 +1304,66 @@ tcache_boot(tsdn_t *tsdn) {
 	for (; i < nhbins; i++) {
 		unsigned stack_size = TCACHE_NSLOTS_LARGE * sizeof(void *);
 		tcache_bin_info[i].stack_size = stack_size;
+		tcache_bin_info[i].ncached_cap_init = TCACHE_NSLOTS_LARGE;
 		total_stack_bytes += stack_size;
 	}
 	total_stack_bytes += total_stack_padding;
 
+	/*
+	 * By default, the budget leaves hot bins 50% of headroom over the
+	 * footprint without adaptive bins, so that they can grow before any
+	 * cold bin has shrunk.
+	 */
+	tcache_bytes_max = (opt_tcache_bytes_max == 0) ? small_cap_bytes +
+	    (small_cap_bytes >> 1) : opt_tcache_bytes_max;
+
 	return false;
 }
 
 void
 tcache_prefork(tsdn_t *tsdn) {
 	malloc_mutex_prefork(tsdn, &tcaches_mtx);
+	if (tcache_percpus != NULL) {
+		for (unsigned i = 0; i < ncpus; i++) {
+			malloc_mutex_prefork(tsdn, &tcache_percpus[i]->mtx);
+			if (tcache_percpu_rseq) {
+				atomic_store_b(&tcache_percpus[i]->rseq_locked,
+				    true, ATOMIC_RELAXED);
+			}
+		}
+		if (tcache_percpu_rseq) {
+			tcache_percpu_rseq_fence(-1);
+		}
+	}
+	malloc_mutex_prefork(tsdn, &tcache_reclaim_mtx);
 }
 
 void
 tcache_postfork_parent(tsdn_t *tsdn) {
+	malloc_mutex_postfork_parent(tsdn, &tcache_reclaim_mtx);
+	if (tcache_percpus != NULL) {
+		for (unsigned i = 0; i < ncpus; i++) {
+			tcache_percpu_rseq_unlock(tcache_percpus[i]);
+			malloc_mutex_postfork_parent(tsdn,
+			    &tcache_percpus[i]->mtx);
+		}
+	}
 	malloc_mutex_postfork_parent(tsdn, &tcaches_mtx);
 }
 
 void
 tcache_postfork_child(tsdn_t *tsdn) {
+	malloc_mutex_postfork_child(tsdn, &tcache_reclaim_mtx);
+	if (tcache_percpus != NULL) {
+		for (unsigned i = 0; i < ncpus; i++) {
+			tcache_percpu_rseq_unlock(tcache_percpus[i]);
+			malloc_mutex_postfork_child(tsdn,
+			    &tcache_percpus[i]->mtx);
+		}
+		/* The child is single threaded; fall back on failure. */
+		if (tcache_percpu_rseq && tcache_percpu_rseq_init()) {
+			tcache_percpu_rseq = false;
+		}
+	}
 	malloc_mutex_postfork_child(tsdn, &tcaches_mtx);
 }
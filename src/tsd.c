@@ -61,6 +61,12 @@ JEMALLOC_DIAGNOSTIC_POP
 typedef ql_head(tsd_t) tsd_list_t;
 static tsd_list_t tsd_nominal_tsds = ql_head_initializer(tsd_nominal_tsds);
 static malloc_mutex_t tsd_nominal_tsds_lock;
+/*
+ * rtree_ctx statistics of the tsds that left the nominal list (in practice,
+ * of exited threads).  Synchronization: tsd_nominal_tsds_lock.
+ */
+static uint64_t tsd_rtree_ctx_nhits_l2_removed = 0;
+static uint64_t tsd_rtree_ctx_nmisses_removed = 0;
 
 /* How many slow-path-enabling features are turned on. */
 static atomic_u32_t tsd_global_slow_count = ATOMIC_INIT(0);
@@ -100,6 +106,15 @@ tsd_remove_nominal(tsd_t *tsd) {
 	assert(tsd_state_get(tsd) <= tsd_state_nominal_max);
 	malloc_mutex_lock(tsd_tsdn(tsd), &tsd_nominal_tsds_lock);
 	ql_remove(&tsd_nominal_tsds, tsd, TSD_MANGLE(tcache).tsd_link);
+	if (config_stats) {
+		rtree_ctx_t *rtree_ctx = tsd_rtree_ctxp_get_unsafe(tsd);
+		tsd_rtree_ctx_nhits_l2_removed += rtree_ctx_stat_read(
+		    &rtree_ctx->nhits_l2);
+		tsd_rtree_ctx_nmisses_removed += rtree_ctx_stat_read(
+		    &rtree_ctx->nmisses);
+		rtree_ctx_stat_reset(&rtree_ctx->nhits_l2);
+		rtree_ctx_stat_reset(&rtree_ctx->nmisses);
+	}
 	malloc_mutex_unlock(tsd_tsdn(tsd), &tsd_nominal_tsds_lock);
 }
 
@@ -121,6 +136,24 @@ tsd_force_recompute(tsdn_t *tsdn) {
 	malloc_mutex_unlock(tsdn, &tsd_nominal_tsds_lock);
 }
 
+void
+tsd_rtree_ctx_stats_read(tsdn_t *tsdn, uint64_t *r_nhits_l2,
+    uint64_t *r_nmisses) {
+	assert(config_stats);
+	malloc_mutex_lock(tsdn, &tsd_nominal_tsds_lock);
+	uint64_t nhits_l2 = tsd_rtree_ctx_nhits_l2_removed;
+	uint64_t nmisses = tsd_rtree_ctx_nmisses_removed;
+	tsd_t *remote_tsd;
+	ql_foreach(remote_tsd, &tsd_nominal_tsds, TSD_MANGLE(tcache).tsd_link) {
+		rtree_ctx_t *rtree_ctx = tsd_rtree_ctxp_get_unsafe(remote_tsd);
+		nhits_l2 += rtree_ctx_stat_read(&rtree_ctx->nhits_l2);
+		nmisses += rtree_ctx_stat_read(&rtree_ctx->nmisses);
+	}
+	malloc_mutex_unlock(tsdn, &tsd_nominal_tsds_lock);
+	*r_nhits_l2 = nhits_l2;
+	*r_nmisses = nmisses;
+}
+
 void
 tsd_global_slow_inc(tsdn_t *tsdn) {
 	atomic_fetch_add_u32(&tsd_global_slow_count, 1, ATOMIC_RELAXED);
@@ -0,0 +1,116 @@
+#include "test/jemalloc_test.h"
+
+const char *malloc_conf = "background_thread:false,max_background_threads:2,"
+    "dirty_decay_ms:100,muzzy_decay_ms:0";
+
+#define NARENAS_SLOW 8
+#define SLOW_NS (100 * 1000 * 1000)
+
+static extent_hooks_t *default_hooks;
+static atomic_b_t helped;
+
+/*
+ * Purging in the slow arenas takes a while, which makes their background
+ * thread busy.  Note whenever another thread than the owner does it.
+ */
+static void
+slow_purge(unsigned arena_ind) {
+#ifdef JEMALLOC_BACKGROUND_THREAD
+	unsigned owner = arena_ind % max_background_threads;
+	for (unsigned i = 0; i < max_background_threads; i++) {
+		if (i != owner && pthread_equal(pthread_self(),
+		    background_thread_info[i].thread)) {
+			atomic_store_b(&helped, true, ATOMIC_RELEASE);
+		}
+	}
+#endif
+	mq_nanosleep(SLOW_NS);
+}
+
+static bool
+slow_decommit(extent_hooks_t *extent_hooks, void *addr, size_t size,
+    size_t offset, size_t length, unsigned arena_ind) {
+	slow_purge(arena_ind);
+	return default_hooks->decommit(default_hooks, addr, size, offset,
+	    length, arena_ind);
+}
+
+static bool
+slow_purge_lazy(extent_hooks_t *extent_hooks, void *addr, size_t size,
+    size_t offset, size_t length, unsigned arena_ind) {
+	slow_purge(arena_ind);
+	return default_hooks->purge_lazy == NULL ||
+	    default_hooks->purge_lazy(default_hooks, addr, size, offset, length,
+	    arena_ind);
+}
+
+static bool
+slow_purge_forced(extent_hooks_t *extent_hooks, void *addr, size_t size,
+    size_t offset, size_t length, unsigned arena_ind) {
+	slow_purge(arena_ind);
+	return default_hooks->purge_forced == NULL ||
+	    default_hooks->purge_forced(default_hooks, addr, size, offset,
+	    length, arena_ind);
+}
+
+static extent_hooks_t hooks;
+
+TEST_BEGIN(test_background_thread_help) {
+	test_skip_if(!have_background_thread);
+	test_skip_if(max_background_threads < 2);
+
+	size_t sz = sizeof(default_hooks);
+	assert_d_eq(mallctl("arena.0.extent_hooks", (void *)&default_hooks,
+	    &sz, NULL, 0), 0, "Unexpected mallctl() failure");
+	memcpy(&hooks, default_hooks, sizeof(hooks));
+	hooks.decommit = slow_decommit;
+	hooks.purge_lazy = slow_purge_lazy;
+	hooks.purge_forced = slow_purge_forced;
+
+	unsigned arenas[NARENAS_SLOW];
+	extent_hooks_t *new_hooks = &hooks;
+	for (unsigned i = 0; i < NARENAS_SLOW; i++) {
+		sz = sizeof(unsigned);
+		assert_d_eq(mallctl("arenas.create", (void *)&arenas[i], &sz,
+		    NULL, 0), 0, "Unexpected mallctl() failure");
+		char cmd[64];
+		malloc_snprintf(cmd, sizeof(cmd), "arena.%u.extent_hooks",
+		    arenas[i]);
+		assert_d_eq(mallctl(cmd, NULL, NULL, (void *)&new_hooks,
+		    sizeof(new_hooks)), 0, "Unexpected mallctl() failure");
+	}
+
+	bool enable = true;
+	assert_d_eq(mallctl("background_thread", NULL, NULL, &enable,
+	    sizeof(enable)), 0, "Unexpected mallctl() failure");
+
+	/* Leave dirty pages in the slow arenas of background thread 0 only. */
+	for (unsigned i = 0; i < NARENAS_SLOW; i++) {
+		if (arenas[i] % max_background_threads != 0) {
+			continue;
+		}
+		void *p = mallocx(SC_LARGE_MINCLASS, MALLOCX_ARENA(arenas[i]) |
+		    MALLOCX_TCACHE_NONE);
+		assert_ptr_not_null(p, "Unexpected mallocx() failure");
+		dallocx(p, MALLOCX_TCACHE_NONE);
+	}
+
+	/* Wait for up to 10 seconds. */
+	for (unsigned i = 0; i < 1000 && !atomic_load_b(&helped,
+	    ATOMIC_ACQUIRE); i++) {
+		mq_nanosleep(10 * 1000 * 1000);
+	}
+	assert_true(atomic_load_b(&helped, ATOMIC_ACQUIRE),
+	    "Another background thread should have helped the busy one");
+
+	enable = false;
+	assert_d_eq(mallctl("background_thread", NULL, NULL, &enable,
+	    sizeof(enable)), 0, "Unexpected mallctl() failure");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_background_thread_help);
+}
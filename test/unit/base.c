@@ -225,10 +225,86 @@ TEST_BEGIN(test_base_hooks_not_null) {
 }
 TEST_END
 
+TEST_BEGIN(test_base_dalloc) {
+	extent_hooks_t hooks_orig;
+	base_t *base;
+	size_t allocated0, allocated1, resident, mapped0, mapped1, n_thp;
+
+	extent_hooks_prep();
+	memcpy(&hooks_orig, &hooks, sizeof(extent_hooks_t));
+	memcpy(&hooks, &hooks_not_null, sizeof(extent_hooks_t));
+
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	base = base_new(tsdn, 0, &hooks);
+	assert_ptr_not_null(base, "Unexpected base_new() failure");
+
+	/* Freed regions are reused, and come back zeroed. */
+	char *p = (char *)base_alloc(tsdn, base, 3 * QUANTUM, QUANTUM);
+	assert_ptr_not_null(p, "Unexpected base_alloc() failure");
+	memset(p, 0xa5, 3 * QUANTUM);
+	base_dalloc(tsdn, base, p, 3 * QUANTUM, QUANTUM);
+	char *q = (char *)base_alloc(tsdn, base, QUANTUM, QUANTUM);
+	assert_ptr_eq(q, p, "Expected reuse of the freed region");
+	char *r = (char *)base_alloc(tsdn, base, 2 * QUANTUM - 1, 1);
+	assert_ptr_eq(r, p + QUANTUM,
+	    "Expected reuse of the remainder of the freed region");
+	for (size_t i = 0; i < 3 * QUANTUM; i++) {
+		assert_c_eq(p[i], 0, "Reused memory should be zeroed");
+	}
+	base_dalloc(tsdn, base, r, 2 * QUANTUM - 1, 1);
+	base_dalloc(tsdn, base, q, QUANTUM, QUANTUM);
+
+	/*
+	 * Use up the first block, so that all the allocations below come from
+	 * a new one, which is unmapped once everything in it has been freed.
+	 */
+	while (extent_bsize_get(&base->blocks->extent) > QUANTUM) {
+		p = (char *)base_alloc(tsdn, base, QUANTUM, QUANTUM);
+		assert_ptr_not_null(p, "Unexpected base_alloc() failure");
+	}
+	if (config_stats) {
+		base_stats_get(tsdn, base, &allocated0, &resident, &mapped0,
+		    &n_thp);
+	}
+	for (unsigned i = 0; i < 2; i++) {
+		p = (char *)base_alloc(tsdn, base, HUGEPAGE, QUANTUM);
+		assert_ptr_not_null(p, "Unexpected base_alloc() failure");
+		q = (char *)base_alloc_extent(tsdn, base);
+		assert_ptr_not_null(q, "Unexpected base_alloc_extent() failure");
+		if (config_stats) {
+			base_stats_get(tsdn, base, &allocated1, &resident,
+			    &mapped1, &n_thp);
+			assert_zu_gt(mapped1, mapped0,
+			    "A new block should have been mapped");
+		}
+
+		called_dalloc = false;
+		base_dalloc(tsdn, base, p, HUGEPAGE, QUANTUM);
+		assert_false(called_dalloc,
+		    "Block in use should not be unmapped");
+		base_dalloc_extent(tsdn, base, (extent_t *)q);
+		assert_true(called_dalloc, "Expected dalloc call");
+		if (config_stats) {
+			base_stats_get(tsdn, base, &allocated1, &resident,
+			    &mapped1, &n_thp);
+			assert_zu_eq(allocated1, allocated0,
+			    "Allocated bytes should be back to where they were");
+			assert_zu_eq(mapped1, mapped0,
+			    "Mapped bytes should be back to where they were");
+		}
+	}
+
+	base_delete(tsdn, base);
+
+	memcpy(&hooks, &hooks_orig, sizeof(extent_hooks_t));
+}
+TEST_END
+
 int
 main(void) {
 	return test(
 	    test_base_hooks_default,
 	    test_base_hooks_null,
-	    test_base_hooks_not_null);
+	    test_base_hooks_not_null,
+	    test_base_dalloc);
 }
@@ -0,0 +1,154 @@
+#include "test/jemalloc_test.h"
+
+#define BATCH_MAX 512
+
+/* Must match batch_alloc_packet_t in src/ctl.c. */
+typedef struct {
+	void **ptrs;
+	size_t num;
+	size_t size;
+	int flags;
+} batch_alloc_packet_t;
+
+static void *ptrs[BATCH_MAX];
+
+static size_t
+batch_alloc_wrapper(size_t num, size_t size, int flags) {
+	batch_alloc_packet_t packet = {ptrs, num, size, flags};
+	size_t filled;
+	size_t len = sizeof(size_t);
+	assert_d_eq(mallctl("experimental.batch_alloc", &filled, &len,
+	    &packet, sizeof(packet)), 0, "Unexpected mallctl() failure");
+	return filled;
+}
+
+static void
+verify_batch(size_t num, size_t size, int flags) {
+	size_t usize = nallocx(size, flags);
+	for (size_t i = 0; i < num; i++) {
+		assert_ptr_not_null(ptrs[i], "Unexpected NULL in batch");
+		assert_zu_eq(sallocx(ptrs[i], 0), usize,
+		    "Unexpected usable size");
+		if (MALLOCX_ZERO_GET(flags) || (config_fill &&
+		    !opt_junk_alloc && opt_zero)) {
+			for (size_t j = 0; j < usize; j++) {
+				assert_c_eq(((char *)ptrs[i])[j], 0,
+				    "Expected zeroed memory");
+			}
+		} else if (config_fill && opt_junk_alloc) {
+			/* Freeing junked the reused regions with another byte. */
+			for (size_t j = 0; j < usize; j++) {
+				assert_c_eq(((char *)ptrs[i])[j],
+				    (char)JEMALLOC_ALLOC_JUNK,
+				    "Expected junk-filled memory");
+			}
+		}
+		for (size_t j = 0; j < i; j++) {
+			assert_ptr_ne(ptrs[i], ptrs[j],
+			    "Duplicate pointer in batch");
+		}
+	}
+}
+
+static void
+release_batch(size_t num) {
+	for (size_t i = 0; i < num; i++) {
+		/* Leave junk behind to check zeroing on reuse. */
+		memset(ptrs[i], 0xa5, sallocx(ptrs[i], 0));
+		dallocx(ptrs[i], 0);
+	}
+}
+
+static void
+test_batch_alloc_impl(int flags) {
+	size_t sizes[] = {1, 8, 100, 1000, SC_SMALL_MAXCLASS,
+	    SC_LARGE_MINCLASS};
+	size_t nums[] = {0, 1, 7, 64, BATCH_MAX};
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (size_t j = 0; j < sizeof(nums) / sizeof(nums[0]); j++) {
+			size_t filled = batch_alloc_wrapper(nums[j], sizes[i],
+			    flags);
+			assert_zu_eq(filled, nums[j],
+			    "Unexpected batch_alloc() fill count");
+			verify_batch(filled, sizes[i], flags);
+			release_batch(filled);
+		}
+	}
+}
+
+TEST_BEGIN(test_batch_alloc) {
+	test_batch_alloc_impl(0);
+}
+TEST_END
+
+TEST_BEGIN(test_batch_alloc_zero) {
+	test_batch_alloc_impl(MALLOCX_ZERO);
+}
+TEST_END
+
+TEST_BEGIN(test_batch_alloc_aligned) {
+	test_batch_alloc_impl(MALLOCX_LG_ALIGN(6));
+	size_t filled = batch_alloc_wrapper(BATCH_MAX, 40, MALLOCX_LG_ALIGN(6));
+	for (size_t i = 0; i < filled; i++) {
+		assert_zu_eq((uintptr_t)ptrs[i] & 63, 0,
+		    "Unexpected misaligned pointer");
+	}
+	release_batch(filled);
+}
+TEST_END
+
+TEST_BEGIN(test_batch_alloc_tcache_none) {
+	test_batch_alloc_impl(MALLOCX_TCACHE_NONE);
+}
+TEST_END
+
+TEST_BEGIN(test_batch_alloc_manual_arena) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+
+	int flags = MALLOCX_ARENA(arena_ind);
+	test_batch_alloc_impl(flags);
+
+	size_t filled = batch_alloc_wrapper(BATCH_MAX, 64, flags);
+	assert_zu_eq(filled, BATCH_MAX, "Unexpected batch_alloc() fill count");
+	for (size_t i = 0; i < filled; i++) {
+		unsigned lookup;
+		sz = sizeof(lookup);
+		assert_d_eq(mallctl("arenas.lookup", &lookup, &sz, &ptrs[i],
+		    sizeof(ptrs[i])), 0, "Unexpected mallctl() failure");
+		assert_u_eq(lookup, arena_ind,
+		    "Allocation should come from the specified arena");
+	}
+	release_batch(filled);
+}
+TEST_END
+
+TEST_BEGIN(test_batch_alloc_einval) {
+	batch_alloc_packet_t packet = {ptrs, 1, 8, 0};
+	size_t filled;
+	size_t len = sizeof(size_t);
+
+	assert_d_eq(mallctl("experimental.batch_alloc", NULL, NULL, &packet,
+	    sizeof(packet)), EINVAL, "Should fail without output");
+	assert_d_eq(mallctl("experimental.batch_alloc", &filled, &len, NULL,
+	    0), EINVAL, "Should fail without input");
+	assert_d_eq(mallctl("experimental.batch_alloc", &filled, &len, &packet,
+	    sizeof(packet) - 1), EINVAL, "Should fail on wrong input size");
+	packet.size = 0;
+	assert_d_eq(mallctl("experimental.batch_alloc", &filled, &len, &packet,
+	    sizeof(packet)), EINVAL, "Should fail on zero size");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_batch_alloc,
+	    test_batch_alloc_zero,
+	    test_batch_alloc_aligned,
+	    test_batch_alloc_tcache_none,
+	    test_batch_alloc_manual_arena,
+	    test_batch_alloc_einval);
+}
@@ -0,0 +1,117 @@
+#include "test/jemalloc_test.h"
+
+#define BATCH_MAX 2000
+
+/* Must match batch_free_packet_t in src/ctl.c. */
+typedef struct {
+	void **ptrs;
+	size_t num;
+	size_t size;
+} batch_free_packet_t;
+
+static void *ptrs[BATCH_MAX];
+
+static void
+batch_free_wrapper(size_t num, size_t size) {
+	batch_free_packet_t packet = {ptrs, num, size};
+	assert_d_eq(mallctl("experimental.batch_free", NULL, NULL, &packet,
+	    sizeof(packet)), 0, "Unexpected mallctl() failure");
+}
+
+static uint64_t
+thread_deallocated(void) {
+	uint64_t deallocated;
+	size_t sz = sizeof(deallocated);
+	assert_d_eq(mallctl("thread.deallocated", (void *)&deallocated, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+	return deallocated;
+}
+
+static size_t
+arena_small_allocated(unsigned arena_ind) {
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	char cmd[128];
+	size_t allocated;
+	size_t sz = sizeof(allocated);
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.small.allocated",
+	    arena_ind);
+	assert_d_eq(mallctl(cmd, (void *)&allocated, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	return allocated;
+}
+
+TEST_BEGIN(test_batch_free_mixed) {
+	size_t usize_sum = 0;
+	for (size_t i = 0; i < BATCH_MAX; i++) {
+		/* Mix of small and large sizes, with a few NULLs. */
+		size_t size = (i % 10 == 9) ? SC_LARGE_MINCLASS + i :
+		    1 + (i * 37) % SC_SMALL_MAXCLASS;
+		if (i % 100 == 50) {
+			ptrs[i] = NULL;
+			continue;
+		}
+		ptrs[i] = mallocx(size, 0);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+		usize_sum += sallocx(ptrs[i], 0);
+	}
+
+	uint64_t before = thread_deallocated();
+	batch_free_wrapper(BATCH_MAX, 0);
+	uint64_t after = thread_deallocated();
+	if (config_stats) {
+		assert_u64_eq(after - before, usize_sum,
+		    "thread.deallocated should account for the whole batch");
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_batch_free_sized) {
+	test_skip_if(!config_stats);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	size_t sizes[] = {8, 96, 4096, SC_SMALL_MAXCLASS};
+	for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (size_t j = 0; j < BATCH_MAX; j++) {
+			ptrs[j] = mallocx(sizes[i], flags);
+			assert_ptr_not_null(ptrs[j],
+			    "Unexpected mallocx() failure");
+		}
+		assert_zu_ge(arena_small_allocated(arena_ind),
+		    BATCH_MAX * sizes[i], "Unexpected small.allocated");
+		batch_free_wrapper(BATCH_MAX, sizes[i]);
+		assert_zu_eq(arena_small_allocated(arena_ind), 0,
+		    "All regions should have been returned to the bins");
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_batch_free_einval) {
+	batch_free_packet_t packet = {NULL, 1, 0};
+	size_t out;
+	size_t len = sizeof(out);
+
+	assert_d_eq(mallctl("experimental.batch_free", NULL, NULL, &packet,
+	    sizeof(packet)), EINVAL, "Should fail on NULL ptrs");
+	packet.ptrs = ptrs;
+	assert_d_eq(mallctl("experimental.batch_free", &out, &len, &packet,
+	    sizeof(packet)), EPERM, "Should fail on read");
+	assert_d_eq(mallctl("experimental.batch_free", NULL, NULL, &packet,
+	    sizeof(packet) - 1), EINVAL, "Should fail on wrong input size");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_batch_free_mixed,
+	    test_batch_free_sized,
+	    test_batch_free_einval);
+}
@@ -0,0 +1,125 @@
+#include "test/jemalloc_test.h"
+
+#define SZ 64
+#define NTHREADS 8
+#define NITER 10000
+
+static unsigned shared_arena_ind;
+
+static unsigned
+bin_nshards(arena_t *arena) {
+	return bins_nshards_get(&arena->bins[sz_size2index(SZ)]);
+}
+
+/* Make bin look like it has been contended through a whole check period. */
+static void
+bin_contend(bin_t *bin) {
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	malloc_mutex_lock(tsdn, &bin->lock);
+	bin->lock.prof_data.n_lock_ops += BIN_CONTENTION_NLOCK_OPS;
+	bin->lock.prof_data.n_wait_times += BIN_CONTENTION_NLOCK_OPS;
+	malloc_mutex_unlock(tsdn, &bin->lock);
+}
+
+TEST_BEGIN(test_bin_shards_grow) {
+	test_skip_if(!config_stats);
+	test_skip_if(opt_bin_shards_max < 2);
+	test_skip_if(bin_infos[sz_size2index(SZ)].n_shards != 1);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	tsd_t *tsd = tsd_fetch();
+	arena_t *arena = arena_get(tsd_tsdn(tsd), arena_ind, false);
+	unsigned nshards = bin_nshards(arena);
+	bin_t *bin = &arena->bins[sz_size2index(SZ)].bin_shards[0];
+
+	void *p = mallocx(SZ, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	dallocx(p, flags);
+
+	/* A single contended period is not enough. */
+	bin_contend(bin);
+	p = mallocx(SZ, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	dallocx(p, flags);
+	assert_u_eq(bin_nshards(arena), nshards,
+	    "Shards should not be added before contention is sustained");
+
+	for (unsigned i = 1; i < BIN_CONTENTION_NSTRIKES; i++) {
+		bin_contend(bin);
+		p = mallocx(SZ, flags);
+		assert_ptr_not_null(p, "Unexpected mallocx() failure");
+		dallocx(p, flags);
+	}
+	assert_u_eq(bin_nshards(arena), nshards + 1,
+	    "Sustained contention should add a shard");
+
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+	char cmd[128];
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.bins.%u.nshards",
+	    arena_ind, sz_size2index(SZ));
+	uint32_t stats_nshards;
+	sz = sizeof(stats_nshards);
+	assert_d_eq(mallctl(cmd, (void *)&stats_nshards, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	assert_u32_eq(stats_nshards, nshards + 1,
+	    "Stats should report the added shard");
+	malloc_snprintf(cmd, sizeof(cmd), "arenas.bin.%u.nshards",
+	    sz_size2index(SZ));
+	uint32_t boot_nshards;
+	assert_d_eq(mallctl(cmd, (void *)&boot_nshards, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	assert_u32_eq(boot_nshards, nshards,
+	    "arenas.bin.<i>.nshards should be the initial count");
+
+	/* The thread gets rebound over the shards there now are. */
+	p = mallocx(SZ, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	assert_u_eq(extent_binshard_get(iealloc(tsd_tsdn(tsd), p)),
+	    tsd_binshardsp_get(tsd)->ticket % (nshards + 1),
+	    "Allocation should come from the thread's new shard");
+	dallocx(p, flags);
+}
+TEST_END
+
+static void *
+thd_start(void *arg) {
+	int flags = MALLOCX_ARENA(shared_arena_ind) | MALLOCX_TCACHE_NONE;
+	for (unsigned i = 0; i < NITER; i++) {
+		void *p = mallocx(SZ, flags);
+		assert_ptr_not_null(p, "Unexpected mallocx() failure");
+		dallocx(p, flags);
+	}
+	return NULL;
+}
+
+TEST_BEGIN(test_bin_shards_threads) {
+	size_t sz = sizeof(shared_arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&shared_arena_ind, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+
+	thd_t thds[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, NULL);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), shared_arena_ind,
+	    false);
+	assert_u_le(bin_nshards(arena), bin_shards_cap(sz_size2index(SZ)),
+	    "Too many shards");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_bin_shards_grow,
+	    test_bin_shards_threads);
+}
@@ -0,0 +1,205 @@
+#include "test/jemalloc_test.h"
+
+#define SZ 64
+#define NTHREADS 8
+#define NITER 1000
+#define NLIVE 64
+
+static atomic_u32_t stage = ATOMIC_INIT(0);
+static bin_t *locked_bin;
+static unsigned shared_arena_ind;
+
+static void
+stage_wait(uint32_t target) {
+	while (atomic_load_u32(&stage, ATOMIC_ACQUIRE) < target) {
+		mq_nanosleep(1000 * 1000);
+	}
+}
+
+/* Holds the bin lock until told to let go; no allocator calls meanwhile. */
+static void *
+thd_lock_start(void *arg) {
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	malloc_mutex_lock(tsdn, &locked_bin->lock);
+	atomic_store_u32(&stage, 1, ATOMIC_RELEASE);
+	stage_wait(2);
+	malloc_mutex_unlock(tsdn, &locked_bin->lock);
+	return NULL;
+}
+
+static unsigned
+stash_count(bin_t *bin) {
+	return (unsigned)(atomic_load_zu(&bin->stash_state, ATOMIC_ACQUIRE) &
+	    BIN_STASH_COUNT_MASK);
+}
+
+TEST_BEGIN(test_bin_stash_lockless) {
+	test_skip_if(opt_bin_stash == 0);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), arena_ind, false);
+	locked_bin = &arena->bins[sz_size2index(SZ)].bin_shards[0];
+
+	void *first = mallocx(SZ, flags);
+	assert_ptr_not_null(first, "Unexpected mallocx() failure");
+	unsigned n = stash_count(locked_bin);
+	assert_u_eq(n, opt_bin_stash, "Allocation should have filled the stash");
+	void *stashed[BIN_STASH_MAX];
+	for (unsigned i = 0; i < n; i++) {
+		stashed[i] = atomic_load_p(&locked_bin->stash[i],
+		    ATOMIC_RELAXED);
+	}
+
+	atomic_store_u32(&stage, 0, ATOMIC_RELAXED);
+	thd_t thd;
+	thd_create(&thd, thd_lock_start, NULL);
+	stage_wait(1);
+
+	/* Must not block on the contended bin. */
+	void *ptrs[BIN_STASH_MAX];
+	for (unsigned i = 0; i < n; i++) {
+		ptrs[i] = mallocx(SZ, flags);
+		assert_ptr_eq(ptrs[i], stashed[n - 1 - i],
+		    "Allocation should pop the stash");
+	}
+	assert_u_eq(stash_count(locked_bin), 0, "Stash should be empty");
+
+	atomic_store_u32(&stage, 2, ATOMIC_RELEASE);
+	thd_join(thd, NULL);
+
+	for (unsigned i = 0; i < n; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	dallocx(first, flags);
+}
+TEST_END
+
+static void *
+thd_alloc_start(void *arg) {
+	uintptr_t id = (uintptr_t)arg;
+	int flags = MALLOCX_ARENA(shared_arena_ind) | MALLOCX_TCACHE_NONE;
+	void *ptrs[NLIVE];
+
+	for (unsigned i = 0; i < NITER; i++) {
+		for (unsigned j = 0; j < NLIVE; j++) {
+			ptrs[j] = mallocx(SZ, flags);
+			assert_ptr_not_null(ptrs[j],
+			    "Unexpected mallocx() failure");
+			memset(ptrs[j], (int)(id + j), SZ);
+		}
+		for (unsigned j = 0; j < NLIVE; j++) {
+			for (unsigned k = 0; k < SZ; k++) {
+				assert_c_eq(((char *)ptrs[j])[k],
+				    (char)(id + j),
+				    "Region handed out more than once");
+			}
+			dallocx(ptrs[j], flags);
+		}
+	}
+	return NULL;
+}
+
+TEST_BEGIN(test_bin_stash_threads) {
+	test_skip_if(opt_bin_stash == 0);
+
+	size_t sz = sizeof(shared_arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&shared_arena_ind, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+
+	thd_t thds[NTHREADS];
+	for (uintptr_t i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_alloc_start, (void *)(i * NLIVE));
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_bin_stash_reset) {
+	test_skip_if(opt_bin_stash == 0);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), arena_ind, false);
+	bin_t *bin = &arena->bins[sz_size2index(SZ)].bin_shards[0];
+
+	void *p = mallocx(SZ, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	assert_u_gt(stash_count(bin), 0, "Allocation should fill the stash");
+
+	char cmd[128];
+	malloc_snprintf(cmd, sizeof(cmd), "arena.%u.reset", arena_ind);
+	assert_d_eq(mallctl(cmd, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	assert_u_eq(stash_count(bin), 0, "Reset should empty the stash");
+
+	p = mallocx(SZ, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	dallocx(p, flags);
+}
+TEST_END
+
+static void
+arena_ctl(const char *name, unsigned arena_ind) {
+	char cmd[128];
+	malloc_snprintf(cmd, sizeof(cmd), "arena.%u.%s", arena_ind, name);
+	assert_d_eq(mallctl(cmd, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+}
+
+TEST_BEGIN(test_bin_stash_drain) {
+	test_skip_if(opt_bin_stash == 0);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), arena_ind, false);
+	bin_t *bin = &arena->bins[sz_size2index(SZ)].bin_shards[0];
+
+	void *p = mallocx(SZ, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	assert_u_gt(stash_count(bin), 0, "Allocation should fill the stash");
+	arena_ctl("decay", arena_ind);
+	assert_u_gt(stash_count(bin), 0,
+	    "Decay should leave a recently filled stash alone");
+	arena_ctl("decay", arena_ind);
+	assert_u_eq(stash_count(bin), 0,
+	    "Decay should drain a stash unused since the last pass");
+	if (config_stats) {
+		assert_zu_eq(bin->stats.curregs, 1,
+		    "Drained regions should no longer count as allocated");
+	}
+
+	void *q = mallocx(SZ, flags);
+	assert_ptr_not_null(q, "Unexpected mallocx() failure");
+	assert_u_gt(stash_count(bin), 0, "Allocation should fill the stash");
+	arena_ctl("purge", arena_ind);
+	assert_u_eq(stash_count(bin), 0, "Purging should drain the stash");
+
+	dallocx(p, flags);
+	dallocx(q, flags);
+	if (config_stats) {
+		assert_zu_eq(bin->stats.curslabs, 0,
+		    "No slab should be left in use");
+	}
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_bin_stash_lockless,
+	    test_bin_stash_threads,
+	    test_bin_stash_reset,
+	    test_bin_stash_drain);
+}
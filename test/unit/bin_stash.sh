@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="bin_stash:16"
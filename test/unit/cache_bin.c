@@ -14,7 +14,10 @@ TEST_BEGIN(test_cache_bin) {
 	void **empty_position = stack + ncached_max;
 	bin->cur_ptr.ptr = empty_position;
 	bin->low_water_position = bin->cur_ptr.lowbits;
+	bin->empty_position = bin->cur_ptr.lowbits;
 	bin->full_position = (uint32_t)(uintptr_t)stack;
+	assert_true(cache_bin_ncached_cap_get(bin) == ncached_max,
+	    "Incorrect cache capacity");
 	assert_ptr_eq(cache_bin_empty_position_get(bin, 0), empty_position,
 	    "Incorrect empty position");
 	/* Not using assert_zu etc on cache_bin_sz_t since it may change. */
@@ -55,10 +58,63 @@ TEST_BEGIN(test_cache_bin) {
 	assert_false(success, "Empty cache bin should not alloc.");
 	assert_ptr_eq(bin->cur_ptr.ptr, stack + ncached_max,
 	    "Bin should be empty");
+
+	dallocx(stack, MALLOCX_TCACHE_NONE);
+}
+TEST_END
+
+TEST_BEGIN(test_cache_bin_cap) {
+	cache_bin_t *bin = &test_bin;
+	void **stack = mallocx(PAGE, MALLOCX_TCACHE_NONE | MALLOCX_ALIGN(PAGE));
+	assert_ptr_not_null(stack, "Unexpected mallocx failure");
+
+	cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(0);
+	void **empty_position = stack + ncached_max;
+	bin->cur_ptr.ptr = empty_position;
+	bin->low_water_position = bin->cur_ptr.lowbits;
+	bin->empty_position = bin->cur_ptr.lowbits;
+	bin->full_position = (uint32_t)(uintptr_t)stack;
+
+	cache_bin_sz_t cap = ncached_max / 2;
+	cache_bin_ncached_cap_set(bin, 0, cap);
+	assert_true(cache_bin_ncached_cap_get(bin) == cap,
+	    "Incorrect cache capacity");
+	assert_ptr_eq(cache_bin_empty_position_get(bin, 0), empty_position,
+	    "Empty position should not move with the capacity");
+	for (cache_bin_sz_t i = 1; i < cap + 1; i++) {
+		bool success = cache_bin_dalloc_easy(bin, (void *)(uintptr_t)i);
+		assert_true(success && cache_bin_ncached_get(bin, 0) == i,
+		    "Bin dalloc failure");
+	}
+	assert_false(cache_bin_dalloc_easy(bin, (void *)1),
+	    "Bin should be full at its capacity");
+	assert_ptr_eq(bin->cur_ptr.ptr, empty_position - cap,
+	    "Incorrect bin cur_ptr");
+
+	/* Growing the capacity makes room without moving the items. */
+	cache_bin_ncached_cap_set(bin, 0, ncached_max);
+	assert_true(cache_bin_dalloc_easy(bin, (void *)(uintptr_t)(cap + 1)),
+	    "Bin should have room after growing");
+	assert_true(cache_bin_ncached_get(bin, 0) == cap + 1,
+	    "Incorrect cache size");
+
+	/* Shrinking requires the items to fit. */
+	cache_bin_ncached_set(bin, 0, 1);
+	cache_bin_ncached_cap_set(bin, 0, 1);
+	assert_false(cache_bin_dalloc_easy(bin, (void *)1),
+	    "Bin should be full at its capacity");
+	bool success;
+	void *ret = cache_bin_alloc_easy(bin, &success, 0);
+	assert_true(success, "Bin alloc failure");
+	assert_ptr_eq(ret, (void *)(uintptr_t)1, "Bin alloc failure");
+
+	dallocx(stack, MALLOCX_TCACHE_NONE);
 }
 TEST_END
 
 int
 main(void) {
-	return test(test_cache_bin);
+	return test(
+	    test_cache_bin,
+	    test_cache_bin_cap);
 }
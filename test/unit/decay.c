@@ -594,6 +594,117 @@ TEST_BEGIN(test_decay_never) {
 }
 TEST_END
 
+static void
+do_decay_curve_set(unsigned arena_ind, const char *curve) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib)/sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.decay_curve", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, (void *)&curve,
+	    sizeof(curve)), 0, "Unexpected mallctlbymib() failure");
+}
+
+TEST_BEGIN(test_decay_curve) {
+	unsigned arena_ind = do_arena_create(1000, 1000);
+	size_t mib[3];
+	size_t miblen = sizeof(mib)/sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.decay_curve", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+
+	const char *curve;
+	size_t sz = sizeof(curve);
+	assert_d_eq(mallctlbymib(mib, miblen, (void *)&curve, &sz, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+	assert_str_eq(curve, decay_curve_names[opt_decay_curve],
+	    "New arenas should use the default curve");
+
+	for (unsigned i = 0; i < decay_curve_names_limit; i++) {
+		do_decay_curve_set(arena_ind, decay_curve_names[i]);
+		assert_d_eq(mallctlbymib(mib, miblen, (void *)&curve, &sz,
+		    NULL, 0), 0, "Unexpected mallctlbymib() failure");
+		assert_str_eq(curve, decay_curve_names[i],
+		    "Unexpected decay curve");
+	}
+
+	const char *invalid = "invalid";
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, (void *)&invalid,
+	    sizeof(invalid)), EINVAL, "Invalid curve should be rejected");
+
+	do_arena_destroy(arena_ind);
+}
+TEST_END
+
+TEST_BEGIN(test_decay_curve_peak) {
+	test_skip_if(check_background_thread_enabled() || !config_stats);
+#define NPS 16
+	unsigned arena_ind = do_arena_create(1000, 0);
+	do_decay_curve_set(arena_ind, "peak");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	size_t sz, large0;
+	sz = sizeof(size_t);
+	assert_d_eq(mallctl("arenas.lextent.0.size", (void *)&large0, &sz, NULL,
+	    0), 0, "Unexpected mallctl failure");
+
+	nstime_init(&time_mock, 0);
+	nstime_update(&time_mock);
+	monotonic_mock = true;
+
+	nstime_monotonic_orig = nstime_monotonic;
+	nstime_update_orig = nstime_update;
+	nstime_monotonic = nstime_monotonic_mock;
+	nstime_update = nstime_update_mock;
+
+	/*
+	 * Record a peak of active pages, then free half of them.  The other
+	 * half keeps the freed extents from being coalesced, so that they can
+	 * be purged one at a time.
+	 */
+	void *ps[NPS];
+	void *guards[NPS];
+	for (unsigned i = 0; i < NPS; i++) {
+		ps[i] = do_mallocx(large0, flags);
+		guards[i] = do_mallocx(large0, flags);
+	}
+	do_decay(arena_ind);
+	for (unsigned i = 0; i < NPS; i++) {
+		dallocx(ps[i], flags);
+	}
+
+	/* Log the dirty pages into the backlog. */
+	nstime_t delta;
+	nstime_init(&delta, 10 * KQU(1000000));
+	nstime_add(&time_mock, &delta);
+	do_decay(arena_ind);
+
+	/*
+	 * Well within the decay time, smoothstep would have purged most of
+	 * the pages, but the peak curve keeps enough to serve the peak again.
+	 */
+	nstime_init(&delta, 600 * KQU(1000000));
+	nstime_add(&time_mock, &delta);
+	do_decay(arena_ind);
+	assert_zu_ge(get_arena_pdirty(arena_ind), NPS * large0 / PAGE / 2,
+	    "Pages needed to get back to the peak should not be purged");
+
+	/* Once the peak is older than the decay time, purge as usual. */
+	nstime_init(&delta, 2000 * KQU(1000000));
+	nstime_add(&time_mock, &delta);
+	do_decay(arena_ind);
+	assert_zu_eq(get_arena_pdirty(arena_ind), 0,
+	    "Pages should be purged once the peak is past");
+
+	nstime_monotonic = nstime_monotonic_orig;
+	nstime_update = nstime_update_orig;
+	for (unsigned i = 0; i < NPS; i++) {
+		dallocx(guards[i], flags);
+	}
+	do_arena_destroy(arena_ind);
+#undef NPS
+}
+TEST_END
+
 int
 main(void) {
 	return test(
@@ -601,5 +712,7 @@ main(void) {
 	    test_decay_ticker,
 	    test_decay_nonmonotonic,
 	    test_decay_now,
-	    test_decay_never);
+	    test_decay_never,
+	    test_decay_curve,
+	    test_decay_curve_peak);
 }
@@ -0,0 +1,112 @@
+#include "test/jemalloc_test.h"
+
+#define SMALL_TOTAL	(1U << 20)
+#define LARGE_TOTAL	(8U << 20)
+
+static unsigned
+do_arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static void
+do_arena_decay(unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.decay", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+}
+
+static size_t
+arena_ndirty(unsigned arena_ind) {
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), arena_ind, false);
+	return eset_npages_get(&arena->eset_dirty);
+}
+
+/*
+ * The unused pages an application thread decaying arena_ind counts: those of
+ * the automatic arenas, and of arena_ind.
+ */
+static size_t
+unused_npages_counted(unsigned arena_ind) {
+	size_t npages = 0;
+	for (unsigned i = 0; i < narenas_total_get(); i++) {
+		arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), i, false);
+		if (arena != NULL && (arena_is_auto(arena) || i == arena_ind)) {
+			npages += eset_npages_get(&arena->eset_dirty) +
+			    eset_npages_get(&arena->eset_muzzy);
+		}
+	}
+	return npages;
+}
+
+/* Leave size bytes of dirty pages in the given arena. */
+static void
+make_dirty(unsigned arena_ind, size_t size, size_t nallocs) {
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	void *ptrs[8];
+	assert_zu_le(nallocs, sizeof(ptrs) / sizeof(ptrs[0]),
+	    "Too many allocations");
+	for (unsigned i = 0; i < nallocs; i++) {
+		ptrs[i] = mallocx(size / nallocs, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	for (unsigned i = 0; i < nallocs; i++) {
+		dallocx(ptrs[i], flags);
+	}
+}
+
+TEST_BEGIN(test_dirty_max) {
+	test_skip_if(opt_dirty_max == 0);
+
+	unsigned small = do_arena_create();
+	unsigned large = do_arena_create();
+	make_dirty(small, SMALL_TOTAL, 4);
+	size_t small_ndirty = arena_ndirty(small);
+	assert_zu_ge(small_ndirty, SMALL_TOTAL >> LG_PAGE,
+	    "Freed pages should be dirty");
+	make_dirty(large, LARGE_TOTAL, 8);
+
+	do_arena_decay(large);
+	assert_zu_le(unused_npages_counted(large), opt_dirty_max >> LG_PAGE,
+	    "Unused pages should be purged down to the maximum");
+	assert_zu_eq(arena_ndirty(small), small_ndirty,
+	    "Another manual arena should not be purged");
+}
+TEST_END
+
+TEST_BEGIN(test_dirty_max_foreign) {
+	test_skip_if(opt_dirty_max == 0);
+
+	unsigned small = do_arena_create();
+	unsigned large = do_arena_create();
+	make_dirty(large, LARGE_TOTAL, 8);
+	size_t large_ndirty = arena_ndirty(large);
+	make_dirty(small, SMALL_TOTAL, 4);
+	size_t small_ndirty = arena_ndirty(small);
+
+	/*
+	 * An application thread neither counts nor purges a manual arena other
+	 * than the one it decays, as the arena may be destroyed meanwhile.
+	 * Without large, the limit is not exceeded.
+	 */
+	do_arena_decay(small);
+	assert_zu_eq(arena_ndirty(large), large_ndirty,
+	    "Another manual arena should not be purged");
+	assert_zu_eq(arena_ndirty(small), small_ndirty,
+	    "Another manual arena should not be counted");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_dirty_max,
+	    test_dirty_max_foreign);
+}
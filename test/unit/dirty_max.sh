@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="dirty_max:4194304,dirty_decay_ms:-1,muzzy_decay_ms:-1"
@@ -0,0 +1,147 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/extent_mmap.h"
+
+#define NTHREADS 4
+#define NITER 1000
+#define NPTRS 8
+
+static unsigned shared_arena_ind;
+
+static void *
+thd_start(void *arg) {
+	unsigned seed = (unsigned)(uintptr_t)arg;
+	int flags = MALLOCX_ARENA(shared_arena_ind) | MALLOCX_TCACHE_NONE;
+	void *ptrs[NPTRS] = {NULL};
+
+	for (unsigned i = 0; i < NITER; i++) {
+		unsigned j = (seed + i) % NPTRS;
+		if (ptrs[j] != NULL) {
+			dallocx(ptrs[j], flags);
+		}
+		/* Spread the sizes over several eset ranges. */
+		size_t sz = SC_LARGE_MINCLASS << ((seed * 7 + i) % 5);
+		ptrs[j] = mallocx(sz + ((i % 3) * PAGE), flags);
+		assert_ptr_not_null(ptrs[j], "Unexpected mallocx() failure");
+	}
+	for (unsigned j = 0; j < NPTRS; j++) {
+		if (ptrs[j] != NULL) {
+			dallocx(ptrs[j], flags);
+		}
+	}
+	return NULL;
+}
+
+static void
+eset_assert_consistent(eset_t *eset) {
+	if (!config_stats) {
+		return;
+	}
+	size_t nbytes = 0;
+	for (pszind_t i = 0; i < ESET_NHEAPS; i++) {
+		nbytes += eset_nbytes_get(eset, i);
+	}
+	assert_zu_eq(nbytes >> LG_PAGE, eset_npages_get(eset),
+	    "Per size class stats and page count disagree");
+}
+
+TEST_BEGIN(test_eset_threads) {
+	size_t sz = sizeof(shared_arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&shared_arena_ind, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+
+	thd_t thds[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, (void *)(uintptr_t)i);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), shared_arena_ind,
+	    false);
+	eset_assert_consistent(&arena->eset_dirty);
+	eset_assert_consistent(&arena->eset_muzzy);
+	eset_assert_consistent(&arena->eset_retained);
+
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.purge", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)shared_arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+	assert_zu_eq(eset_npages_get(&arena->eset_dirty), 0,
+	    "Purging should empty the dirty extents");
+	assert_zu_eq(eset_npages_get(&arena->eset_muzzy), 0,
+	    "Purging should empty the muzzy extents");
+	eset_assert_consistent(&arena->eset_dirty);
+	eset_assert_consistent(&arena->eset_retained);
+}
+TEST_END
+
+#define INVALID_ARENA_IND ((1U << MALLOCX_ARENA_BITS) - 1)
+
+static eset_t eset_order;
+
+/*
+ * Inserts an extent of npages at an address that only orders it; the eset
+ * never touches the memory.
+ */
+static void
+eset_order_insert(tsdn_t *tsdn, extent_t *extent, size_t npages, size_t sn,
+    uintptr_t addr) {
+	extent_init(extent, INVALID_ARENA_IND, (void *)addr, npages << LG_PAGE,
+	    false, SC_NSIZES, sn, extent_state_active, false, true, true,
+	    EXTENT_NOT_HEAD);
+	malloc_mutex_lock(tsdn, &eset_order.mtx);
+	eset_insert(tsdn, &eset_order, extent);
+	malloc_mutex_unlock(tsdn, &eset_order.mtx);
+}
+
+static unsigned
+eset_order_range(const extent_t *extent) {
+	return sz_psz2ind(sz_psz_quantize_floor(extent_size_get(extent))) >>
+	    ESET_LG_RANGE_NHEAPS;
+}
+
+TEST_BEGIN(test_eset_order) {
+	test_skip_if(!maps_coalesce && !opt_retain);
+	test_skip_if(opt_extent_best_fit);
+
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	assert_false(eset_init(tsdn, &eset_order, extent_state_dirty, false),
+	    "Unexpected eset_init() failure");
+
+	/*
+	 * Two extents of sizes that are ranges apart, the large one older and
+	 * inserted first.
+	 */
+	extent_t small, large;
+	uintptr_t base = (uintptr_t)1 << 30;
+	eset_order_insert(tsdn, &large, 64, 1, base + ((uintptr_t)1 << 29));
+	eset_order_insert(tsdn, &small, 2, 2, base);
+	assert_u_lt(eset_order_range(&small), eset_order_range(&large),
+	    "Extents should be in different ranges");
+
+	malloc_mutex_lock(tsdn, &eset_order.mtx);
+	assert_ptr_eq(eset_evict(tsdn, &eset_order), &large,
+	    "Eviction should take the least recently inserted of all ranges");
+	eset_insert(tsdn, &eset_order, &large);
+	malloc_mutex_unlock(tsdn, &eset_order.mtx);
+
+	assert_ptr_eq(eset_fit(tsdn, &eset_order, PAGE, PAGE), &large,
+	    "First fit should take the lowest serial number of all ranges");
+	assert_ptr_eq(eset_fit(tsdn, &eset_order, PAGE, PAGE), &small,
+	    "Unexpected first fit");
+	assert_ptr_null(eset_fit(tsdn, &eset_order, PAGE, PAGE),
+	    "The eset should be empty");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_eset_threads,
+	    test_eset_order);
+}
@@ -0,0 +1,50 @@
+#include "test/jemalloc_test.h"
+
+static void *
+extent_base(void *ptr) {
+	return extent_base_get(iealloc(tsd_tsdn(tsd_fetch()), ptr));
+}
+
+TEST_BEGIN(test_extent_best_fit) {
+	test_skip_if(!opt_extent_best_fit);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	/*
+	 * Leave an older, larger free extent and a newer, smaller one, kept
+	 * apart by live guard allocations so that they are not coalesced.
+	 */
+	size_t small_sz = SC_LARGE_MINCLASS + PAGE;
+	size_t large_sz = SC_LARGE_MINCLASS + 3 * PAGE;
+	void *large = mallocx(large_sz, flags);
+	void *guard0 = mallocx(SC_LARGE_MINCLASS, flags);
+	void *small = mallocx(small_sz, flags);
+	void *guard1 = mallocx(SC_LARGE_MINCLASS, flags);
+	assert_ptr_not_null(large, "Unexpected mallocx() failure");
+	assert_ptr_not_null(guard0, "Unexpected mallocx() failure");
+	assert_ptr_not_null(small, "Unexpected mallocx() failure");
+	assert_ptr_not_null(guard1, "Unexpected mallocx() failure");
+	void *small_base = extent_base(small);
+	dallocx(large, flags);
+	dallocx(small, flags);
+
+	void *p = mallocx(small_sz, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	assert_ptr_eq(extent_base(p), small_base,
+	    "Should reuse the smallest extent that fits");
+
+	dallocx(p, flags);
+	dallocx(guard0, flags);
+	dallocx(guard1, flags);
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_extent_best_fit);
+}
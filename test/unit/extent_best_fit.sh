@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="extent_best_fit:true,dirty_decay_ms:-1"
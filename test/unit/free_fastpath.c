@@ -0,0 +1,75 @@
+#include "test/jemalloc_test.h"
+
+#define NPTRS_MAX 1024
+
+static void *ptrs[NPTRS_MAX];
+
+static uint64_t
+deallocated_get(void) {
+	uint64_t deallocated;
+	size_t sz = sizeof(deallocated);
+	assert_d_eq(mallctl("thread.deallocated", (void *)&deallocated, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+	return deallocated;
+}
+
+static void
+thread_tcache_flush(void) {
+	assert_d_eq(mallctl("thread.tcache.flush", NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+}
+
+/*
+ * Sized frees of small objects go to the tcache, whichever way free_fastpath()
+ * finds the size class.  Debug builds also cross-check the size class against
+ * the rtree there.
+ */
+TEST_BEGIN(test_sdallocx_small) {
+	bool tcache_enabled;
+	size_t sz = sizeof(tcache_enabled);
+	assert_d_eq(mallctl("thread.tcache.enabled", (void *)&tcache_enabled,
+	    &sz, NULL, 0), 0, "Unexpected mallctl() failure");
+	test_skip_if(!tcache_enabled);
+
+	tcache_t *tcache = tsd_tcachep_get(tsd_fetch());
+	for (szind_t i = 0; sz_index2size(i) <= SC_LOOKUP_MAXCLASS; i++) {
+		size_t usize = sz_index2size(i);
+		/* The smallest request size that maps onto the class. */
+		size_t size = (i == 0) ? usize : sz_index2size(i - 1) + 1;
+		/*
+		 * Take regions until one is page aligned, i.e. the first one
+		 * of a slab.  Without a size class lookup, such pointers used
+		 * to be sent down the slow path as possibly sampled.
+		 */
+		unsigned nptrs = 0;
+		bool page_aligned = false;
+		while (!page_aligned && nptrs < NPTRS_MAX) {
+			void *p = mallocx(size, 0);
+			assert_ptr_not_null(p, "Unexpected mallocx() failure");
+			page_aligned = (((uintptr_t)p & PAGE_MASK) == 0);
+			ptrs[nptrs++] = p;
+		}
+		assert_true(page_aligned,
+		    "Expected a page aligned region, size=%zu", usize);
+
+		cache_bin_t *bin = tcache_small_bin_get(tcache, i);
+		for (unsigned j = 0; j < nptrs; j++) {
+			thread_tcache_flush();
+			uint64_t deallocated = deallocated_get();
+			sdallocx(ptrs[j], size, 0);
+			assert_u64_eq(deallocated_get(), deallocated + usize,
+			    "Incorrect thread.deallocated, size=%zu", usize);
+			assert_d_eq(cache_bin_ncached_get(bin, i), 1,
+			    "Region should have been cached, size=%zu",
+			    usize);
+		}
+	}
+	thread_tcache_flush();
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_sdallocx_small);
+}
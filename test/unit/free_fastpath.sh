@@ -0,0 +1,4 @@
+#!/bin/sh
+
+# Junk filling keeps frees off the fast path.
+export MALLOC_CONF="junk:false"
@@ -0,0 +1,153 @@
+#include "test/jemalloc_test.h"
+
+#define NALLOCS 1024
+
+static void *ptrs[NALLOCS];
+
+static unsigned
+arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static void
+arena_ctl(const char *name, unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib(name, mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+}
+
+TEST_BEGIN(test_hpa_packed) {
+	test_skip_if(!opt_hpa);
+
+	unsigned arena_ind = arena_create();
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	size_t sizes[] = {8, 64, 192, 1024, PAGE};
+	size_t slab_pages = 0;
+	unsigned n = 0;
+	for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		const bin_info_t *bin_info = &bin_infos[sz_size2index(
+		    sizes[i])];
+		if (slab_pages + bin_info->slab_size / PAGE >
+		    HPA_REGION_NPAGES) {
+			break;
+		}
+		slab_pages += bin_info->slab_size / PAGE;
+		ptrs[n] = mallocx(sizes[i], flags);
+		assert_ptr_not_null(ptrs[n], "Unexpected mallocx() failure");
+		n++;
+	}
+	/* A fresh arena's first slabs all share a single hugepage. */
+	for (unsigned i = 1; i < n; i++) {
+		assert_ptr_eq(HUGEPAGE_ADDR2BASE(ptrs[i]),
+		    HUGEPAGE_ADDR2BASE(ptrs[0]),
+		    "Slabs should be packed into the same region");
+	}
+	for (unsigned i = 0; i < n; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	arena_ctl("arena.0.destroy", arena_ind);
+}
+TEST_END
+
+TEST_BEGIN(test_hpa_prefer_full) {
+	test_skip_if(!opt_hpa);
+
+	/* Use a size class whose slabs hold one region each. */
+	size_t size = 0;
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		if (bin_infos[i].nregs == 1) {
+			size = bin_infos[i].reg_size;
+			break;
+		}
+	}
+	test_skip_if(size == 0);
+	size_t slab_pages = bin_infos[sz_size2index(size)].slab_size / PAGE;
+	test_skip_if(HPA_REGION_NPAGES / slab_pages + 1 > NALLOCS);
+
+	unsigned arena_ind = arena_create();
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	/* Fill the first region, and spill into a second one. */
+	unsigned n = 0;
+	do {
+		ptrs[n] = mallocx(size, flags);
+		assert_ptr_not_null(ptrs[n], "Unexpected mallocx() failure");
+		n++;
+	} while (HUGEPAGE_ADDR2BASE(ptrs[n - 1]) ==
+	    HUGEPAGE_ADDR2BASE(ptrs[0]));
+	void *full = HUGEPAGE_ADDR2BASE(ptrs[0]);
+	void *spill = HUGEPAGE_ADDR2BASE(ptrs[n - 1]);
+
+	/* Free every other slab of the first region. */
+	unsigned nfreed = 0;
+	for (unsigned i = 0; i < n - 1; i += 2) {
+		if (HUGEPAGE_ADDR2BASE(ptrs[i]) == full) {
+			dallocx(ptrs[i], flags);
+			ptrs[i] = NULL;
+			nfreed++;
+		}
+	}
+	assert_u_gt(nfreed, 1, "Expected several slabs to be freed");
+
+	/* The fuller region is refilled before the one spilled into. */
+	for (unsigned i = 0; i < nfreed; i++) {
+		void *p = mallocx(size, flags);
+		assert_ptr_not_null(p, "Unexpected mallocx() failure");
+		assert_ptr_eq(HUGEPAGE_ADDR2BASE(p), full,
+		    "New slabs should go to the fullest region");
+		assert_ptr_ne(HUGEPAGE_ADDR2BASE(p), spill,
+		    "New slabs should go to the fullest region");
+		dallocx(p, flags);
+	}
+
+	for (unsigned i = 0; i < n; i++) {
+		if (ptrs[i] != NULL) {
+			dallocx(ptrs[i], flags);
+		}
+	}
+	arena_ctl("arena.0.destroy", arena_ind);
+}
+TEST_END
+
+TEST_BEGIN(test_hpa_purge) {
+	test_skip_if(!opt_hpa);
+
+	unsigned arena_ind = arena_create();
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		ptrs[i] = mallocx(SC_SMALL_MAXCLASS, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+		memset(ptrs[i], 0xa5, SC_SMALL_MAXCLASS);
+	}
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	/* Purged regions are still usable. */
+	arena_ctl("arena.0.purge", arena_ind);
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		ptrs[i] = mallocx(SC_SMALL_MAXCLASS, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+		memset(ptrs[i], 0x5a, SC_SMALL_MAXCLASS);
+	}
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	arena_ctl("arena.0.destroy", arena_ind);
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_hpa_packed,
+	    test_hpa_prefer_full,
+	    test_hpa_purge);
+}
@@ -0,0 +1,68 @@
+#include "test/jemalloc_test.h"
+
+#define NALLOCS 8
+
+static unsigned
+arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static void
+do_arena_decay(unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.decay", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+}
+
+static size_t
+eset_nextents(eset_t *eset) {
+	size_t nextents = 0;
+	for (pszind_t i = 0; i < ESET_NHEAPS; i++) {
+		nextents += eset_nextents_get(eset, i);
+	}
+	return nextents;
+}
+
+TEST_BEGIN(test_lazy_coalesce) {
+	test_skip_if(!opt_lazy_coalesce);
+	test_skip_if(!config_stats);
+
+	unsigned arena_ind = arena_create();
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), arena_ind, false);
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	/* Consecutive allocations are carved out of the same grown extent. */
+	void *ptrs[NALLOCS];
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		ptrs[i] = mallocx(SC_LARGE_MINCLASS, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	size_t nextents = eset_nextents(&arena->eset_dirty);
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	assert_zu_eq(eset_nextents(&arena->eset_dirty), nextents + NALLOCS,
+	    "Extents should not be coalesced on deallocation");
+
+	size_t npages = eset_npages_get(&arena->eset_dirty);
+	do_arena_decay(arena_ind);
+	assert_zu_lt(eset_nextents(&arena->eset_dirty), nextents + NALLOCS,
+	    "Extents should be coalesced by the decay pass");
+	assert_zu_eq(eset_npages_get(&arena->eset_dirty), npages,
+	    "Coalescing should not purge");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_lazy_coalesce);
+}
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="lazy_coalesce:true,dirty_decay_ms:-1,muzzy_decay_ms:-1"
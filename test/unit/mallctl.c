@@ -176,7 +176,22 @@ TEST_BEGIN(test_mallctl_opt) {
 	TEST_MALLCTL_OPT(bool, xmalloc, xmalloc);
 	TEST_MALLCTL_OPT(bool, tcache, always);
 	TEST_MALLCTL_OPT(size_t, lg_extent_max_active_fit, always);
+	TEST_MALLCTL_OPT(bool, slab_autotune, always);
+	TEST_MALLCTL_OPT(unsigned, bin_stash, always);
+	TEST_MALLCTL_OPT(unsigned, bin_shards_max, always);
+	TEST_MALLCTL_OPT(bool, hpa, always);
+	TEST_MALLCTL_OPT(bool, lazy_coalesce, always);
+	TEST_MALLCTL_OPT(bool, extent_best_fit, always);
+	TEST_MALLCTL_OPT(const char *, decay_curve, always);
+	TEST_MALLCTL_OPT(bool, pressure_purge, always);
+	TEST_MALLCTL_OPT(size_t, dirty_max, always);
+	TEST_MALLCTL_OPT(bool, rtree_flat, always);
+	TEST_MALLCTL_OPT(bool, slab_map, always);
 	TEST_MALLCTL_OPT(size_t, lg_tcache_max, always);
+	TEST_MALLCTL_OPT(bool, tcache_adaptive, always);
+	TEST_MALLCTL_OPT(size_t, tcache_bytes_max, always);
+	TEST_MALLCTL_OPT(size_t, tcache_global_bytes_max, always);
+	TEST_MALLCTL_OPT(bool, percpu_tcache, always);
 	TEST_MALLCTL_OPT(const char *, thp, always);
 	TEST_MALLCTL_OPT(const char *, zero_realloc, always);
 	TEST_MALLCTL_OPT(bool, prof, prof);
@@ -0,0 +1,157 @@
+#include "test/jemalloc_test.h"
+
+#define NPTRS 64
+#define NTHREADS 8
+#define NITER 10000
+
+static size_t
+tcache_bytes(void) {
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	char cmd[128];
+	size_t bytes;
+	size_t sz = sizeof(bytes);
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.tcache_bytes",
+	    MALLCTL_ARENAS_ALL);
+	assert_d_eq(mallctl(cmd, (void *)&bytes, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	return bytes;
+}
+
+static void
+thread_tcache_flush(void) {
+	assert_d_eq(mallctl("thread.tcache.flush", NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+}
+
+TEST_BEGIN(test_percpu_tcache_basic) {
+	test_skip_if(!opt_percpu_tcache);
+
+	bool enabled;
+	size_t sz = sizeof(enabled);
+	assert_d_eq(mallctl("thread.tcache.enabled", (void *)&enabled, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+	assert_false(enabled, "Threads should not have a tcache of their own");
+
+	void *ptrs[NPTRS];
+	for (unsigned i = 0; i < NPTRS; i++) {
+		ptrs[i] = malloc(64);
+		assert_ptr_not_null(ptrs[i], "Unexpected malloc() failure");
+	}
+	for (unsigned i = 0; i < NPTRS; i++) {
+		free(ptrs[i]);
+	}
+	if (config_stats) {
+		assert_zu_gt(tcache_bytes(), 0,
+		    "Freed objects should be cached per CPU");
+	}
+	thread_tcache_flush();
+	if (config_stats) {
+		assert_zu_eq(tcache_bytes(), 0,
+		    "Flushing should empty all per CPU caches");
+	}
+}
+TEST_END
+
+static void *
+thd_start(void *arg) {
+	uintptr_t tag = (uintptr_t)arg;
+	void *ptrs[NPTRS];
+	for (unsigned i = 0; i < NITER; i++) {
+		unsigned n = i % NPTRS;
+		ptrs[n] = mallocx(8 << (i % 8), 0);
+		assert_ptr_not_null(ptrs[n], "Unexpected mallocx() failure");
+		/* Objects handed out twice would be overwritten. */
+		*(uintptr_t *)ptrs[n] = tag;
+		/* Flushes lock the caches of other CPUs too. */
+		if (tag == 0 && i % 1000 == 0) {
+			thread_tcache_flush();
+		}
+		if (n == NPTRS - 1) {
+			for (unsigned j = 0; j < NPTRS; j++) {
+				assert_zu_eq(*(uintptr_t *)ptrs[j], tag,
+				    "Object should not be shared");
+				dallocx(ptrs[j], 0);
+			}
+		}
+	}
+	return NULL;
+}
+
+TEST_BEGIN(test_percpu_tcache_threads) {
+	test_skip_if(!opt_percpu_tcache);
+
+	thd_t thds[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, (void *)(uintptr_t)i);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+	thread_tcache_flush();
+}
+TEST_END
+
+static uint64_t
+percpu_lock_ops(void) {
+	uint64_t n = 0;
+	for (unsigned i = 0; i < ncpus; i++) {
+		n += tcache_percpus[i]->mtx.prof_data.n_lock_ops;
+	}
+	return n;
+}
+
+TEST_BEGIN(test_percpu_tcache_rseq) {
+	test_skip_if(!opt_percpu_tcache);
+	test_skip_if(!config_stats);
+	test_skip_if(!tcache_percpu_rseq);
+
+	void *p = malloc(64);
+	assert_ptr_not_null(p, "Unexpected malloc() failure");
+	free(p);
+
+	uint64_t lock_ops = percpu_lock_ops();
+	for (unsigned i = 0; i < NITER; i++) {
+		p = malloc(64);
+		assert_ptr_not_null(p, "Unexpected malloc() failure");
+		free(p);
+	}
+	/* Only GC events, and misses after migrations, take the mutexes. */
+	assert_u64_lt(percpu_lock_ops() - lock_ops, NITER / 10,
+	    "Cache hits should not take the per CPU mutex");
+	thread_tcache_flush();
+}
+TEST_END
+
+TEST_BEGIN(test_percpu_tcache_thread_enabled) {
+	test_skip_if(!opt_percpu_tcache);
+
+	/* A thread may still opt into a tcache of its own. */
+	bool enabled = true;
+	assert_d_eq(mallctl("thread.tcache.enabled", NULL, NULL,
+	    (void *)&enabled, sizeof(enabled)), 0,
+	    "Unexpected mallctl() failure");
+	assert_true(tcache_available(tsd_fetch()),
+	    "Thread should have a tcache");
+	void *p = malloc(64);
+	assert_ptr_not_null(p, "Unexpected malloc() failure");
+	free(p);
+	thread_tcache_flush();
+
+	enabled = false;
+	assert_d_eq(mallctl("thread.tcache.enabled", NULL, NULL,
+	    (void *)&enabled, sizeof(enabled)), 0,
+	    "Unexpected mallctl() failure");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_percpu_tcache_basic,
+	    test_percpu_tcache_threads,
+	    test_percpu_tcache_rseq,
+	    test_percpu_tcache_thread_enabled);
+}
@@ -0,0 +1,83 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/pressure.h"
+
+TEST_BEGIN(test_pressure_psi_parse) {
+	uint64_t avg10;
+
+	assert_false(pressure_psi_parse(
+	    "some avg10=12.34 avg60=5.00 avg300=1.00 total=123456\n"
+	    "full avg10=3.21 avg60=1.00 avg300=0.50 total=23456\n", &avg10),
+	    "Unexpected parse failure");
+	assert_u64_eq(avg10, 1234, "Wrong some avg10");
+
+	assert_false(pressure_psi_parse(
+	    "full avg10=3.21 avg60=1.00 avg300=0.50 total=23456\n"
+	    "some avg10=0.07 avg60=0.00 avg300=0.00 total=12\n", &avg10),
+	    "Unexpected parse failure");
+	assert_u64_eq(avg10, 7, "Wrong some avg10");
+
+	assert_false(pressure_psi_parse("some avg10=100.00", &avg10),
+	    "Unexpected parse failure");
+	assert_u64_eq(avg10, 10000, "Wrong some avg10");
+
+	assert_true(pressure_psi_parse("full avg10=3.21 avg60=1.00\n", &avg10),
+	    "Missing some line should fail");
+	assert_true(pressure_psi_parse("some avg10=x\n", &avg10),
+	    "Malformed metric should fail");
+	assert_true(pressure_psi_parse("", &avg10),
+	    "Empty file should fail");
+}
+TEST_END
+
+TEST_BEGIN(test_pressure_cgroup_value_parse) {
+	uint64_t value;
+
+	assert_false(pressure_cgroup_value_parse("1073741824\n", &value),
+	    "Unexpected parse failure");
+	assert_u64_eq(value, 1073741824, "Wrong value");
+	assert_false(pressure_cgroup_value_parse("max\n", &value),
+	    "Unexpected parse failure");
+	assert_u64_eq(value, UINT64_MAX, "max should have no limit");
+	assert_true(pressure_cgroup_value_parse("12k\n", &value),
+	    "Trailing garbage should fail");
+	assert_true(pressure_cgroup_value_parse("\n", &value),
+	    "Empty value should fail");
+}
+TEST_END
+
+TEST_BEGIN(test_pressure_cgroup_path_parse) {
+	char path[64];
+
+	assert_false(pressure_cgroup_path_parse(
+	    "12:memory:/legacy\n0::/system.slice/app.service\n", path,
+	    sizeof(path)), "Unexpected parse failure");
+	assert_str_eq(path, "/system.slice/app.service", "Wrong path");
+
+	assert_false(pressure_cgroup_path_parse("0::/\n", path, sizeof(path)),
+	    "Unexpected parse failure");
+	assert_str_eq(path, "", "Root cgroup should have an empty path");
+
+	assert_true(pressure_cgroup_path_parse("12:memory:/legacy\n", path,
+	    sizeof(path)), "cgroup v1 only should fail");
+	assert_true(pressure_cgroup_path_parse("0::/a/long/path\n", path, 8),
+	    "Too long path should fail");
+}
+TEST_END
+
+TEST_BEGIN(test_pressure_high) {
+	/* Not expected to be high here; just check that polling works. */
+	for (unsigned i = 0; i < 2; i++) {
+		pressure_high();
+	}
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_pressure_psi_parse,
+	    test_pressure_cgroup_value_parse,
+	    test_pressure_cgroup_path_parse,
+	    test_pressure_high);
+}
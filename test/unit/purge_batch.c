@@ -0,0 +1,172 @@
+#include "test/jemalloc_test.h"
+
+#define NRUNS 16
+
+static unsigned
+arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static void
+do_arena_purge(unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.purge", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+}
+
+static void
+do_dirty_decay_ms_set(unsigned arena_ind, ssize_t decay_ms) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.dirty_decay_ms", mib, &miblen),
+	    0, "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, (void *)&decay_ms,
+	    sizeof(decay_ms)), 0, "Unexpected mallctlbymib() failure");
+}
+
+static uint64_t
+get_arena_stat_u64(const char *name, unsigned arena_ind) {
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	size_t mib[4];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib(name, mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[2] = (size_t)arena_ind;
+	uint64_t val;
+	size_t sz = sizeof(val);
+	assert_d_eq(mallctlbymib(mib, miblen, (void *)&val, &sz, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+	return val;
+}
+
+static size_t
+get_arena_pdirty(unsigned arena_ind) {
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	size_t mib[4];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	assert_d_eq(mallctlnametomib("stats.arenas.0.pdirty", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[2] = (size_t)arena_ind;
+	size_t pdirty;
+	size_t sz = sizeof(pdirty);
+	assert_d_eq(mallctlbymib(mib, miblen, (void *)&pdirty, &sz, NULL, 0),
+	    0, "Unexpected mallctlbymib() failure");
+	return pdirty;
+}
+
+/* Returns true if two separate ranges can be purged with a single call. */
+static bool
+purge_batch_supported(bool lazy) {
+	bool commit = true;
+	void *addr = pages_map(NULL, 3 * PAGE, PAGE, &commit);
+	assert_ptr_not_null(addr, "Unexpected pages_map() failure");
+	pages_range_t ranges[2] = {
+		{addr, PAGE},
+		{(void *)((uintptr_t)addr + 2 * PAGE), PAGE}
+	};
+	bool supported = lazy ? !pages_purge_lazy_batch(ranges, 2) :
+	    !pages_purge_forced_batch(ranges, 2);
+	pages_unmap(addr, 3 * PAGE);
+	return supported;
+}
+
+static bool
+retain_enabled(void) {
+	bool retain;
+	size_t sz = sizeof(retain);
+	assert_d_eq(mallctl("opt.retain", (void *)&retain, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	return retain;
+}
+
+/*
+ * Leave NRUNS dirty extents in the arena, kept apart by live guards, which are
+ * returned.
+ */
+static void
+dirty_extents_leave(unsigned arena_ind, void **guards) {
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	void *ptrs[NRUNS];
+	for (unsigned i = 0; i < NRUNS; i++) {
+		ptrs[i] = mallocx(SC_LARGE_MINCLASS, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+		guards[i] = mallocx(SC_LARGE_MINCLASS, flags);
+		assert_ptr_not_null(guards[i], "Unexpected mallocx() failure");
+	}
+	for (unsigned i = 0; i < NRUNS; i++) {
+		dallocx(ptrs[i], flags);
+	}
+}
+
+static void
+guards_free(unsigned arena_ind, void **guards) {
+	for (unsigned i = 0; i < NRUNS; i++) {
+		dallocx(guards[i], MALLOCX_ARENA(arena_ind) |
+		    MALLOCX_TCACHE_NONE);
+	}
+}
+
+TEST_BEGIN(test_purge_batch_forced) {
+	test_skip_if(!config_stats);
+	test_skip_if(!retain_enabled());
+	/* Decommitting can't be batched. */
+	test_skip_if(pages_can_decommit());
+	test_skip_if(!purge_batch_supported(false));
+
+	unsigned arena_ind = arena_create();
+	void *guards[NRUNS];
+	dirty_extents_leave(arena_ind, guards);
+
+	do_arena_purge(arena_ind);
+	assert_zu_eq(get_arena_pdirty(arena_ind), 0,
+	    "Dirty pages should all have been purged");
+	assert_u64_eq(get_arena_stat_u64("stats.arenas.0.dirty_nmadvise",
+	    arena_ind), 1, "Separate extents should be purged together");
+
+	guards_free(arena_ind, guards);
+}
+TEST_END
+
+TEST_BEGIN(test_purge_batch_lazy) {
+	test_skip_if(!config_stats);
+	test_skip_if(!purge_batch_supported(true));
+
+	unsigned arena_ind = arena_create();
+	void *guards[NRUNS];
+	dirty_extents_leave(arena_ind, guards);
+
+	/* Decay everything, lazily since muzzy pages never decay. */
+	do_dirty_decay_ms_set(arena_ind, 0);
+	assert_zu_eq(get_arena_pdirty(arena_ind), 0,
+	    "Dirty pages should all have been purged");
+	assert_u64_eq(get_arena_stat_u64("stats.arenas.0.dirty_nmadvise",
+	    arena_ind), 1, "Separate extents should be purged together");
+	assert_u64_ge(get_arena_stat_u64("stats.arenas.0.dirty_purged",
+	    arena_ind), NRUNS * (SC_LARGE_MINCLASS >> LG_PAGE),
+	    "All the freed extents should have been purged");
+
+	guards_free(arena_ind, guards);
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_purge_batch_forced,
+	    test_purge_batch_lazy);
+}
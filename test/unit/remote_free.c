@@ -0,0 +1,219 @@
+#include "test/jemalloc_test.h"
+
+#define NPTRS 8
+#define SZ 64
+
+static atomic_u32_t stage = ATOMIC_INIT(0);
+static bin_t *locked_bin;
+static void *ptrs[NPTRS];
+
+static void
+stage_wait(uint32_t target) {
+	while (atomic_load_u32(&stage, ATOMIC_ACQUIRE) < target) {
+		mq_nanosleep(1000 * 1000);
+	}
+}
+
+/* Holds the bin lock until told to let go; no allocator calls meanwhile. */
+static void *
+thd_start(void *arg) {
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	malloc_mutex_lock(tsdn, &locked_bin->lock);
+	atomic_store_u32(&stage, 1, ATOMIC_RELEASE);
+	stage_wait(2);
+	malloc_mutex_unlock(tsdn, &locked_bin->lock);
+	return NULL;
+}
+
+static unsigned
+remote_free_count(bin_t *bin) {
+	unsigned n = 0;
+	for (void *p = atomic_load_p(&bin->remote_free, ATOMIC_ACQUIRE);
+	    p != NULL; p = *(void **)p) {
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Allocates ptrs from a fresh arena, and frees them through the calling
+ * thread's tcache (whose arena is a different one) while the bin is locked by
+ * another thread.  Returns the arena index.
+ */
+static unsigned
+remote_free_setup(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	for (unsigned i = 0; i < NPTRS; i++) {
+		ptrs[i] = mallocx(SZ, MALLOCX_ARENA(arena_ind) |
+		    MALLOCX_TCACHE_NONE);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	arena_t *arena = arena_get(tsd_tsdn(tsd_fetch()), arena_ind, false);
+	locked_bin = &arena->bins[sz_size2index(SZ)].bin_shards[0];
+
+	atomic_store_u32(&stage, 0, ATOMIC_RELAXED);
+	thd_t thd;
+	thd_create(&thd, thd_start, NULL);
+	stage_wait(1);
+
+	/* Must not block on the contended bin. */
+	for (unsigned i = 0; i < NPTRS; i++) {
+		dallocx(ptrs[i], 0);
+	}
+	assert_d_eq(mallctl("thread.tcache.flush", NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	assert_u_eq(remote_free_count(locked_bin), NPTRS,
+	    "Flushed objects should be on the remote free list");
+
+	atomic_store_u32(&stage, 2, ATOMIC_RELEASE);
+	thd_join(thd, NULL);
+	return arena_ind;
+}
+
+static size_t
+arena_small_allocated(unsigned arena_ind) {
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	char cmd[128];
+	size_t allocated;
+	size_t sz = sizeof(allocated);
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.small.allocated",
+	    arena_ind);
+	assert_d_eq(mallctl(cmd, (void *)&allocated, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	return allocated;
+}
+
+TEST_BEGIN(test_remote_free_fill) {
+	test_skip_if(!opt_tcache);
+
+	unsigned arena_ind = remote_free_setup();
+	/* The refill takes the remotely freed objects first. */
+	void *p = mallocx(SZ, MALLOCX_ARENA(arena_ind));
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	assert_ptr_null(atomic_load_p(&locked_bin->remote_free,
+	    ATOMIC_RELAXED), "Remote free list should have been taken");
+	bool found = false;
+	for (unsigned i = 0; i < NPTRS; i++) {
+		found |= (p == ptrs[i]);
+	}
+	assert_true(found, "Refill should recycle remotely freed objects");
+	dallocx(p, 0);
+	assert_d_eq(mallctl("thread.tcache.flush", NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+}
+TEST_END
+
+TEST_BEGIN(test_remote_free_drain) {
+	test_skip_if(!opt_tcache);
+
+	unsigned arena_ind = remote_free_setup();
+	if (config_stats) {
+		assert_zu_eq(arena_small_allocated(arena_ind), NPTRS * SZ,
+		    "Objects are still allocated until drained");
+	}
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	arena_bin_remote_drain(tsdn, arena_get(tsdn, arena_ind, false),
+	    sz_size2index(SZ));
+	assert_ptr_null(atomic_load_p(&locked_bin->remote_free,
+	    ATOMIC_RELAXED), "Remote free list should have been drained");
+	if (config_stats) {
+		assert_zu_eq(arena_small_allocated(arena_ind), 0,
+		    "Drained objects should be back in their slabs");
+	}
+}
+TEST_END
+
+static size_t
+bin_curregs(unsigned arena_ind) {
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	char cmd[128];
+	size_t curregs;
+	size_t sz = sizeof(curregs);
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.bins.%u.curregs",
+	    arena_ind, (unsigned)sz_size2index(SZ));
+	assert_d_eq(mallctl(cmd, (void *)&curregs, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	return curregs;
+}
+
+/*
+ * The thread that held the bin is gone, and nothing fills from the bin again;
+ * a decay pass over the arena still drains it.
+ */
+TEST_BEGIN(test_remote_free_decay) {
+	test_skip_if(!opt_tcache);
+	test_skip_if(!config_stats);
+
+	unsigned arena_ind = remote_free_setup();
+	assert_zu_eq(bin_curregs(arena_ind), NPTRS,
+	    "Objects are still allocated until drained");
+	char cmd[64];
+	malloc_snprintf(cmd, sizeof(cmd), "arena.%u.decay", arena_ind);
+	assert_d_eq(mallctl(cmd, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	assert_ptr_null(atomic_load_p(&locked_bin->remote_free,
+	    ATOMIC_RELAXED), "Decay should drain the remote free list");
+	assert_zu_eq(bin_curregs(arena_ind), 0,
+	    "Drained objects should be back in their slabs");
+}
+TEST_END
+
+TEST_BEGIN(test_remote_free_background) {
+	test_skip_if(!opt_tcache);
+	test_skip_if(!config_stats);
+	test_skip_if(!have_background_thread);
+
+	unsigned arena_ind = remote_free_setup();
+	assert_zu_eq(bin_curregs(arena_ind), NPTRS,
+	    "Objects are still allocated until drained");
+	bool enable = true;
+	assert_d_eq(mallctl("background_thread", NULL, NULL, &enable,
+	    sizeof(enable)), 0, "Unexpected mallctl() failure");
+	/* Wait for up to 10 seconds. */
+	for (unsigned i = 0; i < 1000 && bin_curregs(arena_ind) != 0; i++) {
+		mq_nanosleep(10 * 1000 * 1000);
+	}
+	enable = false;
+	assert_d_eq(mallctl("background_thread", NULL, NULL, &enable,
+	    sizeof(enable)), 0, "Unexpected mallctl() failure");
+	assert_zu_eq(bin_curregs(arena_ind), 0,
+	    "Background threads should drain the remote free list");
+}
+TEST_END
+
+TEST_BEGIN(test_remote_free_dalloc) {
+	test_skip_if(!opt_tcache);
+	test_skip_if(!config_stats);
+
+	/* Goes to the same bin shard as the remotely freed objects. */
+	unsigned arena_ind = remote_free_setup();
+	void *p = mallocx(SZ, MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	assert_zu_eq(bin_curregs(arena_ind), NPTRS + 1,
+	    "Objects are still allocated until drained");
+	dallocx(p, MALLOCX_TCACHE_NONE);
+	assert_ptr_null(atomic_load_p(&locked_bin->remote_free,
+	    ATOMIC_RELAXED), "Deallocation should drain the remote free list");
+	assert_zu_eq(bin_curregs(arena_ind), 0,
+	    "Drained objects should be back in their slabs");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_remote_free_fill,
+	    test_remote_free_drain,
+	    test_remote_free_decay,
+	    test_remote_free_background,
+	    test_remote_free_dalloc);
+}
@@ -74,7 +74,8 @@ TEST_BEGIN(test_rtree_read_empty) {
 	rtree_t *rtree = &test_rtree;
 	rtree_ctx_t rtree_ctx;
 	rtree_ctx_data_init(&rtree_ctx);
-	assert_false(rtree_new(rtree, false), "Unexpected rtree_new() failure");
+	assert_false(rtree_new(rtree, false, false),
+	    "Unexpected rtree_new() failure");
 	assert_ptr_null(rtree_extent_read(tsdn, rtree, &rtree_ctx, PAGE,
 	    false), "rtree_extent_read() should return NULL for empty tree");
 	rtree_delete(tsdn, rtree);
@@ -98,7 +99,8 @@ TEST_BEGIN(test_rtree_extrema) {
 	rtree_t *rtree = &test_rtree;
 	rtree_ctx_t rtree_ctx;
 	rtree_ctx_data_init(&rtree_ctx);
-	assert_false(rtree_new(rtree, false), "Unexpected rtree_new() failure");
+	assert_false(rtree_new(rtree, false, false),
+	    "Unexpected rtree_new() failure");
 
 	assert_false(rtree_write(tsdn, rtree, &rtree_ctx, PAGE, &extent_a,
 	    extent_szind_get(&extent_a), extent_slab_get(&extent_a)),
@@ -133,7 +135,8 @@ TEST_BEGIN(test_rtree_bits) {
 	rtree_t *rtree = &test_rtree;
 	rtree_ctx_t rtree_ctx;
 	rtree_ctx_data_init(&rtree_ctx);
-	assert_false(rtree_new(rtree, false), "Unexpected rtree_new() failure");
+	assert_false(rtree_new(rtree, false, false),
+	    "Unexpected rtree_new() failure");
 
 	for (unsigned i = 0; i < sizeof(keys)/sizeof(uintptr_t); i++) {
 		assert_false(rtree_write(tsdn, rtree, &rtree_ctx, keys[i],
@@ -171,7 +174,8 @@ TEST_BEGIN(test_rtree_random) {
 	extent_init(&extent, INVALID_ARENA_IND, NULL, 0, false, SC_NSIZES, 0,
 	    extent_state_active, false, false, true, EXTENT_NOT_HEAD);
 
-	assert_false(rtree_new(rtree, false), "Unexpected rtree_new() failure");
+	assert_false(rtree_new(rtree, false, false),
+	    "Unexpected rtree_new() failure");
 
 	for (unsigned i = 0; i < NSET; i++) {
 		keys[i] = (uintptr_t)gen_rand64(sfmt);
@@ -211,6 +215,120 @@ TEST_BEGIN(test_rtree_random) {
 }
 TEST_END
 
+TEST_BEGIN(test_rtree_ctx_cache) {
+	test_skip_if(!config_stats);
+	/*
+	 * Consecutive leaves, as many as the L1 and L2 caches hold together,
+	 * all remain cached, however they are accessed.
+	 */
+#define NLEAVES (RTREE_CTX_NCACHE + RTREE_CTX_NCACHE_L2)
+	tsdn_t *tsdn = tsdn_fetch();
+	rtree_t *rtree = &test_rtree;
+	rtree_ctx_t rtree_ctx;
+	rtree_ctx_data_init(&rtree_ctx);
+	unsigned ptrbits = ZU(1) << (LG_SIZEOF_PTR+3);
+	uintptr_t leafsize = ZU(1) << (ptrbits -
+	    (rtree_levels[RTREE_HEIGHT-1].cumbits -
+	    rtree_levels[RTREE_HEIGHT-1].bits));
+
+	extent_t extent;
+	extent_init(&extent, INVALID_ARENA_IND, NULL, 0, false, SC_NSIZES, 0,
+	    extent_state_active, false, false, true, EXTENT_NOT_HEAD);
+
+	assert_false(rtree_new(rtree, false, false),
+	    "Unexpected rtree_new() failure");
+	for (unsigned i = 1; i <= NLEAVES; i++) {
+		assert_false(rtree_write(tsdn, rtree, &rtree_ctx, i * leafsize,
+		    &extent, SC_NSIZES, false),
+		    "Unexpected rtree_write() failure");
+	}
+	assert_u64_eq(rtree_ctx_stat_read(&rtree_ctx.nmisses), NLEAVES,
+	    "Each new leaf should miss once");
+
+	for (unsigned pass = 0; pass < 2; pass++) {
+		for (unsigned i = 1; i <= NLEAVES; i++) {
+			unsigned j = (pass == 0) ? i : NLEAVES + 1 - i;
+			assert_ptr_eq(rtree_extent_read(tsdn, rtree, &rtree_ctx,
+			    j * leafsize, true), &extent,
+			    "rtree_extent_read() should return previously set "
+			    "value, j=%u", j);
+		}
+	}
+	assert_u64_eq(rtree_ctx_stat_read(&rtree_ctx.nmisses), NLEAVES,
+	    "Cached leaves should not miss");
+	assert_u64_gt(rtree_ctx_stat_read(&rtree_ctx.nhits_l2), 0,
+	    "Expected L2 hits");
+
+	for (unsigned i = 1; i <= NLEAVES; i++) {
+		rtree_clear(tsdn, rtree, &rtree_ctx, i * leafsize);
+	}
+	rtree_delete(tsdn, rtree);
+#undef NLEAVES
+}
+TEST_END
+
+TEST_BEGIN(test_rtree_flat) {
+#define NSET 16
+#define SEED 42
+	tsdn_t *tsdn = tsdn_fetch();
+	uintptr_t keys[NSET];
+	rtree_t *rtree = &test_rtree;
+	rtree_ctx_t rtree_ctx;
+	rtree_ctx_data_init(&rtree_ctx);
+
+	extent_t extent;
+	extent_init(&extent, INVALID_ARENA_IND, NULL, 0, false, SC_NBINS - 1, 0,
+	    extent_state_active, false, false, true, EXTENT_NOT_HEAD);
+
+	assert_false(rtree_new(rtree, false, true),
+	    "Unexpected rtree_new() failure");
+#ifdef RTREE_FLAT
+	bool flat = (rtree->flat != NULL);
+#else
+	bool flat = false;
+#endif
+	if (!flat) {
+		rtree_delete(tsdn, rtree);
+	}
+	test_skip_if(!flat);
+
+	sfmt_t *sfmt = init_gen_rand(SEED);
+
+	assert_ptr_null(rtree_extent_read(tsdn, rtree, &rtree_ctx, PAGE,
+	    false), "rtree_extent_read() should return NULL for empty map");
+	for (unsigned i = 0; i < NSET; i++) {
+		keys[i] = (uintptr_t)gen_rand64(sfmt) | PAGE;
+		assert_false(rtree_write(tsdn, rtree, &rtree_ctx, keys[i],
+		    &extent, SC_NBINS - 1, true),
+		    "Unexpected rtree_write() failure");
+	}
+	for (unsigned i = 0; i < NSET; i++) {
+		assert_ptr_eq(rtree_extent_read(tsdn, rtree, &rtree_ctx,
+		    keys[i], true), &extent,
+		    "rtree_extent_read() should return previously set value, "
+		    "i=%u", i);
+		szind_t szind;
+		bool slab;
+		assert_true(rtree_szind_slab_read_fast(tsdn, rtree, &rtree_ctx,
+		    keys[i], &szind, &slab),
+		    "The flat page map should always hit");
+		assert_u_eq(szind, SC_NBINS - 1, "Unexpected szind, i=%u", i);
+		assert_true(slab, "Unexpected slab, i=%u", i);
+	}
+	for (unsigned i = 0; i < NSET; i++) {
+		rtree_clear(tsdn, rtree, &rtree_ctx, keys[i]);
+		assert_ptr_null(rtree_extent_read(tsdn, rtree, &rtree_ctx,
+		    keys[i], true), "rtree_extent_read() should return NULL "
+		    "after rtree_clear(), i=%u", i);
+	}
+
+	rtree_delete(tsdn, rtree);
+	fini_gen_rand(sfmt);
+#undef NSET
+#undef SEED
+}
+TEST_END
+
 int
 main(void) {
 	rtree_node_alloc_orig = rtree_node_alloc;
@@ -226,5 +344,7 @@ main(void) {
 	    test_rtree_read_empty,
 	    test_rtree_extrema,
 	    test_rtree_bits,
-	    test_rtree_random);
+	    test_rtree_random,
+	    test_rtree_ctx_cache,
+	    test_rtree_flat);
 }
@@ -29,8 +29,23 @@ TEST_BEGIN(test_arena_slab_regind) {
 }
 TEST_END
 
+TEST_BEGIN(test_slab_hot_fields) {
+	assert_zu_le(offsetof(extent_t, e_slab_data) + sizeof(bitmap_t),
+	    CACHELINE,
+	    "The first bitmap group should share the first cache line with "
+	    "e_bits and e_addr");
+	assert_zu_ge(offsetof(extent_t, ql_link),
+	    offsetof(extent_t, e_slab_data) + sizeof(slab_data_t),
+	    "List linkage should follow the slab data");
+	assert_zu_ge(offsetof(extent_t, ph_link),
+	    offsetof(extent_t, e_slab_data) + sizeof(slab_data_t),
+	    "Heap linkage should follow the slab data");
+}
+TEST_END
+
 int
 main(void) {
 	return test(
-	    test_arena_slab_regind);
+	    test_arena_slab_regind,
+	    test_slab_hot_fields);
 }
@@ -0,0 +1,122 @@
+#include "test/jemalloc_test.h"
+
+#define NALLOCS (64 * 64)
+#define NMORE (2 * NALLOCS)
+
+static void *ptrs[NALLOCS];
+static void *more[NMORE];
+
+static bool
+slab_autotune_enabled(void) {
+	bool enabled;
+	size_t sz = sizeof(enabled);
+	assert_d_eq(mallctl("opt.slab_autotune", (void *)&enabled, &sz, NULL,
+	    0), 0, "Unexpected mallctl() failure");
+	return enabled;
+}
+
+static size_t
+bin_slab_size(size_t size) {
+	unsigned binind = (unsigned)sz_size2index(size);
+	char cmd[128];
+	size_t slab_size;
+	size_t sz = sizeof(slab_size);
+	malloc_snprintf(cmd, sizeof(cmd), "arenas.bin.%u.slab_size", binind);
+	assert_d_eq(mallctl(cmd, (void *)&slab_size, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	return slab_size;
+}
+
+typedef struct {
+	void *slabcur_addr;
+	size_t nfree;
+	size_t nregs;
+	size_t size;
+	size_t bin_nfree;
+	size_t bin_nregs;
+} util_stats_t;
+
+static void
+util_query(void *ptr, util_stats_t *stats) {
+	size_t sz = sizeof(*stats);
+	assert_d_eq(mallctl("experimental.utilization.query", (void *)stats,
+	    &sz, (void *)&ptr, sizeof(ptr)), 0, "Unexpected mallctl() failure");
+	assert_zu_le(stats->nfree, stats->nregs, "Too many free regions");
+	assert_zu_le(stats->nregs * sallocx(ptr, 0), stats->size,
+	    "Regions should fit in the slab");
+	assert_zu_le(stats->bin_nfree, stats->bin_nregs,
+	    "Too many free regions in bin");
+}
+
+TEST_BEGIN(test_slab_autotune) {
+	test_skip_if(!config_stats);
+	test_skip_if(!slab_autotune_enabled());
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	size_t size = 64;
+	size_t slab_size = bin_slab_size(size);
+	util_stats_t stats;
+
+	/* A growing bin that keeps needing new slabs should get larger ones. */
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		ptrs[i] = mallocx(size, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	util_query(ptrs[0], &stats);
+	assert_zu_eq(stats.size, slab_size,
+	    "First slab should have the configured size");
+	util_query(ptrs[NALLOCS - 1], &stats);
+	assert_zu_gt(stats.size, slab_size,
+	    "Later slabs should have grown");
+	assert_zu_eq(stats.bin_nregs - stats.bin_nfree, NALLOCS,
+	    "Bin region counts should hold across slab sizes");
+	size_t slab_size_max = stats.size;
+
+	/*
+	 * Leave it sparsely used; once it needs new slabs again, they should
+	 * get smaller.
+	 */
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		if (i % 8 != 0) {
+			dallocx(ptrs[i], flags);
+			ptrs[i] = NULL;
+		}
+	}
+	bool shrunk = false;
+	unsigned nmore;
+	for (nmore = 0; nmore < NMORE && !shrunk; nmore++) {
+		more[nmore] = mallocx(size, flags);
+		assert_ptr_not_null(more[nmore],
+		    "Unexpected mallocx() failure");
+		util_query(more[nmore], &stats);
+		shrunk = (stats.size < slab_size_max);
+	}
+	assert_true(shrunk, "Poor utilization should have led to smaller slabs");
+
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		if (ptrs[i] != NULL) {
+			dallocx(ptrs[i], flags);
+		}
+	}
+	for (unsigned i = 0; i < nmore; i++) {
+		dallocx(more[i], flags);
+	}
+	void *p = mallocx(size, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	util_query(p, &stats);
+	assert_zu_eq(stats.bin_nregs - stats.bin_nfree, 1,
+	    "Bin region counts should hold across slab sizes");
+	dallocx(p, flags);
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_slab_autotune);
+}
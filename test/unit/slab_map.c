@@ -0,0 +1,96 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/slab_map.h"
+
+/* Not jemalloc memory, so its pages can be marked freely. */
+static char buf[8 * PAGE] JEMALLOC_ALIGNED(PAGE);
+
+TEST_BEGIN(test_slab_map_small) {
+	test_skip_if(slab_map == NULL);
+
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		size_t sz = sz_index2size(i);
+		void *p = mallocx(sz, MALLOCX_TCACHE_NONE);
+		assert_ptr_not_null(p, "Unexpected mallocx() failure");
+		szind_t szind;
+		assert_true(slab_map_lookup((uintptr_t)p, &szind),
+		    "Small allocation should be in the slab map, size=%zu",
+		    sz);
+		assert_u_eq(szind, i, "Wrong size class, size=%zu", sz);
+		dallocx(p, MALLOCX_TCACHE_NONE);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_slab_map_large) {
+	test_skip_if(slab_map == NULL);
+
+	void *p = mallocx(SC_LARGE_MINCLASS, MALLOCX_TCACHE_NONE);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	szind_t szind;
+	assert_false(slab_map_lookup((uintptr_t)p, &szind),
+	    "Large allocation should not be in the slab map");
+	dallocx(p, MALLOCX_TCACHE_NONE);
+
+	assert_false(slab_map_lookup(0, &szind),
+	    "NULL should not be in the slab map");
+}
+TEST_END
+
+TEST_BEGIN(test_slab_map_set_clear) {
+	test_skip_if(slab_map == NULL);
+
+	szind_t szind;
+	slab_map_set(&buf[PAGE], 4 * PAGE, 3);
+	assert_false(slab_map_lookup((uintptr_t)&buf[PAGE - 1], &szind),
+	    "Page before the slab should not be in the slab map");
+	for (size_t i = PAGE; i < 5 * PAGE; i += PAGE / 2) {
+		assert_true(slab_map_lookup((uintptr_t)&buf[i], &szind),
+		    "Slab page should be in the slab map, i=%zu", i);
+		assert_u_eq(szind, 3, "Wrong size class, i=%zu", i);
+	}
+	assert_false(slab_map_lookup((uintptr_t)&buf[5 * PAGE], &szind),
+	    "Page after the slab should not be in the slab map");
+
+	slab_map_clear(&buf[PAGE], 4 * PAGE);
+	for (size_t i = 0; i < sizeof(buf); i += PAGE / 2) {
+		assert_false(slab_map_lookup((uintptr_t)&buf[i], &szind),
+		    "Page should no longer be in the slab map, i=%zu", i);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_slab_map_arena_destroy) {
+	test_skip_if(slab_map == NULL);
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	void *p = mallocx(1, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	szind_t szind;
+	assert_true(slab_map_lookup((uintptr_t)p, &szind),
+	    "Small allocation should be in the slab map");
+
+	size_t mib[3];
+	size_t miblen = sizeof(mib)/sizeof(size_t);
+	assert_d_eq(mallctlnametomib("arena.0.destroy", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	assert_d_eq(mallctlbymib(mib, miblen, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+	assert_false(slab_map_lookup((uintptr_t)p, &szind),
+	    "Slabs of a destroyed arena should leave the slab map");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_slab_map_small,
+	    test_slab_map_large,
+	    test_slab_map_set_clear,
+	    test_slab_map_arena_destroy);
+}
@@ -361,6 +361,121 @@ TEST_BEGIN(test_stats_arenas_lextents) {
 }
 TEST_END
 
+static uint64_t
+decay_hist_sum(unsigned arena_ind, const char *name) {
+	char cmd[128];
+	uint64_t sum = 0;
+	for (unsigned j = 0; j < ARENA_DECAY_NHIST; j++) {
+		uint64_t count;
+		size_t sz = sizeof(count);
+		malloc_snprintf(cmd, sizeof(cmd),
+		    "stats.arenas.%u.decay_hist.%u.%s", arena_ind, j, name);
+		assert_d_eq(mallctl(cmd, (void *)&count, &sz, NULL, 0), 0,
+		    "Unexpected mallctl() failure");
+		sum += count;
+	}
+	return sum;
+}
+
+TEST_BEGIN(test_stats_arenas_decay_hist) {
+	unsigned arena_ind;
+	uint64_t epoch, dirty_npurge, dirty_nmadvise;
+	size_t sz;
+	char cmd[64];
+	int expected = config_stats ? 0 : ENOENT;
+
+	sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	void *p = mallocx(SC_LARGE_MINCLASS, flags);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	dallocx(p, flags);
+
+	malloc_snprintf(cmd, sizeof(cmd), "arena.%u.purge", arena_ind);
+	assert_d_eq(mallctl(cmd, NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch, sizeof(epoch)),
+	    0, "Unexpected mallctl() failure");
+
+	sz = sizeof(uint64_t);
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.decay_hist.0."
+	    "dirty_npurge", arena_ind);
+	assert_d_eq(mallctl(cmd, (void *)&dirty_npurge, &sz, NULL, 0),
+	    expected, "Unexpected mallctl() result");
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.decay_hist.%u."
+	    "dirty_npurge", arena_ind, ARENA_DECAY_NHIST);
+	assert_d_eq(mallctl(cmd, (void *)&dirty_npurge, &sz, NULL, 0), ENOENT,
+	    "Unexpected mallctl() result for an out of range bucket");
+
+	if (!config_stats) {
+		return;
+	}
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.dirty_npurge",
+	    arena_ind);
+	assert_d_eq(mallctl(cmd, (void *)&dirty_npurge, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.dirty_nmadvise",
+	    arena_ind);
+	assert_d_eq(mallctl(cmd, (void *)&dirty_nmadvise, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+
+	assert_u64_gt(dirty_npurge, 0,
+	    "At least one purge should have occurred");
+	assert_u64_eq(decay_hist_sum(arena_ind, "dirty_npurge"), dirty_npurge,
+	    "Each purge sweep should be in the histogram");
+	uint64_t dirty_npurge_app = decay_hist_sum(arena_ind,
+	    "dirty_npurge_app");
+	assert_u64_gt(dirty_npurge_app, 0,
+	    "The purge by this thread should be in the histogram");
+	assert_u64_le(dirty_npurge_app, dirty_npurge,
+	    "Application threads only make some of the purge sweeps");
+	assert_u64_eq(decay_hist_sum(arena_ind, "dirty_nmadvise"),
+	    dirty_nmadvise, "Each madvise call should be in the histogram");
+	assert_u64_ge(decay_hist_sum(arena_ind, "dirty_nlocked"), dirty_npurge,
+	    "The decay mutex is locked at least once per purge sweep");
+}
+TEST_END
+
+TEST_BEGIN(test_stats_rtree_ctx) {
+	uint64_t thread_nhits_l2, thread_nmisses, nhits_l2, nmisses;
+	int expected = config_stats ? 0 : ENOENT;
+
+	/* Free enough to touch the rtree_ctx cache of this thread. */
+	for (unsigned i = 0; i < 16; i++) {
+		void *p = mallocx(SC_LARGE_MINCLASS, MALLOCX_TCACHE_NONE);
+		assert_ptr_not_null(p, "Unexpected mallocx() failure");
+		dallocx(p, MALLOCX_TCACHE_NONE);
+	}
+
+	size_t sz = sizeof(uint64_t);
+	assert_d_eq(mallctl("thread.rtree_ctx.nhits_l2",
+	    (void *)&thread_nhits_l2, &sz, NULL, 0), expected,
+	    "Unexpected mallctl() result");
+	assert_d_eq(mallctl("thread.rtree_ctx.nmisses",
+	    (void *)&thread_nmisses, &sz, NULL, 0), expected,
+	    "Unexpected mallctl() result");
+
+	uint64_t epoch = 1;
+	assert_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+	assert_d_eq(mallctl("stats.rtree_ctx.nhits_l2", (void *)&nhits_l2, &sz,
+	    NULL, 0), expected, "Unexpected mallctl() result");
+	assert_d_eq(mallctl("stats.rtree_ctx.nmisses", (void *)&nmisses, &sz,
+	    NULL, 0), expected, "Unexpected mallctl() result");
+
+	if (config_stats) {
+		assert_u64_gt(thread_nmisses, 0,
+		    "The first lookup of this thread should have missed");
+		assert_u64_ge(nhits_l2, thread_nhits_l2,
+		    "Global L2 hits should include this thread's");
+		assert_u64_ge(nmisses, thread_nmisses,
+		    "Global misses should include this thread's");
+	}
+}
+TEST_END
+
 int
 main(void) {
 	return test_no_reentrancy(
@@ -370,5 +485,7 @@ main(void) {
 	    test_stats_arenas_small,
 	    test_stats_arenas_large,
 	    test_stats_arenas_bins,
-	    test_stats_arenas_lextents);
+	    test_stats_arenas_lextents,
+	    test_stats_arenas_decay_hist,
+	    test_stats_rtree_ctx);
 }
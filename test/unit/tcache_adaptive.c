@@ -0,0 +1,133 @@
+#include "test/jemalloc_test.h"
+
+#define NPTRS 1024
+
+static void *ptrs[NPTRS];
+
+static cache_bin_t *
+hot_bin_get(szind_t binind) {
+	tcache_t *tcache = tsd_tcachep_get(tsd_fetch());
+	return tcache_small_bin_get(tcache, binind);
+}
+
+static void
+budget_check(void) {
+	tcache_t *tcache = tsd_tcachep_get(tsd_fetch());
+	size_t cap_bytes = 0;
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		cap_bytes += cache_bin_ncached_cap_get(
+		    tcache_small_bin_get(tcache, i)) * sz_index2size(i);
+	}
+	assert_zu_eq(cap_bytes, tcache->small_cap_bytes,
+	    "Inconsistent small_cap_bytes");
+}
+
+/*
+ * Allocate and free twice the current capacity of the bin, so that each round
+ * both refills and flushes it.
+ */
+static void
+thrash(size_t size, szind_t binind, unsigned nrounds) {
+	for (unsigned i = 0; i < nrounds; i++) {
+		size_t n = 2 * cache_bin_ncached_cap_get(hot_bin_get(binind));
+		assert_zu_le(n, NPTRS, "Capacity grew too large");
+		for (size_t j = 0; j < n; j++) {
+			ptrs[j] = mallocx(size, 0);
+			assert_ptr_not_null(ptrs[j],
+			    "Unexpected mallocx() failure");
+		}
+		for (size_t j = 0; j < n; j++) {
+			dallocx(ptrs[j], 0);
+		}
+	}
+}
+
+TEST_BEGIN(test_tcache_adaptive) {
+	test_skip_if(!opt_tcache);
+	assert_true(opt_tcache_adaptive, "Should run with tcache_adaptive");
+
+	size_t size = 64;
+	szind_t binind = sz_size2index(size);
+	cache_bin_sz_t cap_init = tcache_bin_info[binind].ncached_cap_init;
+	assert_true(cache_bin_ncached_max_get(binind) > cap_init,
+	    "Adaptive bins should reserve room to grow");
+
+	thrash(size, binind, 100);
+	cache_bin_sz_t cap_hot = cache_bin_ncached_cap_get(hot_bin_get(binind));
+	assert_true(cap_hot > cap_init, "Hot bin capacity should grow");
+	budget_check();
+
+	/* Leave the bin alone while another size class keeps GC going. */
+	for (unsigned i = 0; i < 100000; i++) {
+		dallocx(mallocx(size * 4, 0), 0);
+	}
+	assert_true(cache_bin_ncached_cap_get(hot_bin_get(binind)) < cap_hot,
+	    "Cold bin capacity should shrink");
+	budget_check();
+}
+TEST_END
+
+TEST_BEGIN(test_tcache_adaptive_balanced) {
+	test_skip_if(!opt_tcache);
+
+	/*
+	 * A bin whose frees and allocations balance out within the cache never
+	 * refills or flushes, but is anything but cold.
+	 */
+	size_t size = 128;
+	szind_t binind = sz_size2index(size);
+	for (unsigned j = 0; j < 4; j++) {
+		ptrs[j] = mallocx(size, 0);
+		assert_ptr_not_null(ptrs[j], "Unexpected mallocx() failure");
+	}
+	for (unsigned i = 0; i < 100000; i++) {
+		for (unsigned j = 0; j < 4; j++) {
+			dallocx(ptrs[j], 0);
+		}
+		for (unsigned j = 0; j < 4; j++) {
+			ptrs[j] = mallocx(size, 0);
+			assert_ptr_not_null(ptrs[j],
+			    "Unexpected mallocx() failure");
+		}
+	}
+	assert_true(cache_bin_ncached_cap_get(hot_bin_get(binind)) >=
+	    tcache_bin_info[binind].ncached_cap_init,
+	    "Balanced bin capacity should not shrink");
+	budget_check();
+	for (unsigned j = 0; j < 4; j++) {
+		dallocx(ptrs[j], 0);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_tcache_adaptive_budget) {
+	test_skip_if(!opt_tcache);
+
+	tcache_t *tcache = tsd_tcachep_get(tsd_fetch());
+	size_t budget = tcache_bytes_max;
+	if (opt_tcache_bytes_max == 0) {
+		size_t cap_init_bytes = 0;
+		for (szind_t i = 0; i < SC_NBINS; i++) {
+			cap_init_bytes += tcache_bin_info[i].ncached_cap_init *
+			    sz_index2size(i);
+		}
+		assert_zu_gt(budget, cap_init_bytes,
+		    "Default budget should leave room to grow");
+	}
+	for (size_t size = 8; size <= 1024; size <<= 1) {
+		thrash(size, sz_size2index(size), 50);
+		assert_zu_le(tcache->small_cap_bytes, budget,
+		    "Growth should respect tcache_bytes_max");
+	}
+	budget_check();
+}
+TEST_END
+
+int
+main(void) {
+	/* The tcache is bypassed when reentrant. */
+	return test_no_reentrancy(
+	    test_tcache_adaptive,
+	    test_tcache_adaptive_balanced,
+	    test_tcache_adaptive_budget);
+}
@@ -0,0 +1,117 @@
+#include "test/jemalloc_test.h"
+
+#define NPTRS 64
+
+static atomic_u32_t stage = ATOMIC_INIT(0);
+static tcache_t *blocked_tcache;
+static mtx_t block_mtx;
+
+static void
+stage_wait(uint32_t target) {
+	while (atomic_load_u32(&stage, ATOMIC_ACQUIRE) < target) {
+		mq_nanosleep(1000 * 1000);
+	}
+}
+
+/* Racy, as the owner may be using the tcache. */
+static size_t
+tcache_ncached(tcache_t *tcache) {
+	size_t ncached = 0;
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		ncached += cache_bin_ncached_get_racy(
+		    tcache_small_bin_get(tcache, i), i);
+	}
+	return ncached;
+}
+
+static void *
+thd_start(void *arg) {
+	void *ptrs[NPTRS];
+	for (unsigned i = 0; i < NPTRS; i++) {
+		ptrs[i] = mallocx(64, 0);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	for (unsigned i = 0; i < NPTRS; i++) {
+		dallocx(ptrs[i], 0);
+	}
+
+	tcache_t *tcache = tsd_tcachep_get(tsd_fetch());
+	assert_zu_gt(tcache_ncached(tcache), 0,
+	    "Freed objects should be cached");
+
+	/* Block without calling into the allocator until released. */
+	blocked_tcache = tcache;
+	atomic_store_u32(&stage, 1, ATOMIC_RELEASE);
+	mtx_lock(&block_mtx);
+	mtx_unlock(&block_mtx);
+
+	/* The cache is still usable after the flush. */
+	void *p = mallocx(64, 0);
+	assert_ptr_not_null(p, "Unexpected mallocx() failure");
+	dallocx(p, 0);
+
+	return NULL;
+}
+
+/* Start a thread that fills its tcache, then blocks until thd_release(). */
+static void
+thd_start_blocked(thd_t *thd) {
+	assert_false(mtx_init(&block_mtx), "Unexpected mtx_init() failure");
+	mtx_lock(&block_mtx);
+	atomic_store_u32(&stage, 0, ATOMIC_RELAXED);
+	thd_create(thd, thd_start, NULL);
+	stage_wait(1);
+}
+
+static void
+thd_release(thd_t *thd) {
+	mtx_unlock(&block_mtx);
+	thd_join(*thd, NULL);
+	mtx_fini(&block_mtx);
+}
+
+TEST_BEGIN(test_tcache_reclaim_blocked) {
+	test_skip_if(!opt_tcache);
+
+	thd_t thd;
+	thd_start_blocked(&thd);
+	/*
+	 * tcache_global_bytes_max is 1, so a single pass flushes the blocked
+	 * thread, whether or not it is considered idle yet.
+	 */
+	tcache_reclaim(tsd_tsdn(tsd_fetch()));
+	assert_zu_eq(tcache_ncached(blocked_tcache), 0,
+	    "The tcache of the blocked thread should have been flushed");
+	thd_release(&thd);
+}
+TEST_END
+
+TEST_BEGIN(test_tcache_reclaim_background) {
+	test_skip_if(!opt_tcache);
+	test_skip_if(!have_background_thread);
+
+	thd_t thd;
+	thd_start_blocked(&thd);
+	bool enable = true;
+	assert_d_eq(mallctl("background_thread", NULL, NULL, &enable,
+	    sizeof(enable)), 0, "Unexpected mallctl() failure");
+	/* Wait for up to 10 seconds. */
+	for (unsigned i = 0; i < 1000 && tcache_ncached(blocked_tcache) != 0;
+	    i++) {
+		mq_nanosleep(10 * 1000 * 1000);
+	}
+	assert_zu_eq(tcache_ncached(blocked_tcache), 0,
+	    "The background thread should have flushed the blocked thread");
+	enable = false;
+	assert_d_eq(mallctl("background_thread", NULL, NULL, &enable,
+	    sizeof(enable)), 0, "Unexpected mallctl() failure");
+	thd_release(&thd);
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_tcache_reclaim_blocked,
+	    test_tcache_reclaim_background);
+}